@@ -19,8 +19,12 @@
 #include "boolean.h"
 #include <string.h>
 #include <stdio.h>
+#include <stdint.h>
 #include "general.h"
 
+// SRAM is compared and written in pages, so only what changed hits the disk.
+#define AUTOSAVE_PAGE_SIZE 4096
+
 struct autosave
 {
    volatile bool quit;
@@ -35,8 +39,111 @@ struct autosave
    const char *path;
    size_t bufsize;
    unsigned interval;
+
+   uint8_t *dirty; // One flag per page.
+   size_t pages;
+   bool file_synced; // File on disk matches buffer, apart from dirty pages.
 };
 
+static size_t autosave_page_size(const autosave_t *save, size_t page)
+{
+   size_t offset = page * AUTOSAVE_PAGE_SIZE;
+   return save->bufsize - offset < AUTOSAVE_PAGE_SIZE ? save->bufsize - offset : AUTOSAVE_PAGE_SIZE;
+}
+
+// The main thread holds the lock while the core runs, so the full compare runs without it.
+// It may see a page mid-write, so it only flags candidates.
+// Flagged pages are compared again and copied under the lock, and marked dirty if they really changed.
+// A page changed after the first pass is picked up on the next interval.
+static bool autosave_snapshot(autosave_t *save)
+{
+   size_t i;
+   bool candidates = false, differ = false;
+   const uint8_t *retro = (const uint8_t*)save->retro_buffer;
+   uint8_t *buffer = (uint8_t*)save->buffer;
+
+   for (i = 0; i < save->pages; i++)
+   {
+      size_t offset = i * AUTOSAVE_PAGE_SIZE;
+      save->dirty[i] = memcmp(buffer + offset, retro + offset, autosave_page_size(save, i)) != 0;
+      candidates |= save->dirty[i];
+   }
+
+   if (!candidates)
+      return false;
+
+   autosave_lock(save);
+   for (i = 0; i < save->pages; i++)
+   {
+      size_t offset = i * AUTOSAVE_PAGE_SIZE;
+      size_t size = autosave_page_size(save, i);
+
+      if (!save->dirty[i])
+         continue;
+
+      save->dirty[i] = memcmp(buffer + offset, retro + offset, size) != 0;
+      if (save->dirty[i])
+      {
+         memcpy(buffer + offset, retro + offset, size);
+         differ = true;
+      }
+   }
+   autosave_unlock(save);
+
+   return differ;
+}
+
+static bool autosave_write_full(autosave_t *save)
+{
+   bool failed = false;
+   FILE *file = fopen(save->path, "wb");
+   if (!file)
+      return false;
+
+   failed |= fwrite(save->buffer, 1, save->bufsize, file) != save->bufsize;
+   failed |= fflush(file) != 0;
+   failed |= fclose(file) != 0;
+   return !failed;
+}
+
+// Rewrites dirty pages in place, runs of adjacent pages in one go.
+static bool autosave_write_dirty(autosave_t *save, size_t *written)
+{
+   size_t i = 0;
+   bool failed = false;
+   FILE *file = fopen(save->path, "r+b");
+   if (!file)
+      return false;
+
+   // A file of another size was not written by us, replace it.
+   if (fseek(file, 0, SEEK_END) != 0 || ftell(file) != (long)save->bufsize)
+   {
+      fclose(file);
+      return false;
+   }
+
+   while (i < save->pages && !failed)
+   {
+      size_t start = i, offset, size;
+      if (!save->dirty[i++])
+         continue;
+
+      while (i < save->pages && save->dirty[i])
+         i++;
+
+      offset = start * AUTOSAVE_PAGE_SIZE;
+      size = i * AUTOSAVE_PAGE_SIZE < save->bufsize ? i * AUTOSAVE_PAGE_SIZE - offset : save->bufsize - offset;
+
+      failed |= fseek(file, offset, SEEK_SET) != 0;
+      failed |= !failed && fwrite((const uint8_t*)save->buffer + offset, 1, size, file) != size;
+      *written += size;
+   }
+
+   failed |= fflush(file) != 0;
+   failed |= fclose(file) != 0;
+   return !failed;
+}
+
 static void autosave_thread(void *data)
 {
    autosave_t *save = (autosave_t*)data;
@@ -45,34 +152,29 @@ static void autosave_thread(void *data)
 
    while (!save->quit)
    {
-      autosave_lock(save);
-      bool differ = memcmp(save->buffer, save->retro_buffer, save->bufsize) != 0;
-      if (differ)
-         memcpy(save->buffer, save->retro_buffer, save->bufsize);
-      autosave_unlock(save);
-
-      if (differ)
+      if (autosave_snapshot(save))
       {
-         // Should probably deal with this more elegantly.
-         FILE *file = fopen(save->path, "wb");
-         if (file)
+         size_t written = 0;
+         bool ok = save->file_synced && autosave_write_dirty(save, &written);
+
+         if (!ok)
          {
-            // Avoid spamming down stderr ... :)
-            if (first_log)
-            {
-               RARCH_LOG("Autosaving SRAM to \"%s\", will continue to check every %u seconds ...\n", save->path, save->interval);
-               first_log = false;
-            }
-            else
-               RARCH_LOG("SRAM changed ... autosaving ...\n");
-
-            bool failed = false;
-            failed |= fwrite(save->buffer, 1, save->bufsize, file) != save->bufsize;
-            failed |= fflush(file) != 0;
-            failed |= fclose(file) != 0;
-            if (failed)
-               RARCH_WARN("Failed to autosave SRAM. Disk might be full.\n");
+            written = save->bufsize;
+            ok = autosave_write_full(save);
          }
+         save->file_synced = ok;
+
+         // Avoid spamming down stderr ... :)
+         if (first_log)
+         {
+            RARCH_LOG("Autosaving SRAM to \"%s\", will continue to check every %u seconds ...\n", save->path, save->interval);
+            first_log = false;
+         }
+         else
+            RARCH_LOG("SRAM changed ... autosaving %u bytes ...\n", (unsigned)written);
+
+         if (!ok)
+            RARCH_WARN("Failed to autosave SRAM. Disk might be full.\n");
       }
 
       slock_lock(save->cond_lock);
@@ -93,9 +195,15 @@ autosave_t *autosave_new(const char *path, const void *data, size_t size, unsign
    handle->path = path;
    handle->buffer = malloc(size);
    handle->retro_buffer = data;
+   handle->pages = (size + AUTOSAVE_PAGE_SIZE - 1) / AUTOSAVE_PAGE_SIZE;
+   handle->dirty = (uint8_t*)calloc(handle->pages, sizeof(*handle->dirty));
+   // The core may have touched SRAM since it was loaded, so the first write covers all of it.
+   handle->file_synced = false;
 
-   if (!handle->buffer)
+   if (!handle->buffer || !handle->dirty)
    {
+      free(handle->buffer);
+      free(handle->dirty);
       free(handle);
       return NULL;
    }
@@ -136,6 +244,7 @@ void autosave_free(autosave_t *handle)
    scond_free(handle->cond);
 
    free(handle->buffer);
+   free(handle->dirty);
    free(handle);
 }
 
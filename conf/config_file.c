@@ -58,31 +58,86 @@ struct config_file
    struct config_entry_list *tail;
    unsigned include_depth;
 
+   // Open addressing index over entries. Maps a key to the first entry in list order with that key,
+   // which is the one lookups have always returned.
+   struct config_entry_list **index;
+   size_t index_size; // Power of two.
+   size_t index_count;
+
    struct include_list *includes;
 };
 
 static config_file_t *config_file_new_internal(const char *path, unsigned depth);
 
-static char *getaline(FILE *file)
+static uint32_t config_hash(const char *key)
 {
-   char *newline = (char*)malloc(9);
-   size_t cur_size = 8;
-   size_t index = 0;
+   uint32_t hash = 5381;
+   while (*key)
+      hash = (hash << 5) + hash + (uint8_t)*key++;
+   return hash;
+}
 
-   int in = getc(file);
-   while (in != EOF && in != '\n')
-   {
-      if (index == cur_size)
-      {
-         cur_size *= 2;
-         newline = (char*)realloc(newline, cur_size + 1);
-      }
+static struct config_entry_list **config_index_slot(struct config_entry_list **index,
+      size_t size, const char *key)
+{
+   size_t mask = size - 1;
+   size_t i = config_hash(key) & mask;
+   while (index[i] && strcmp(index[i]->key, key) != 0)
+      i = (i + 1) & mask;
+   return &index[i];
+}
+
+static bool config_index_grow(config_file_t *conf)
+{
+   size_t i;
+   size_t size = conf->index_size ? conf->index_size * 2 : 64;
+   struct config_entry_list **index = (struct config_entry_list**)calloc(size, sizeof(*index));
+   if (!index)
+      return false;
+
+   for (i = 0; i < conf->index_size; i++)
+      if (conf->index[i])
+         *config_index_slot(index, size, conf->index[i]->key) = conf->index[i];
+
+   free(conf->index);
+   conf->index = index;
+   conf->index_size = size;
+   return true;
+}
 
-      newline[index++] = in;
-      in = getc(file);
+// If replace is false, an existing entry with the same key keeps priority.
+static void config_index_insert(config_file_t *conf, struct config_entry_list *entry, bool replace)
+{
+   // Keep load factor below 3/4. If growing fails, the table is still valid, only fuller.
+   if ((conf->index_count + 1) * 4 > conf->index_size * 3 && !config_index_grow(conf)
+         && conf->index_count + 1 >= conf->index_size)
+      return;
+
+   struct config_entry_list **slot = config_index_slot(conf->index, conf->index_size, entry->key);
+   if (!*slot)
+   {
+      *slot = entry;
+      conf->index_count++;
    }
-   newline[index] = '\0';
-   return newline; 
+   else if (replace)
+      *slot = entry;
+}
+
+static struct config_entry_list *config_get_entry(config_file_t *conf, const char *key)
+{
+   if (!conf->index)
+      return NULL;
+   return *config_index_slot(conf->index, conf->index_size, key);
+}
+
+static void config_append_entry(config_file_t *conf, struct config_entry_list *entry)
+{
+   if (conf->entries)
+      conf->tail->next = entry;
+   else
+      conf->entries = entry;
+   conf->tail = entry;
+   config_index_insert(conf, entry, false);
 }
 
 static char *extract_value(char *line, bool is_value)
@@ -138,33 +193,23 @@ static void set_list_readonly(struct config_entry_list *list)
 // Move semantics? :)
 static void add_child_list(config_file_t *parent, config_file_t *child)
 {
-   if (parent->entries)
-   {
-      struct config_entry_list *head = parent->entries;
-      while (head->next)
-         head = head->next;
+   struct config_entry_list *list;
 
-      set_list_readonly(child->entries);
-      head->next = child->entries;
-   }
+   if (!child->entries)
+      return;
+
+   set_list_readonly(child->entries);
+   if (parent->entries)
+      parent->tail->next = child->entries;
    else
-   {
-      set_list_readonly(child->entries);
       parent->entries = child->entries;
-   }
+   parent->tail = child->tail;
 
-   child->entries = NULL;
+   for (list = child->entries; list; list = list->next)
+      config_index_insert(parent, list, false);
 
-   // Rebase tail.
-   if (parent->entries)
-   {
-      struct config_entry_list *head = parent->entries;
-      while (head->next)
-         head = head->next;
-      parent->tail = head;
-   }
-   else
-      parent->tail = NULL;
+   child->entries = NULL;
+   child->tail = NULL;
 }
 
 static void add_include_list(config_file_t *conf, const char *path)
@@ -263,6 +308,8 @@ static bool parse_line(config_file_t *conf, struct config_entry_list *list, char
    if (!*line)
       return false;
 
+   const char *key_start;
+
    char *comment = strip_comment(line);
 
    // Starting line with # and include includes config files. :)
@@ -282,21 +329,15 @@ static bool parse_line(config_file_t *conf, struct config_entry_list *list, char
    while (isspace(*line))
       line++;
 
-   char *key = (char*)malloc(9);
-   size_t cur_size = 8;
-   size_t index = 0;
-
+   key_start = line;
    while (isgraph(*line))
-   {
-      if (index == cur_size)
-      {
-         cur_size *= 2;
-         key = (char*)realloc(key, cur_size + 1);
-      }
+      line++;
 
-      key[index++] = *line++;
-   }
-   key[index] = '\0';
+   char *key = (char*)malloc(line - key_start + 1);
+   if (!key)
+      return false;
+   memcpy(key, key_start, line - key_start);
+   key[line - key_start] = '\0';
    list->key = key;
 
    list->value = extract_value(line, true);
@@ -312,14 +353,23 @@ static bool parse_line(config_file_t *conf, struct config_entry_list *list, char
 
 bool config_append_file(config_file_t *conf, const char *path)
 {
+   size_t i;
    config_file_t *new_conf = config_file_new(path);
    if (!new_conf)
       return false;
 
    if (new_conf->tail)
    {
+      if (!conf->entries)
+         conf->tail = new_conf->tail;
+
       new_conf->tail->next = conf->entries;
       conf->entries        = new_conf->entries; // Pilfer.
+
+      // New entries are in front, so they take over existing keys.
+      for (i = 0; i < new_conf->index_size; i++)
+         if (new_conf->index[i])
+            config_index_insert(conf, new_conf->index[i], true);
       new_conf->entries    = NULL;
    }
 
@@ -327,8 +377,35 @@ bool config_append_file(config_file_t *conf, const char *path)
    return true;
 }
 
+// Tokenizes a whole file held in buf. Lines are split in place, only keys and values are copied out.
+static void config_file_parse_buffer(config_file_t *conf, char *buf)
+{
+   char *line = buf;
+
+   while (*line)
+   {
+      char *next = strchr(line, '\n');
+      if (next)
+         *next++ = '\0';
+      else
+         next = line + strlen(line);
+
+      struct config_entry_list *list = (struct config_entry_list*)calloc(1, sizeof(*list));
+      if (!list)
+         return;
+
+      if (parse_line(conf, list, line))
+         config_append_entry(conf, list);
+      else
+         free(list);
+
+      line = next;
+   }
+}
+
 static config_file_t *config_file_new_internal(const char *path, unsigned depth)
 {
+   char *buf = NULL;
    struct config_file *conf = (struct config_file*)calloc(1, sizeof(*conf));
    if (!conf)
       return NULL;
@@ -344,50 +421,23 @@ static config_file_t *config_file_new_internal(const char *path, unsigned depth)
    }
 
    conf->include_depth = depth;
-   FILE *file = fopen(path, "r");
 
-   if (!file)
+   // Read everything in one go, getc() per character is slow with thousands of .info files.
+   if (read_file(path, (void**)&buf) < 0)
    {
       free(conf->path);
       free(conf);
       return NULL;
    }
 
-   while (!feof(file))
-   {
-      struct config_entry_list *list = (struct config_entry_list*)calloc(1, sizeof(*list));
-      char *line = getaline(file);
-
-      if (line)
-      {
-         if (parse_line(conf, list, line))
-         {
-            if (conf->entries)
-            {
-               conf->tail->next = list;
-               conf->tail = list;
-            }
-            else
-            {
-               conf->entries = list;
-               conf->tail = list;
-            }
-         }
-
-         free(line);
-      }
-
-      if (list != conf->tail)
-         free(list);
-   }
-   fclose(file);
+   config_file_parse_buffer(conf, buf);
+   free(buf);
 
    return conf;
 }
 
 config_file_t *config_file_new_from_string(const char *from_string)
 {
-   size_t i;
    struct config_file *conf = (struct config_file*)calloc(1, sizeof(*conf));
    if (!conf)
       return NULL;
@@ -397,39 +447,13 @@ config_file_t *config_file_new_from_string(const char *from_string)
 
    conf->path = NULL;
    conf->include_depth = 0;
-   
-   struct string_list *lines = string_split(from_string, "\n");
-   if (!lines)
-      return conf;
 
-   for (i = 0; i < lines->size; i++)
-   {
-      struct config_entry_list *list = (struct config_entry_list*)calloc(1, sizeof(*list));
-      
-      char* line = lines->elems[i].data;
-    
-      if (line)
-      {
-         if (parse_line(conf, list, line))
-         {
-            if (conf->entries)
-            {
-               conf->tail->next = list;
-               conf->tail = list;
-            }
-            else
-            {
-               conf->entries = list;
-               conf->tail = list;
-            }
-         }
-      }
+   char *buf = strdup(from_string);
+   if (!buf)
+      return conf;
 
-      if (list != conf->tail)
-         free(list);
-   }
-   
-   string_list_free(lines);
+   config_file_parse_buffer(conf, buf);
+   free(buf);
 
    return conf;
 }
@@ -463,181 +487,129 @@ void config_file_free(config_file_t *conf)
       free(hold);
    }
 
+   free(conf->index);
    free(conf->path);
    free(conf);
 }
 
 bool config_get_double(config_file_t *conf, const char *key, double *in)
 {
-   struct config_entry_list *list = conf->entries;
+   struct config_entry_list *list = config_get_entry(conf, key);
+   if (!list)
+      return false;
 
-   while (list)
-   {
-      if (strcmp(key, list->key) == 0)
-      {
-         *in = strtod(list->value, NULL);
-         return true;
-      }
-      list = list->next;
-   }
-   return false;
+   *in = strtod(list->value, NULL);
+   return true;
 }
 
 bool config_get_float(config_file_t *conf, const char *key, float *in)
 {
-   struct config_entry_list *list = conf->entries;
+   struct config_entry_list *list = config_get_entry(conf, key);
+   if (!list)
+      return false;
 
-   while (list)
-   {
-      if (strcmp(key, list->key) == 0)
-      {
-         // strtof() is C99/POSIX. Just use the more portable kind.
-         *in = (float)strtod(list->value, NULL);
-         return true;
-      }
-      list = list->next;
-   }
-   return false;
+   // strtof() is C99/POSIX. Just use the more portable kind.
+   *in = (float)strtod(list->value, NULL);
+   return true;
 }
 
 bool config_get_int(config_file_t *conf, const char *key, int *in)
 {
-   struct config_entry_list *list = conf->entries;
+   struct config_entry_list *list = config_get_entry(conf, key);
+   if (!list)
+      return false;
 
-   while (list)
+   errno = 0;
+   int val = strtol(list->value, NULL, 0);
+   if (errno == 0)
    {
-      if (strcmp(key, list->key) == 0)
-      {
-         errno = 0;
-         int val = strtol(list->value, NULL, 0);
-         if (errno == 0)
-         {
-            *in = val;
-            return true;
-         }
-         else
-            return false;
-      }
-      list = list->next;
+      *in = val;
+      return true;
    }
-   return false;
+   else
+      return false;
 }
 
 bool config_get_uint64(config_file_t *conf, const char *key, uint64_t *in)
 {
-   struct config_entry_list *list = conf->entries;
+   struct config_entry_list *list = config_get_entry(conf, key);
+   if (!list)
+      return false;
 
-   while (list)
+   errno = 0;
+   uint64_t val = strtoull(list->value, NULL, 0);
+   if (errno == 0)
    {
-      if (strcmp(key, list->key) == 0)
-      {
-         errno = 0;
-         uint64_t val = strtoull(list->value, NULL, 0);
-         if (errno == 0)
-         {
-            *in = val;
-            return true;
-         }
-         else
-            return false;
-      }
-      list = list->next;
+      *in = val;
+      return true;
    }
-   return false;
+   else
+      return false;
 }
 
 bool config_get_uint(config_file_t *conf, const char *key, unsigned *in)
 {
-   struct config_entry_list *list = conf->entries;
+   struct config_entry_list *list = config_get_entry(conf, key);
+   if (!list)
+      return false;
 
-   while (list != NULL)
+   errno = 0;
+   unsigned val = strtoul(list->value, NULL, 0);
+   if (errno == 0)
    {
-      if (strcmp(key, list->key) == 0)
-      {
-         errno = 0;
-         unsigned val = strtoul(list->value, NULL, 0);
-         if (errno == 0)
-         {
-            *in = val;
-            return true;
-         }
-         else
-            return false;
-      }
-      list = list->next;
+      *in = val;
+      return true;
    }
-
-   return false;
+   else
+      return false;
 }
 
 bool config_get_hex(config_file_t *conf, const char *key, unsigned *in)
 {
-   struct config_entry_list *list = conf->entries;
+   struct config_entry_list *list = config_get_entry(conf, key);
+   if (!list)
+      return false;
 
-   while (list)
+   errno = 0;
+   unsigned val = strtoul(list->value, NULL, 16);
+   if (errno == 0)
    {
-      if (strcmp(key, list->key) == 0)
-      {
-         errno = 0;
-         unsigned val = strtoul(list->value, NULL, 16);
-         if (errno == 0)
-         {
-            *in = val;
-            return true;
-         }
-         else
-            return false;
-      }
-      list = list->next;
+      *in = val;
+      return true;
    }
-   return false;
+   else
+      return false;
 }
 
 bool config_get_char(config_file_t *conf, const char *key, char *in)
 {
-   struct config_entry_list *list = conf->entries;
+   struct config_entry_list *list = config_get_entry(conf, key);
+   if (!list)
+      return false;
 
-   while (list)
-   {
-      if (strcmp(key, list->key) == 0)
-      {
-         if (list->value[0] && list->value[1])
-            return false;
-         *in = *list->value;
-         return true;
-      }
-      list = list->next;
-   }
-   return false;
+   if (list->value[0] && list->value[1])
+      return false;
+   *in = *list->value;
+   return true;
 }
 
 bool config_get_string(config_file_t *conf, const char *key, char **str)
 {
-   struct config_entry_list *list = conf->entries;
+   struct config_entry_list *list = config_get_entry(conf, key);
+   if (!list)
+      return false;
 
-   while (list)
-   {
-      if (strcmp(key, list->key) == 0)
-      {
-         *str = strdup(list->value);
-         return true;
-      }
-      list = list->next;
-   }
-   return false;
+   *str = strdup(list->value);
+   return true;
 }
 
 bool config_get_array(config_file_t *conf, const char *key, char *buf, size_t size)
 {
-   struct config_entry_list *list = conf->entries;
+   struct config_entry_list *list = config_get_entry(conf, key);
+   if (!list)
+      return false;
 
-   while (list)
-   {
-      if (strcmp(key, list->key) == 0)
-         return strlcpy(buf, list->value, size) < size;
-      list = list->next;
-   }
-   return false;
+   return strlcpy(buf, list->value, size) < size;
 }
 
 bool config_get_path(config_file_t *conf, const char *key, char *buf, size_t size)
@@ -645,72 +617,54 @@ bool config_get_path(config_file_t *conf, const char *key, char *buf, size_t siz
 #if defined(RARCH_CONSOLE)
    return config_get_array(conf, key, buf, size);
 #else
-   struct config_entry_list *list = conf->entries;
+   struct config_entry_list *list = config_get_entry(conf, key);
+   if (!list)
+      return false;
 
-   while (list)
-   {
-      if (strcmp(key, list->key) == 0)
-      {
-         fill_pathname_expand_special(buf, list->value, size);
-         return true;
-      }
-      list = list->next;
-   }
-   return false;
+   fill_pathname_expand_special(buf, list->value, size);
+   return true;
 #endif
 }
 
 bool config_get_bool(config_file_t *conf, const char *key, bool *in)
 {
-   struct config_entry_list *list = conf->entries;
+   struct config_entry_list *list = config_get_entry(conf, key);
+   if (!list)
+      return false;
 
-   while (list)
-   {
-      if (strcmp(key, list->key) == 0)
-      {
-         if (strcasecmp(list->value, "true") == 0)
-            *in = true;
-         else if (strcasecmp(list->value, "1") == 0)
-            *in = true;
-         else if (strcasecmp(list->value, "false") == 0)
-            *in = false;
-         else if (strcasecmp(list->value, "0") == 0)
-            *in = false;
-         else
-            return false;
-
-         return true;
-      }
-      list = list->next;
-   }
-   return false;
+   if (strcasecmp(list->value, "true") == 0)
+      *in = true;
+   else if (strcasecmp(list->value, "1") == 0)
+      *in = true;
+   else if (strcasecmp(list->value, "false") == 0)
+      *in = false;
+   else if (strcasecmp(list->value, "0") == 0)
+      *in = false;
+   else
+      return false;
+
+   return true;
 }
 
 void config_set_string(config_file_t *conf, const char *key, const char *val)
 {
-   struct config_entry_list *list = conf->entries;
-   struct config_entry_list *last = list;
-   while (list)
-   {
-      if (!list->readonly && (strcmp(key, list->key) == 0))
-      {
-         free(list->value);
-         list->value = strdup(val);
-         return;
-      }
+   struct config_entry_list *list = config_get_entry(conf, key);
 
-      last = list;
+   // The index points at the first entry. If it came from an #include, a writable one may follow.
+   while (list && (list->readonly || strcmp(key, list->key) != 0))
       list = list->next;
+
+   if (list)
+   {
+      free(list->value);
+      list->value = strdup(val);
+      return;
    }
 
    struct config_entry_list *elem = (struct config_entry_list*)calloc(1, sizeof(*elem));
    elem->key = strdup(key);
    elem->value = strdup(val);
-
-   if (last)
-      last->next = elem;
-   else
-      conf->entries = elem;
+   config_append_entry(conf, elem);
 }
 
 void config_set_path(config_file_t *conf, const char *entry, const char *val)
@@ -837,16 +791,7 @@ void config_file_dump_all(config_file_t *conf)
 
 bool config_entry_exists(config_file_t *conf, const char *entry)
 {
-   struct config_entry_list *list = conf->entries;
-
-   while (list)
-   {
-      if (strcmp(entry, list->key) == 0)
-         return true;
-      list = list->next;
-   }
-
-   return false;
+   return config_get_entry(conf, entry) != NULL;
 }
 
 bool config_get_entry_list_head(config_file_t *conf, struct config_file_entry *entry)
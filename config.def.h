@@ -385,6 +385,12 @@ static const bool gpu_screenshot = true;
 // Record post-shaded GPU output instead of raw game footage if available.
 static const bool gpu_record = false;
 
+// Export post-filtered (CPU filter) video to shared memory rather than raw game output.
+static const bool frame_export_post_filter = false;
+
+// Number of frames kept in the shared memory export ring.
+static const unsigned frame_export_video_slots = 4;
+
 // OSD-messages
 static const bool font_enable = true;
 
@@ -455,6 +461,13 @@ static const unsigned rewind_buffer_size = 20 << 20; // 20MiB
 // How many frames to rewind at a time.
 static const unsigned rewind_granularity = 1;
 
+// Recorded movies embed a savestate every this many frames, so playback can seek.
+static const unsigned movie_keyframe_interval = 600;
+
+// Runs the core this many frames ahead of the input and shows the last one, to hide latency built into games.
+// Costs a savestate, a state load and this many extra frames of emulation per frame. 0 disables.
+static const unsigned run_ahead_frames = 0;
+
 // Pause gameplay when gameplay loses focus.
 static const bool pause_nonactive = false;
 
@@ -478,12 +491,26 @@ static const bool savestate_auto_index = false;
 static const bool savestate_auto_save = false;
 static const bool savestate_auto_load = true;
 
+// Deflate savestates. Compressed states are detected when loading either way.
+// Off by default, as older RetroArch builds and other tools can't read compressed states.
+static const bool savestate_compression = false;
+
 // Slowmotion ratio.
 static const float slowmotion_ratio = 3.0;
 
 // Maximum fast forward ratio (Negative => no limit).
 static const float fastforward_ratio = -1.0;
 
+// While fast forwarding, skip this many frames between each one shown.
+// Skipped frames bypass filters, the video driver and the audio chain.
+static const unsigned fastforward_frameskip = 0;
+
+// While fast forwarding, show at most this many frames per second instead (0 => use fastforward_frameskip).
+static const float fastforward_present_rate = 0.0;
+
+// Show the fast forward speed on screen, updated every second.
+static const bool fastforward_show_speed = false;
+
 // Enable stdin/network command interface
 static const bool network_cmd_enable = false;
 static const uint16_t network_cmd_port = 55355;
@@ -158,6 +158,12 @@ static const bool _ffmpeg_supp = true;
 static const bool _ffmpeg_supp = false;
 #endif
 
+#ifdef HAVE_RECORD_LOSSLESS
+static const bool _lossless_supp = true;
+#else
+static const bool _lossless_supp = false;
+#endif
+
 #ifdef HAVE_FREETYPE
 static const bool _freetype_supp = true;
 #else
@@ -0,0 +1,1042 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2014 - Hans-Kristian Arntzen
+ *
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "content_db.h"
+#include "general.h"
+#include "file_path.h"
+#include "hash.h"
+#include "compat/strl.h"
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <sys/stat.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef HAVE_THREADS
+#include "thread.h"
+#include "performance.h"
+#endif
+
+#ifdef HAVE_MMAP
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// Layout is the header, records sorted by path, the CRC32 and SHA-256 indices,
+// the extension table and finally the string table.
+// Everything is addressed by offset so the file can be mapped and used in place.
+// Strings are offsets into the string table + 1, with 0 meaning NULL.
+// The hash indices hold record numbers sorted by hash, so copies of the same content are adjacent.
+#define CONTENT_DB_MAGIC 0x44434152 // 'RACD'
+#define CONTENT_DB_VERSION 1
+
+// Hashing is mostly waiting on the disk, more threads than this only thrash it.
+#define CONTENT_DB_MAX_THREADS 8
+#define CONTENT_DB_MAX_DEPTH 32
+#define CONTENT_DB_CHUNK_SIZE (256 * 1024)
+#define CONTENT_DB_MAX_EXT 32
+
+struct content_db_header
+{
+   uint32_t magic;
+   uint32_t version;
+   uint32_t count;
+   uint32_t ext_count;
+   uint32_t strings_size;
+   uint32_t pad;
+};
+
+struct content_db_record
+{
+   uint32_t path;
+   uint32_t core;
+   uint64_t size;
+   int64_t mtime;
+   uint32_t crc32;
+   uint8_t sha256[32];
+   uint32_t pad;
+};
+
+// Sorted by extension, then core. Extensions are lower case, without '.'.
+struct content_db_ext
+{
+   uint32_t ext;
+   uint32_t core;
+};
+
+struct content_db
+{
+   uint8_t *data;
+   size_t size;
+   bool mapped;
+
+   const struct content_db_header *header;
+   const struct content_db_record *records;
+   const uint32_t *crc_index;
+   const uint32_t *sha_index;
+   const struct content_db_ext *exts;
+   const char *strings;
+};
+
+void content_db_free(content_db_t *db)
+{
+   if (!db)
+      return;
+
+#ifdef HAVE_MMAP
+   if (db->mapped)
+      munmap(db->data, db->size);
+   else
+#endif
+      free(db->data);
+   free(db);
+}
+
+// Only the layout is checked here so that opening a huge index stays cheap.
+// Offsets and record numbers are checked when they are used.
+content_db_t *content_db_open(const char *path)
+{
+   const struct content_db_header *header;
+   uint64_t expected;
+#ifdef HAVE_MMAP
+   struct stat st;
+   int fd;
+#else
+   long size;
+#endif
+   content_db_t *db = (content_db_t*)calloc(1, sizeof(*db));
+   if (!db)
+      return NULL;
+
+#ifdef HAVE_MMAP
+   if ((fd = open(path, O_RDONLY)) < 0)
+      goto error;
+
+   if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(*header))
+   {
+      close(fd);
+      goto error;
+   }
+
+   db->data = (uint8_t*)mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+   close(fd);
+   if (db->data == (uint8_t*)MAP_FAILED)
+   {
+      db->data = NULL;
+      goto error;
+   }
+   db->size   = st.st_size;
+   db->mapped = true;
+#else
+   if ((size = read_file(path, (void**)&db->data)) < (long)sizeof(*header))
+      goto error;
+   db->size = size;
+#endif
+
+   header = (const struct content_db_header*)db->data;
+   if (header->magic != CONTENT_DB_MAGIC || header->version != CONTENT_DB_VERSION)
+      goto error;
+
+   expected = sizeof(*header) +
+      (uint64_t)header->count * (sizeof(*db->records) + 2 * sizeof(uint32_t)) +
+      (uint64_t)header->ext_count * sizeof(*db->exts) +
+      header->strings_size;
+   if (expected != db->size || !header->strings_size)
+      goto error;
+
+   db->header    = header;
+   db->records   = (const struct content_db_record*)(header + 1);
+   db->crc_index = (const uint32_t*)(db->records + header->count);
+   db->sha_index = db->crc_index + header->count;
+   db->exts      = (const struct content_db_ext*)(db->sha_index + header->count);
+   db->strings   = (const char*)(db->exts + header->ext_count);
+
+   if (db->strings[header->strings_size - 1] != '\0')
+      goto error;
+
+   return db;
+
+error:
+   RARCH_WARN("Content database \"%s\" is missing or invalid.\n", path);
+   content_db_free(db);
+   return NULL;
+}
+
+static const char *content_db_string(const content_db_t *db, uint32_t offset)
+{
+   return offset && offset <= db->header->strings_size ? db->strings + offset - 1 : NULL;
+}
+
+static const struct content_db_record *content_db_indexed(const content_db_t *db,
+      const uint32_t *index, size_t i)
+{
+   return index[i] < db->header->count ? &db->records[index[i]] : NULL;
+}
+
+static bool content_db_get_record(const content_db_t *db,
+      const struct content_db_record *record, struct content_db_entry *entry)
+{
+   if (!record || !(entry->path = content_db_string(db, record->path)))
+      return false;
+
+   entry->core   = content_db_string(db, record->core);
+   entry->size   = record->size;
+   entry->mtime  = record->mtime;
+   entry->crc32  = record->crc32;
+   entry->sha256 = record->sha256;
+   return true;
+}
+
+size_t content_db_size(const content_db_t *db)
+{
+   return db->header->count;
+}
+
+bool content_db_get(const content_db_t *db, size_t index, struct content_db_entry *entry)
+{
+   if (index >= db->header->count)
+      return false;
+   return content_db_get_record(db, &db->records[index], entry);
+}
+
+bool content_db_find_path(const content_db_t *db, const char *path, struct content_db_entry *entry)
+{
+   size_t lo = 0, hi = db->header->count;
+
+   while (lo < hi)
+   {
+      size_t mid = lo + (hi - lo) / 2;
+      const char *mid_path = content_db_string(db, db->records[mid].path);
+      int cmp = mid_path ? strcmp(mid_path, path) : -1;
+
+      if (!cmp)
+         return content_db_get_record(db, &db->records[mid], entry);
+      if (cmp < 0)
+         lo = mid + 1;
+      else
+         hi = mid;
+   }
+
+   return false;
+}
+
+bool content_db_find_sha256(const content_db_t *db, const uint8_t *sha256, struct content_db_entry *entry)
+{
+   const struct content_db_record *record;
+   size_t lo = 0, hi = db->header->count;
+
+   while (lo < hi)
+   {
+      size_t mid = lo + (hi - lo) / 2;
+      record = content_db_indexed(db, db->sha_index, mid);
+      if (!record)
+         return false;
+
+      if (memcmp(record->sha256, sha256, sizeof(record->sha256)) < 0)
+         lo = mid + 1;
+      else
+         hi = mid;
+   }
+
+   if (lo == db->header->count)
+      return false;
+
+   record = content_db_indexed(db, db->sha_index, lo);
+   if (!record || memcmp(record->sha256, sha256, sizeof(record->sha256)))
+      return false;
+   return content_db_get_record(db, record, entry);
+}
+
+size_t content_db_find_crc32(const content_db_t *db, uint32_t crc,
+      struct content_db_entry *entries, size_t max)
+{
+   size_t lo = 0, hi = db->header->count, num = 0;
+
+   while (lo < hi)
+   {
+      size_t mid = lo + (hi - lo) / 2;
+      const struct content_db_record *record = content_db_indexed(db, db->crc_index, mid);
+      if (!record)
+         return 0;
+
+      if (record->crc32 < crc)
+         lo = mid + 1;
+      else
+         hi = mid;
+   }
+
+   for (; lo < db->header->count; lo++)
+   {
+      const struct content_db_record *record = content_db_indexed(db, db->crc_index, lo);
+      if (!record || record->crc32 != crc)
+         break;
+      if (num < max && !content_db_get_record(db, record, &entries[num]))
+         break;
+      num++;
+   }
+
+   return num;
+}
+
+static bool content_db_lower_ext(char *out, const char *ext)
+{
+   size_t i;
+   for (i = 0; ext[i]; i++)
+   {
+      if (i + 1 >= CONTENT_DB_MAX_EXT)
+         return false;
+      out[i] = tolower((unsigned char)ext[i]);
+   }
+   out[i] = '\0';
+   return true;
+}
+
+size_t content_db_find_cores(const content_db_t *db, const char *ext,
+      const char **cores, size_t max)
+{
+   char key[CONTENT_DB_MAX_EXT];
+   size_t lo = 0, hi = db->header->ext_count, num = 0;
+
+   if (!content_db_lower_ext(key, ext))
+      return 0;
+
+   while (lo < hi)
+   {
+      size_t mid = lo + (hi - lo) / 2;
+      const char *mid_ext = content_db_string(db, db->exts[mid].ext);
+
+      if (!mid_ext || strcmp(mid_ext, key) < 0)
+         lo = mid + 1;
+      else
+         hi = mid;
+   }
+
+   for (; lo < db->header->ext_count; lo++)
+   {
+      const char *cur_ext = content_db_string(db, db->exts[lo].ext);
+      const char *core = content_db_string(db, db->exts[lo].core);
+      if (!cur_ext || strcmp(cur_ext, key) || !core)
+         break;
+      if (num < max)
+         cores[num] = core;
+      num++;
+   }
+
+   return num;
+}
+
+bool content_db_find_core(const content_db_t *db, const char *path, char *core, size_t size)
+{
+   struct content_db_entry entry;
+   const char *cores[2];
+
+   if (content_db_find_path(db, path, &entry))
+   {
+      if (!entry.core)
+         return false;
+      strlcpy(core, entry.core, size);
+      return true;
+   }
+
+   if (content_db_find_cores(db, path_get_extension(path), cores, 2) == 1)
+   {
+      strlcpy(core, cores[0], size);
+      return true;
+   }
+
+   return false;
+}
+
+// Extension to core map, copied out of the core info list so the scan does not depend on its lifetime.
+struct content_db_ext_map
+{
+   char *ext;
+   char *core;
+   uint32_t core_offset; // Set while writing.
+};
+
+struct content_db_cores
+{
+   struct content_db_ext_map *map;
+   size_t count;
+   char *all_ext; // For dir_list_new(). NULL indexes every file.
+};
+
+static void content_db_cores_free(struct content_db_cores *cores)
+{
+   size_t i;
+   for (i = 0; i < cores->count; i++)
+   {
+      free(cores->map[i].ext);
+      free(cores->map[i].core);
+   }
+   free(cores->map);
+   free(cores->all_ext);
+   memset(cores, 0, sizeof(*cores));
+}
+
+static int content_db_ext_map_compare(const void *a_, const void *b_)
+{
+   const struct content_db_ext_map *a = (const struct content_db_ext_map*)a_;
+   const struct content_db_ext_map *b = (const struct content_db_ext_map*)b_;
+   int cmp = strcmp(a->ext, b->ext);
+   return cmp ? cmp : strcmp(a->core, b->core);
+}
+
+static bool content_db_cores_init(struct content_db_cores *cores, const core_info_list_t *list)
+{
+   size_t i, j, num = 0;
+
+   memset(cores, 0, sizeof(*cores));
+   if (!list)
+      return true;
+
+   for (i = 0; i < list->count; i++)
+      if (list->list[i].supported_extensions_list && list->list[i].path)
+         num += list->list[i].supported_extensions_list->size;
+
+   if ((list->all_ext && !(cores->all_ext = strdup(list->all_ext))) ||
+         !(cores->map = (struct content_db_ext_map*)calloc(num + 1, sizeof(*cores->map))))
+      goto error;
+
+   for (i = 0; i < list->count; i++)
+   {
+      const core_info_t *info = &list->list[i];
+      if (!info->supported_extensions_list || !info->path)
+         continue;
+
+      for (j = 0; j < info->supported_extensions_list->size; j++)
+      {
+         char ext[CONTENT_DB_MAX_EXT];
+         struct content_db_ext_map *entry = &cores->map[cores->count];
+
+         if (!content_db_lower_ext(ext, info->supported_extensions_list->elems[j].data) || !*ext)
+            continue;
+
+         entry->ext  = strdup(ext);
+         entry->core = strdup(info->path);
+         cores->count++;
+         if (!entry->ext || !entry->core)
+            goto error;
+      }
+   }
+
+   qsort(cores->map, cores->count, sizeof(*cores->map), content_db_ext_map_compare);
+
+   // Several .info files can list the same extension twice.
+   for (i = 0, j = 0; i < cores->count; i++)
+   {
+      if (j && !content_db_ext_map_compare(&cores->map[j - 1], &cores->map[i]))
+      {
+         free(cores->map[i].ext);
+         free(cores->map[i].core);
+      }
+      else
+         cores->map[j++] = cores->map[i];
+   }
+   cores->count = j;
+
+   return true;
+
+error:
+   content_db_cores_free(cores);
+   return false;
+}
+
+// Returns the map entry if exactly one core supports the extension of path, otherwise -1.
+static long content_db_cores_match(const struct content_db_cores *cores, const char *path)
+{
+   char key[CONTENT_DB_MAX_EXT];
+   size_t lo = 0, hi = cores->count;
+
+   if (!content_db_lower_ext(key, path_get_extension(path)) || !*key)
+      return -1;
+
+   while (lo < hi)
+   {
+      size_t mid = lo + (hi - lo) / 2;
+      if (strcmp(cores->map[mid].ext, key) < 0)
+         lo = mid + 1;
+      else
+         hi = mid;
+   }
+
+   if (lo == cores->count || strcmp(cores->map[lo].ext, key))
+      return -1;
+   if (lo + 1 < cores->count && !strcmp(cores->map[lo + 1].ext, key))
+      return -1;
+   return lo;
+}
+
+struct content_db_item
+{
+   char *path;
+   uint64_t size;
+   int64_t mtime;
+   uint32_t crc32;
+   uint8_t sha256[32];
+   long core; // Entry in the extension map, -1 if none.
+   bool valid;
+};
+
+struct content_db_scan
+{
+   char *db_path;
+   char *dir;
+   struct content_db_cores cores;
+
+#ifdef HAVE_THREADS
+   sthread_t *thread;
+   slock_t *lock;
+#endif
+   bool cancel;
+   bool done;
+   bool ok;
+   size_t hashed;
+   size_t to_hash;
+};
+
+struct content_db_builder
+{
+   struct content_db_cores *cores;
+   content_db_scan_t *scan; // NULL when building synchronously.
+
+   struct content_db_item *items;
+   size_t count, cap;
+
+   size_t *pending;
+   size_t num_pending;
+#ifdef HAVE_THREADS
+   size_t next;
+   slock_t *lock;
+#endif
+};
+
+static bool content_db_cancelled(content_db_scan_t *scan)
+{
+   bool cancel = false;
+#ifdef HAVE_THREADS
+   if (scan)
+   {
+      slock_lock(scan->lock);
+      cancel = scan->cancel;
+      slock_unlock(scan->lock);
+   }
+#endif
+   return cancel;
+}
+
+static void content_db_progress(content_db_scan_t *scan, size_t hashed, size_t to_hash)
+{
+#ifdef HAVE_THREADS
+   if (!scan)
+      return;
+   slock_lock(scan->lock);
+   scan->hashed  += hashed;
+   scan->to_hash += to_hash;
+   slock_unlock(scan->lock);
+#endif
+}
+
+static bool content_db_add_item(struct content_db_builder *builder, const char *path)
+{
+   struct stat st;
+   struct content_db_item *item;
+
+   // Unreadable files are skipped, they do not fail the scan.
+   if (stat(path, &st) < 0)
+      return true;
+
+   if (builder->count == builder->cap)
+   {
+      size_t new_cap = builder->cap ? builder->cap * 2 : 256;
+      struct content_db_item *new_items = (struct content_db_item*)
+         realloc(builder->items, new_cap * sizeof(*new_items));
+      if (!new_items)
+         return false;
+      builder->items = new_items;
+      builder->cap   = new_cap;
+   }
+
+   item = &builder->items[builder->count];
+   memset(item, 0, sizeof(*item));
+   if (!(item->path = strdup(path)))
+      return false;
+   item->size  = st.st_size;
+   item->mtime = st.st_mtime;
+   item->core  = content_db_cores_match(builder->cores, path);
+   builder->count++;
+   return true;
+}
+
+static bool content_db_collect(struct content_db_builder *builder, const char *dir, unsigned depth)
+{
+   size_t i;
+   bool ret = true;
+   struct string_list *list;
+
+   if (depth > CONTENT_DB_MAX_DEPTH)
+      return true;
+   if (content_db_cancelled(builder->scan))
+      return false;
+
+   // Subdirectories which can't be opened are skipped, only the root is required.
+   if (!(list = dir_list_new(dir, builder->cores->all_ext, true)))
+   {
+      if (!depth)
+         RARCH_ERR("Failed to open content directory: \"%s\"\n", dir);
+      return depth > 0;
+   }
+
+   for (i = 0; i < list->size && ret; i++)
+   {
+      const char *path = list->elems[i].data;
+
+      if (list->elems[i].attr.b)
+      {
+#ifndef _WIN32
+         // Don't follow symlinked directories, they can form loops.
+         struct stat st;
+         if (lstat(path, &st) == 0 && S_ISLNK(st.st_mode))
+            continue;
+#endif
+         ret = content_db_collect(builder, path, depth + 1);
+      }
+      else
+         ret = content_db_add_item(builder, path);
+   }
+
+   dir_list_free(list);
+   return ret;
+}
+
+static bool content_db_hash_file(content_db_scan_t *scan, struct content_db_item *item, uint8_t *buf)
+{
+   size_t len;
+   bool ret;
+   struct sha256_ctx sha;
+   FILE *file = fopen(item->path, "rb");
+   if (!file)
+      return false;
+
+   item->crc32 = 0;
+   sha256_init(&sha);
+
+   while ((len = fread(buf, 1, CONTENT_DB_CHUNK_SIZE, file)) > 0)
+   {
+      item->crc32 = crc32_update(item->crc32, buf, len);
+      sha256_update(&sha, buf, len);
+
+      if (content_db_cancelled(scan))
+         break;
+   }
+
+   ret = !ferror(file) && feof(file);
+   fclose(file);
+   sha256_digest(&sha, item->sha256);
+   return ret;
+}
+
+static void content_db_hash_worker(void *data)
+{
+   struct content_db_builder *builder = (struct content_db_builder*)data;
+   uint8_t *buf = (uint8_t*)malloc(CONTENT_DB_CHUNK_SIZE);
+   struct content_db_item *item;
+   size_t index = 0;
+
+   for (;;)
+   {
+#ifdef HAVE_THREADS
+      if (builder->lock)
+      {
+         slock_lock(builder->lock);
+         index = builder->next++;
+         slock_unlock(builder->lock);
+      }
+#endif
+
+      if (!buf || index >= builder->num_pending || content_db_cancelled(builder->scan))
+         break;
+
+      item = &builder->items[builder->pending[index++]];
+      item->valid = content_db_hash_file(builder->scan, item, buf);
+      content_db_progress(builder->scan, 1, 0);
+   }
+
+   free(buf);
+}
+
+static void content_db_hash_parallel(struct content_db_builder *builder)
+{
+#ifdef HAVE_THREADS
+   size_t i;
+   sthread_t **workers = NULL;
+   unsigned threads = rarch_get_cpu_cores();
+
+   if (threads > CONTENT_DB_MAX_THREADS)
+      threads = CONTENT_DB_MAX_THREADS;
+   if (threads > builder->num_pending)
+      threads = builder->num_pending;
+
+   if (threads > 1 && (builder->lock = slock_new()) &&
+         (workers = (sthread_t**)calloc(threads - 1, sizeof(*workers))))
+   {
+      unsigned started = 0;
+
+      for (i = 0; i < threads - 1; i++)
+         if ((workers[started] = sthread_create(content_db_hash_worker, builder)))
+            started++;
+
+      content_db_hash_worker(builder);
+
+      for (i = 0; i < started; i++)
+         sthread_join(workers[i]);
+
+      free(workers);
+      slock_free(builder->lock);
+      builder->lock = NULL;
+      return;
+   }
+
+   if (builder->lock)
+      slock_free(builder->lock);
+   builder->lock = NULL;
+#endif
+
+   content_db_hash_worker(builder);
+}
+
+static int content_db_item_compare(const void *a_, const void *b_)
+{
+   const struct content_db_item *a = (const struct content_db_item*)a_;
+   const struct content_db_item *b = (const struct content_db_item*)b_;
+   return strcmp(a->path, b->path);
+}
+
+static int content_db_crc_compare(const void *a_, const void *b_)
+{
+   const struct content_db_record *a = *(const struct content_db_record**)a_;
+   const struct content_db_record *b = *(const struct content_db_record**)b_;
+   if (a->crc32 != b->crc32)
+      return a->crc32 < b->crc32 ? -1 : 1;
+   return memcmp(a->sha256, b->sha256, sizeof(a->sha256));
+}
+
+static int content_db_sha_compare(const void *a_, const void *b_)
+{
+   const struct content_db_record *a = *(const struct content_db_record**)a_;
+   const struct content_db_record *b = *(const struct content_db_record**)b_;
+   return memcmp(a->sha256, b->sha256, sizeof(a->sha256));
+}
+
+// Files under a name no single core claims take the core of identical indexed files, if those agree on one.
+// The scan has hashed everything already, so the menu then finds such copies by path without reading them.
+static void content_db_share_cores(struct content_db_record *records, const uint32_t *sha_index, size_t count)
+{
+   size_t i, j, k;
+
+   for (i = 0; i < count; i = j)
+   {
+      const struct content_db_record *first = &records[sha_index[i]];
+      uint32_t core = 0;
+      bool agree = true;
+
+      for (j = i; j < count && !memcmp(records[sha_index[j]].sha256, first->sha256, sizeof(first->sha256)); j++)
+      {
+         uint32_t cur = records[sha_index[j]].core;
+         if (core && cur && cur != core)
+            agree = false;
+         if (cur)
+            core = cur;
+      }
+
+      // Empty files are all identical, that says nothing.
+      if (!core || !agree || !first->size)
+         continue;
+
+      for (k = i; k < j; k++)
+         if (!records[sha_index[k]].core)
+            records[sha_index[k]].core = core;
+   }
+}
+
+static uint32_t content_db_put_string(char *strings, size_t *pos, const char *str)
+{
+   size_t len = strlen(str) + 1;
+   memcpy(strings + *pos, str, len);
+   *pos += len;
+   return *pos - len + 1;
+}
+
+static bool content_db_write(const char *path, struct content_db_builder *builder)
+{
+   char tmp_path[PATH_MAX];
+   size_t i, j, count = 0, ext_count = 0, strings_size = 0, pos = 0;
+   struct content_db_header *header;
+   struct content_db_record *records;
+   struct content_db_ext *exts;
+   uint32_t *crc_index, *sha_index;
+   const struct content_db_record **sorted = NULL;
+   struct content_db_cores *cores = builder->cores;
+   uint64_t size;
+   uint8_t *data = NULL;
+   char *strings;
+   bool ret = false;
+
+   if ((size_t)snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path) >= sizeof(tmp_path))
+   {
+      RARCH_WARN("Content database path \"%s\" is too long.\n", path);
+      return false;
+   }
+
+   for (i = 0; i < builder->count; i++)
+      if (builder->items[i].valid)
+         builder->items[count++] = builder->items[i];
+      else
+         free(builder->items[i].path);
+   builder->count = count;
+
+   qsort(builder->items, count, sizeof(*builder->items), content_db_item_compare);
+
+   for (i = 0; i < cores->count; i++)
+      strings_size += strlen(cores->map[i].ext) + strlen(cores->map[i].core) + 2;
+   for (i = 0; i < count; i++)
+      strings_size += strlen(builder->items[i].path) + 1;
+   strings_size++; // Never empty.
+
+   size = sizeof(*header) + (uint64_t)count * (sizeof(*records) + 2 * sizeof(uint32_t)) +
+      (uint64_t)cores->count * sizeof(*exts) + strings_size;
+   if (strings_size > UINT32_MAX || count > UINT32_MAX || size > SIZE_MAX)
+      return false;
+
+   if (!(data = (uint8_t*)calloc(1, size)) ||
+         !(sorted = (const struct content_db_record**)malloc((count + 1) * sizeof(*sorted))))
+      goto end;
+
+   header    = (struct content_db_header*)data;
+   records   = (struct content_db_record*)(header + 1);
+   crc_index = (uint32_t*)(records + count);
+   sha_index = crc_index + count;
+   exts      = (struct content_db_ext*)(sha_index + count);
+   strings   = (char*)(exts + cores->count);
+
+   // Cores appear many times in the map, store each path once.
+   for (i = 0; i < cores->count; i++)
+   {
+      for (j = 0; j < i; j++)
+         if (!strcmp(cores->map[j].core, cores->map[i].core))
+            break;
+      cores->map[i].core_offset = j < i ? cores->map[j].core_offset :
+         content_db_put_string(strings, &pos, cores->map[i].core);
+   }
+
+   for (i = 0; i < cores->count; i++)
+   {
+      if (i && ext_count && !strcmp(cores->map[i - 1].ext, cores->map[i].ext))
+         exts[ext_count].ext = exts[ext_count - 1].ext;
+      else
+         exts[ext_count].ext = content_db_put_string(strings, &pos, cores->map[i].ext);
+      exts[ext_count++].core = cores->map[i].core_offset;
+   }
+
+   for (i = 0; i < count; i++)
+   {
+      const struct content_db_item *item = &builder->items[i];
+      records[i].path  = content_db_put_string(strings, &pos, item->path);
+      records[i].core  = item->core >= 0 ? cores->map[item->core].core_offset : 0;
+      records[i].size  = item->size;
+      records[i].mtime = item->mtime;
+      records[i].crc32 = item->crc32;
+      memcpy(records[i].sha256, item->sha256, sizeof(records[i].sha256));
+   }
+
+   for (i = 0; i < count; i++)
+      sorted[i] = &records[i];
+   qsort(sorted, count, sizeof(*sorted), content_db_crc_compare);
+   for (i = 0; i < count; i++)
+      crc_index[i] = sorted[i] - records;
+
+   qsort(sorted, count, sizeof(*sorted), content_db_sha_compare);
+   for (i = 0; i < count; i++)
+      sha_index[i] = sorted[i] - records;
+
+   content_db_share_cores(records, sha_index, count);
+
+   header->magic        = CONTENT_DB_MAGIC;
+   header->version      = CONTENT_DB_VERSION;
+   header->count        = count;
+   header->ext_count    = ext_count;
+   header->strings_size = strings_size;
+
+   // Write to a temporary and rename, readers which have the old index mapped keep it intact.
+   ret = write_file(tmp_path, data, size) && rename(tmp_path, path) == 0;
+   if (!ret)
+   {
+      remove(tmp_path);
+      RARCH_WARN("Failed to write content database to \"%s\".\n", path);
+   }
+
+end:
+   free(sorted);
+   free(data);
+   return ret;
+}
+
+static bool content_db_build_internal(const char *db_path, const char *dir,
+      struct content_db_cores *cores, content_db_scan_t *scan)
+{
+   size_t i;
+   bool ret = false;
+   content_db_t *old_db = NULL;
+   struct content_db_builder builder = {0};
+
+   builder.cores = cores;
+   builder.scan  = scan;
+
+   if (!content_db_collect(&builder, dir, 0))
+      goto end;
+
+   if (!(builder.pending = (size_t*)malloc((builder.count + 1) * sizeof(*builder.pending))))
+      goto end;
+
+   // Anything which looks unchanged since the last scan keeps its hashes.
+   if (path_file_exists(db_path))
+      old_db = content_db_open(db_path);
+
+   for (i = 0; i < builder.count; i++)
+   {
+      struct content_db_item *item = &builder.items[i];
+      struct content_db_entry entry;
+
+      if (old_db && content_db_find_path(old_db, item->path, &entry) &&
+            entry.size == item->size && entry.mtime == item->mtime)
+      {
+         item->crc32 = entry.crc32;
+         memcpy(item->sha256, entry.sha256, sizeof(item->sha256));
+         item->valid = true;
+      }
+      else
+         builder.pending[builder.num_pending++] = i;
+   }
+
+   content_db_free(old_db);
+
+   RARCH_LOG("Content database: %u files, %u to hash.\n",
+         (unsigned)builder.count, (unsigned)builder.num_pending);
+
+   content_db_progress(scan, 0, builder.num_pending);
+   content_db_hash_parallel(&builder);
+
+   if (content_db_cancelled(scan))
+      goto end;
+
+   ret = content_db_write(db_path, &builder);
+
+end:
+   for (i = 0; i < builder.count; i++)
+      free(builder.items[i].path);
+   free(builder.items);
+   free(builder.pending);
+   return ret;
+}
+
+bool content_db_build(const char *db_path, const char *dir, const core_info_list_t *cores)
+{
+   bool ret;
+   struct content_db_cores map;
+
+   if (!content_db_cores_init(&map, cores))
+      return false;
+
+   ret = content_db_build_internal(db_path, dir, &map, NULL);
+   content_db_cores_free(&map);
+   return ret;
+}
+
+#ifdef HAVE_THREADS
+static void content_db_scan_thread(void *data)
+{
+   content_db_scan_t *scan = (content_db_scan_t*)data;
+   bool ret = content_db_build_internal(scan->db_path, scan->dir, &scan->cores, scan);
+
+   slock_lock(scan->lock);
+   scan->ok   = ret;
+   scan->done = true;
+   slock_unlock(scan->lock);
+}
+
+content_db_scan_t *content_db_scan_new(const char *db_path, const char *dir, const core_info_list_t *cores)
+{
+   content_db_scan_t *scan = (content_db_scan_t*)calloc(1, sizeof(*scan));
+   if (!scan)
+      return NULL;
+
+   scan->db_path = strdup(db_path);
+   scan->dir     = strdup(dir);
+   scan->lock    = slock_new();
+
+   if (!scan->db_path || !scan->dir || !scan->lock ||
+         !content_db_cores_init(&scan->cores, cores) ||
+         !(scan->thread = sthread_create(content_db_scan_thread, scan)))
+   {
+      content_db_scan_free(scan);
+      return NULL;
+   }
+
+   return scan;
+}
+
+bool content_db_scan_poll(content_db_scan_t *scan, bool *ok, size_t *done, size_t *total)
+{
+   bool finished;
+
+   slock_lock(scan->lock);
+   finished = scan->done;
+   if (ok)
+      *ok = scan->ok;
+   if (done)
+      *done = scan->hashed;
+   if (total)
+      *total = scan->to_hash;
+   slock_unlock(scan->lock);
+
+   return finished;
+}
+
+void content_db_scan_free(content_db_scan_t *scan)
+{
+   if (!scan)
+      return;
+
+   if (scan->thread)
+   {
+      slock_lock(scan->lock);
+      scan->cancel = true;
+      slock_unlock(scan->lock);
+      sthread_join(scan->thread);
+   }
+
+   if (scan->lock)
+      slock_free(scan->lock);
+   content_db_cores_free(&scan->cores);
+   free(scan->db_path);
+   free(scan->dir);
+   free(scan);
+}
+#endif
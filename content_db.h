@@ -0,0 +1,83 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2014 - Hans-Kristian Arntzen
+ *
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __RARCH_CONTENT_DB_H
+#define __RARCH_CONTENT_DB_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "boolean.h"
+#include "frontend/info/core_info.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// On-disk index of a content directory.
+// The file is mapped as is, lookups by path, hash and extension are binary searches.
+typedef struct content_db content_db_t;
+
+struct content_db_entry
+{
+   const char *path;
+   const char *core; // Set if exactly one core supports the extension, otherwise NULL.
+   uint64_t size;
+   int64_t mtime;
+   uint32_t crc32;
+   const uint8_t *sha256; // 32 bytes, binary.
+};
+
+content_db_t *content_db_open(const char *path);
+void content_db_free(content_db_t *db);
+
+size_t content_db_size(const content_db_t *db);
+bool content_db_get(const content_db_t *db, size_t index, struct content_db_entry *entry);
+
+bool content_db_find_path(const content_db_t *db, const char *path, struct content_db_entry *entry);
+bool content_db_find_sha256(const content_db_t *db, const uint8_t *sha256, struct content_db_entry *entry);
+
+// Fills up to max entries with the given CRC32. Returns the number of matches, which can exceed max.
+size_t content_db_find_crc32(const content_db_t *db, uint32_t crc,
+      struct content_db_entry *entries, size_t max);
+
+// Fills up to max core paths supporting the extension (without '.'). Returns the number of matches.
+size_t content_db_find_cores(const content_db_t *db, const char *ext,
+      const char **cores, size_t max);
+
+// Picks the core for path without testing every core's extensions.
+// The path is looked up first, then the extension. The file itself is never read, so this is cheap enough for the menu.
+// Returns false if the index can't tell, the caller should fall back to core info.
+bool content_db_find_core(const content_db_t *db, const char *path, char *core, size_t size);
+
+// Scans dir recursively and writes a new index to db_path.
+// Only files with extensions supported by cores are indexed, unless cores is NULL.
+// Files whose size and mtime match the previous index at db_path are not hashed again.
+bool content_db_build(const char *db_path, const char *dir, const core_info_list_t *cores);
+
+// Runs content_db_build() on a worker thread. Only available with HAVE_THREADS.
+typedef struct content_db_scan content_db_scan_t;
+
+content_db_scan_t *content_db_scan_new(const char *db_path, const char *dir, const core_info_list_t *cores);
+// Returns true once the scan has finished. *ok tells if the index was written.
+// *done and *total track hashing progress, and may be NULL.
+bool content_db_scan_poll(content_db_scan_t *scan, bool *ok, size_t *done, size_t *total);
+// Cancels the scan if it is still running. The previous index is kept.
+void content_db_scan_free(content_db_scan_t *scan);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
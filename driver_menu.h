@@ -22,6 +22,7 @@
 #include "boolean.h"
 #include "file_list.h"
 #include "frontend/info/core_info.h"
+#include "content_db.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -143,6 +144,17 @@ typedef struct
    bool defer_core;
    char deferred_path[PATH_MAX];
 
+   // Directory being listed in the background, merged into selection_buf as entries arrive.
+   dir_list_async_t *dir_list_async;
+   unsigned dir_list_type;
+   size_t dir_list_start;
+   char dir_list_path[PATH_MAX];
+
+   // Refreshes the content database in the background.
+   content_db_scan_t *content_scan;
+   // Opened on first use, and again once the scan has written a new index.
+   content_db_t *content_db;
+
    // Quick jumping indices with L/R.
    // Rebuilt when parsing directory.
    size_t scroll_indices[2 * (26 + 2) + 1];
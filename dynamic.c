@@ -443,6 +443,12 @@ void dylib_close(dylib_t lib)
 }
 #endif
 
+// Frontend-only bits are not part of the libretro API.
+static uint64_t rarch_get_cpu_features_libretro(void)
+{
+   return rarch_get_cpu_features() & ~RARCH_SIMD_FRONTEND_MASK;
+}
+
 static void rarch_log_libretro(enum retro_log_level level, const char *fmt, ...)
 {
    if ((unsigned)level < g_settings.libretro_log_level)
@@ -854,7 +860,7 @@ bool rarch_environment_cb(unsigned cmd, void *data)
          RARCH_LOG("Environ GET_PERF_INTERFACE.\n");
          struct retro_perf_callback *cb = (struct retro_perf_callback*)data;
          cb->get_time_usec    = rarch_get_time_usec;
-         cb->get_cpu_features = rarch_get_cpu_features;
+         cb->get_cpu_features = rarch_get_cpu_features_libretro;
          cb->get_perf_counter = rarch_get_perf_counter;
          cb->perf_register    = retro_perf_register; // libretro specific path.
          cb->perf_start       = rarch_perf_start;
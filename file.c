@@ -25,6 +25,7 @@
 #include "patch.h"
 #include "compat/strl.h"
 #include "hash.h"
+#include "performance.h"
 #include "file_extract.h"
 
 #ifdef _WIN32
@@ -39,110 +40,332 @@
 #endif
 #endif
 
-static void patch_rom(uint8_t **buf, ssize_t *size)
+#ifdef HAVE_MMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+struct rom_patch
 {
-   uint8_t *ret_buf = *buf;
-   ssize_t ret_size = *size;
+   const char *desc;
+   const char *path;
+   patch_func_t func;
+   patch_size_func_t size_func;
+   bool in_place; // Can be applied directly on the source buffer.
 
-   const char *patch_desc = NULL;
-   const char *patch_path = NULL;
-   patch_error_t err = PATCH_UNKNOWN;
-   patch_func_t func = NULL;
+   void *data;
+   ssize_t size;
+};
 
-   ssize_t patch_size = 0;
-   void *patch_data = NULL;
-   bool success = false;
+// Picks the patch to apply and reads it into memory.
+static bool rom_patch_open(struct rom_patch *patch)
+{
+   memset(patch, 0, sizeof(*patch));
 
    if (g_extern.ups_pref + g_extern.bps_pref + g_extern.ips_pref > 1)
    {
       RARCH_WARN("Several patches are explicitly defined, ignoring all ...\n");
-      return;
+      return false;
    }
 
    bool allow_bps = !g_extern.ups_pref && !g_extern.ips_pref;
    bool allow_ups = !g_extern.bps_pref && !g_extern.ips_pref;
    bool allow_ips = !g_extern.ups_pref && !g_extern.bps_pref;
 
-   if (allow_ups && *g_extern.ups_name && (patch_size = read_file(g_extern.ups_name, &patch_data)) >= 0)
+   if (allow_ups && *g_extern.ups_name && (patch->size = read_file(g_extern.ups_name, &patch->data)) >= 0)
    {
-      patch_desc = "UPS";
-      patch_path = g_extern.ups_name;
-      func = ups_apply_patch;
+      patch->desc = "UPS";
+      patch->path = g_extern.ups_name;
+      patch->func = ups_apply_patch;
+      patch->size_func = ups_target_size;
    }
-   else if (allow_bps && *g_extern.bps_name && (patch_size = read_file(g_extern.bps_name, &patch_data)) >= 0)
+   else if (allow_bps && *g_extern.bps_name && (patch->size = read_file(g_extern.bps_name, &patch->data)) >= 0)
    {
-      patch_desc = "BPS";
-      patch_path = g_extern.bps_name;
-      func = bps_apply_patch;
+      patch->desc = "BPS";
+      patch->path = g_extern.bps_name;
+      patch->func = bps_apply_patch;
+      patch->size_func = bps_target_size;
    }
-   else if (allow_ips && *g_extern.ips_name && (patch_size = read_file(g_extern.ips_name, &patch_data)) >= 0)
+   else if (allow_ips && *g_extern.ips_name && (patch->size = read_file(g_extern.ips_name, &patch->data)) >= 0)
    {
-      patch_desc = "IPS";
-      patch_path = g_extern.ips_name;
-      func = ips_apply_patch;
+      patch->desc = "IPS";
+      patch->path = g_extern.ips_name;
+      patch->func = ips_apply_patch;
+      patch->size_func = ips_target_size;
+      patch->in_place = true;
    }
    else
    {
       RARCH_LOG("Did not find a valid ROM patch.\n");
-      return;
+      return false;
    }
 
-   RARCH_LOG("Found %s file in \"%s\", attempting to patch ...\n", patch_desc, patch_path);
+   RARCH_LOG("Found %s file in \"%s\", attempting to patch ...\n", patch->desc, patch->path);
+   return true;
+}
 
-   size_t target_size = ret_size * 4; // Just to be sure ...
-   uint8_t *patched_rom = (uint8_t*)malloc(target_size);
-   if (!patched_rom)
+static void rom_patch_close(struct rom_patch *patch)
+{
+   free(patch->data);
+   patch->data = NULL;
+}
+
+static bool rom_patch_size(const struct rom_patch *patch, size_t source_size, size_t *target_size)
+{
+   patch_error_t err = patch->size_func((const uint8_t*)patch->data, patch->size, source_size, target_size);
+   if (err != PATCH_SUCCESS)
    {
-      RARCH_ERR("Failed to allocate memory for patched ROM ...\n");
-      goto error;
+      RARCH_ERR("Failed to patch %s: Error #%u\n", patch->desc, (unsigned)err);
+      return false;
    }
+   return true;
+}
 
-   err = func((const uint8_t*)patch_data, patch_size, ret_buf, ret_size, patched_rom, &target_size);
-   if (err == PATCH_SUCCESS)
+// target holds rom_patch_size() bytes plus a null-terminator, like read_file().
+static bool rom_patch_apply(const struct rom_patch *patch,
+      const uint8_t *source, size_t source_size, uint8_t *target, size_t *target_size)
+{
+   patch_error_t err;
+
+   RARCH_PERFORMANCE_INIT(patch_rom);
+   RARCH_PERFORMANCE_START(patch_rom);
+   err = patch->func((const uint8_t*)patch->data, patch->size, source, source_size, target, target_size);
+   RARCH_PERFORMANCE_STOP(patch_rom);
+
+   if (err != PATCH_SUCCESS)
    {
-      RARCH_LOG("ROM patched successfully (%s).\n", patch_desc);
-      success = true;
+      RARCH_ERR("Failed to patch %s: Error #%u\n", patch->desc, (unsigned)err);
+      return false;
    }
-   else
-      RARCH_ERR("Failed to patch %s: Error #%u\n", patch_desc, (unsigned)err);
 
-   if (success)
+   target[*target_size] = '\0';
+   RARCH_LOG("ROM patched successfully (%s).\n", patch->desc);
+   return true;
+}
+
+// Patches the ROM in *buf. On failure, the unpatched ROM is kept.
+static bool patch_rom(const struct rom_patch *patch, uint8_t **buf, ssize_t *size)
+{
+   size_t target_size = 0;
+   uint8_t *target = NULL;
+
+   if (!rom_patch_size(patch, *size, &target_size))
+      return false;
+
+   if (patch->in_place)
    {
-      free(ret_buf);
-      *buf = patched_rom;
-      *size = target_size;
+      if (target_size > (size_t)*size)
+      {
+         if (!(target = (uint8_t*)realloc(*buf, target_size + 1)))
+            goto error;
+         *buf = target;
+      }
+      target = *buf;
    }
+   else if (!(target = (uint8_t*)malloc(target_size + 1)))
+      goto error;
 
-   free(patch_data);
-   return;
+   if (!rom_patch_apply(patch, *buf, *size, target, &target_size))
+   {
+      if (target != *buf)
+         free(target);
+      return false;
+   }
+
+   if (target != *buf)
+      free(*buf);
+   *buf = target;
+   *size = target_size;
+   return true;
 
 error:
-   *buf = ret_buf;
-   *size = ret_size;
-   free(patch_data);
+   RARCH_ERR("Failed to allocate memory for patched ROM ...\n");
+   return false;
+}
+
+#ifdef HAVE_MMAP
+// Patches straight from a mapping of the ROM file, so only the patched copy is held in memory.
+// *mapped tells if the patch was attempted at all.
+static bool patch_rom_mapped(const struct rom_patch *patch, const char *path,
+      uint8_t **buf, ssize_t *size, bool *mapped)
+{
+   struct stat st;
+   void *source = MAP_FAILED;
+   size_t target_size = 0;
+   uint8_t *target = NULL;
+   bool ret = false;
+   int fd = open(path, O_RDONLY);
+
+   *mapped = false;
+   if (fd < 0)
+      return false;
+   if (fstat(fd, &st) < 0 || st.st_size <= 0)
+      goto end;
+   if ((source = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED)
+      goto end;
+
+   *mapped = true;
+   if (!rom_patch_size(patch, st.st_size, &target_size))
+      goto end;
+   if (!(target = (uint8_t*)malloc(target_size + 1)))
+   {
+      RARCH_ERR("Failed to allocate memory for patched ROM ...\n");
+      goto end;
+   }
+
+   if (!(ret = rom_patch_apply(patch, (const uint8_t*)source, st.st_size, target, &target_size)))
+   {
+      free(target);
+      goto end;
+   }
+
+   *buf = target;
+   *size = target_size;
+
+end:
+   if (source != MAP_FAILED)
+      munmap(source, st.st_size);
+   close(fd);
+   return ret;
+}
+#endif
+
+static void hash_first_rom(const uint8_t *buf, size_t size, const uint32_t *crc)
+{
+   // Content can be hundreds of MB, so keep an eye on hashing throughput.
+   RARCH_PERFORMANCE_INIT(content_crc32);
+   RARCH_PERFORMANCE_START(content_crc32);
+   g_extern.cart_crc = crc ? *crc : crc32_calculate(buf, size);
+   RARCH_PERFORMANCE_STOP(content_crc32);
+
+   RARCH_PERFORMANCE_INIT(content_sha256);
+   RARCH_PERFORMANCE_START(content_sha256);
+   sha256_hash(g_extern.sha256, buf, size);
+   RARCH_PERFORMANCE_STOP(content_sha256);
+
+   RARCH_LOG("CRC32: 0x%x, SHA256: %s\n",
+         (unsigned)g_extern.cart_crc, g_extern.sha256);
+}
+
+// First ROM is significant, attempt to do patching, CRC checking, etc ...
+// crc is the CRC32 of the unpatched ROM if it is already known.
+static void process_first_rom(uint8_t **buf, ssize_t *size, const uint32_t *crc)
+{
+   struct rom_patch patch;
+
+   // Attempt to apply a patch.
+   if (!g_extern.block_patch && rom_patch_open(&patch))
+   {
+      if (patch_rom(&patch, buf, size))
+         crc = NULL;
+      rom_patch_close(&patch);
+   }
+
+   hash_first_rom(*buf, *size, crc);
 }
 
 static ssize_t read_rom_file(const char *path, void **buf)
 {
    uint8_t *ret_buf = NULL;
-   ssize_t ret = read_file(path, (void**)&ret_buf);
+   ssize_t ret = -1;
+   struct rom_patch patch = {0};
+
+   if (!g_extern.block_patch && rom_patch_open(&patch))
+   {
+#ifdef HAVE_MMAP
+      // In-place patches need a writable copy of the ROM anyway.
+      bool mapped = false;
+      if (!patch.in_place && patch_rom_mapped(&patch, path, &ret_buf, &ret, &mapped))
+      {
+         rom_patch_close(&patch);
+         hash_first_rom(ret_buf, ret, NULL);
+         *buf = ret_buf;
+         return ret;
+      }
+
+      // Don't try the same patch twice, load the ROM unpatched.
+      if (mapped)
+         rom_patch_close(&patch);
+#endif
+   }
+
+   ret = read_file(path, (void**)&ret_buf);
    if (ret <= 0)
+   {
+      rom_patch_close(&patch);
       return ret;
+   }
+
+   if (patch.data)
+      patch_rom(&patch, &ret_buf, &ret);
+   rom_patch_close(&patch);
 
-   if (!g_extern.block_patch)
+   hash_first_rom(ret_buf, ret, NULL);
+   *buf = ret_buf;
+   return ret;
+}
+
+#ifdef HAVE_ZLIB
+// Inflates the first matching entry of a ZIP straight into the load buffer.
+// rom_path receives the path the entry would have been extracted to, for the core's info.path.
+static ssize_t read_rom_archive(const char *zip_path, const char *valid_ext, bool first,
+      void **buf, char *rom_path, size_t rom_path_size)
+{
+   uint32_t crc = 0;
+   ssize_t size = -1;
+   uint8_t *ret_buf = NULL;
+   const struct zlib_archive_entry *entry;
+   zlib_archive_t *archive = zlib_archive_open(zip_path);
+
+   if (!archive)
+      return -1;
+
+   if (!(entry = zlib_archive_find_ext(archive, valid_ext)))
+      goto end;
+
+   // Null-terminated like read_file().
+   if (!(ret_buf = (uint8_t*)malloc(entry->size + 1)))
+      goto end;
+
+   if (!zlib_archive_read(entry, ret_buf, &crc))
    {
-      // Attempt to apply a patch.
-      patch_rom(&ret_buf, &ret);
+      RARCH_ERR("Failed to inflate \"%s\" from \"%s\".\n", entry->name, zip_path);
+      free(ret_buf);
+      goto end;
    }
-   
-   g_extern.cart_crc = crc32_calculate(ret_buf, ret);
-   sha256_hash(g_extern.sha256, ret_buf, ret);
-   RARCH_LOG("CRC32: 0x%x, SHA256: %s\n",
-         (unsigned)g_extern.cart_crc, g_extern.sha256);
+   ret_buf[entry->size] = '\0';
+
+   if (crc != entry->crc32)
+      RARCH_WARN("File CRC differs from ZIP CRC. File: 0x%x, ZIP: 0x%x.\n",
+            (unsigned)crc, (unsigned)entry->crc32);
+
+   fill_pathname_resolve_relative(rom_path, zip_path, path_basename(entry->name), rom_path_size);
+
+   size = entry->size;
+   if (first)
+      process_first_rom(&ret_buf, &size, &crc);
    *buf = ret_buf;
-   return ret;
+
+end:
+   zlib_archive_free(archive);
+   return size;
 }
 
+// need_fullpath cores still get a real file. Prefer tmpfs, it is deleted on exit anyway.
+static const char *archive_extraction_dir(void)
+{
+   if (*g_settings.extraction_directory)
+      return g_settings.extraction_directory;
+#if defined(__linux__) && !defined(ANDROID)
+   if (path_is_directory("/dev/shm"))
+      return "/dev/shm";
+#endif
+   return NULL;
+}
+#endif
+
 // Attempt to save valuable RAM data somewhere ...
 static void dump_to_file_desperate(const void *data, size_t size, unsigned type)
 {
@@ -184,7 +407,16 @@ bool save_state(const char *path)
    if (size == 0)
       return false;
 
-   void *data = malloc(size);
+   // With a state writer, compressing and writing happens on its thread.
+   // The state is only serialized here.
+   void *data = NULL;
+#ifdef HAVE_THREADS
+   if (g_extern.state_writer)
+      data = state_writer_get_buffer(g_extern.state_writer, size);
+   else
+#endif
+      data = malloc(size);
+
    if (!data)
    {
       RARCH_ERR("Failed to allocate memory for save state buffer.\n");
@@ -193,8 +425,23 @@ bool save_state(const char *path)
 
    RARCH_LOG("State size: %d bytes.\n", (int)size);
    bool ret = pretro_serialize(data, size);
+
+#ifdef HAVE_THREADS
+   if (g_extern.state_writer)
+   {
+      if (ret)
+         state_writer_write(g_extern.state_writer, path, data, size, g_settings.savestate_compression);
+      else
+      {
+         state_writer_release(g_extern.state_writer, data);
+         RARCH_ERR("Failed to save state to \"%s\".\n", path);
+      }
+      return ret;
+   }
+#endif
+
    if (ret)
-      ret = write_file(path, data, size);
+      ret = state_write_file(path, data, size, g_settings.savestate_compression);
 
    if (!ret)
       RARCH_ERR("Failed to save state to \"%s\".\n", path);
@@ -214,7 +461,13 @@ bool load_state(const char *path)
 {
    unsigned i;
    void *buf = NULL;
-   ssize_t size = read_file(path, &buf);
+
+#ifdef HAVE_THREADS
+   // The state might still be on its way to disk.
+   state_writer_flush(g_extern.state_writer);
+#endif
+
+   ssize_t size = state_read_file(path, &buf);
 
    RARCH_LOG("Loading state: \"%s\".\n", path);
 
@@ -276,6 +529,7 @@ bool load_state(const char *path)
    for (i = 0; i < num_blocks; i++)
       free(blocks[i].data);
    free(blocks);
+   free(buf);
    return ret;
 }
 
@@ -330,6 +584,15 @@ static bool load_roms(const struct retro_subsystem_info *special, const struct s
    if (!info)
       return false;
 
+#ifdef HAVE_ZLIB
+   char (*archive_paths)[PATH_MAX] = (char(*)[PATH_MAX])calloc(roms->size, sizeof(*archive_paths));
+   if (!archive_paths)
+   {
+      free(info);
+      return false;
+   }
+#endif
+
    for (i = 0; i < roms->size; i++)
    {
       const char *path = roms->elems[i].data;
@@ -347,6 +610,28 @@ static bool load_roms(const struct retro_subsystem_info *special, const struct s
 
       info[i].path = *path ? path : NULL;
 
+#ifdef HAVE_ZLIB
+      if (attr & 8) // Inflate the ROM from its archive into memory.
+      {
+         const char *valid_ext = special ?
+            special->roms[i].valid_extensions :
+            g_extern.system.info.valid_extensions;
+
+         RARCH_LOG("Loading ROM from archive: %s.\n", path);
+         long size = read_rom_archive(path, valid_ext, i == 0, (void**)&info[i].data,
+               archive_paths[i], sizeof(archive_paths[i]));
+         if (size < 0)
+         {
+            RARCH_ERR("Could not read ROM from archive \"%s\".\n", path);
+            ret = false;
+            goto end;
+         }
+
+         info[i].path = archive_paths[i];
+         info[i].size = size;
+      }
+      else
+#endif
       if (!need_fullpath && *path) // Load the ROM into memory.
       {
          RARCH_LOG("Loading ROM file: %s.\n", path);
@@ -377,6 +662,9 @@ end:
    for (i = 0; i < roms->size; i++)
       free((void*)info[i].data);
    free(info);
+#ifdef HAVE_ZLIB
+   free(archive_paths);
+#endif
    return ret;
 }
 
@@ -462,17 +750,24 @@ bool init_rom_file(void)
 
       if (ext && !strcasecmp(ext, "zip"))
       {
+         // Cores loading from memory get the ROM inflated straight into the load buffer.
+         if (!(roms->elems[i].attr.i & 2))
+         {
+            roms->elems[i].attr.i |= 8;
+            continue;
+         }
+
          char temporary_rom[PATH_MAX];
          strlcpy(temporary_rom, roms->elems[i].data, sizeof(temporary_rom));
+         // Removed again on exit, along with the tracks of a zipped .cue.
          if (!zlib_extract_first_rom(temporary_rom, sizeof(temporary_rom), valid_ext,
-                  *g_settings.extraction_directory ? g_settings.extraction_directory : NULL))
+                  archive_extraction_dir(), g_extern.temporary_roms))
          {
             RARCH_ERR("Failed to extract ROM from zipped file: %s.\n", temporary_rom);
             string_list_free(roms);
             return false;
          }
          string_list_set(roms, i, temporary_rom);
-         string_list_append(g_extern.temporary_roms, temporary_rom, attr);
       }
    }
 #endif
@@ -16,6 +16,7 @@
 #include "file_extract.h"
 #include "file.h"
 #include "compat/strl.h"
+#include "compat/posix_string.h"
 #include "general.h"
 #include <stdio.h>
 #include <stdlib.h>
@@ -25,14 +26,26 @@
 
 #include "hash.h"
 
+#ifdef HAVE_THREADS
+#include "thread.h"
+#include "performance.h"
+#endif
+
 // File backends. Can be fleshed out later, but keep it simple for now.
 // The file is mapped to memory directly (via mmap() or just plain read_file()).
+struct zlib_archive_stamp
+{
+   uint64_t size;
+   int64_t mtime;
+};
+
 struct zlib_file_backend
 {
    void *(*open)(const char *path);
    const uint8_t *(*data)(void *handle);
    size_t (*size)(void *handle);
    void (*free)(void *handle); // Closes, unmaps and frees.
+   bool (*stamp)(const char *path, struct zlib_archive_stamp *stamp); // False if archive can't be cached.
 };
 
 #ifdef HAVE_MMAP
@@ -105,6 +118,17 @@ error:
    zlib_file_free(data);
    return NULL;
 }
+
+static bool zlib_file_stamp(const char *path, struct zlib_archive_stamp *stamp)
+{
+   struct stat st;
+   if (stat(path, &st) < 0)
+      return false;
+
+   stamp->size = st.st_size;
+   stamp->mtime = st.st_mtime;
+   return true;
+}
 #else
 typedef struct
 {
@@ -153,6 +177,14 @@ error:
    zlib_file_free(data);
    return NULL;
 }
+
+static bool zlib_file_stamp(const char *path, struct zlib_archive_stamp *stamp)
+{
+   // Whole archive lives in memory here, don't keep it around.
+   (void)path;
+   (void)stamp;
+   return false;
+}
 #endif
 
 static const struct zlib_file_backend zlib_backend = {
@@ -160,6 +192,7 @@ static const struct zlib_file_backend zlib_backend = {
    zlib_file_data,
    zlib_file_size,
    zlib_file_free,
+   zlib_file_stamp,
 };
 
 const struct zlib_file_backend *zlib_get_default_file_backend(void)
@@ -177,6 +210,9 @@ const struct zlib_file_backend *zlib_get_default_file_backend(void)
    goto end; \
 } while(0)
 
+// Size of the chunks streamed through inflate() when writing to a file.
+#define ZLIB_CHUNK_SIZE (128 * 1024)
+
 static uint32_t read_le(const uint8_t *data, unsigned size)
 {
    unsigned i;
@@ -188,73 +224,108 @@ static uint32_t read_le(const uint8_t *data, unsigned size)
    return val;
 }
 
-bool zlib_inflate_data_to_file(const char *path, const uint8_t *cdata,
-      uint32_t csize, uint32_t size, uint32_t crc32)
+struct zlib_archive
 {
-   bool ret = true;
-   uint8_t *out_data = (uint8_t*)malloc(size);
-   if (!out_data)
-      return false;
-
-   uint32_t real_crc32 = 0;
-   z_stream stream = {0};
+   char path[PATH_MAX];
+   struct zlib_archive_stamp stamp;
+   bool has_stamp;
+   unsigned refcount;
+
+   void *handle;
+   struct zlib_archive_entry *entries;
+   size_t num_entries;
+   char *names;
+
+   // Open addressing, values are index + 1, 0 is empty.
+   uint32_t *hash;
+   size_t hash_size;
+};
 
-   if (inflateInit2(&stream, -MAX_WBITS) != Z_OK)
-      GOTO_END_ERROR();
+// The most recently opened archive is kept open while it is unchanged on disk,
+// so listing an archive in the menu and then loading from it only parses the central directory once.
+// The cache holds a reference of its own. It is dropped when another archive is opened, or on deinit.
+static zlib_archive_t *zlib_archive_cached;
 
-   stream.next_in = (uint8_t*)cdata;
-   stream.avail_in = csize;
-   stream.next_out = out_data;
-   stream.avail_out = size;
+#ifdef HAVE_THREADS
+static slock_t *zlib_archive_lock;
+#endif
 
-   if (inflate(&stream, Z_FINISH) != Z_STREAM_END)
-   {
-      inflateEnd(&stream);
-      GOTO_END_ERROR();
-   }
-   inflateEnd(&stream);
+static void zlib_archive_cache_lock(void)
+{
+#ifdef HAVE_THREADS
+   if (zlib_archive_lock)
+      slock_lock(zlib_archive_lock);
+#endif
+}
 
-   real_crc32 = crc32_calculate(out_data, size);
-   if (real_crc32 != crc32)
-      RARCH_WARN("File CRC differs from ZIP CRC. File: 0x%x, ZIP: 0x%x.\n",
-            (unsigned)real_crc32, (unsigned)crc32);
+static void zlib_archive_cache_unlock(void)
+{
+#ifdef HAVE_THREADS
+   if (zlib_archive_lock)
+      slock_unlock(zlib_archive_lock);
+#endif
+}
 
-   if (!write_file(path, out_data, size))
-      GOTO_END_ERROR();
+void zlib_archive_init(void)
+{
+#ifdef HAVE_THREADS
+   if (!zlib_archive_lock)
+      zlib_archive_lock = slock_new();
+#endif
+}
 
-end:
-   free(out_data);
-   return ret;
+void zlib_archive_deinit(void)
+{
+   zlib_archive_t *cached;
+
+   zlib_archive_cache_lock();
+   cached = zlib_archive_cached;
+   zlib_archive_cached = NULL;
+   zlib_archive_cache_unlock();
+   zlib_archive_free(cached);
+
+#ifdef HAVE_THREADS
+   if (zlib_archive_lock)
+      slock_free(zlib_archive_lock);
+   zlib_archive_lock = NULL;
+#endif
 }
 
-bool zlib_parse_file(const char *file, zlib_file_cb file_cb, void *userdata)
+static uint32_t zlib_hash_name(const char *name)
 {
-   const uint8_t *footer = NULL;
-   const uint8_t *directory = NULL;
+   uint32_t hash = 5381;
+   while (*name)
+      hash = (hash * 33) ^ (uint8_t)*name++;
+   return hash;
+}
 
-   bool ret = true;
-   const uint8_t *data = NULL;
+static void zlib_archive_destroy(zlib_archive_t *archive)
+{
+   if (!archive)
+      return;
 
-   const struct zlib_file_backend *backend = zlib_get_default_file_backend();
-   if (!backend)
-      return false;
+   if (archive->handle)
+      zlib_get_default_file_backend()->free(archive->handle);
+   free(archive->entries);
+   free(archive->names);
+   free(archive->hash);
+   free(archive);
+}
 
-   ssize_t zip_size = 0;
-   void *handle = backend->open(file);
-   if (!handle)
-      GOTO_END_ERROR();
+static bool zlib_archive_index(zlib_archive_t *archive, const uint8_t *data, size_t zip_size)
+{
+   size_t i, names_size = 0;
+   const uint8_t *footer, *directory, *dir_end;
+   char *name_ptr;
 
-   zip_size = backend->size(handle);
    if (zip_size < 22)
-      GOTO_END_ERROR();
-
-   data = backend->data(handle);
+      return false;
 
    footer = data + zip_size - 22;
    for (;; footer--)
    {
       if (footer <= data + 22)
-         GOTO_END_ERROR();
+         return false;
       if (read_le(footer, 4) == 0x06054b50)
       {
          unsigned comment_len = read_le(footer + 20, 2);
@@ -263,169 +334,720 @@ bool zlib_parse_file(const char *file, zlib_file_cb file_cb, void *userdata)
       }
    }
 
+   if (read_le(footer + 16, 4) > (size_t)(footer - data))
+      return false;
    directory = data + read_le(footer + 16, 4);
 
-   for (;;)
+   // First pass counts entries and name storage, second pass fills them in.
+   // Both check that each record, with its name, extra field and comment, ends before the footer.
+   for (dir_end = directory; footer - dir_end >= 46 && read_le(dir_end, 4) == 0x02014b50; )
    {
-      uint32_t signature = read_le(directory + 0, 4);
-      if (signature != 0x02014b50)
-         break;
+      unsigned namelength = read_le(dir_end + 28, 2);
+      size_t record_size  = 46 + namelength + read_le(dir_end + 30, 2) + read_le(dir_end + 32, 2);
+      if (namelength >= PATH_MAX || record_size > (size_t)(footer - dir_end))
+         return false;
+
+      names_size += namelength + 1;
+      archive->num_entries++;
+      dir_end += record_size;
+   }
 
-      unsigned cmode = read_le(directory + 10, 2);
-      uint32_t crc32 = read_le(directory + 16, 4);
-      uint32_t csize = read_le(directory + 20, 4);
-      uint32_t size  = read_le(directory + 24, 4);
+   archive->entries = (struct zlib_archive_entry*)calloc(archive->num_entries + 1, sizeof(*archive->entries));
+   archive->names = (char*)malloc(names_size + 1);
+   archive->hash_size = 1;
+   while (archive->hash_size < 2 * archive->num_entries)
+      archive->hash_size <<= 1;
+   archive->hash = (uint32_t*)calloc(archive->hash_size, sizeof(*archive->hash));
+   if (!archive->entries || !archive->names || !archive->hash)
+      return false;
 
+   name_ptr = archive->names;
+   for (i = 0; i < archive->num_entries; i++)
+   {
+      struct zlib_archive_entry *entry = &archive->entries[i];
       unsigned namelength    = read_le(directory + 28, 2);
       unsigned extralength   = read_le(directory + 30, 2);
       unsigned commentlength = read_le(directory + 32, 2);
+      uint32_t offset        = read_le(directory + 42, 4);
+      size_t data_offset;
+      uint32_t h;
 
-      char filename[PATH_MAX] = {0};
-      if (namelength >= PATH_MAX)
-         GOTO_END_ERROR();
+      if (footer - directory < 46 || read_le(directory, 4) != 0x02014b50 ||
+            46 + namelength + extralength + commentlength > (size_t)(footer - directory))
+         return false;
 
-      memcpy(filename, directory + 46, namelength);
+      if ((size_t)offset + 30 > zip_size)
+         return false;
 
-      uint32_t offset   = read_le(directory + 42, 4);
-      unsigned offsetNL = read_le(data + offset + 26, 2);
-      unsigned offsetEL = read_le(data + offset + 28, 2);
+      memcpy(name_ptr, directory + 46, namelength);
+      name_ptr[namelength] = '\0';
 
-      const uint8_t *cdata = data + offset + 30 + offsetNL + offsetEL;
+      entry->name  = name_ptr;
+      entry->cmode = read_le(directory + 10, 2);
+      entry->crc32 = read_le(directory + 16, 4);
+      entry->csize = read_le(directory + 20, 4);
+      entry->size  = read_le(directory + 24, 4);
+      data_offset  = (size_t)offset + 30 + read_le(data + offset + 26, 2) + read_le(data + offset + 28, 2);
 
-      //RARCH_LOG("OFFSET: %u, CSIZE: %u, SIZE: %u.\n", offset + 30 + offsetNL + offsetEL, csize, size);
+      if (data_offset > zip_size || entry->csize > zip_size - data_offset)
+         return false;
+      entry->cdata = data + data_offset;
 
-      if (!file_cb(filename, cdata, cmode, csize, size, crc32, userdata))
-         break;
+      h = zlib_hash_name(entry->name) & (archive->hash_size - 1);
+      while (archive->hash[h])
+         h = (h + 1) & (archive->hash_size - 1);
+      archive->hash[h] = i + 1;
 
+      name_ptr += namelength + 1;
       directory += 46 + namelength + extralength + commentlength;
    }
 
-end:
-   if (handle)
-      backend->free(handle);
-   return ret;
+   return true;
+}
+
+zlib_archive_t *zlib_archive_open(const char *path)
+{
+   const struct zlib_file_backend *backend = zlib_get_default_file_backend();
+   zlib_archive_t *archive;
+   struct zlib_archive_stamp stamp = {0};
+   bool has_stamp = backend->stamp(path, &stamp);
+
+   zlib_archive_cache_lock();
+   if (zlib_archive_cached && has_stamp && zlib_archive_cached->has_stamp &&
+         !strcmp(zlib_archive_cached->path, path) &&
+         !memcmp(&zlib_archive_cached->stamp, &stamp, sizeof(stamp)))
+   {
+      archive = zlib_archive_cached;
+      archive->refcount++;
+      zlib_archive_cache_unlock();
+      return archive;
+   }
+   zlib_archive_cache_unlock();
+
+   archive = (zlib_archive_t*)calloc(1, sizeof(*archive));
+   if (!archive)
+      return NULL;
+
+   strlcpy(archive->path, path, sizeof(archive->path));
+   archive->stamp = stamp;
+   archive->has_stamp = has_stamp;
+   archive->refcount = 1;
+
+   if (!(archive->handle = backend->open(path)))
+      goto error;
+
+   if (!zlib_archive_index(archive, backend->data(archive->handle), backend->size(archive->handle)))
+   {
+      RARCH_ERR("Failed to parse ZIP central directory: %s.\n", path);
+      goto error;
+   }
+
+   // The previously cached archive stays valid for its holders, it just can't be shared anymore.
+   if (has_stamp)
+   {
+      zlib_archive_t *previous;
+
+      zlib_archive_cache_lock();
+      previous = zlib_archive_cached;
+      zlib_archive_cached = archive;
+      archive->refcount++;
+      zlib_archive_cache_unlock();
+
+      zlib_archive_free(previous);
+   }
+
+   return archive;
+
+error:
+   zlib_archive_destroy(archive);
+   return NULL;
 }
 
-struct zip_extract_userdata
+void zlib_archive_free(zlib_archive_t *archive)
 {
-   char *zip_path;
-   const char *extraction_directory;
-   size_t zip_path_size;
-   struct string_list *ext;
-   bool found_rom;
+   bool destroy;
+
+   if (!archive)
+      return;
+
+   zlib_archive_cache_lock();
+   destroy = --archive->refcount == 0;
+   zlib_archive_cache_unlock();
+
+   if (destroy)
+      zlib_archive_destroy(archive);
+}
+
+size_t zlib_archive_size(const zlib_archive_t *archive)
+{
+   return archive->num_entries;
+}
+
+const struct zlib_archive_entry *zlib_archive_get(const zlib_archive_t *archive, size_t index)
+{
+   return index < archive->num_entries ? &archive->entries[index] : NULL;
+}
+
+const struct zlib_archive_entry *zlib_archive_find(const zlib_archive_t *archive, const char *name)
+{
+   uint32_t h;
+   if (!archive->num_entries)
+      return NULL;
+
+   for (h = zlib_hash_name(name) & (archive->hash_size - 1); archive->hash[h];
+         h = (h + 1) & (archive->hash_size - 1))
+   {
+      const struct zlib_archive_entry *entry = &archive->entries[archive->hash[h] - 1];
+      if (!strcmp(entry->name, name))
+         return entry;
+   }
+
+   return NULL;
+}
+
+#ifdef HAVE_THREADS
+// For large entries, CRC of the already inflated part runs on a second thread
+// while the rest is inflated.
+#define ZLIB_CRC_PIPELINE_MIN (4 * 1024 * 1024)
+#define ZLIB_CRC_PIPELINE_STEP (1024 * 1024)
+
+struct zlib_crc_pipeline
+{
+   const uint8_t *data;
+   size_t avail;
+   bool done;
+   uint32_t crc;
+
+   slock_t *lock;
+   scond_t *cond;
 };
 
-static bool zip_extract_cb(const char *name, const uint8_t *cdata, unsigned cmode, uint32_t csize, uint32_t size,
-      uint32_t crc32, void *userdata)
+static void zlib_crc_thread(void *data)
 {
-   struct zip_extract_userdata *data = (struct zip_extract_userdata*)userdata;
+   struct zlib_crc_pipeline *pipe = (struct zlib_crc_pipeline*)data;
+   size_t pos = 0;
 
-   // Extract first ROM that matches our list.
-   const char *ext = path_get_extension(name);
-   if (ext && string_list_find_elem(data->ext, ext))
+   for (;;)
    {
-      char new_path[PATH_MAX];
+      size_t avail;
+      bool done;
 
-      if (data->extraction_directory)
-         fill_pathname_join(new_path, data->extraction_directory,
-               path_basename(name), sizeof(new_path));
-      else
-         fill_pathname_resolve_relative(new_path, data->zip_path,
-               path_basename(name), sizeof(new_path));
+      slock_lock(pipe->lock);
+      while (pipe->avail == pos && !pipe->done)
+         scond_wait(pipe->cond, pipe->lock);
+      avail = pipe->avail;
+      done = pipe->done;
+      slock_unlock(pipe->lock);
 
-      switch (cmode)
+      if (avail > pos)
       {
-         case 0: // Uncompressed
-            data->found_rom = write_file(new_path, cdata, size);
+         pipe->crc = crc32(pipe->crc, pipe->data + pos, avail - pos);
+         pos = avail;
+      }
+      else if (done)
+         break;
+   }
+}
+
+static bool zlib_inflate_pipelined(const struct zlib_archive_entry *entry, uint8_t *buf, uint32_t *crc)
+{
+   int zret = Z_OK;
+   z_stream stream = {0};
+   sthread_t *thread = NULL;
+   struct zlib_crc_pipeline pipe = {0};
+
+   pipe.data = buf;
+   pipe.lock = slock_new();
+   pipe.cond = scond_new();
+   if (!pipe.lock || !pipe.cond || !(thread = sthread_create(zlib_crc_thread, &pipe)))
+      goto error;
+
+   if (inflateInit2(&stream, -MAX_WBITS) != Z_OK)
+      goto error;
+
+   stream.next_in = (uint8_t*)entry->cdata;
+   stream.avail_in = entry->csize;
+   stream.next_out = buf;
+
+   while (zret == Z_OK)
+   {
+      size_t left = entry->size - stream.total_out;
+      stream.avail_out = left < ZLIB_CRC_PIPELINE_STEP ? left : ZLIB_CRC_PIPELINE_STEP;
+      if (!stream.avail_out)
+         break;
+
+      zret = inflate(&stream, Z_NO_FLUSH);
+
+      slock_lock(pipe.lock);
+      pipe.avail = stream.total_out;
+      scond_signal(pipe.cond);
+      slock_unlock(pipe.lock);
+   }
+   inflateEnd(&stream);
+
+   slock_lock(pipe.lock);
+   pipe.done = true;
+   scond_signal(pipe.cond);
+   slock_unlock(pipe.lock);
+   sthread_join(thread);
+   thread = NULL;
+
+   if (zret != Z_STREAM_END || stream.total_out != entry->size)
+      goto error;
+
+   *crc = pipe.crc;
+   scond_free(pipe.cond);
+   slock_free(pipe.lock);
+   return true;
+
+error:
+   if (thread)
+   {
+      slock_lock(pipe.lock);
+      pipe.done = true;
+      scond_signal(pipe.cond);
+      slock_unlock(pipe.lock);
+      sthread_join(thread);
+   }
+   if (pipe.cond)
+      scond_free(pipe.cond);
+   if (pipe.lock)
+      slock_free(pipe.lock);
+   return false;
+}
+#endif
+
+bool zlib_archive_read(const struct zlib_archive_entry *entry, void *buf, uint32_t *crc)
+{
+   z_stream stream = {0};
+
+   switch (entry->cmode)
+   {
+      case 0:
+         if (entry->csize != entry->size)
             return false;
+         memcpy(buf, entry->cdata, entry->size);
+         break;
 
-         case 8: // Deflate
-            if (zlib_inflate_data_to_file(new_path, cdata, csize, size, crc32))
-            {
-               strlcpy(data->zip_path, new_path, data->zip_path_size);
-               data->found_rom = true;
-               return false;
-            }
-            else
-               return false;
-
-         default:
+      case 8:
+#ifdef HAVE_THREADS
+         if (crc && entry->size >= ZLIB_CRC_PIPELINE_MIN)
+            return zlib_inflate_pipelined(entry, (uint8_t*)buf, crc);
+#endif
+         if (inflateInit2(&stream, -MAX_WBITS) != Z_OK)
             return false;
-      }
+
+         stream.next_in = (uint8_t*)entry->cdata;
+         stream.avail_in = entry->csize;
+         stream.next_out = (uint8_t*)buf;
+         stream.avail_out = entry->size;
+
+         if (inflate(&stream, Z_FINISH) != Z_STREAM_END)
+         {
+            inflateEnd(&stream);
+            return false;
+         }
+         inflateEnd(&stream);
+         break;
+
+      default:
+         RARCH_ERR("Unsupported ZIP compression method %u for: %s.\n", entry->cmode, entry->name);
+         return false;
    }
 
+   if (crc)
+      *crc = crc32_calculate((const uint8_t*)buf, entry->size);
    return true;
 }
 
-bool zlib_extract_first_rom(char *zip_path, size_t zip_path_size, const char *valid_exts,
-      const char *extraction_directory)
+static bool zlib_stream_to_file(const char *path, const uint8_t *cdata,
+      unsigned cmode, uint32_t csize, uint32_t size, uint32_t expected_crc32)
+{
+   bool ret = true;
+   int zret = Z_OK;
+   uint32_t real_crc32 = 0;
+   uint8_t *chunk = NULL;
+   z_stream stream = {0};
+   bool stream_init = false;
+
+   FILE *file = fopen(path, "wb");
+   if (!file)
+   {
+      RARCH_ERR("Failed to open \"%s\" for writing.\n", path);
+      return false;
+   }
+
+   if (cmode == 0)
+   {
+      if (csize != size || fwrite(cdata, 1, size, file) != size)
+         GOTO_END_ERROR();
+      real_crc32 = crc32_calculate(cdata, size);
+      goto end;
+   }
+   else if (cmode != 8)
+      GOTO_END_ERROR();
+
+   if (!(chunk = (uint8_t*)malloc(ZLIB_CHUNK_SIZE)))
+      GOTO_END_ERROR();
+
+   if (inflateInit2(&stream, -MAX_WBITS) != Z_OK)
+      GOTO_END_ERROR();
+   stream_init = true;
+
+   stream.next_in = (uint8_t*)cdata;
+   stream.avail_in = csize;
+
+   while (zret != Z_STREAM_END)
+   {
+      size_t have;
+
+      stream.next_out = chunk;
+      stream.avail_out = ZLIB_CHUNK_SIZE;
+
+      zret = inflate(&stream, Z_NO_FLUSH);
+      if (zret != Z_OK && zret != Z_STREAM_END)
+         GOTO_END_ERROR();
+
+      have = ZLIB_CHUNK_SIZE - stream.avail_out;
+      if (!have && zret != Z_STREAM_END)
+         GOTO_END_ERROR(); // Truncated stream.
+
+      real_crc32 = crc32(real_crc32, chunk, have);
+      if (fwrite(chunk, 1, have, file) != have)
+         GOTO_END_ERROR();
+   }
+
+   if (stream.total_out != size)
+      GOTO_END_ERROR();
+
+end:
+   if (ret && real_crc32 != expected_crc32)
+      RARCH_WARN("File CRC differs from ZIP CRC. File: 0x%x, ZIP: 0x%x.\n",
+            (unsigned)real_crc32, (unsigned)expected_crc32);
+
+   if (stream_init)
+      inflateEnd(&stream);
+   free(chunk);
+   if (fclose(file) != 0)
+      ret = false;
+   if (!ret)
+      remove(path);
+   return ret;
+}
+
+bool zlib_inflate_data_to_file(const char *path, const uint8_t *cdata,
+      uint32_t csize, uint32_t size, uint32_t crc32)
+{
+   return zlib_stream_to_file(path, cdata, 8, csize, size, crc32);
+}
+
+bool zlib_archive_extract(const struct zlib_archive_entry *entry, const char *path)
 {
-   bool ret;
-   struct zip_extract_userdata userdata = {0};
+   return zlib_stream_to_file(path, entry->cdata, entry->cmode,
+         entry->csize, entry->size, entry->crc32);
+}
+
+struct zlib_extract_batch
+{
+   const struct zlib_archive_entry **entries;
+   const char **paths;
+   bool *ok;
+};
+
+static void zlib_extract_task(void *data, size_t index)
+{
+   struct zlib_extract_batch *batch = (struct zlib_extract_batch*)data;
+   batch->ok[index] = zlib_archive_extract(batch->entries[index], batch->paths[index]);
+}
+
+bool zlib_archive_extract_parallel(const struct zlib_archive_entry **entries,
+      const char **paths, size_t num)
+{
+   size_t i;
+   bool ret = true;
+   struct zlib_extract_batch batch;
+
+   batch.entries = entries;
+   batch.paths = paths;
+   if (!(batch.ok = (bool*)calloc(num ? num : 1, sizeof(*batch.ok))))
+      return false;
+
+#ifdef HAVE_THREADS
+   sthread_parallel_for(num, rarch_get_cpu_cores(), zlib_extract_task, &batch);
+#else
+   for (i = 0; i < num; i++)
+      zlib_extract_task(&batch, i);
+#endif
+
+   for (i = 0; i < num; i++)
+      ret &= batch.ok[i];
+
+   free(batch.ok);
+   return ret;
+}
+
+bool zlib_parse_file(const char *file, zlib_file_cb file_cb, void *userdata)
+{
+   size_t i;
+   zlib_archive_t *archive = zlib_archive_open(file);
+   if (!archive)
+   {
+      RARCH_ERR("ZIP extraction failed at line: %d.\n", __LINE__);
+      return false;
+   }
+
+   for (i = 0; i < archive->num_entries; i++)
+   {
+      const struct zlib_archive_entry *entry = &archive->entries[i];
+      if (!file_cb(entry->name, entry->cdata, entry->cmode, entry->csize, entry->size,
+               entry->crc32, userdata))
+         break;
+   }
+
+   zlib_archive_free(archive);
+   return true;
+}
+
+const struct zlib_archive_entry *zlib_archive_find_ext(const zlib_archive_t *archive,
+      const char *valid_exts)
+{
+   size_t i;
+   const struct zlib_archive_entry *entry = NULL;
    struct string_list *list;
 
    if (!valid_exts)
    {
       RARCH_ERR("Libretro implementation does not have any valid extensions. Cannot unzip without knowing this.\n");
-      return false;
+      return NULL;
    }
 
-   ret = true;
-   list = string_split(valid_exts, "|");
-   if (!list)
-      GOTO_END_ERROR();
+   if (!(list = string_split(valid_exts, "|")))
+      return NULL;
+
+   for (i = 0; i < archive->num_entries && !entry; i++)
+   {
+      const char *ext = path_get_extension(archive->entries[i].name);
+      if (ext && string_list_find_elem(list, ext))
+         entry = &archive->entries[i];
+   }
+
+   if (!entry)
+      RARCH_ERR("Didn't find any ROMS that matched valid extensions for libretro implementation.\n");
 
-   userdata.zip_path = zip_path;
-   userdata.zip_path_size = zip_path_size;
-   userdata.extraction_directory = extraction_directory;
-   userdata.ext = list;
+   string_list_free(list);
+   return entry;
+}
+
+// Sheets name further files, e.g. the tracks of a disc image, which must be extracted next to them.
+#define ZLIB_SHEET_MAX_SIZE (256 * 1024)
+#define ZLIB_EXTRACT_MAX 128
+
+static bool zlib_is_sheet(const char *name)
+{
+   const char *ext = path_get_extension(name);
+   return !strcasecmp(ext, "cue") || !strcasecmp(ext, "m3u");
+}
+
+struct zlib_extract_set
+{
+   const struct zlib_archive_entry *entries[ZLIB_EXTRACT_MAX];
+   size_t num;
+};
+
+static void zlib_archive_add_sheet(const zlib_archive_t *archive,
+      const struct zlib_archive_entry *sheet, struct zlib_extract_set *set, unsigned depth);
+
+// Adds the entry a sheet refers to, looked up next to the sheet in the archive.
+static void zlib_archive_add_ref(const zlib_archive_t *archive,
+      const struct zlib_archive_entry *sheet, const char *ref,
+      struct zlib_extract_set *set, unsigned depth)
+{
+   size_t i, dir_len;
+   char name[PATH_MAX];
+   const struct zlib_archive_entry *entry;
+   const char *slash = strrchr(sheet->name, '/');
+
+   // Everything is extracted into one directory, so subdirectories can't be reproduced.
+   if (strchr(ref, '/') || strchr(ref, '\\'))
+   {
+      RARCH_WARN("\"%s\" refers to \"%s\" in another directory, not extracting it.\n", sheet->name, ref);
+      return;
+   }
+
+   dir_len = slash ? (size_t)(slash - sheet->name) + 1 : 0;
+   if (dir_len + strlen(ref) >= sizeof(name))
+      return;
+   memcpy(name, sheet->name, dir_len);
+   strlcpy(name + dir_len, ref, sizeof(name) - dir_len);
+
+   if (!(entry = zlib_archive_find(archive, name)))
+   {
+      RARCH_WARN("\"%s\" refers to \"%s\", which is not in the archive.\n", sheet->name, ref);
+      return;
+   }
+
+   for (i = 0; i < set->num; i++)
+      if (set->entries[i] == entry)
+         return;
+
+   if (set->num == ZLIB_EXTRACT_MAX)
+   {
+      RARCH_WARN("\"%s\" refers to too many files, not extracting \"%s\".\n", sheet->name, ref);
+      return;
+   }
+   set->entries[set->num++] = entry;
+
+   // A playlist names the sheets of each disc, which name their tracks.
+   if (depth == 0 && zlib_is_sheet(entry->name))
+      zlib_archive_add_sheet(archive, entry, set, depth + 1);
+}
+
+// Adds the files named by FILE lines of a .cue, or the lines of a .m3u.
+static void zlib_archive_add_sheet(const zlib_archive_t *archive,
+      const struct zlib_archive_entry *sheet, struct zlib_extract_set *set, unsigned depth)
+{
+   char *text, *line, *save = NULL;
+   bool cue = !strcasecmp(path_get_extension(sheet->name), "cue");
+
+   if (sheet->size > ZLIB_SHEET_MAX_SIZE || !(text = (char*)malloc(sheet->size + 1)))
+      return;
+
+   if (!zlib_archive_read(sheet, text, NULL))
+   {
+      free(text);
+      return;
+   }
+   text[sheet->size] = '\0';
+
+   for (line = strtok_r(text, "\r\n", &save); line; line = strtok_r(NULL, "\r\n", &save))
+   {
+      char *ref = line, *end;
+
+      while (*ref == ' ' || *ref == '\t')
+         ref++;
+
+      if (cue)
+      {
+         if (strncmp(ref, "FILE", 4) || (ref[4] != ' ' && ref[4] != '\t'))
+            continue;
+         ref += 5;
+         while (*ref == ' ' || *ref == '\t')
+            ref++;
+
+         // FILE "name" TYPE, or FILE name TYPE without quotes.
+         if (*ref == '"')
+            end = strchr(++ref, '"');
+         else
+            end = strpbrk(ref, " \t");
+         if (end)
+            *end = '\0';
+      }
+      else if (*ref == '#')
+         continue;
 
-   if (!zlib_parse_file(zip_path, zip_extract_cb, &userdata))
+      if (*ref)
+         zlib_archive_add_ref(archive, sheet, ref, set, depth);
+   }
+
+   free(text);
+}
+
+bool zlib_extract_first_rom(char *zip_path, size_t zip_path_size, const char *valid_exts,
+      const char *extraction_directory, struct string_list *extracted)
+{
+   size_t i;
+   bool ret = true;
+   zlib_archive_t *archive = NULL;
+   struct zlib_extract_set *set = NULL;
+   char (*paths)[PATH_MAX] = NULL;
+   const char *path_ptrs[ZLIB_EXTRACT_MAX];
+
+   if (!(archive = zlib_archive_open(zip_path)))
    {
       RARCH_ERR("Parsing ZIP failed.\n");
       GOTO_END_ERROR();
    }
 
-   if (!userdata.found_rom)
+   if (!(set = (struct zlib_extract_set*)calloc(1, sizeof(*set))))
+      GOTO_END_ERROR();
+
+   // Extract first ROM that matches our list.
+   if (!(set->entries[0] = zlib_archive_find_ext(archive, valid_exts)))
+      GOTO_END_ERROR();
+   set->num = 1;
+
+   if (zlib_is_sheet(set->entries[0]->name))
+      zlib_archive_add_sheet(archive, set->entries[0], set, 0);
+
+   if (!(paths = (char (*)[PATH_MAX])calloc(set->num, sizeof(*paths))))
+      GOTO_END_ERROR();
+
+   for (i = 0; i < set->num; i++)
+   {
+      if (extraction_directory)
+         fill_pathname_join(paths[i], extraction_directory,
+               path_basename(set->entries[i]->name), sizeof(paths[i]));
+      else
+         fill_pathname_resolve_relative(paths[i], zip_path,
+               path_basename(set->entries[i]->name), sizeof(paths[i]));
+      path_ptrs[i] = paths[i];
+   }
+
+   if (set->num > 1)
+      RARCH_LOG("Extracting \"%s\" and %u files it refers to.\n",
+            set->entries[0]->name, (unsigned)(set->num - 1));
+
+   if (!zlib_archive_extract_parallel(set->entries, path_ptrs, set->num))
    {
-      RARCH_ERR("Didn't find any ROMS that matched valid extensions for libretro implementation.\n");
+      for (i = 0; i < set->num; i++)
+         remove(paths[i]);
       GOTO_END_ERROR();
    }
 
+   if (extracted)
+   {
+      union string_list_elem_attr attr;
+      memset(&attr, 0, sizeof(attr));
+      for (i = 0; i < set->num; i++)
+         string_list_append(extracted, paths[i], attr);
+   }
+
+   strlcpy(zip_path, paths[0], zip_path_size);
+
 end:
-   if (list)
-      string_list_free(list);
+   free(paths);
+   free(set);
+   zlib_archive_free(archive);
    return ret;
 }
 
-static bool zlib_get_file_list_cb(const char *path, const uint8_t *cdata, unsigned cmode,
-      uint32_t csize, uint32_t size,
-      uint32_t crc32, void *userdata)
-{
-   (void)cdata;
-   (void)cmode;
-   (void)csize;
-   (void)size;
-   (void)crc32;
-   struct string_list *list = (struct string_list*)userdata;
-   union string_list_elem_attr attr;
-   memset(&attr, 0, sizeof(attr));
-   return string_list_append(list, path, attr);
-}
-
 struct string_list *zlib_get_file_list(const char *path)
 {
-   struct string_list *list = string_list_new();
-   if (!list)
-      return NULL;
+   size_t i;
+   union string_list_elem_attr attr;
+   struct string_list *list;
+   zlib_archive_t *archive = zlib_archive_open(path);
 
-   if (!zlib_parse_file(path, zlib_get_file_list_cb, list))
+   if (!archive)
    {
       RARCH_ERR("Parsing ZIP failed.\n");
-      string_list_free(list);
       return NULL;
    }
-   else
-      return list;
-}
 
+   memset(&attr, 0, sizeof(attr));
+   if ((list = string_list_new()))
+   {
+      for (i = 0; i < archive->num_entries; i++)
+      {
+         if (!string_list_append(list, archive->entries[i].name, attr))
+         {
+            string_list_free(list);
+            list = NULL;
+            break;
+         }
+      }
+   }
+
+   zlib_archive_free(archive);
+   return list;
+}
@@ -29,12 +29,56 @@ typedef bool (*zlib_file_cb)(const char *name,
 // Low-level file parsing. Enumerates over all files and calls file_cb with userdata.
 bool zlib_parse_file(const char *file, zlib_file_cb file_cb, void *userdata);
 
-// Built with zlib_parse_file.
-bool zlib_extract_first_rom(char *zip_path, size_t zip_path_size, const char *valid_exts, const char *extraction_dir);
+// Extracts the first entry matching valid_exts and replaces zip_path with the extracted path.
+// If that entry is a .cue or .m3u, the files it names are extracted next to it.
+// If extracted is non-NULL, every path written is appended to it.
+bool zlib_extract_first_rom(char *zip_path, size_t zip_path_size, const char *valid_exts, const char *extraction_dir,
+      struct string_list *extracted);
 struct string_list *zlib_get_file_list(const char *path);
 
 bool zlib_inflate_data_to_file(const char *path, const uint8_t *data,
       uint32_t csize, uint32_t size, uint32_t crc32);
 
+// Parsed archive. The central directory is read once and indexed by name.
+// Entry data points straight into the mapped archive and is valid until the handle is freed.
+typedef struct zlib_archive zlib_archive_t;
+
+struct zlib_archive_entry
+{
+   const char *name;
+   const uint8_t *cdata;
+   unsigned cmode; // 0 = stored, 8 = deflate.
+   uint32_t csize;
+   uint32_t size;
+   uint32_t crc32;
+};
+
+// Sets up the lock guarding the shared handle. Must be called before archives are opened from more than one thread.
+void zlib_archive_init(void);
+void zlib_archive_deinit(void);
+
+// Handles are shared. The most recently opened archive stays open until another one is opened or zlib_archive_deinit(),
+// so opening it again while it is unchanged on disk returns the same index.
+zlib_archive_t *zlib_archive_open(const char *path);
+void zlib_archive_free(zlib_archive_t *archive);
+
+size_t zlib_archive_size(const zlib_archive_t *archive);
+const struct zlib_archive_entry *zlib_archive_get(const zlib_archive_t *archive, size_t index);
+const struct zlib_archive_entry *zlib_archive_find(const zlib_archive_t *archive, const char *name);
+// First entry with an extension in valid_exts ('|' delimited).
+const struct zlib_archive_entry *zlib_archive_find_ext(const zlib_archive_t *archive, const char *valid_exts);
+
+// Decompresses into a caller buffer of at least entry->size bytes.
+// If crc is non-NULL, it receives the CRC32 of the decompressed data.
+// For large entries, the CRC is computed on a second thread while inflating.
+bool zlib_archive_read(const struct zlib_archive_entry *entry, void *buf, uint32_t *crc);
+
+// Decompresses in fixed size chunks directly to path.
+bool zlib_archive_extract(const struct zlib_archive_entry *entry, const char *path);
+
+// Extracts entries[i] to paths[i], several entries at a time with threads. False if any failed.
+bool zlib_archive_extract_parallel(const struct zlib_archive_entry **entries,
+      const char **paths, size_t num);
+
 #endif
 
@@ -133,6 +133,60 @@ void file_list_sort_on_alt(file_list_t *list)
    qsort(list->list, list->size, sizeof(list->list[0]), file_list_alt_cmp);
 }
 
+// qsort_r() is not in standard C, sadly.
+static unsigned file_list_sort_last_type;
+
+static int file_list_type_cmp(const struct item_file *a, const struct item_file *b)
+{
+   int a_last = a->type == file_list_sort_last_type;
+   int b_last = b->type == file_list_sort_last_type;
+   if (a_last != b_last)
+      return a_last - b_last;
+   return strcasecmp(a->path, b->path);
+}
+
+static int file_list_qsort_type_cmp(const void *a_, const void *b_)
+{
+   return file_list_type_cmp((const struct item_file*)a_, (const struct item_file*)b_);
+}
+
+void file_list_sort_merge(file_list_t *list, size_t start, size_t sorted, unsigned last_type)
+{
+   size_t i, j, out, num = list->size - start;
+   struct item_file *tmp;
+
+   if (sorted >= list->size)
+      return;
+
+   file_list_sort_last_type = last_type;
+   qsort(list->list + sorted, list->size - sorted, sizeof(list->list[0]), file_list_qsort_type_cmp);
+
+   if (sorted <= start)
+      return;
+
+   // If the allocation fails, fall back to sorting everything from scratch.
+   if (!(tmp = (struct item_file*)malloc(num * sizeof(*tmp))))
+   {
+      qsort(list->list + start, num, sizeof(list->list[0]), file_list_qsort_type_cmp);
+      return;
+   }
+
+   for (i = start, j = sorted, out = 0; i < sorted && j < list->size; out++)
+   {
+      if (file_list_type_cmp(&list->list[j], &list->list[i]) < 0)
+         tmp[out] = list->list[j++];
+      else
+         tmp[out] = list->list[i++];
+   }
+
+   memcpy(tmp + out, list->list + i, (sorted - i) * sizeof(*tmp));
+   out += sorted - i;
+   memcpy(tmp + out, list->list + j, (list->size - j) * sizeof(*tmp));
+
+   memcpy(list->list + start, tmp, num * sizeof(*tmp));
+   free(tmp);
+}
+
 void file_list_get_at_offset(const file_list_t *list, size_t index,
       const char **path, unsigned *file_type)
 {
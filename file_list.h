@@ -54,6 +54,9 @@ void file_list_get_alt_at_offset(const file_list_t *list, size_t index,
       const char **alt);
 
 void file_list_sort_on_alt(file_list_t *list);
+// Sorts entries [sorted, size) and merges them into the already sorted entries [start, sorted).
+// Entries of last_type come after all others, ties are broken by path, ignoring case.
+void file_list_sort_merge(file_list_t *list, size_t start, size_t sorted, unsigned last_type);
 
 bool file_list_search(const file_list_t *list, const char *needle, size_t *index);
 
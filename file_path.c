@@ -23,6 +23,10 @@
 #include "compat/posix_string.h"
 #include "miscellaneous.h"
 
+#ifdef HAVE_THREADS
+#include "thread.h"
+#endif
+
 #if (defined(__CELLOS_LV2__) && !defined(__PSL1GHT__)) || defined(__QNX__) || defined(PSP)
 #include <unistd.h> //stat() is defined here
 #endif
@@ -350,29 +354,33 @@ void dir_list_sort(struct string_list *list, bool dir_first)
          dir_first ? qstrcmp_dir : qstrcmp_plain);
 }
 
+// Called for every entry which passes the filters. Return false to stop listing.
+typedef bool (*dir_list_cb)(const char *path, bool is_dir, void *userdata);
+// Optional, called before every entry, filtered or not. Return true to stop listing.
+typedef bool (*dir_list_cancel_cb)(void *userdata);
+
 #ifdef _WIN32 // Because the API is just fucked up ...
-struct string_list *dir_list_new(const char *dir, const char *ext, bool include_dirs)
+static bool dir_list_read(const char *dir, const struct string_list *ext_list, bool include_dirs,
+      dir_list_cb cb, dir_list_cancel_cb cancelled, void *userdata)
 {
-   struct string_list *list = string_list_new();
-   if (!list)
-      return NULL;
-
    HANDLE hFind = INVALID_HANDLE_VALUE;
    WIN32_FIND_DATA ffd;
 
    char path_buf[PATH_MAX];
    snprintf(path_buf, sizeof(path_buf), "%s\\*", dir);
 
-   struct string_list *ext_list = NULL;
-   if (ext)
-      ext_list = string_split(ext, "|");
-
    hFind = FindFirstFile(path_buf, &ffd);
    if (hFind == INVALID_HANDLE_VALUE)
-      goto error;
+      return false;
 
    do
    {
+      if (cancelled && cancelled(userdata))
+      {
+         FindClose(hFind);
+         return false;
+      }
+
       const char *name     = ffd.cFileName;
       const char *file_ext = path_get_extension(name);
       bool is_dir          = ffd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY;
@@ -389,26 +397,16 @@ struct string_list *dir_list_new(const char *dir, const char *ext, bool include_
       char file_path[PATH_MAX];
       fill_pathname_join(file_path, dir, name, sizeof(file_path));
 
-      union string_list_elem_attr attr;
-      attr.b = is_dir;
-
-      if (!string_list_append(list, file_path, attr))
-         goto error;
+      if (!cb(file_path, is_dir, userdata))
+      {
+         FindClose(hFind);
+         return false;
+      }
    }
    while (FindNextFile(hFind, &ffd) != 0);
 
    FindClose(hFind);
-   string_list_free(ext_list);
-   return list;
-
-error:
-   RARCH_ERR("Failed to open directory: \"%s\"\n", dir);
-   if (hFind != INVALID_HANDLE_VALUE)
-      FindClose(hFind);
-   
-   string_list_free(list);
-   string_list_free(ext_list);
-   return NULL;
+   return true;
 }
 #else
 static bool dirent_is_directory(const char *path, const struct dirent *entry)
@@ -428,25 +426,24 @@ static bool dirent_is_directory(const char *path, const struct dirent *entry)
 #endif
 }
 
-struct string_list *dir_list_new(const char *dir, const char *ext, bool include_dirs)
+static bool dir_list_read(const char *dir, const struct string_list *ext_list, bool include_dirs,
+      dir_list_cb cb, dir_list_cancel_cb cancelled, void *userdata)
 {
-   struct string_list *list = string_list_new();
-   if (!list)
-      return NULL;
-
    DIR *directory = NULL;
    const struct dirent *entry = NULL;
 
-   struct string_list *ext_list = NULL;
-   if (ext)
-      ext_list = string_split(ext, "|");
-
    directory = opendir(dir);
    if (!directory)
-      goto error;
+      return false;
 
    while ((entry = readdir(directory)))
    {
+      if (cancelled && cancelled(userdata))
+      {
+         closedir(directory);
+         return false;
+      }
+
       const char *name     = entry->d_name;
       const char *file_ext = path_get_extension(name);
 
@@ -463,27 +460,190 @@ struct string_list *dir_list_new(const char *dir, const char *ext, bool include_
       if (!is_dir && ext_list && !string_list_find_elem_prefix(ext_list, ".", file_ext))
          continue;
 
-      union string_list_elem_attr attr;
-      attr.b = is_dir;
-
-      if (!string_list_append(list, file_path, attr))
-         goto error;
+      if (!cb(file_path, is_dir, userdata))
+      {
+         closedir(directory);
+         return false;
+      }
    }
 
    closedir(directory);
+   return true;
+}
+#endif
+
+static bool dir_list_append(const char *path, bool is_dir, void *userdata)
+{
+   union string_list_elem_attr attr;
+   attr.b = is_dir;
+   return string_list_append((struct string_list*)userdata, path, attr);
+}
+
+struct string_list *dir_list_new(const char *dir, const char *ext, bool include_dirs)
+{
+   struct string_list *list = string_list_new();
+   if (!list)
+      return NULL;
+
+   struct string_list *ext_list = NULL;
+   if (ext)
+      ext_list = string_split(ext, "|");
+
+   if (!dir_list_read(dir, ext_list, include_dirs, dir_list_append, NULL, list))
+   {
+      RARCH_ERR("Failed to open directory: \"%s\"\n", dir);
+      string_list_free(list);
+      list = NULL;
+   }
 
    string_list_free(ext_list);
    return list;
+}
 
-error:
-   RARCH_ERR("Failed to open directory: \"%s\"\n", dir);
+// Moves all elements of src to the end of dst, leaving src empty.
+static bool string_list_move(struct string_list *dst, struct string_list *src)
+{
+   if (dst->size + src->size > dst->cap &&
+         !string_list_capacity(dst, (dst->size + src->size) * 2))
+      return false;
 
-   if (directory)
-      closedir(directory);
+   memcpy(dst->elems + dst->size, src->elems, src->size * sizeof(*src->elems));
+   dst->size += src->size;
+   src->size = 0;
+   return true;
+}
 
-   string_list_free(list);
-   string_list_free(ext_list);
-   return NULL;
+#ifdef HAVE_THREADS
+// Entries are handed over in batches to keep lock traffic down.
+#define DIR_LIST_ASYNC_BATCH 256
+
+struct dir_list_async
+{
+   char *dir;
+   struct string_list *ext_list;
+   bool include_dirs;
+
+   struct string_list *batch; // Owned by the worker.
+
+   slock_t *lock;
+   struct string_list *ready; // Handed over, not yet polled.
+   bool done;
+   bool error;
+   bool cancel;
+
+   sthread_t *thread;
+};
+
+static bool dir_list_async_flush(dir_list_async_t *list)
+{
+   bool error;
+
+   slock_lock(list->lock);
+   if (!string_list_move(list->ready, list->batch))
+      list->error = true;
+   error = list->error;
+   slock_unlock(list->lock);
+
+   return !error;
+}
+
+static bool dir_list_async_append(const char *path, bool is_dir, void *userdata)
+{
+   dir_list_async_t *list = (dir_list_async_t*)userdata;
+   if (!dir_list_append(path, is_dir, list->batch))
+      return false;
+   return list->batch->size < DIR_LIST_ASYNC_BATCH || dir_list_async_flush(list);
+}
+
+// Checked for every entry, so a large directory with few matches still stops quickly.
+// The lock is uncontended, which is cheap next to readdir() and stat().
+static bool dir_list_async_cancelled(void *userdata)
+{
+   bool cancel;
+   dir_list_async_t *list = (dir_list_async_t*)userdata;
+
+   slock_lock(list->lock);
+   cancel = list->cancel;
+   slock_unlock(list->lock);
+
+   return cancel;
+}
+
+static void dir_list_async_thread(void *data)
+{
+   dir_list_async_t *list = (dir_list_async_t*)data;
+   bool ret = dir_list_read(list->dir, list->ext_list, list->include_dirs,
+         dir_list_async_append, dir_list_async_cancelled, list);
+
+   slock_lock(list->lock);
+   if (!ret && !list->cancel)
+   {
+      RARCH_ERR("Failed to open directory: \"%s\"\n", list->dir);
+      list->error = true;
+   }
+   if (!string_list_move(list->ready, list->batch))
+      list->error = true;
+   list->done = true;
+   slock_unlock(list->lock);
+}
+
+dir_list_async_t *dir_list_async_new(const char *dir, const char *ext, bool include_dirs)
+{
+   dir_list_async_t *list = (dir_list_async_t*)calloc(1, sizeof(*list));
+   if (!list)
+      return NULL;
+
+   list->dir          = strdup(dir);
+   list->ext_list     = ext ? string_split(ext, "|") : NULL;
+   list->include_dirs = include_dirs;
+   list->batch        = string_list_new();
+   list->ready        = string_list_new();
+   list->lock         = slock_new();
+
+   if (!list->dir || (ext && !list->ext_list) || !list->batch || !list->ready || !list->lock ||
+         !(list->thread = sthread_create(dir_list_async_thread, list)))
+   {
+      dir_list_async_free(list);
+      return NULL;
+   }
+
+   return list;
+}
+
+bool dir_list_async_poll(dir_list_async_t *list, struct string_list *out, bool *error)
+{
+   bool done;
+
+   slock_lock(list->lock);
+   if (!string_list_move(out, list->ready))
+      list->error = true;
+   done   = list->done;
+   *error = list->error;
+   slock_unlock(list->lock);
+
+   return done || *error;
+}
+
+void dir_list_async_free(dir_list_async_t *list)
+{
+   if (!list)
+      return;
+
+   if (list->thread)
+   {
+      slock_lock(list->lock);
+      list->cancel = true;
+      slock_unlock(list->lock);
+      sthread_join(list->thread);
+   }
+
+   if (list->lock)
+      slock_free(list->lock);
+   string_list_free(list->ready);
+   string_list_free(list->batch);
+   string_list_free(list->ext_list);
+   free(list->dir);
+   free(list);
 }
 #endif
 
@@ -54,6 +54,17 @@ struct string_list
 struct string_list *dir_list_new(const char *dir, const char *ext, bool include_dirs);
 void dir_list_sort(struct string_list *list, bool dir_first);
 void dir_list_free(struct string_list *list);
+
+// Lists a directory on a worker thread. Filtering is the same as dir_list_new().
+// Only available with HAVE_THREADS.
+typedef struct dir_list_async dir_list_async_t;
+
+dir_list_async_t *dir_list_async_new(const char *dir, const char *ext, bool include_dirs);
+// Moves entries found since the last poll to the end of out. They are unsorted.
+// Returns true once the listing has finished or failed, *error tells which.
+bool dir_list_async_poll(dir_list_async_t *list, struct string_list *out, bool *error);
+// Cancels the listing if it is still running.
+void dir_list_async_free(dir_list_async_t *list);
 bool string_list_find_elem(const struct string_list *list, const char *elem);
 bool string_list_find_elem_prefix(const struct string_list *list, const char *prefix, const char *elem);
 struct string_list *string_split(const char *str, const char *delim);
@@ -0,0 +1,265 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2014 - Hans-Kristian Arntzen
+ *
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "frame_export.h"
+#include "general.h"
+#include "miscellaneous.h"
+#include "performance.h"
+#include "compat/strl.h"
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+#define FRAME_EXPORT_PAGE_SIZE 4096
+
+struct frame_export
+{
+   uint8_t *map;
+   size_t map_size;
+   struct frame_export_header *header;
+   size_t slot_data_size;
+   uint8_t *audio;
+
+   // Private copies, only the producer writes these.
+   uint32_t video_seq;
+   uint32_t audio_write;
+   bool warned;
+
+   char name[PATH_MAX];
+};
+
+static size_t frame_export_align(size_t size)
+{
+   return (size + FRAME_EXPORT_PAGE_SIZE - 1) & ~(size_t)(FRAME_EXPORT_PAGE_SIZE - 1);
+}
+
+// Full barriers on both sides, so consumers see everything written before,
+// and the waiters check in frame_export_wake() cannot move ahead of the store.
+static void frame_export_publish(volatile uint32_t *word, uint32_t val)
+{
+   __sync_synchronize();
+   *word = val;
+   __sync_synchronize();
+}
+
+static void frame_export_wake(frame_export_t *handle, volatile uint32_t *word)
+{
+#ifdef __linux__
+   if (handle->header->waiters)
+      syscall(SYS_futex, word, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+#else
+   (void)handle;
+   (void)word;
+#endif
+}
+
+frame_export_t *frame_export_new(const char *name, const struct frame_export_params *params)
+{
+   int fd;
+   size_t header_size, slot_size, audio_size, total;
+   struct frame_export_header *header;
+   frame_export_t *handle = (frame_export_t*)calloc(1, sizeof(*handle));
+   if (!handle)
+      return NULL;
+
+   // POSIX wants exactly one leading slash.
+   if (*name != '/')
+      snprintf(handle->name, sizeof(handle->name), "/%s", name);
+   else
+      strlcpy(handle->name, name, sizeof(handle->name));
+
+   header_size = frame_export_align(sizeof(struct frame_export_header));
+   handle->slot_data_size = (size_t)params->max_width * params->max_height * sizeof(uint32_t);
+   slot_size = frame_export_align(FRAME_EXPORT_SLOT_DATA + handle->slot_data_size);
+
+   // About a second of audio.
+   audio_size = next_pow2((uint32_t)(params->sample_rate * params->channels * sizeof(int16_t)));
+   if (audio_size < FRAME_EXPORT_PAGE_SIZE)
+      audio_size = FRAME_EXPORT_PAGE_SIZE;
+
+   total = header_size + slot_size * params->video_slots + audio_size;
+   if (!params->video_slots || !params->channels || total > UINT32_MAX)
+   {
+      RARCH_ERR("Invalid frame export size (%u slots of %u x %u).\n",
+            params->video_slots, params->max_width, params->max_height);
+      goto error;
+   }
+
+   // Consumers might still map an old object. Give them a new one rather than resizing it under them.
+   shm_unlink(handle->name);
+   fd = shm_open(handle->name, O_RDWR | O_CREAT | O_EXCL, 0600);
+   if (fd < 0)
+   {
+      RARCH_ERR("Failed to create shared memory object \"%s\".\n", handle->name);
+      goto error;
+   }
+
+   if (ftruncate(fd, total) < 0)
+   {
+      RARCH_ERR("Failed to resize shared memory object \"%s\".\n", handle->name);
+      close(fd);
+      shm_unlink(handle->name);
+      goto error;
+   }
+
+   handle->map = (uint8_t*)mmap(NULL, total, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+   close(fd);
+   if (handle->map == MAP_FAILED)
+   {
+      RARCH_ERR("Failed to map shared memory object \"%s\".\n", handle->name);
+      handle->map = NULL;
+      shm_unlink(handle->name);
+      goto error;
+   }
+
+   handle->map_size = total;
+   handle->header   = header = (struct frame_export_header*)handle->map;
+   handle->audio    = handle->map + header_size + slot_size * params->video_slots;
+
+   header->version         = FRAME_EXPORT_VERSION;
+   header->header_size     = header_size;
+   header->video_slots     = params->video_slots;
+   header->video_slot_size = slot_size;
+   header->audio_offset    = handle->audio - handle->map;
+   header->audio_size      = audio_size;
+   header->audio_channels  = params->channels;
+   header->max_width       = params->max_width;
+   header->max_height      = params->max_height;
+   header->fps             = params->fps;
+   header->sample_rate     = params->sample_rate;
+   header->producer_pid    = getpid();
+
+   // Magic goes last, a consumer which sees it can trust the rest of the header.
+   __sync_synchronize();
+   memcpy(header->magic, FRAME_EXPORT_MAGIC, sizeof(header->magic));
+   __sync_synchronize();
+
+   return handle;
+
+error:
+   free(handle);
+   return NULL;
+}
+
+void frame_export_free(frame_export_t *handle)
+{
+   if (!handle)
+      return;
+
+   if (handle->map)
+   {
+      frame_export_publish(&handle->header->producer_pid, 0);
+      frame_export_wake(handle, &handle->header->video_seq);
+      frame_export_wake(handle, &handle->header->audio_write);
+
+      munmap(handle->map, handle->map_size);
+      shm_unlink(handle->name);
+   }
+
+   free(handle);
+}
+
+void frame_export_video(frame_export_t *handle, const void *data,
+      unsigned width, unsigned height, size_t pitch,
+      enum frame_export_pix_format pix_fmt)
+{
+   unsigned h;
+   struct frame_export_slot *slot;
+   struct frame_export_header *header = handle->header;
+   uint32_t n = handle->video_seq;
+   size_t line = width * (pix_fmt == FRAME_EXPORT_PIX_XRGB8888 ? sizeof(uint32_t) : sizeof(uint16_t));
+
+   if (data && line * height > handle->slot_data_size)
+   {
+      if (!handle->warned)
+         RARCH_WARN("Frame of %u x %u does not fit in the frame export slots, dropping it.\n", width, height);
+      handle->warned = true;
+      return;
+   }
+
+   RARCH_PERFORMANCE_INIT(frame_export_copy);
+   RARCH_PERFORMANCE_START(frame_export_copy);
+
+   slot = (struct frame_export_slot*)(handle->map + header->header_size +
+         (size_t)(n % header->video_slots) * header->video_slot_size);
+
+   frame_export_publish(&slot->seq, FRAME_EXPORT_SEQ_BUSY(n));
+
+   slot->flags       = data ? 0 : FRAME_EXPORT_DUPE;
+   slot->pix_fmt     = pix_fmt;
+   slot->width       = width;
+   slot->height      = height;
+   slot->pitch       = line;
+   slot->audio_write = header->audio_write;
+   slot->time_usec   = rarch_get_time_usec();
+
+   if (data)
+   {
+      uint8_t *out = (uint8_t*)slot + FRAME_EXPORT_SLOT_DATA;
+      const uint8_t *in = (const uint8_t*)data;
+
+      if (pitch == line)
+         memcpy(out, in, line * height);
+      else
+      {
+         for (h = 0; h < height; h++, out += line, in += pitch)
+            memcpy(out, in, line);
+      }
+   }
+
+   frame_export_publish(&slot->seq, FRAME_EXPORT_SEQ_DONE(n));
+   frame_export_publish(&header->video_seq, ++handle->video_seq);
+   frame_export_wake(handle, &header->video_seq);
+
+   RARCH_PERFORMANCE_STOP(frame_export_copy);
+}
+
+void frame_export_audio(frame_export_t *handle, const int16_t *data, size_t frames)
+{
+   size_t first;
+   struct frame_export_header *header = handle->header;
+   size_t size = frames * header->audio_channels * sizeof(int16_t);
+   const uint8_t *in = (const uint8_t*)data;
+   uint32_t pos;
+
+   // Only the newest audio_size bytes can be kept anyway.
+   if (size > header->audio_size)
+   {
+      handle->audio_write += size - header->audio_size;
+      in   += size - header->audio_size;
+      size  = header->audio_size;
+   }
+
+   pos   = handle->audio_write & (header->audio_size - 1);
+   first = header->audio_size - pos;
+   if (first > size)
+      first = size;
+
+   memcpy(handle->audio + pos, in, first);
+   memcpy(handle->audio, in + first, size - first);
+
+   handle->audio_write += size;
+   frame_export_publish(&header->audio_write, handle->audio_write);
+   frame_export_wake(handle, &header->audio_write);
+}
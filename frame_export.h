@@ -0,0 +1,127 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2014 - Hans-Kristian Arntzen
+ *
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __RARCH_FRAME_EXPORT_H
+#define __RARCH_FRAME_EXPORT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "boolean.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Frames and audio are published to a POSIX shared memory object,
+// so an external encoder can read them in place.
+// Everything is in host byte order, the consumer runs on the same machine.
+//
+// The object starts with struct frame_export_header.
+// At header_size follow video_slots slots of video_slot_size bytes.
+// Frame n (counting from 0) goes to slot n % video_slots.
+// Each slot starts with struct frame_export_slot, pixels follow at FRAME_EXPORT_SLOT_DATA.
+// At audio_offset follows a ring of audio_size bytes of interleaved signed 16-bit PCM.
+//
+// The producer never waits for consumers, a slow consumer loses frames.
+// To read frame n, wait until video_seq > n, then check that the slot seq is
+// FRAME_EXPORT_SEQ_DONE(n) before and after reading it. Any other value means it was overwritten.
+// Audio byte i is at audio_offset + (i & (audio_size - 1)) once audio_write > i,
+// and is valid as long as audio_write - i <= audio_size.
+// Counters are 32-bit and wrap around, compare them by subtraction.
+//
+// On Linux, video_seq and audio_write are futex words.
+// Increment waiters before FUTEX_WAIT and decrement it after, the producer only wakes if it is non-zero.
+// producer_pid is cleared (and waiters woken) when RetroArch stops exporting.
+
+#define FRAME_EXPORT_MAGIC "RAEXPRT1"
+#define FRAME_EXPORT_VERSION 1
+#define FRAME_EXPORT_SLOT_DATA 64
+
+#define FRAME_EXPORT_SEQ_BUSY(n) (2 * (uint32_t)(n) + 1)
+#define FRAME_EXPORT_SEQ_DONE(n) (2 * (uint32_t)(n) + 2)
+
+enum frame_export_pix_format
+{
+   FRAME_EXPORT_PIX_RGB565 = 0,
+   FRAME_EXPORT_PIX_XRGB8888
+};
+
+enum frame_export_slot_flags
+{
+   FRAME_EXPORT_DUPE = 1 << 0 // No pixels, shows the previous frame again.
+};
+
+struct frame_export_header
+{
+   char magic[8];
+   uint32_t version;
+   uint32_t header_size;
+   uint32_t video_slots;
+   uint32_t video_slot_size;
+   uint32_t audio_offset;
+   uint32_t audio_size; // Power of two.
+   uint32_t audio_channels;
+   uint32_t max_width;
+   uint32_t max_height;
+   uint32_t reserved;
+   double fps;
+   double sample_rate;
+
+   volatile uint32_t producer_pid;
+   volatile uint32_t video_seq;   // Frames published so far.
+   volatile uint32_t audio_write; // Audio bytes published so far.
+   volatile uint32_t waiters;
+};
+
+struct frame_export_slot
+{
+   volatile uint32_t seq;
+   uint32_t flags;
+   uint32_t pix_fmt; // enum frame_export_pix_format
+   uint32_t width;
+   uint32_t height;
+   uint32_t pitch;
+   uint32_t audio_write; // audio_write when the frame was published, to line up A/V.
+   uint32_t reserved;
+   int64_t time_usec;    // rarch_get_time_usec() when the frame was published, CLOCK_MONOTONIC on Linux.
+};
+
+typedef struct frame_export frame_export_t;
+
+struct frame_export_params
+{
+   unsigned max_width;
+   unsigned max_height;
+   unsigned video_slots;
+   unsigned channels;
+   double fps;
+   double sample_rate;
+};
+
+// Creates (or replaces) the shared memory object name. It is unlinked again by frame_export_free().
+frame_export_t *frame_export_new(const char *name, const struct frame_export_params *params);
+void frame_export_free(frame_export_t *handle);
+
+// data == NULL publishes a dupe. Frames larger than max_width x max_height are dropped.
+void frame_export_video(frame_export_t *handle, const void *data,
+      unsigned width, unsigned height, size_t pitch,
+      enum frame_export_pix_format pix_fmt);
+void frame_export_audio(frame_export_t *handle, const int16_t *data, size_t frames);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
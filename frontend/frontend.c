@@ -19,6 +19,7 @@
 #include "../general.h"
 #include "../conf/config_file.h"
 #include "../file.h"
+#include "../file_extract.h"
 
 #include "frontend_context.h"
 
@@ -252,6 +253,10 @@ void main_exit(args_type() args)
    rarch_deinit_msg_queue();
 
    rarch_perf_log();
+   rarch_perf_deinit();
+#ifdef HAVE_ZLIB
+   zlib_archive_deinit();
+#endif
 
 #if defined(HAVE_LOGGER) && !defined(ANDROID)
    logger_shutdown();
@@ -356,6 +361,7 @@ returntype main_entry(signature())
    declare_argv();
    args_type() args = (args_type())args_initial_ptr();
    int ret = 0;
+   int exit_code = 0;
 
    driver.frontend_ctx = (frontend_ctx_driver_t*)frontend_ctx_init_first();
 
@@ -370,7 +376,7 @@ returntype main_entry(signature())
 
    if (!(ret = (main_load_content(argc, argv, driver.frontend_ctx->environment_get,
          driver.frontend_ctx->process_args))))
-      return_var(ret);
+      return_negative();
 
 #if defined(HAVE_MENU)
 #if defined(RARCH_CONSOLE) || defined(RARCH_MOBILE)
@@ -391,8 +397,11 @@ returntype main_entry(signature())
    while ((g_extern.is_paused && !g_extern.is_oneshot) ? rarch_main_idle_iterate() : rarch_main_iterate());
 #endif
 
+   exit_code = g_extern.exit_code;
    main_exit(args);
 #endif
 
+   if (exit_code)
+      return_var(exit_code);
    returnfunc();
 }
@@ -14,6 +14,7 @@
  */
 
 #include "core_info.h"
+#include <ctype.h>
 #include "../../general.h"
 #include "../../file.h"
 #include "../../file_ext.h"
@@ -24,161 +25,782 @@
 #include "../../config.h"
 #endif
 
+#ifdef HAVE_THREADS
+#include "../../thread.h"
+#include "../../performance.h"
+#endif
+
+#define CORE_INFO_MAX_THREADS 16
+// Not worth spinning up threads for a handful of small files.
+#define CORE_INFO_MIN_PER_THREAD 8
+
 static core_info_list_t *global_core_list;
 
+static void core_info_ext_set_add(const char **set, size_t set_size,
+      char *all_ext, size_t *pos, const char *ext)
+{
+   uint32_t hash = 5381;
+   const char *c;
+   size_t slot, len = strlen(ext);
+
+   if (!len)
+      return;
+
+   for (c = ext; *c; c++)
+      hash = (hash << 5) + hash + (uint8_t)tolower((uint8_t)*c);
+
+   for (slot = hash & (set_size - 1); set[slot]; slot = (slot + 1) & (set_size - 1))
+      if (!strcasecmp(set[slot], ext))
+         return;
+   set[slot] = ext;
+
+   if (*pos)
+      all_ext[(*pos)++] = '|';
+   memcpy(all_ext + *pos, ext, len);
+   *pos += len;
+}
+
+// Builds the '|' separated union of all supported extensions.
+// Duplicates are dropped through an open addressing set of the extensions added so far.
 static void core_info_list_resolve_all_extensions(core_info_list_t *core_info_list)
 {
-   size_t i, all_ext_len = 0;
+   size_t i, j, num_ext = 1, all_ext_len = 0, set_size = 16, pos = 0;
+   const char **set;
+
    if (!core_info_list)
       return;
 
    for (i = 0; i < core_info_list->count; i++)
    {
-      all_ext_len += core_info_list->list[i].supported_extensions ?
-         (strlen(core_info_list->list[i].supported_extensions) + 2) : 0;
+      const struct string_list *list = core_info_list->list[i].supported_extensions_list;
+      if (!list)
+         continue;
+
+      num_ext += list->size;
+      for (j = 0; j < list->size; j++)
+         all_ext_len += strlen(list->elems[j].data) + 1;
    }
+   all_ext_len += strlen("zip") + 1;
+
+   while (set_size < 2 * num_ext)
+      set_size *= 2;
 
-   if (all_ext_len)
+   set = (const char**)calloc(set_size, sizeof(*set));
+   core_info_list->all_ext = (char*)malloc(all_ext_len);
+   if (!set || !core_info_list->all_ext)
    {
-      all_ext_len += strlen("|zip");
-      core_info_list->all_ext = (char*)calloc(1, all_ext_len);
+      free(set);
+      free(core_info_list->all_ext);
+      core_info_list->all_ext = NULL;
+      return;
    }
 
-   if (core_info_list->all_ext)
+   for (i = 0; i < core_info_list->count; i++)
    {
-      for (i = 0; i < core_info_list->count; i++)
+      const struct string_list *list = core_info_list->list[i].supported_extensions_list;
+      for (j = 0; list && j < list->size; j++)
+         core_info_ext_set_add(set, set_size, core_info_list->all_ext, &pos, list->elems[j].data);
+   }
+
+   // We extract zips ourselves, so they are always supported.
+   core_info_ext_set_add(set, set_size, core_info_list->all_ext, &pos, "zip");
+
+   core_info_list->all_ext[pos] = '\0';
+   free(set);
+}
+
+// Reads one .info file into info. Returns false if there is none.
+static bool core_info_parse(core_info_t *info, const char *info_path)
+{
+   unsigned c, count = 0;
+   config_file_t *conf = config_file_new(info_path);
+   if (!conf)
+      return false;
+
+   config_get_string(conf, "display_name", &info->display_name);
+   config_get_string(conf, "systemname", &info->systemname);
+   if (config_get_string(conf, "supported_extensions", &info->supported_extensions) &&
+         info->supported_extensions)
+      info->supported_extensions_list = string_split(info->supported_extensions, "|");
+
+   if (config_get_string(conf, "authors", &info->authors) &&
+         info->authors)
+      info->authors_list = string_split(info->authors, "|");
+
+   if (config_get_string(conf, "permissions", &info->permissions) &&
+         info->permissions)
+      info->permissions_list = string_split(info->permissions, "|");
+   if (config_get_string(conf, "notes", &info->notes) &&
+         info->notes)
+      info->note_list = string_split(info->notes, "|");
+
+   if (config_get_uint(conf, "firmware_count", &count) && count &&
+         (info->firmware = (core_info_firmware_t*)calloc(count, sizeof(*info->firmware))))
+   {
+      info->firmware_count = count;
+      for (c = 0; c < count; c++)
       {
-         if (core_info_list->list[i].supported_extensions)
-         {
-            strlcat(core_info_list->all_ext, core_info_list->list[i].supported_extensions, all_ext_len);
-            strlcat(core_info_list->all_ext, "|", all_ext_len);
-         }
+         char path_key[64], desc_key[64], opt_key[64];
+
+         snprintf(path_key, sizeof(path_key), "firmware%u_path", c);
+         snprintf(desc_key, sizeof(desc_key), "firmware%u_desc", c);
+         snprintf(opt_key, sizeof(opt_key), "firmware%u_opt", c);
+
+         config_get_string(conf, path_key, &info->firmware[c].path);
+         config_get_string(conf, desc_key, &info->firmware[c].desc);
+         config_get_bool(conf, opt_key , &info->firmware[c].optional);
       }
-      strlcat(core_info_list->all_ext, "|zip", all_ext_len);
    }
+
+   config_file_free(conf);
+   return true;
+}
+
+struct core_info_load
+{
+   core_info_t *info;
+   char *info_path; // NULL if the info was taken from the cache.
+   int64_t info_size;
+   int64_t info_mtime;
+};
+
+#ifdef HAVE_THREADS
+struct core_info_parse_batch
+{
+   struct core_info_load *loads;
+   const size_t *pending;
+};
+
+static void core_info_parse_task(void *data, size_t index)
+{
+   struct core_info_parse_batch *batch = (struct core_info_parse_batch*)data;
+   struct core_info_load *load = &batch->loads[batch->pending[index]];
+   load->info->has_info = core_info_parse(load->info, load->info_path);
 }
+#endif
 
-static void core_info_list_resolve_all_firmware(core_info_list_t *core_info_list)
+// Parses loads[pending[i]]. Reading .info files is mostly waiting on I/O,
+// so we use a few more threads than there are cores.
+static void core_info_parse_parallel(struct core_info_load *loads, const size_t *pending, size_t num)
 {
+#ifdef HAVE_THREADS
+   struct core_info_parse_batch batch = { loads, pending };
+   unsigned threads = rarch_get_cpu_cores() * 2;
+
+   if (threads > CORE_INFO_MAX_THREADS)
+      threads = CORE_INFO_MAX_THREADS;
+   if (threads > num / CORE_INFO_MIN_PER_THREAD)
+      threads = num / CORE_INFO_MIN_PER_THREAD;
+
+   sthread_parallel_for(num, threads, core_info_parse_task, &batch);
+#else
    size_t i;
-   unsigned c;
-   if (!core_info_list)
+   for (i = 0; i < num; i++)
+      loads[pending[i]].info->has_info = core_info_parse(loads[pending[i]].info, loads[pending[i]].info_path);
+#endif
+}
+
+static void core_info_get_info_path(char *info_path, size_t size,
+      const char *core_path, const char *info_dir)
+{
+   char info_path_base[PATH_MAX];
+   fill_pathname_base(info_path_base, core_path, sizeof(info_path_base));
+   path_remove_extension(info_path_base);
+
+#if defined(RARCH_MOBILE) || defined(RARCH_CONSOLE)
+   char *substr = strrchr(info_path_base, '_');
+   if (substr)
+      *substr = '\0';
+#endif
+
+   strlcat(info_path_base, ".info", sizeof(info_path_base));
+   fill_pathname_join(info_path, info_dir, info_path_base, size);
+}
+
+#ifndef RARCH_CONSOLE
+#include <sys/stat.h>
+#define HAVE_CORE_INFO_CACHE
+
+// Binary cache of the resolved list, so cold start does not parse every .info file.
+// Layout is the header, entries, firmware, list words and finally the string table.
+// Everything is addressed by offset so the file can be used in place.
+// Strings are offsets into the string table + 1, with 0 meaning NULL.
+// Lists are indices into the word table, which holds a count followed by that many strings.
+#define CORE_INFO_CACHE_MAGIC 0x49434152 // 'RACI'
+#define CORE_INFO_CACHE_VERSION 1
+
+struct core_info_cache_header
+{
+   uint32_t magic;
+   uint32_t version;
+   uint32_t count;
+   uint32_t firmware_count;
+   uint32_t words_count;
+   uint32_t strings_size;
+   uint32_t modules_path;
+   uint32_t info_dir;
+   int64_t modules_mtime;
+   int64_t info_mtime;
+};
+
+struct core_info_cache_entry
+{
+   uint32_t path;
+   uint32_t display_name;
+   uint32_t systemname;
+   uint32_t supported_extensions;
+   uint32_t authors;
+   uint32_t permissions;
+   uint32_t notes;
+   uint32_t lists[4]; // supported_extensions, authors, permissions, notes. 0 = no list.
+   uint32_t firmware;
+   uint32_t firmware_count;
+   uint32_t pad;
+   int64_t info_size; // -1 if the core has no .info file.
+   int64_t info_mtime;
+};
+
+struct core_info_cache_firmware
+{
+   uint32_t path;
+   uint32_t desc;
+   uint32_t optional;
+};
+
+struct core_info_cache
+{
+   uint8_t *data;
+   const struct core_info_cache_header *header;
+   const struct core_info_cache_entry *entries;
+   const struct core_info_cache_firmware *firmware;
+   const uint32_t *words;
+   const char *strings;
+};
+
+// Growable buffers used while writing the cache.
+struct core_info_cache_writer
+{
+   struct core_info_cache_entry *entries;
+   struct core_info_cache_firmware *firmware;
+   size_t firmware_count, firmware_cap;
+   uint32_t *words;
+   size_t words_count, words_cap;
+   char *strings;
+   size_t strings_size, strings_cap;
+   bool error;
+};
+
+static bool core_info_stat(const char *path, int64_t *size, int64_t *mtime)
+{
+   struct stat st;
+   if (stat(path, &st) < 0)
+      return false;
+   if (size)
+      *size = st.st_size;
+   *mtime = st.st_mtime;
+   return true;
+}
+
+static const char *core_info_cache_string(const struct core_info_cache *cache, uint32_t offset)
+{
+   return offset ? cache->strings + offset - 1 : NULL;
+}
+
+static bool core_info_cache_check_string(const struct core_info_cache_header *header, uint32_t offset)
+{
+   return offset <= header->strings_size;
+}
+
+static bool core_info_cache_check_list(const struct core_info_cache *cache, uint32_t index)
+{
+   uint32_t i;
+   const struct core_info_cache_header *header = cache->header;
+   if (!index)
+      return true;
+   if (index >= header->words_count || cache->words[index] > header->words_count - index - 1)
+      return false;
+   for (i = 0; i < cache->words[index]; i++)
+      if (!cache->words[index + 1 + i] || !core_info_cache_check_string(header, cache->words[index + 1 + i]))
+         return false;
+   return true;
+}
+
+static void core_info_cache_free(struct core_info_cache *cache)
+{
+   if (!cache)
       return;
+   free(cache->data);
+   free(cache);
+}
 
-   for (i = 0; i < core_info_list->count; i++)
+// Loads and validates the whole cache. Any inconsistency throws it away.
+static struct core_info_cache *core_info_cache_load(const char *path,
+      const char *modules_path, const char *info_dir)
+{
+   size_t i, j;
+   long size;
+   const struct core_info_cache_header *header;
+   struct core_info_cache *cache = (struct core_info_cache*)calloc(1, sizeof(*cache));
+   if (!cache)
+      return NULL;
+
+   if ((size = read_file(path, (void**)&cache->data)) < (long)sizeof(*header))
+      goto error;
+
+   header = (const struct core_info_cache_header*)cache->data;
+   if (header->magic != CORE_INFO_CACHE_MAGIC || header->version != CORE_INFO_CACHE_VERSION)
+      goto error;
+
+   if ((uint64_t)size != sizeof(*header) +
+         (uint64_t)header->count * sizeof(*cache->entries) +
+         (uint64_t)header->firmware_count * sizeof(*cache->firmware) +
+         (uint64_t)header->words_count * sizeof(*cache->words) +
+         header->strings_size || !header->strings_size)
+      goto error;
+
+   cache->header   = header;
+   cache->entries  = (const struct core_info_cache_entry*)(header + 1);
+   cache->firmware = (const struct core_info_cache_firmware*)(cache->entries + header->count);
+   cache->words    = (const uint32_t*)(cache->firmware + header->firmware_count);
+   cache->strings  = (const char*)(cache->words + header->words_count);
+
+   if (cache->strings[header->strings_size - 1] != '\0')
+      goto error;
+
+   if (!header->modules_path || !core_info_cache_check_string(header, header->modules_path) ||
+         !header->info_dir || !core_info_cache_check_string(header, header->info_dir))
+      goto error;
+
+   // A cache for another directory is useless.
+   if (strcmp(core_info_cache_string(cache, header->modules_path), modules_path) ||
+         strcmp(core_info_cache_string(cache, header->info_dir), info_dir))
+      goto error;
+
+   for (i = 0; i < header->count; i++)
    {
-      core_info_t *info = &core_info_list->list[i];
+      const struct core_info_cache_entry *entry = &cache->entries[i];
+      if (!entry->path ||
+            !core_info_cache_check_string(header, entry->path) ||
+            !core_info_cache_check_string(header, entry->display_name) ||
+            !core_info_cache_check_string(header, entry->systemname) ||
+            !core_info_cache_check_string(header, entry->supported_extensions) ||
+            !core_info_cache_check_string(header, entry->authors) ||
+            !core_info_cache_check_string(header, entry->permissions) ||
+            !core_info_cache_check_string(header, entry->notes))
+         goto error;
+
+      for (j = 0; j < 4; j++)
+         if (!core_info_cache_check_list(cache, entry->lists[j]))
+            goto error;
+
+      if (entry->firmware > header->firmware_count ||
+            entry->firmware_count > header->firmware_count - entry->firmware)
+         goto error;
+   }
 
-      if (!info->data)
-         continue;
+   for (i = 0; i < header->firmware_count; i++)
+      if (!core_info_cache_check_string(header, cache->firmware[i].path) ||
+            !core_info_cache_check_string(header, cache->firmware[i].desc))
+         goto error;
 
-      unsigned count = 0;
-      if (!config_get_uint(info->data, "firmware_count", &count))
-         continue;
+   return cache;
 
-      info->firmware = (core_info_firmware_t*)calloc(count, sizeof(*info->firmware));
-      if (!info->firmware)
-         continue;
+error:
+   core_info_cache_free(cache);
+   return NULL;
+}
 
-      for (c = 0; c < count; c++)
+// Cache entries are stored in directory order, so the next entry is almost always the one we want.
+static const struct core_info_cache_entry *core_info_cache_find(const struct core_info_cache *cache,
+      const char *core_path, size_t *hint)
+{
+   size_t i, count = cache->header->count;
+   for (i = 0; i < count; i++)
+   {
+      size_t index = (*hint + i) % count;
+      if (!strcmp(core_info_cache_string(cache, cache->entries[index].path), core_path))
       {
-         char path_key[64], desc_key[64], opt_key[64];
+         *hint = index + 1;
+         return &cache->entries[index];
+      }
+   }
+   return NULL;
+}
 
-         snprintf(path_key, sizeof(path_key), "firmware%u_path", c);
-         snprintf(desc_key, sizeof(desc_key), "firmware%u_desc", c);
-         snprintf(opt_key, sizeof(opt_key), "firmware%u_opt", c);
+static char *core_info_cache_strdup(const struct core_info_cache *cache, uint32_t offset)
+{
+   return offset ? strdup(core_info_cache_string(cache, offset)) : NULL;
+}
+
+static struct string_list *core_info_cache_list(const struct core_info_cache *cache, uint32_t index)
+{
+   uint32_t i;
+   union string_list_elem_attr attr = {0};
+   struct string_list *list;
+
+   if (!index || !(list = string_list_new()))
+      return NULL;
 
-         config_get_string(info->data, path_key, &info->firmware[c].path);
-         config_get_string(info->data, desc_key, &info->firmware[c].desc);
-         config_get_bool(info->data, opt_key , &info->firmware[c].optional);
+   for (i = 0; i < cache->words[index]; i++)
+   {
+      if (!string_list_append(list, core_info_cache_string(cache, cache->words[index + 1 + i]), attr))
+      {
+         string_list_free(list);
+         return NULL;
       }
    }
+
+   return list;
 }
 
-core_info_list_t *core_info_list_new(const char *modules_path)
+static void core_info_cache_get(const struct core_info_cache *cache,
+      const struct core_info_cache_entry *entry, core_info_t *info)
+{
+   uint32_t i;
+
+   info->display_name              = core_info_cache_strdup(cache, entry->display_name);
+   info->systemname                = core_info_cache_strdup(cache, entry->systemname);
+   info->supported_extensions      = core_info_cache_strdup(cache, entry->supported_extensions);
+   info->authors                   = core_info_cache_strdup(cache, entry->authors);
+   info->permissions               = core_info_cache_strdup(cache, entry->permissions);
+   info->notes                     = core_info_cache_strdup(cache, entry->notes);
+   info->supported_extensions_list = core_info_cache_list(cache, entry->lists[0]);
+   info->authors_list              = core_info_cache_list(cache, entry->lists[1]);
+   info->permissions_list          = core_info_cache_list(cache, entry->lists[2]);
+   info->note_list                 = core_info_cache_list(cache, entry->lists[3]);
+
+   if (entry->firmware_count &&
+         (info->firmware = (core_info_firmware_t*)calloc(entry->firmware_count, sizeof(*info->firmware))))
+   {
+      info->firmware_count = entry->firmware_count;
+      for (i = 0; i < entry->firmware_count; i++)
+      {
+         const struct core_info_cache_firmware *fw = &cache->firmware[entry->firmware + i];
+         info->firmware[i].path     = core_info_cache_strdup(cache, fw->path);
+         info->firmware[i].desc     = core_info_cache_strdup(cache, fw->desc);
+         info->firmware[i].optional = fw->optional;
+      }
+   }
+}
+
+static bool core_info_cache_reserve(void **buf, size_t *cap, size_t size, size_t elem_size)
+{
+   if (size <= *cap)
+      return true;
+
+   size_t new_cap = *cap ? *cap : 256;
+   while (new_cap < size)
+      new_cap *= 2;
+
+   void *new_buf = realloc(*buf, new_cap * elem_size);
+   if (!new_buf)
+      return false;
+
+   *buf = new_buf;
+   *cap = new_cap;
+   return true;
+}
+
+static uint32_t core_info_cache_add_string(struct core_info_cache_writer *writer, const char *str)
+{
+   if (!str)
+      return 0;
+
+   size_t len = strlen(str) + 1;
+   if (!core_info_cache_reserve((void**)&writer->strings, &writer->strings_cap,
+            writer->strings_size + len, 1))
+   {
+      writer->error = true;
+      return 0;
+   }
+
+   memcpy(writer->strings + writer->strings_size, str, len);
+   writer->strings_size += len;
+   return writer->strings_size - len + 1;
+}
+
+static uint32_t core_info_cache_add_list(struct core_info_cache_writer *writer, const struct string_list *list)
+{
+   size_t i;
+   if (!list)
+      return 0;
+
+   // Word 0 is reserved so that 0 can mean no list.
+   size_t index = writer->words_count ? writer->words_count : 1;
+   if (!core_info_cache_reserve((void**)&writer->words, &writer->words_cap,
+            index + 1 + list->size, sizeof(*writer->words)))
+   {
+      writer->error = true;
+      return 0;
+   }
+
+   writer->words[0] = 0;
+   writer->words[index] = list->size;
+   for (i = 0; i < list->size; i++)
+      writer->words[index + 1 + i] = core_info_cache_add_string(writer, list->elems[i].data);
+   writer->words_count = index + 1 + list->size;
+   return index;
+}
+
+static void core_info_cache_add(struct core_info_cache_writer *writer, struct core_info_cache_entry *entry,
+      const core_info_t *info, int64_t info_size, int64_t info_mtime)
 {
-   struct string_list *contents = dir_list_new(modules_path, EXT_EXECUTABLES, false);
    size_t i;
 
+   memset(entry, 0, sizeof(*entry));
+   entry->path                 = core_info_cache_add_string(writer, info->path);
+   entry->display_name         = core_info_cache_add_string(writer, info->display_name);
+   entry->systemname           = core_info_cache_add_string(writer, info->systemname);
+   entry->supported_extensions = core_info_cache_add_string(writer, info->supported_extensions);
+   entry->authors              = core_info_cache_add_string(writer, info->authors);
+   entry->permissions          = core_info_cache_add_string(writer, info->permissions);
+   entry->notes                = core_info_cache_add_string(writer, info->notes);
+   entry->lists[0]             = core_info_cache_add_list(writer, info->supported_extensions_list);
+   entry->lists[1]             = core_info_cache_add_list(writer, info->authors_list);
+   entry->lists[2]             = core_info_cache_add_list(writer, info->permissions_list);
+   entry->lists[3]             = core_info_cache_add_list(writer, info->note_list);
+   entry->info_size            = info_size;
+   entry->info_mtime           = info_mtime;
+
+   if (!core_info_cache_reserve((void**)&writer->firmware, &writer->firmware_cap,
+            writer->firmware_count + info->firmware_count, sizeof(*writer->firmware)))
+   {
+      writer->error = true;
+      return;
+   }
+
+   entry->firmware       = writer->firmware_count;
+   entry->firmware_count = info->firmware_count;
+   for (i = 0; i < info->firmware_count; i++)
+   {
+      struct core_info_cache_firmware *fw = &writer->firmware[writer->firmware_count++];
+      fw->path     = core_info_cache_add_string(writer, info->firmware[i].path);
+      fw->desc     = core_info_cache_add_string(writer, info->firmware[i].desc);
+      fw->optional = info->firmware[i].optional;
+   }
+}
+
+static bool core_info_cache_write(struct core_info_cache_writer *writer, const char *path,
+      struct core_info_cache_header *header)
+{
+   char tmp_path[PATH_MAX];
+   size_t size;
+   uint8_t *data, *ptr;
+   bool ret;
+
+   if (writer->error)
+      return false;
+
+   if ((size_t)snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path) >= sizeof(tmp_path))
+   {
+      RARCH_WARN("Core info cache path \"%s\" is too long.\n", path);
+      return false;
+   }
+
+   header->magic          = CORE_INFO_CACHE_MAGIC;
+   header->version        = CORE_INFO_CACHE_VERSION;
+   header->firmware_count = writer->firmware_count;
+   header->words_count    = writer->words_count;
+   header->strings_size   = writer->strings_size;
+
+   size = sizeof(*header) + header->count * sizeof(*writer->entries) +
+      header->firmware_count * sizeof(*writer->firmware) +
+      header->words_count * sizeof(*writer->words) + header->strings_size;
+   if (!(data = ptr = (uint8_t*)malloc(size)))
+      return false;
+
+   memcpy(ptr, header, sizeof(*header));
+   ptr += sizeof(*header);
+   memcpy(ptr, writer->entries, header->count * sizeof(*writer->entries));
+   ptr += header->count * sizeof(*writer->entries);
+   memcpy(ptr, writer->firmware, header->firmware_count * sizeof(*writer->firmware));
+   ptr += header->firmware_count * sizeof(*writer->firmware);
+   memcpy(ptr, writer->words, header->words_count * sizeof(*writer->words));
+   ptr += header->words_count * sizeof(*writer->words);
+   memcpy(ptr, writer->strings, header->strings_size);
+
+   // Write to a temporary and rename so a concurrent instance never sees a partial cache.
+   ret = write_file(tmp_path, data, size) && rename(tmp_path, path) == 0;
+   if (!ret)
+   {
+      remove(tmp_path);
+      RARCH_WARN("Failed to write core info cache to \"%s\".\n", path);
+   }
+
+   free(data);
+   return ret;
+}
+#endif
+
+core_info_list_t *core_info_list_new(const char *modules_path)
+{
+   size_t i, count, loaded, num_pending = 0;
+   size_t *pending = NULL;
+   struct core_info_load *loads = NULL;
+   struct string_list *contents = NULL;
+   const char *info_dir = *g_settings.libretro_info_path ? g_settings.libretro_info_path : modules_path;
+
    core_info_t *core_info = NULL;
    core_info_list_t *core_info_list = NULL;
 
+#ifdef HAVE_CORE_INFO_CACHE
+   const char *cache_path = g_settings.core_info_cache_path;
+   struct core_info_cache *cache = NULL;
+   struct core_info_cache_header header = {0};
+   struct core_info_cache_writer writer = {0};
+   size_t hint = 0, reparsed;
+
+   if (*cache_path)
+      cache = core_info_cache_load(cache_path, modules_path, info_dir);
+
+   core_info_stat(modules_path, NULL, &header.modules_mtime);
+   core_info_stat(info_dir, NULL, &header.info_mtime);
+
+   // If neither directory changed, the set of cores is the same as last time and readdir can be skipped.
+   if (cache && cache->header->modules_mtime == header.modules_mtime &&
+         cache->header->info_mtime == header.info_mtime)
+   {
+      union string_list_elem_attr attr = {0};
+      if ((contents = string_list_new()))
+      {
+         for (i = 0; i < cache->header->count; i++)
+            if (!string_list_append(contents, core_info_cache_string(cache, cache->entries[i].path), attr))
+               break;
+
+         if (i < cache->header->count)
+         {
+            string_list_free(contents);
+            contents = NULL;
+         }
+      }
+   }
+#endif
+
    if (!contents)
-      return NULL;
+      contents = dir_list_new(modules_path, EXT_EXECUTABLES, false);
+
+   if (!contents)
+      goto error;
+
+   count = contents->size;
 
    core_info_list = (core_info_list_t*)calloc(1, sizeof(*core_info_list));
    if (!core_info_list)
       goto error;
 
-   core_info = (core_info_t*)calloc(contents->size, sizeof(*core_info));
+   core_info = (core_info_t*)calloc(count, sizeof(*core_info));
    if (!core_info)
       goto error;
 
    core_info_list->list = core_info;
-   core_info_list->count = contents->size;
 
-   for (i = 0; i < contents->size; i++)
+#ifdef HAVE_CORE_INFO_CACHE
+   if (*cache_path)
+   {
+      writer.entries = (struct core_info_cache_entry*)calloc(count, sizeof(*writer.entries));
+      writer.error = !writer.entries;
+   }
+#endif
+
+   loads = (struct core_info_load*)calloc(count, sizeof(*loads));
+   pending = (size_t*)calloc(count, sizeof(*pending));
+   if (!loads || !pending)
+      goto error;
+
+   core_info_list->count = count;
+
+   for (i = 0; i < count; i++)
    {
-      char info_path_base[PATH_MAX], info_path[PATH_MAX];
+      char info_path[PATH_MAX];
       core_info[i].path = strdup(contents->elems[i].data);
 
       if (!core_info[i].path)
          break;
 
-      fill_pathname_base(info_path_base, contents->elems[i].data, sizeof(info_path_base));
-      path_remove_extension(info_path_base);
+      core_info_get_info_path(info_path, sizeof(info_path), core_info[i].path, info_dir);
+      loads[i].info = &core_info[i];
 
-#if defined(RARCH_MOBILE) || defined(RARCH_CONSOLE)
-      char *substr = strrchr(info_path_base, '_');
-      if (substr)
-         *substr = '\0';
+#ifdef HAVE_CORE_INFO_CACHE
+      // Only .info files that changed since the cache was written are parsed again.
+      const struct core_info_cache_entry *entry = NULL;
+
+      loads[i].info_size = -1;
+      core_info_stat(info_path, &loads[i].info_size, &loads[i].info_mtime);
+      if (cache)
+         entry = core_info_cache_find(cache, core_info[i].path, &hint);
+
+      if (entry && entry->info_size == loads[i].info_size && entry->info_mtime == loads[i].info_mtime)
+      {
+         core_info_cache_get(cache, entry, &core_info[i]);
+         core_info[i].has_info = loads[i].info_size >= 0;
+         continue;
+      }
 #endif
 
-      strlcat(info_path_base, ".info", sizeof(info_path_base));
+      if (!(loads[i].info_path = strdup(info_path)))
+         break;
+      pending[num_pending++] = i;
+   }
 
-      fill_pathname_join(info_path, (*g_settings.libretro_info_path) ? g_settings.libretro_info_path : modules_path,
-            info_path_base, sizeof(info_path));
+   // Don't expose cores we failed to set up.
+   loaded = core_info_list->count = i;
 
-      core_info[i].data = config_file_new(info_path);
+   core_info_parse_parallel(loads, pending, num_pending);
 
-      if (core_info[i].data)
-      {
-         unsigned count = 0;
-         config_get_string(core_info[i].data, "display_name", &core_info[i].display_name);
-         config_get_string(core_info[i].data, "systemname", &core_info[i].systemname);
-         config_get_uint(core_info[i].data, "firmware_count", &count);
-         core_info[i].firmware_count = count;
-         if (config_get_string(core_info[i].data, "supported_extensions", &core_info[i].supported_extensions) &&
-               core_info[i].supported_extensions)
-            core_info[i].supported_extensions_list = string_split(core_info[i].supported_extensions, "|");
-
-         if (config_get_string(core_info[i].data, "authors", &core_info[i].authors) &&
-               core_info[i].authors)
-            core_info[i].authors_list = string_split(core_info[i].authors, "|");
-
-         if (config_get_string(core_info[i].data, "permissions", &core_info[i].permissions) &&
-               core_info[i].permissions)
-            core_info[i].permissions_list = string_split(core_info[i].permissions, "|");
-         if (config_get_string(core_info[i].data, "notes", &core_info[i].notes) &&
-               core_info[i].notes)
-            core_info[i].note_list = string_split(core_info[i].notes, "|");
-      }
+   for (i = 0; i < loaded; i++)
+   {
+#ifdef HAVE_CORE_INFO_CACHE
+      if (writer.entries)
+         core_info_cache_add(&writer, &writer.entries[i], &core_info[i],
+               loads[i].info_size, loads[i].info_mtime);
+#endif
 
       if (!core_info[i].display_name)
          core_info[i].display_name = strdup(path_basename(core_info[i].path));
    }
 
    core_info_list_resolve_all_extensions(core_info_list);
-   core_info_list_resolve_all_firmware(core_info_list);
 
-   dir_list_free(contents);
-   return core_info_list;
+#ifdef HAVE_CORE_INFO_CACHE
+   reparsed = num_pending;
+   if (writer.entries && loaded == count && (!cache || reparsed ||
+            cache->header->count != count ||
+            cache->header->modules_mtime != header.modules_mtime ||
+            cache->header->info_mtime != header.info_mtime))
+   {
+      header.count        = count;
+      header.modules_path = core_info_cache_add_string(&writer, modules_path);
+      header.info_dir     = core_info_cache_add_string(&writer, info_dir);
+      if (core_info_cache_write(&writer, cache_path, &header))
+         RARCH_LOG("Updated core info cache \"%s\" (%u of %u cores parsed).\n",
+               cache_path, (unsigned)reparsed, (unsigned)count);
+   }
+#endif
 
 error:
+   if (loads)
+   {
+      for (i = 0; i < count; i++)
+         free(loads[i].info_path);
+   }
+   free(loads);
+   free(pending);
+#ifdef HAVE_CORE_INFO_CACHE
+   core_info_cache_free(cache);
+   free(writer.entries);
+   free(writer.firmware);
+   free(writer.words);
+   free(writer.strings);
+#endif
    if (contents)
       dir_list_free(contents);
-   core_info_list_free(core_info_list);
-   return NULL;
+
+   if (!core_info)
+   {
+      core_info_list_free(core_info_list);
+      return NULL;
+   }
+   return core_info_list;
 }
 
 void core_info_list_free(core_info_list_t *core_info_list)
@@ -193,6 +815,7 @@ void core_info_list_free(core_info_list_t *core_info_list)
 
       free(info->path);
       free(info->display_name);
+      free(info->systemname);
       free(info->supported_extensions);
       free(info->authors);
       free(info->permissions);
@@ -202,7 +825,6 @@ void core_info_list_free(core_info_list_t *core_info_list)
       string_list_free(info->authors_list);
       string_list_free(info->note_list);
       string_list_free(info->permissions_list);
-      config_file_free(info->data);
 
       for (j = 0; j < info->firmware_count; j++)
       {
@@ -225,7 +847,7 @@ size_t core_info_list_num_info_files(core_info_list_t *core_info_list)
 
    num = 0;
    for (i = 0; i < core_info_list->count; i++)
-      num += !!core_info_list->list[i].data;
+      num += core_info_list->list[i].has_info;
    return num;
 }
 
@@ -296,61 +918,45 @@ const char *core_info_list_get_all_extensions(core_info_list_t *core_info_list)
    return "";
 }
 
-// qsort_r() is not in standard C, sadly.
-static const char *core_info_tmp_path;
-static const struct string_list *core_info_tmp_list;
-
 static int core_info_qsort_cmp(const void *a_, const void *b_)
 {
    const core_info_t *a = (const core_info_t*)a_;
    const core_info_t *b = (const core_info_t*)b_;
-
-   int support_a = core_info_does_support_any_file(a, core_info_tmp_list) ||
-      core_info_does_support_file(a, core_info_tmp_path);
-   int support_b = core_info_does_support_any_file(b, core_info_tmp_list) ||
-      core_info_does_support_file(b, core_info_tmp_path);
-
-   if (support_a != support_b)
-      return support_b - support_a;
-   else
-      return strcasecmp(a->display_name, b->display_name);
+   return strcasecmp(a->display_name, b->display_name);
 }
 
 void core_info_list_get_supported_cores(core_info_list_t *core_info_list, const char *path,
       const core_info_t **infos, size_t *num_infos)
 {
+   size_t supported = 0, i;
    if (!core_info_list)
       return;
 
-   core_info_tmp_path = path;
-
-#ifdef HAVE_ZLIB
    struct string_list *list = NULL;
+#ifdef HAVE_ZLIB
    if (!strcasecmp(path_get_extension(path), "zip"))
       list = zlib_get_file_list(path);
-   core_info_tmp_list = list;
 #endif
 
-   // Let supported core come first in list so we can return a pointer to them.
-   qsort(core_info_list->list, core_info_list->count, sizeof(core_info_t), core_info_qsort_cmp);
-
-   size_t supported, i;
-   supported = 0;
-   for (i = 0; i < core_info_list->count; i++, supported++)
+   // Let supported cores come first in list so we can return a pointer to them.
+   // Each core is tested once, then both halves are sorted by name.
+   for (i = 0; i < core_info_list->count; i++)
    {
-      const core_info_t *core = &core_info_list->list[i];
-      if (!core_info_does_support_file(core, path)
-#ifdef HAVE_ZLIB
-            && !core_info_does_support_any_file(core, list)
-#endif
-         )
-         break;
+      core_info_t *core = &core_info_list->list[i];
+      if (core_info_does_support_file(core, path) || core_info_does_support_any_file(core, list))
+      {
+         core_info_t tmp = core_info_list->list[supported];
+         core_info_list->list[supported++] = *core;
+         *core = tmp;
+      }
    }
 
-#ifdef HAVE_ZLIB
+   qsort(core_info_list->list, supported, sizeof(core_info_t), core_info_qsort_cmp);
+   qsort(core_info_list->list + supported, core_info_list->count - supported,
+         sizeof(core_info_t), core_info_qsort_cmp);
+
    if (list)
       string_list_free(list);
-#endif
 
    *infos = core_info_list->list;
    *num_infos = supported;
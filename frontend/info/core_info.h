@@ -37,7 +37,7 @@ typedef struct
 typedef struct
 {
    char *path;
-   config_file_t *data;
+   bool has_info; // A .info file was found for this core.
    char *display_name;
    char *systemname;
    char *supported_extensions;
@@ -263,7 +263,7 @@ static void menu_common_entries_init(void *data, unsigned menu_type)
             core_info_t *info = menu->core_info_current;
             file_list_clear(menu->selection_buf);
 
-            if (info->data)
+            if (info->has_info)
             {
                snprintf(tmp, sizeof(tmp), "Core name: %s",
                      info->display_name ? info->display_name : "");
@@ -1807,6 +1807,116 @@ static int menu_viewport_iterate(unsigned action)
    return 0;
 }
 
+// Pushes directory entries to the selection buffer, filtered for menu_type.
+static void menu_push_dir_entries(const struct string_list *list, const char *dir, unsigned menu_type)
+{
+   size_t i;
+
+   for (i = 0; i < list->size; i++)
+   {
+      bool is_dir = list->elems[i].attr.b;
+
+      if ((menu_common_type_is(menu_type) == MENU_FILE_DIRECTORY) && !is_dir)
+         continue;
+
+      // Need to preserve slash first time.
+      const char *path = list->elems[i].data;
+      if (*dir)
+         path = path_basename(path);
+
+#ifdef HAVE_LIBRETRO_MANAGEMENT
+      if (menu_type == MENU_SETTINGS_CORE && (is_dir || strcasecmp(path, SALAMANDER_FILE) == 0))
+         continue;
+#endif
+
+      // Push menu_type further down in the chain.
+      // Needed for shader manager currently.
+      file_list_push(driver.menu->selection_buf, path,
+            is_dir ? menu_type : MENU_FILE_PLAIN, 0);
+   }
+}
+
+static void menu_clamp_selection(void)
+{
+   // Before a refresh, we could have deleted a file on disk, causing
+   // selection_ptr to suddendly be out of range. Ensure it doesn't overflow.
+   if (driver.menu->selection_ptr >= file_list_get_size(driver.menu->selection_buf) && file_list_get_size(driver.menu->selection_buf))
+      menu_set_navigation(driver.menu, file_list_get_size(driver.menu->selection_buf) - 1);
+   else if (!file_list_get_size(driver.menu->selection_buf))
+      menu_clear_navigation(driver.menu);
+}
+
+#ifdef HAVE_THREADS
+static void menu_dir_list_async_cancel(void)
+{
+   dir_list_async_free(driver.menu->dir_list_async);
+   driver.menu->dir_list_async = NULL;
+}
+
+// Merges entries found by the listing thread since last frame into the selection buffer.
+static void menu_dir_list_async_iterate(void)
+{
+   menu_handle_t *menu = driver.menu;
+   const char *dir = NULL, *selected = NULL;
+   unsigned menu_type = 0;
+   bool error = false, done;
+   size_t i, sorted, size;
+   struct string_list *found;
+
+   if (!menu->dir_list_async)
+      return;
+
+   // We left the directory before it was fully listed.
+   file_list_get_last(menu->menu_stack, &dir, &menu_type);
+   if (menu_type != menu->dir_list_type || strcmp(dir, menu->dir_list_path) != 0)
+   {
+      menu_dir_list_async_cancel();
+      return;
+   }
+
+   if (!(found = string_list_new()))
+      return;
+
+   done = dir_list_async_poll(menu->dir_list_async, found, &error);
+
+   if (menu->selection_ptr < file_list_get_size(menu->selection_buf))
+      file_list_get_at_offset(menu->selection_buf, menu->selection_ptr, &selected, NULL);
+
+   sorted = file_list_get_size(menu->selection_buf);
+   menu_push_dir_entries(found, dir, menu_type);
+   string_list_free(found);
+
+   size = file_list_get_size(menu->selection_buf);
+   if (size != sorted)
+   {
+      file_list_sort_merge(menu->selection_buf, menu->dir_list_start, sorted, MENU_FILE_PLAIN);
+
+      // Keep the cursor on the same entry while new ones are merged in.
+      for (i = menu->dir_list_start; selected && i < size; i++)
+      {
+         const char *path = NULL;
+         file_list_get_at_offset(menu->selection_buf, i, &path, NULL);
+         if (path == selected)
+         {
+            if (i != menu->selection_ptr)
+               menu_set_navigation(menu, i);
+            break;
+         }
+      }
+
+      menu_build_scroll_indices(menu->selection_buf);
+      menu_clamp_selection();
+   }
+
+   if (done)
+   {
+      menu_dir_list_async_cancel();
+      if (!error && driver.menu_ctx && driver.menu_ctx->backend->entries_init)
+         driver.menu_ctx->backend->entries_init(menu, menu_type);
+   }
+}
+#endif
+
 static void menu_parse_and_resolve(unsigned menu_type)
 {
    const core_info_t *info = NULL;
@@ -1822,6 +1932,9 @@ static void menu_parse_and_resolve(unsigned menu_type)
 
    dir = NULL;
 
+#ifdef HAVE_THREADS
+   menu_dir_list_async_cancel();
+#endif
    file_list_clear(driver.menu->selection_buf);
 
    // parsing switch
@@ -1958,6 +2071,24 @@ static void menu_parse_and_resolve(unsigned menu_type)
             else
                exts = g_extern.system.valid_extensions;
 
+#ifdef HAVE_THREADS
+            // Listing can stall for seconds on network storage. Do it on a thread and let
+            // menu_dir_list_async_iterate() merge entries in as they arrive.
+            // Cores are listed directly since their display names are resolved right below.
+            // Menu drivers mirroring the list through list_insert can't follow reordering.
+            if (menu_type != MENU_SETTINGS_CORE && !(driver.menu_ctx && driver.menu_ctx->list_insert) &&
+                  (driver.menu->dir_list_async = dir_list_async_new(dir, exts, true)))
+            {
+               if (menu_common_type_is(menu_type) == MENU_FILE_DIRECTORY)
+                  file_list_push(driver.menu->selection_buf, "<Use this directory>", MENU_FILE_USE_DIRECTORY, 0);
+
+               driver.menu->dir_list_type = menu_type;
+               driver.menu->dir_list_start = file_list_get_size(driver.menu->selection_buf);
+               strlcpy(driver.menu->dir_list_path, dir, sizeof(driver.menu->dir_list_path));
+               break;
+            }
+#endif
+
             struct string_list *list = dir_list_new(dir, exts, true);
             if (!list)
                return;
@@ -1967,29 +2098,7 @@ static void menu_parse_and_resolve(unsigned menu_type)
             if (menu_common_type_is(menu_type) == MENU_FILE_DIRECTORY)
                file_list_push(driver.menu->selection_buf, "<Use this directory>", MENU_FILE_USE_DIRECTORY, 0);
 
-            list_size = list->size;
-            for (i = 0; i < list_size; i++)
-            {
-               bool is_dir = list->elems[i].attr.b;
-
-               if ((menu_common_type_is(menu_type) == MENU_FILE_DIRECTORY) && !is_dir)
-                  continue;
-
-               // Need to preserve slash first time.
-               const char *path = list->elems[i].data;
-               if (*dir)
-                  path = path_basename(path);
-
-#ifdef HAVE_LIBRETRO_MANAGEMENT
-               if (menu_type == MENU_SETTINGS_CORE && (is_dir || strcasecmp(path, SALAMANDER_FILE) == 0))
-                  continue;
-#endif
-
-               // Push menu_type further down in the chain.
-               // Needed for shader manager currently.
-               file_list_push(driver.menu->selection_buf, path,
-                     is_dir ? menu_type : MENU_FILE_PLAIN, 0);
-            }
+            menu_push_dir_entries(list, dir, menu_type);
 
             if (driver.menu_ctx && driver.menu_ctx->backend->entries_init)
                driver.menu_ctx->backend->entries_init(driver.menu, menu_type);
@@ -2043,12 +2152,7 @@ static void menu_parse_and_resolve(unsigned menu_type)
    if (menu_type != MENU_SETTINGS_OPEN_HISTORY)
       menu_build_scroll_indices(driver.menu->selection_buf);
 
-   // Before a refresh, we could have deleted a file on disk, causing
-   // selection_ptr to suddendly be out of range. Ensure it doesn't overflow.
-   if (driver.menu->selection_ptr >= file_list_get_size(driver.menu->selection_buf) && file_list_get_size(driver.menu->selection_buf))
-      menu_set_navigation(driver.menu, file_list_get_size(driver.menu->selection_buf) - 1);
-   else if (!file_list_get_size(driver.menu->selection_buf))
-      menu_clear_navigation(driver.menu);
+   menu_clamp_selection();
 }
 
 // This only makes sense for PC so far.
@@ -2157,10 +2261,7 @@ static int menu_common_setting_set_perf(unsigned setting, unsigned action,
       struct retro_perf_counter **counters, unsigned offset)
 {
    if (counters[offset] && action == MENU_ACTION_START)
-   {
-      counters[offset]->total = 0;
-      counters[offset]->call_cnt = 0;
-   }
+      rarch_perf_reset(counters[offset]);
    return 0;
 }
 
@@ -2284,6 +2385,10 @@ static int menu_common_iterate(unsigned action)
 
    setting_data = (rarch_setting_t *)setting_data_get_list();
 
+#ifdef HAVE_THREADS
+   menu_dir_list_async_iterate();
+#endif
+
    file_list_get_last(driver.menu->menu_stack, &dir, &menu_type);
 
    if (driver.video_data && driver.menu_ctx && driver.menu_ctx->set_texture)
@@ -4558,16 +4663,17 @@ static int menu_common_setting_set(unsigned setting, unsigned action)
 static void menu_common_setting_set_label_perf(char *type_str, size_t type_str_size, unsigned *w, unsigned type,
       const struct retro_perf_counter **counters, unsigned offset)
 {
-   if (counters[offset] && counters[offset]->call_cnt)
+   rarch_perf_stats_t stats;
+   if (counters[offset] && rarch_perf_get_stats(counters[offset], &stats))
    {
       snprintf(type_str, type_str_size,
 #ifdef _WIN32
-            "%I64u ticks, %I64u runs.",
+            stats.unit == RARCH_PERF_UNIT_COUNT ? "%I64u avg, %I64u samples." : "%I64u ticks, %I64u runs.",
 #else
-            "%llu ticks, %llu runs.",
+            stats.unit == RARCH_PERF_UNIT_COUNT ? "%llu avg, %llu samples." : "%llu ticks, %llu runs.",
 #endif
-            ((unsigned long long)counters[offset]->total / (unsigned long long)counters[offset]->call_cnt),
-            (unsigned long long)counters[offset]->call_cnt);
+            ((unsigned long long)stats.total / (unsigned long long)stats.call_cnt),
+            (unsigned long long)stats.call_cnt);
    }
    else
    {
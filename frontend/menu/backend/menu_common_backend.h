@@ -24,7 +24,7 @@
 #endif
 
 #ifndef MAX_COUNTERS
-#define MAX_COUNTERS 64
+#define MAX_COUNTERS 256
 #endif
 
 typedef enum
@@ -48,33 +48,67 @@ void menu_update_system_info(menu_handle_t *menu, bool *load_no_rom)
 #endif
 }
 
+// Asks the content database first, it answers without going through every core.
+static bool menu_content_db_find_core(menu_handle_t *menu, const char *path, char *core, size_t size)
+{
+#if defined(HAVE_THREADS) && !defined(RARCH_CONSOLE)
+   bool ok;
+   if (menu->content_scan && content_db_scan_poll(menu->content_scan, &ok, NULL, NULL))
+   {
+      content_db_scan_free(menu->content_scan);
+      menu->content_scan = NULL;
+
+      // The open index still maps the old file, switch to the new one.
+      if (ok)
+      {
+         content_db_free(menu->content_db);
+         menu->content_db = NULL;
+      }
+   }
+#endif
+
+   if (!menu->content_db && *g_settings.content_database_path &&
+         path_file_exists(g_settings.content_database_path))
+      menu->content_db = content_db_open(g_settings.content_database_path);
+
+   return menu->content_db && content_db_find_core(menu->content_db, path, core, size) &&
+      path_file_exists(core);
+}
+
 // When selection is presented back, returns 0. If it can make a decision right now, returns -1.
 int menu_defer_core(core_info_list_t *core_info, const char *dir, const char *path, char *deferred_path, size_t sizeof_deferred_path)
 {
+   char core_path[PATH_MAX];
+   const char *core = NULL;
    const core_info_t *info = NULL;
    size_t supported = 0;
 
    fill_pathname_join(deferred_path, dir, path, sizeof_deferred_path);
 
-   if (core_info)
-      core_info_list_get_supported_cores(core_info, deferred_path, &info, &supported);
-
-   if (supported == 1) // Can make a decision right now.
+   if (driver.menu && menu_content_db_find_core(driver.menu, deferred_path, core_path, sizeof(core_path)))
+      core = core_path;
+   else
    {
-      strlcpy(g_extern.fullpath, deferred_path, sizeof(g_extern.fullpath));
+      if (core_info)
+         core_info_list_get_supported_cores(core_info, deferred_path, &info, &supported);
 
-      if (path_file_exists(info->path))
-         strlcpy(g_settings.libretro, info->path, sizeof(g_settings.libretro));
+      if (supported != 1) // Present a selection.
+         return 0;
+      core = info->path;
+   }
+
+   // Can make a decision right now.
+   strlcpy(g_extern.fullpath, deferred_path, sizeof(g_extern.fullpath));
+
+   if (path_file_exists(core))
+      strlcpy(g_settings.libretro, core, sizeof(g_settings.libretro));
 
 #ifdef HAVE_DYNAMIC
-      g_extern.lifecycle_state |= (1ULL << MODE_LOAD_GAME);
+   g_extern.lifecycle_state |= (1ULL << MODE_LOAD_GAME);
 #else
-      rarch_environment_cb(RETRO_ENVIRONMENT_EXEC, (void*)g_extern.fullpath);
+   rarch_environment_cb(RETRO_ENVIRONMENT_EXEC, (void*)g_extern.fullpath);
 #endif
-      return -1;
-   }
-
-   return 0;
+   return -1;
 }
 
 void menu_content_history_push_current(void)
@@ -226,6 +260,20 @@ bool load_menu_content(void)
    return true;
 }
 
+// The index is rebuilt on every start, unchanged files are not hashed again.
+static void menu_content_db_scan(menu_handle_t *menu)
+{
+#if defined(HAVE_THREADS) && !defined(RARCH_CONSOLE)
+   content_db_scan_free(menu->content_scan);
+   menu->content_scan = NULL;
+
+   if (*g_settings.content_database_path && *g_settings.menu_content_directory &&
+         path_is_directory(g_settings.menu_content_directory))
+      menu->content_scan = content_db_scan_new(g_settings.content_database_path,
+            g_settings.menu_content_directory, menu->core_info);
+#endif
+}
+
 void *menu_init(const void *data)
 {
    menu_handle_t *menu;
@@ -260,6 +308,7 @@ void *menu_init(const void *data)
    menu->current_pad = 0;
 
    menu_update_libretro_info(menu);
+   menu_content_db_scan(menu);
 
    if (menu_ctx && menu_ctx->backend && menu_ctx->backend->shader_manager_init)
       menu_ctx->backend->shader_manager_init(menu);
@@ -290,6 +339,15 @@ void menu_free(void *data)
    libretro_free_system_info(&menu->info);
 #endif
 
+#ifdef HAVE_THREADS
+   dir_list_async_free(menu->dir_list_async);
+#endif
+
+#if defined(HAVE_THREADS) && !defined(RARCH_CONSOLE)
+   content_db_scan_free(menu->content_scan);
+#endif
+   content_db_free(menu->content_db);
+
    file_list_free(menu->menu_stack);
    file_list_free(menu->selection_buf);
 
@@ -27,6 +27,10 @@
 #include "rewind.h"
 #include "movie.h"
 #include "autosave.h"
+#include "state_writer.h"
+#include "screenshot.h"
+#include "frame_export.h"
+#include "replay_hash.h"
 #include "dynamic.h"
 #include "cheats.h"
 #include "audio/dsp_filter.h"
@@ -258,6 +262,15 @@ struct settings
    } osk;
 #endif
 
+#ifdef HAVE_FRAME_EXPORT
+   struct
+   {
+      char shm_name[PATH_MAX];
+      bool post_filter;
+      unsigned video_slots;
+   } frame_export;
+#endif
+
    struct
    {
       char driver[32];
@@ -316,6 +329,8 @@ struct settings
    char libretro_directory[PATH_MAX];
    unsigned libretro_log_level;
    char libretro_info_path[PATH_MAX];
+   char core_info_cache_path[PATH_MAX];
+   char content_database_path[PATH_MAX];
    char cheat_database[PATH_MAX];
    char cheat_settings_path[PATH_MAX];
 
@@ -327,9 +342,14 @@ struct settings
    bool rewind_enable;
    size_t rewind_buffer_size;
    unsigned rewind_granularity;
+   unsigned movie_keyframe_interval;
+   unsigned run_ahead_frames;
 
    float slowmotion_ratio;
    float fastforward_ratio;
+   unsigned fastforward_frameskip;
+   float fastforward_present_rate;
+   bool fastforward_show_speed;
 
    bool pause_nonactive;
    unsigned autosave_interval;
@@ -338,6 +358,7 @@ struct settings
    bool savestate_auto_index;
    bool savestate_auto_save;
    bool savestate_auto_load;
+   bool savestate_compression;
 
    bool network_cmd_enable;
    uint16_t network_cmd_port;
@@ -377,6 +398,9 @@ struct global
 {
    bool verbosity;
    bool perfcnt_enable;
+   char perfcnt_export_path[PATH_MAX];
+   unsigned perfcnt_export_interval;
+   char perfcnt_trace_path[PATH_MAX];
    bool audio_active;
    bool video_active;
 #ifdef HAVE_CAMERA
@@ -462,6 +486,38 @@ struct global
       retro_time_t last_frame_time;
    } frame_limit;
 
+   // Headless benchmark (--benchmark).
+   struct
+   {
+      unsigned frames;
+      unsigned frame;
+      retro_time_t start_time;
+   } benchmark;
+
+   // Frame skipping and speed measurement while fast-forwarding.
+   struct
+   {
+      bool skip; // Current frame is neither shown nor heard.
+      unsigned skipped;
+      retro_time_t last_present;
+
+      retro_time_t start_time; // 0 while not fast-forwarding.
+      uint64_t frames;
+      retro_time_t report_time;
+      uint64_t report_frames;
+      unsigned report_presented; // Frames shown since the last report.
+   } fastforward;
+
+   // Run-ahead (run_ahead_frames).
+   struct
+   {
+      void *state;
+      size_t state_size;
+      bool hide_video;
+      bool hide_audio;
+      bool warned;
+   } run_ahead;
+
    struct
    {
       struct retro_system_info info;
@@ -578,8 +634,18 @@ struct global
       char movie_start_path[PATH_MAX];
       bool movie_start_recording;
       bool movie_start_playback;
+      uint64_t movie_start_frame; // --bsvseek
       bool movie_end;
    } bsv;
+
+   // Hashes movie playback to check determinism (--replay-hash, --replay-verify).
+   struct
+   {
+      char log_path[PATH_MAX];
+      char verify_path[PATH_MAX];
+      unsigned interval;
+      replay_hash_t *hash;
+   } replay;
 #endif
 
 #ifdef HAVE_OSK
@@ -604,10 +670,26 @@ struct global
    uint16_t turbo_enable[MAX_PLAYERS];
    unsigned turbo_count;
 
+   // Input resolved once per poll, so input_state() is a lookup.
+   // A port or key is resolved on its first query after each poll.
+   struct
+   {
+      unsigned poll; // 0 before the first poll.
+      unsigned buttons_poll[MAX_PLAYERS];
+      unsigned analog_poll[MAX_PLAYERS];
+      uint16_t buttons[MAX_PLAYERS];
+      int16_t analog[MAX_PLAYERS][4];
+      uint32_t keys_valid[RETROK_LAST / 32 + 1];
+      uint32_t keys[RETROK_LAST / 32 + 1];
+   } input_snapshot;
+
    // Autosave support.
    autosave_t **autosave;
    unsigned num_autosave;
 
+   state_writer_t *state_writer;
+   screenshot_writer_t *screenshot_writer;
+
    // Netplay.
 #ifdef HAVE_NETPLAY
    netplay_t *netplay;
@@ -636,6 +718,10 @@ struct global
    size_t record_gpu_height;
 #endif
 
+#ifdef HAVE_FRAME_EXPORT
+   frame_export_t *frame_export;
+#endif
+
    struct
    {
       const void *data;
@@ -704,6 +790,7 @@ struct global
 
    bool main_is_init;
    bool error_in_init;
+   int exit_code; // Returned from main() when non-zero.
    bool config_save_on_exit;
    char error_string[1024];
    jmp_buf error_sjlj_context;
@@ -804,6 +891,10 @@ static inline void rarch_reinit_drivers(void)
 void rarch_init_recording(void);
 void rarch_deinit_recording(void);
 #endif
+#ifdef HAVE_FRAME_EXPORT
+void rarch_init_frame_export(void);
+void rarch_deinit_frame_export(void);
+#endif
 /////////
 
 #ifdef __cplusplus
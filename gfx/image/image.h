@@ -17,6 +17,7 @@
 #define __RARCH_IMAGE_CONTEXT_H
 
 #include <stdint.h>
+#include <stddef.h>
 #include "../../boolean.h"
 
 #ifdef _XBOX1
@@ -41,4 +42,8 @@ struct texture_image
 bool texture_image_load(struct texture_image *img, const char *path);
 void texture_image_free(struct texture_image *img);
 
+// Loads imgs[i] from paths[i], decoding several images at once where possible.
+// Images that fail to load (or have a NULL path) are left empty. Returns the number of images loaded.
+size_t texture_image_load_batch(struct texture_image *imgs, const char * const *paths, size_t count);
+
 #endif
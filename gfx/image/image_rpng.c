@@ -26,6 +26,11 @@
 #include "../../general.h"
 #include "../rpng/rpng.h"
 
+#ifdef HAVE_THREADS
+#include "../../thread.h"
+#include "../../performance.h"
+#endif
+
 static bool rpng_image_load_tga_shift(const char *path, struct texture_image *out_img,
       unsigned a_shift, unsigned r_shift, unsigned g_shift, unsigned b_shift)
 {
@@ -228,3 +233,54 @@ bool texture_image_load(struct texture_image *out_img, const char *path)
 
    return ret;
 }
+
+static bool texture_image_load_slot(struct texture_image *img, const char *path)
+{
+   if (path && texture_image_load(img, path))
+      return true;
+
+   memset(img, 0, sizeof(*img));
+   return false;
+}
+
+#ifdef HAVE_THREADS
+#define IMAGE_LOAD_MAX_THREADS 8
+
+struct texture_image_batch
+{
+   struct texture_image *imgs;
+   const char * const *paths;
+};
+
+static void texture_image_batch_task(void *data, size_t index)
+{
+   struct texture_image_batch *batch = (struct texture_image_batch*)data;
+   texture_image_load_slot(&batch->imgs[index], batch->paths[index]);
+}
+#endif
+
+// Decoding is CPU bound and images don't share any state, so we go wide on the cores we have.
+size_t texture_image_load_batch(struct texture_image *imgs, const char * const *paths, size_t count)
+{
+   size_t i, loaded = 0;
+
+#ifdef HAVE_THREADS
+   struct texture_image_batch batch = { imgs, paths };
+   unsigned threads = rarch_get_cpu_cores();
+
+   if (threads > IMAGE_LOAD_MAX_THREADS)
+      threads = IMAGE_LOAD_MAX_THREADS;
+   sthread_parallel_for(count, threads, texture_image_batch_task, &batch);
+
+   // Failed slots are cleared, so a loaded image is one with pixels.
+   for (i = 0; i < count; i++)
+      if (imgs[i].pixels)
+         loaded++;
+   return loaded;
+#else
+   for (i = 0; i < count; i++)
+      if (texture_image_load_slot(&imgs[i], paths[i]))
+         loaded++;
+   return loaded;
+#endif
+}
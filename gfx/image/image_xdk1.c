@@ -60,3 +60,16 @@ void texture_image_free(struct texture_image *img)
       img->pixels->Release();
    memset(img, 0, sizeof(*img));
 }
+
+size_t texture_image_load_batch(struct texture_image *imgs, const char * const *paths, size_t count)
+{
+   size_t i, loaded = 0;
+   for (i = 0; i < count; i++)
+   {
+      if (paths[i] && texture_image_load(&imgs[i], paths[i]))
+         loaded++;
+      else
+         memset(&imgs[i], 0, sizeof(imgs[i]));
+   }
+   return loaded;
+}
@@ -32,6 +32,30 @@ static inline uint32_t crc32_calculate(const uint8_t *data, size_t length)
 {
    return crc32(0, data, length);
 }
+
+static inline uint32_t crc32_update(uint32_t crc, const uint8_t *data, size_t length)
+{
+   return crc32(crc, data, length);
+}
+#endif
+
+#ifdef HAVE_MMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+#if defined(RARCH_INTERNAL) && defined(HAVE_THREADS)
+#include "../../thread.h"
+#include "../../performance.h"
+#define RPNG_THREADS
 #endif
 
 #undef GOTO_END_ERROR
@@ -53,7 +77,7 @@ struct png_chunk
 {
    uint32_t size;
    char type[4];
-   uint8_t *data;
+   const uint8_t *data;
 };
 
 struct png_ihdr
@@ -79,20 +103,99 @@ enum png_chunk_type
 
 static uint32_t dword_be(const uint8_t *buf)
 {
-   return (buf[0] << 24) | (buf[1] << 16) | (buf[2] << 8) | (buf[3] << 0);
+   return ((uint32_t)buf[0] << 24) | (buf[1] << 16) | (buf[2] << 8) | (buf[3] << 0);
 }
 
-static bool read_chunk_header(FILE *file, struct png_chunk *chunk)
+// The whole file is mapped (or read in one go), chunks are parsed in place.
+struct png_file
 {
-   uint8_t dword[4] = {0};
-   if (fread(dword, 1, 4, file) != 4)
+   const uint8_t *data;
+   size_t size;
+   bool mapped;
+};
+
+static bool png_file_open(struct png_file *file, const char *path)
+{
+#ifdef HAVE_MMAP
+   struct stat st;
+   void *data;
+   int fd = open(path, O_RDONLY);
+   if (fd < 0)
+      return false;
+
+   if (fstat(fd, &st) < 0 || st.st_size <= 0)
+   {
+      close(fd);
+      return false;
+   }
+
+   data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+   close(fd);
+   if (data != MAP_FAILED)
+   {
+      file->data   = (const uint8_t*)data;
+      file->size   = st.st_size;
+      file->mapped = true;
+      return true;
+   }
+#endif
+
+   uint8_t *buf;
+   long len;
+   FILE *f = fopen(path, "rb");
+   if (!f)
       return false;
 
-   chunk->size = dword_be(dword);
+   fseek(f, 0, SEEK_END);
+   len = ftell(f);
+   rewind(f);
 
-   if (fread(chunk->type, 1, 4, file) != 4)
+   if (len <= 0 || !(buf = (uint8_t*)malloc(len)))
+   {
+      fclose(f);
+      return false;
+   }
+
+   if (fread(buf, 1, len, f) != (size_t)len)
+   {
+      free(buf);
+      fclose(f);
       return false;
+   }
 
+   fclose(f);
+   file->data   = buf;
+   file->size   = len;
+   file->mapped = false;
+   return true;
+}
+
+static void png_file_close(struct png_file *file)
+{
+#ifdef HAVE_MMAP
+   if (file->mapped)
+      munmap((void*)file->data, file->size);
+   else
+#endif
+      free((void*)file->data);
+   memset(file, 0, sizeof(*file));
+}
+
+static bool png_next_chunk(const uint8_t **ptr, const uint8_t *end, struct png_chunk *chunk)
+{
+   size_t avail = end - *ptr;
+   if (avail < 2 * sizeof(uint32_t))
+      return false;
+
+   chunk->size = dword_be(*ptr);
+   memcpy(chunk->type, *ptr + 4, 4);
+   if (chunk->size > avail - 2 * sizeof(uint32_t))
+      return false;
+
+   // Ignore CRC, a truncated one is fine as well.
+   chunk->data = *ptr + 8;
+   avail -= chunk->size + 2 * sizeof(uint32_t);
+   *ptr += chunk->size + 2 * sizeof(uint32_t) + (avail < sizeof(uint32_t) ? avail : sizeof(uint32_t));
    return true;
 }
 
@@ -107,12 +210,6 @@ struct
    { "PLTE", PNG_CHUNK_PLTE },
 };
 
-struct idat_buffer
-{
-   uint8_t *data;
-   size_t size;
-};
-
 static enum png_chunk_type png_chunk_type(const struct png_chunk *chunk)
 {
    unsigned i;
@@ -125,35 +222,10 @@ static enum png_chunk_type png_chunk_type(const struct png_chunk *chunk)
    return PNG_CHUNK_NOOP;
 }
 
-static bool png_read_chunk(FILE *file, struct png_chunk *chunk)
-{
-   free(chunk->data);
-   chunk->data = (uint8_t*)calloc(1, chunk->size + sizeof(uint32_t)); // CRC32
-   if (!chunk->data)
-      return false;
-
-   if (fread(chunk->data, 1, chunk->size + sizeof(uint32_t), file) != (chunk->size + sizeof(uint32_t)))
-   {
-      free(chunk->data);
-      return false;
-   }
-
-   // Ignore CRC.
-   return true;
-}
-
-static void png_free_chunk(struct png_chunk *chunk)
-{
-   free(chunk->data);
-   chunk->data = NULL;
-}
-
-static bool png_parse_ihdr(FILE *file, struct png_chunk *chunk, struct png_ihdr *ihdr)
+static bool png_parse_ihdr(const struct png_chunk *chunk, struct png_ihdr *ihdr)
 {
    unsigned i;
    bool ret = true;
-   if (!png_read_chunk(file, chunk))
-      return false;
 
    if (chunk->size != 13)
       GOTO_END_ERROR();
@@ -225,7 +297,6 @@ static bool png_parse_ihdr(FILE *file, struct png_chunk *chunk, struct png_ihdr
    //   GOTO_END_ERROR();
 
 end:
-   png_free_chunk(chunk);
    return ret;
 }
 
@@ -245,9 +316,260 @@ static inline int paeth(int a, int b, int c)
       return c;
 }
 
-static inline void copy_line_rgb(uint32_t *data, const uint8_t *decoded, unsigned width, unsigned bpp)
+static void png_unfilter_sub_c(uint8_t *line, unsigned pitch, unsigned bpp)
+{
+   unsigned i;
+   for (i = bpp; i < pitch; i++)
+      line[i] += line[i - bpp];
+}
+
+static void png_unfilter_up(uint8_t *line, const uint8_t *prev, unsigned pitch)
+{
+   unsigned i = 0;
+#if defined(__SSE2__)
+   for (; i + 16 <= pitch; i += 16)
+   {
+      __m128i x = _mm_loadu_si128((const __m128i*)(line + i));
+      __m128i b = _mm_loadu_si128((const __m128i*)(prev + i));
+      _mm_storeu_si128((__m128i*)(line + i), _mm_add_epi8(x, b));
+   }
+#elif defined(__ARM_NEON__)
+   for (; i + 16 <= pitch; i += 16)
+      vst1q_u8(line + i, vaddq_u8(vld1q_u8(line + i), vld1q_u8(prev + i)));
+#endif
+   for (; i < pitch; i++)
+      line[i] += prev[i];
+}
+
+static void png_unfilter_avg_c(uint8_t *line, const uint8_t *prev, unsigned pitch, unsigned bpp)
+{
+   unsigned i;
+   for (i = 0; i < bpp; i++)
+      line[i] += prev[i] >> 1;
+   for (i = bpp; i < pitch; i++)
+      line[i] += (line[i - bpp] + prev[i]) >> 1;
+}
+
+static void png_unfilter_paeth_c(uint8_t *line, const uint8_t *prev, unsigned pitch, unsigned bpp)
+{
+   unsigned i;
+   for (i = 0; i < bpp; i++)
+      line[i] += paeth(0, prev[i], 0);
+   for (i = bpp; i < pitch; i++)
+      line[i] += paeth(line[i - bpp], prev[i], prev[i - bpp]);
+}
+
+#if defined(__SSE2__) || defined(__ARM_NEON__)
+// Sub, Average and Paeth depend on the pixel to the left, so for 3 and 4 byte pixels
+// we go one pixel at a time, but handle all channels of it at once.
+// Pixels are loaded through a dword so 3 byte pixels never touch memory past the line.
+static inline uint32_t png_load_pixel(const uint8_t *p, unsigned bpp)
+{
+   uint32_t v = 0;
+   memcpy(&v, p, bpp);
+   return v;
+}
+
+static inline void png_store_pixel(uint8_t *p, uint32_t v, unsigned bpp)
+{
+   memcpy(p, &v, bpp);
+}
+#endif
+
+#if defined(__SSE2__)
+static void png_unfilter_sub_simd(uint8_t *line, unsigned pitch, unsigned bpp)
+{
+   unsigned i;
+   __m128i a = _mm_setzero_si128();
+   for (i = 0; i < pitch; i += bpp)
+   {
+      a = _mm_add_epi8(a, _mm_cvtsi32_si128(png_load_pixel(line + i, bpp)));
+      png_store_pixel(line + i, _mm_cvtsi128_si32(a), bpp);
+   }
+}
+
+static void png_unfilter_avg_simd(uint8_t *line, const uint8_t *prev, unsigned pitch, unsigned bpp)
+{
+   unsigned i;
+   const __m128i one = _mm_set1_epi8(1);
+   __m128i a = _mm_setzero_si128();
+   for (i = 0; i < pitch; i += bpp)
+   {
+      __m128i b   = _mm_cvtsi32_si128(png_load_pixel(prev + i, bpp));
+      __m128i x   = _mm_cvtsi32_si128(png_load_pixel(line + i, bpp));
+      // pavgb rounds up, take the carried bit back out.
+      __m128i avg = _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), one));
+      a = _mm_add_epi8(x, avg);
+      png_store_pixel(line + i, _mm_cvtsi128_si32(a), bpp);
+   }
+}
+
+static inline __m128i png_abs_epi16(__m128i x)
+{
+   return _mm_max_epi16(x, _mm_sub_epi16(_mm_setzero_si128(), x));
+}
+
+static inline __m128i png_select(__m128i mask, __m128i a, __m128i b)
+{
+   return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+static void png_unfilter_paeth_simd(uint8_t *line, const uint8_t *prev, unsigned pitch, unsigned bpp)
+{
+   unsigned i;
+   const __m128i zero = _mm_setzero_si128();
+   __m128i a = zero, c = zero;
+   for (i = 0; i < pitch; i += bpp)
+   {
+      __m128i b = _mm_unpacklo_epi8(_mm_cvtsi32_si128(png_load_pixel(prev + i, bpp)), zero);
+      __m128i x = _mm_unpacklo_epi8(_mm_cvtsi32_si128(png_load_pixel(line + i, bpp)), zero);
+
+      // p = a + b - c, so p - a = b - c, p - b = a - c and p - c is the sum of those.
+      __m128i pa = _mm_sub_epi16(b, c);
+      __m128i pb = _mm_sub_epi16(a, c);
+      __m128i pc = png_abs_epi16(_mm_add_epi16(pa, pb));
+      pa = png_abs_epi16(pa);
+      pb = png_abs_epi16(pb);
+
+      __m128i smallest = _mm_min_epi16(pc, _mm_min_epi16(pa, pb));
+      __m128i pred = png_select(_mm_cmpeq_epi16(smallest, pa), a,
+            png_select(_mm_cmpeq_epi16(smallest, pb), b, c));
+
+      a = _mm_and_si128(_mm_add_epi16(x, pred), _mm_set1_epi16(0xff));
+      c = b;
+      png_store_pixel(line + i, _mm_cvtsi128_si32(_mm_packus_epi16(a, a)), bpp);
+   }
+}
+#elif defined(__ARM_NEON__)
+static inline uint8x8_t png_load_pixel_neon(const uint8_t *p, unsigned bpp)
+{
+   return vreinterpret_u8_u32(vdup_n_u32(png_load_pixel(p, bpp)));
+}
+
+static inline void png_store_pixel_neon(uint8_t *p, uint8x8_t v, unsigned bpp)
+{
+   png_store_pixel(p, vget_lane_u32(vreinterpret_u32_u8(v), 0), bpp);
+}
+
+static void png_unfilter_sub_simd(uint8_t *line, unsigned pitch, unsigned bpp)
+{
+   unsigned i;
+   uint8x8_t a = vdup_n_u8(0);
+   for (i = 0; i < pitch; i += bpp)
+   {
+      a = vadd_u8(a, png_load_pixel_neon(line + i, bpp));
+      png_store_pixel_neon(line + i, a, bpp);
+   }
+}
+
+static void png_unfilter_avg_simd(uint8_t *line, const uint8_t *prev, unsigned pitch, unsigned bpp)
 {
    unsigned i;
+   uint8x8_t a = vdup_n_u8(0);
+   for (i = 0; i < pitch; i += bpp)
+   {
+      uint8x8_t b = png_load_pixel_neon(prev + i, bpp);
+      a = vadd_u8(png_load_pixel_neon(line + i, bpp), vhadd_u8(a, b));
+      png_store_pixel_neon(line + i, a, bpp);
+   }
+}
+
+static void png_unfilter_paeth_simd(uint8_t *line, const uint8_t *prev, unsigned pitch, unsigned bpp)
+{
+   unsigned i;
+   uint8x8_t a = vdup_n_u8(0), c = vdup_n_u8(0);
+   for (i = 0; i < pitch; i += bpp)
+   {
+      uint8x8_t b = png_load_pixel_neon(prev + i, bpp);
+
+      uint16x8_t pa = vabdl_u8(b, c);
+      uint16x8_t pb = vabdl_u8(a, c);
+      uint16x8_t pc = vabdq_u16(vaddl_u8(a, b), vshll_n_u8(c, 1));
+      uint16x8_t smallest = vminq_u16(pc, vminq_u16(pa, pb));
+
+      uint8x8_t pred = vbsl_u8(vmovn_u16(vceqq_u16(smallest, pa)), a,
+            vbsl_u8(vmovn_u16(vceqq_u16(smallest, pb)), b, c));
+
+      a = vadd_u8(png_load_pixel_neon(line + i, bpp), pred);
+      c = b;
+      png_store_pixel_neon(line + i, a, bpp);
+   }
+}
+#endif
+
+// Undoes the filter of a line in place. prev is the previous unfiltered line.
+static bool png_unfilter_line(unsigned filter, uint8_t *line, const uint8_t *prev,
+      unsigned pitch, unsigned bpp)
+{
+#if defined(__SSE2__) || defined(__ARM_NEON__)
+   bool simd = bpp == 3 || bpp == 4;
+#endif
+
+   switch (filter)
+   {
+      case 0: // None
+         break;
+
+      case 1: // Sub
+#if defined(__SSE2__) || defined(__ARM_NEON__)
+         if (simd)
+            png_unfilter_sub_simd(line, pitch, bpp);
+         else
+#endif
+            png_unfilter_sub_c(line, pitch, bpp);
+         break;
+
+      case 2: // Up
+         png_unfilter_up(line, prev, pitch);
+         break;
+
+      case 3: // Average
+#if defined(__SSE2__) || defined(__ARM_NEON__)
+         if (simd)
+            png_unfilter_avg_simd(line, prev, pitch, bpp);
+         else
+#endif
+            png_unfilter_avg_c(line, prev, pitch, bpp);
+         break;
+
+      case 4: // Paeth
+#if defined(__SSE2__) || defined(__ARM_NEON__)
+         if (simd)
+            png_unfilter_paeth_simd(line, prev, pitch, bpp);
+         else
+#endif
+            png_unfilter_paeth_c(line, prev, pitch, bpp);
+         break;
+
+      default:
+         return false;
+   }
+
+   return true;
+}
+
+static inline void copy_line_rgb(uint32_t *data, const uint8_t *decoded, unsigned width, unsigned bpp)
+{
+   unsigned i = 0;
+   if (bpp == 8)
+   {
+#if defined(__ARM_NEON__)
+      for (; i + 8 <= width; i += 8, decoded += 24)
+      {
+         uint8x8x3_t rgb = vld3_u8(decoded);
+         uint8x8x4_t bgra;
+         bgra.val[0] = rgb.val[2];
+         bgra.val[1] = rgb.val[1];
+         bgra.val[2] = rgb.val[0];
+         bgra.val[3] = vdup_n_u8(0xff);
+         vst4_u8((uint8_t*)(data + i), bgra);
+      }
+#endif
+      for (; i < width; i++, decoded += 3)
+         data[i] = (0xffu << 24) | (decoded[0] << 16) | (decoded[1] << 8) | (decoded[2] << 0);
+      return;
+   }
+
    bpp /= 8;
    for (i = 0; i < width; i++)
    {
@@ -263,7 +585,35 @@ static inline void copy_line_rgb(uint32_t *data, const uint8_t *decoded, unsigne
 
 static inline void copy_line_rgba(uint32_t *data, const uint8_t *decoded, unsigned width, unsigned bpp)
 {
-   unsigned i;
+   unsigned i = 0;
+   if (bpp == 8)
+   {
+#if defined(__SSE2__)
+      // Read as little endian dwords, RGBA is ABGR, so R and B swap places.
+      const __m128i mask_ag = _mm_set1_epi32(0xff00ff00);
+      const __m128i mask_b  = _mm_set1_epi32(0x000000ff);
+      for (; i + 4 <= width; i += 4, decoded += 16)
+      {
+         __m128i x = _mm_loadu_si128((const __m128i*)decoded);
+         __m128i r = _mm_slli_epi32(_mm_and_si128(x, mask_b), 16);
+         __m128i b = _mm_and_si128(_mm_srli_epi32(x, 16), mask_b);
+         _mm_storeu_si128((__m128i*)(data + i), _mm_or_si128(_mm_and_si128(x, mask_ag), _mm_or_si128(r, b)));
+      }
+#elif defined(__ARM_NEON__)
+      for (; i + 8 <= width; i += 8, decoded += 32)
+      {
+         uint8x8x4_t rgba = vld4_u8(decoded);
+         uint8x8_t r = rgba.val[0];
+         rgba.val[0] = rgba.val[2];
+         rgba.val[2] = r;
+         vst4_u8((uint8_t*)(data + i), rgba);
+      }
+#endif
+      for (; i < width; i++, decoded += 4)
+         data[i] = ((uint32_t)decoded[3] << 24) | (decoded[0] << 16) | (decoded[1] << 8) | (decoded[2] << 0);
+      return;
+   }
+
    bpp /= 8;
    for (i = 0; i < width; i++)
    {
@@ -387,9 +737,9 @@ static void png_pass_geom(const struct png_ihdr *ihdr,
 
 
 static bool png_reverse_filter(uint32_t *data, const struct png_ihdr *ihdr,
-      const uint8_t *inflate_buf, size_t inflate_buf_size, const uint32_t *palette)
+      uint8_t *inflate_buf, size_t inflate_buf_size, const uint32_t *palette)
 {
-   unsigned i, h;
+   unsigned h;
    bool ret = true;
 
    unsigned bpp;
@@ -400,75 +750,36 @@ static bool png_reverse_filter(uint32_t *data, const struct png_ihdr *ihdr,
    if (inflate_buf_size < pass_size)
       return false;
 
-   uint8_t *prev_scanline    = (uint8_t*)calloc(1, pitch);
-   uint8_t *decoded_scanline = (uint8_t*)calloc(1, pitch);
+   // Lines are unfiltered in place, so the previous line is right behind the current one.
+   uint8_t *zero_scanline = (uint8_t*)calloc(1, pitch);
+   const uint8_t *prev_scanline = zero_scanline;
 
-   if (!prev_scanline || !decoded_scanline)
+   if (!zero_scanline)
       GOTO_END_ERROR();
 
    for (h = 0; h < ihdr->height;
          h++, inflate_buf += pitch, data += ihdr->width)
    {
       unsigned filter = *inflate_buf++;
-      switch (filter)
-      {
-         case 0: // None
-            memcpy(decoded_scanline, inflate_buf, pitch);
-            break;
-
-         case 1: // Sub
-            for (i = 0; i < bpp; i++)
-               decoded_scanline[i] = inflate_buf[i];
-            for (i = bpp; i < pitch; i++)
-               decoded_scanline[i] = decoded_scanline[i - bpp] + inflate_buf[i];
-            break;
-
-         case 2: // Up
-            for (i = 0; i < pitch; i++)
-               decoded_scanline[i] = prev_scanline[i] + inflate_buf[i];
-            break;
-
-         case 3: // Average
-            for (i = 0; i < bpp; i++)
-            {
-               uint8_t avg = prev_scanline[i] >> 1;
-               decoded_scanline[i] = avg + inflate_buf[i];
-            }
-            for (i = bpp; i < pitch; i++)
-            {
-               uint8_t avg = (decoded_scanline[i - bpp] + prev_scanline[i]) >> 1;
-               decoded_scanline[i] = avg + inflate_buf[i];
-            }
-            break;
-
-         case 4: // Paeth
-            for (i = 0; i < bpp; i++)
-               decoded_scanline[i] = paeth(0, prev_scanline[i], 0) + inflate_buf[i];
-            for (i = bpp; i < pitch; i++)
-               decoded_scanline[i] = paeth(decoded_scanline[i - bpp], prev_scanline[i], prev_scanline[i - bpp]) + inflate_buf[i];
-            break;
-
-         default:
-            GOTO_END_ERROR();
-      }
+      if (!png_unfilter_line(filter, inflate_buf, prev_scanline, pitch, bpp))
+         GOTO_END_ERROR();
 
       if (ihdr->color_type == 0)
-         copy_line_bw(data, decoded_scanline, ihdr->width, ihdr->depth);
+         copy_line_bw(data, inflate_buf, ihdr->width, ihdr->depth);
       else if (ihdr->color_type == 2)
-         copy_line_rgb(data, decoded_scanline, ihdr->width, ihdr->depth);
+         copy_line_rgb(data, inflate_buf, ihdr->width, ihdr->depth);
       else if (ihdr->color_type == 3)
-         copy_line_plt(data, decoded_scanline, ihdr->width, ihdr->depth, palette);
+         copy_line_plt(data, inflate_buf, ihdr->width, ihdr->depth, palette);
       else if (ihdr->color_type == 4)
-         copy_line_gray_alpha(data, decoded_scanline, ihdr->width, ihdr->depth);
+         copy_line_gray_alpha(data, inflate_buf, ihdr->width, ihdr->depth);
       else if (ihdr->color_type == 6)
-         copy_line_rgba(data, decoded_scanline, ihdr->width, ihdr->depth);
+         copy_line_rgba(data, inflate_buf, ihdr->width, ihdr->depth);
 
-      memcpy(prev_scanline, decoded_scanline, pitch);
+      prev_scanline = inflate_buf;
    }
 
 end:
-   free(decoded_scanline);
-   free(prev_scanline);
+   free(zero_scanline);
    return ret;
 }
 
@@ -494,7 +805,7 @@ static void deinterlace_pass(uint32_t *data, const struct png_ihdr *ihdr,
 }
 
 static bool png_reverse_filter_adam7(uint32_t *data, const struct png_ihdr *ihdr,
-      const uint8_t *inflate_buf, size_t inflate_buf_size, const uint32_t *palette)
+      uint8_t *inflate_buf, size_t inflate_buf_size, const uint32_t *palette)
 {
    unsigned pass;
    static const struct adam7_pass passes[] = {
@@ -548,31 +859,30 @@ static bool png_reverse_filter_adam7(uint32_t *data, const struct png_ihdr *ihdr
    return true;
 }
 
-static bool png_append_idat(FILE *file, const struct png_chunk *chunk, struct idat_buffer *buf)
+// Feeds one IDAT chunk to the inflater. The zlib stream may span any number of chunks.
+static bool png_inflate_idat(z_stream *stream, const struct png_chunk *chunk, bool *stream_end)
 {
-   uint8_t *new_buffer = (uint8_t*)realloc(buf->data, buf->size + chunk->size);
-   if (!new_buffer)
-      return false;
+   stream->next_in  = (Bytef*)chunk->data;
+   stream->avail_in = chunk->size;
+
+   while (stream->avail_in && !*stream_end)
+   {
+      int ret = inflate(stream, Z_NO_FLUSH);
+      if (ret == Z_STREAM_END)
+         *stream_end = true;
+      else if (ret != Z_OK)
+         return false;
+   }
 
-   buf->data  = new_buffer;
-   if (fread(buf->data + buf->size, 1, chunk->size, file) != chunk->size)
-      return false;
-   if (fseek(file, sizeof(uint32_t), SEEK_CUR) < 0)
-      return false;
-   buf->size += chunk->size;
    return true;
 }
 
-static bool png_read_plte(FILE *file, uint32_t *buffer, unsigned entries)
+static bool png_read_plte(const uint8_t *buf, uint32_t *buffer, unsigned entries)
 {
    unsigned i;
    if (entries > 256)
       return false;
 
-   uint8_t buf[256 * 3];
-   if (fread(buf, 3, entries, file) != entries)
-      return false;
-
    for (i = 0; i < entries; i++)
    {
       uint32_t r = buf[3 * i + 0];
@@ -581,60 +891,49 @@ static bool png_read_plte(FILE *file, uint32_t *buffer, unsigned entries)
       buffer[i] = (r << 16) | (g << 8) | (b << 0) | (0xffu << 24);
    }
 
-   if (fseek(file, sizeof(uint32_t), SEEK_CUR) < 0)
-      return false;
-
    return true;
 }
 
 bool rpng_load_image_argb(const char *path, uint32_t **data, unsigned *width, unsigned *height)
 {
-   long pos;
    *data   = NULL;
    *width  = 0;
    *height = 0;
 
    bool ret = true;
-   FILE *file = fopen(path, "rb");
-   if (!file)
+   struct png_file file = {0};
+   if (!png_file_open(&file, path))
       return false;
 
-   fseek(file, 0, SEEK_END);
-   long file_len = ftell(file);
-   rewind(file);
+   const uint8_t *ptr = file.data;
+   const uint8_t *end = file.data + file.size;
 
    bool has_ihdr = false;
    bool has_idat = false;
    bool has_iend = false;
    bool has_plte = false;
+   bool stream_end = false;
    uint8_t *inflate_buf = NULL;
    size_t inflate_buf_size = 0;
    z_stream stream = {0};
 
-   struct idat_buffer idat_buf = {0};
    struct png_ihdr ihdr = {0};
    uint32_t palette[256] = {0};
 
-   char header[8];
-   if (fread(header, 1, sizeof(header), file) != sizeof(header))
+   if (file.size < sizeof(png_magic) || memcmp(ptr, png_magic, sizeof(png_magic)) != 0)
       GOTO_END_ERROR();
+   ptr += sizeof(png_magic);
 
-   if (memcmp(header, png_magic, sizeof(png_magic)) != 0)
-      GOTO_END_ERROR();
-
-   // feof() apparently isn't triggered after a seek (IEND).
-   for (pos = ftell(file); pos < file_len && pos >= 0; pos = ftell(file))
+   while (ptr < end && !has_iend)
    {
       struct png_chunk chunk = {0};
-      if (!read_chunk_header(file, &chunk))
+      if (!png_next_chunk(&ptr, end, &chunk))
          GOTO_END_ERROR();
 
       switch (png_chunk_type(&chunk))
       {
          case PNG_CHUNK_NOOP:
          default:
-            if (fseek(file, chunk.size + sizeof(uint32_t), SEEK_CUR) < 0)
-               GOTO_END_ERROR();
             break;
 
          case PNG_CHUNK_ERROR:
@@ -644,7 +943,7 @@ bool rpng_load_image_argb(const char *path, uint32_t **data, unsigned *width, un
             if (has_ihdr || has_idat || has_iend)
                GOTO_END_ERROR();
 
-            if (!png_parse_ihdr(file, &chunk, &ihdr))
+            if (!png_parse_ihdr(&chunk, &ihdr))
                GOTO_END_ERROR();
 
             has_ihdr = true;
@@ -657,7 +956,7 @@ bool rpng_load_image_argb(const char *path, uint32_t **data, unsigned *width, un
             if (chunk.size % 3)
                GOTO_END_ERROR();
 
-            if (!png_read_plte(file, palette, chunk.size / 3))
+            if (!png_read_plte(chunk.data, palette, chunk.size / 3))
                GOTO_END_ERROR();
 
             has_plte = true;
@@ -667,49 +966,39 @@ bool rpng_load_image_argb(const char *path, uint32_t **data, unsigned *width, un
             if (!has_ihdr || has_iend || (ihdr.color_type == 3 && !has_plte))
                GOTO_END_ERROR();
 
-            if (!png_append_idat(file, &chunk, &idat_buf))
-               GOTO_END_ERROR();
+            if (!has_idat)
+            {
+               png_pass_geom(&ihdr, ihdr.width, ihdr.height, NULL, NULL, &inflate_buf_size);
+               if (ihdr.interlace == 1) // To be sure.
+                  inflate_buf_size *= 2;
+
+               inflate_buf = (uint8_t*)malloc(inflate_buf_size);
+               if (!inflate_buf)
+                  GOTO_END_ERROR();
+
+               if (inflateInit(&stream) != Z_OK)
+                  GOTO_END_ERROR();
+
+               stream.next_out  = inflate_buf;
+               stream.avail_out = inflate_buf_size;
+               has_idat = true;
+            }
 
-            has_idat = true;
+            if (!png_inflate_idat(&stream, &chunk, &stream_end))
+               GOTO_END_ERROR();
             break;
 
          case PNG_CHUNK_IEND:
             if (!has_ihdr || !has_idat)
                GOTO_END_ERROR();
 
-            if (fseek(file, sizeof(uint32_t), SEEK_CUR) < 0)
-               GOTO_END_ERROR();
-
             has_iend = true;
             break;
       }
    }
 
-   if (!has_ihdr || !has_idat || !has_iend)
-      GOTO_END_ERROR();
-
-   if (inflateInit(&stream) != Z_OK)
-      GOTO_END_ERROR();
-
-   png_pass_geom(&ihdr, ihdr.width, ihdr.height, NULL, NULL, &inflate_buf_size);
-   if (ihdr.interlace == 1) // To be sure.
-      inflate_buf_size *= 2;
-
-   inflate_buf = (uint8_t*)malloc(inflate_buf_size);
-   if (!inflate_buf)
-      GOTO_END_ERROR();
-
-   stream.next_in   = idat_buf.data;
-   stream.avail_in  = idat_buf.size;
-   stream.avail_out = inflate_buf_size;
-   stream.next_out  = inflate_buf;
-
-   if (inflate(&stream, Z_FINISH) != Z_STREAM_END)
-   {
-      inflateEnd(&stream);
+   if (!has_ihdr || !has_idat || !has_iend || !stream_end)
       GOTO_END_ERROR();
-   }
-   inflateEnd(&stream);
 
    *width  = ihdr.width;
    *height = ihdr.height;
@@ -731,11 +1020,14 @@ bool rpng_load_image_argb(const char *path, uint32_t **data, unsigned *width, un
       GOTO_END_ERROR();
 
 end:
-   if (file)
-      fclose(file);
+   if (has_idat)
+      inflateEnd(&stream);
+   png_file_close(&file);
    if (!ret)
+   {
       free(*data);
-   free(idat_buf.data);
+      *data = NULL;
+   }
    free(inflate_buf);
    return ret;
 }
@@ -785,17 +1077,6 @@ static bool png_write_ihdr(FILE *file, const struct png_ihdr *ihdr)
    return true;
 }
 
-static bool png_write_idat(FILE *file, const uint8_t *data, size_t size)
-{
-   if (fwrite(data, 1, size, file) != size)
-      return false;
-
-   if (!png_write_crc(file, data + sizeof(uint32_t), size - sizeof(uint32_t)))
-      return false;
-
-   return true;
-}
-
 static bool png_write_iend(FILE *file)
 {
    const uint8_t data[] = {
@@ -895,74 +1176,78 @@ static unsigned filter_paeth(uint8_t *target, const uint8_t *line, const uint8_t
    return count_sad(target, width);
 }
 
-static bool rpng_save_image(const char *path, const uint8_t *data,
-      unsigned width, unsigned height, unsigned pitch, unsigned bpp)
-{
-   unsigned h;
-   bool ret = true;
-   struct png_ihdr ihdr = {0};
+// The image is filtered and deflated in independent blocks of rows, pigz style.
+// Every block but the last ends with a sync flush, so the raw deflate streams concatenate,
+// and each block is primed with the 32k of filtered data before it to keep the ratio.
+#define RPNG_ENCODE_BLOCK_SIZE (256 * 1024)
+#define RPNG_ENCODE_MAX_BLOCKS 64
+#define RPNG_ENCODE_MAX_THREADS 8
+#define RPNG_DEFLATE_WINDOW (32 * 1024)
 
-   size_t encode_buf_size  = 0;
-   uint8_t *encode_buf     = NULL;
-   uint8_t *deflate_buf    = NULL;
-   uint8_t *rgba_line      = NULL;
-   uint8_t *up_filtered    = NULL;
-   uint8_t *sub_filtered   = NULL;
-   uint8_t *avg_filtered   = NULL;
-   uint8_t *paeth_filtered = NULL;
-   uint8_t *prev_encoded   = NULL;
-   uint8_t *encode_target  = NULL;
+struct rpng_encode_block
+{
+   unsigned first_row;
+   unsigned rows;
 
-   z_stream stream = {0};
+   uint8_t *out; // Raw deflate data, with room for the zlib header and trailer.
+   size_t out_size;
+   uint32_t adler;
+   bool ok;
+};
 
-   FILE *file = fopen(path, "wb");
-   if (!file)
-      GOTO_END_ERROR();
+struct rpng_encode
+{
+   const uint8_t *data;
+   unsigned width, height, pitch, bpp;
 
-   if (fwrite(png_magic, 1, sizeof(png_magic), file) != sizeof(png_magic))
-      GOTO_END_ERROR();
+   uint8_t *encode_buf; // Filtered rows, each prefixed with the filter type.
+   size_t line_size;
 
-   ihdr.width = width;
-   ihdr.height = height;
-   ihdr.depth = 8;
-   ihdr.color_type = bpp == sizeof(uint32_t) ? 6 : 2; // RGBA or RGB
-   if (!png_write_ihdr(file, &ihdr))
-      GOTO_END_ERROR();
+   struct rpng_encode_block *blocks;
+   unsigned num_blocks;
+};
 
-   encode_buf_size = (width * bpp + 1) * height;
-   encode_buf = (uint8_t*)malloc(encode_buf_size);
-   if (!encode_buf)
-      GOTO_END_ERROR();
+static void rpng_copy_line(const struct rpng_encode *enc, uint8_t *dst, unsigned row)
+{
+   const uint8_t *src = enc->data + row * enc->pitch;
+   if (enc->bpp == sizeof(uint32_t))
+      copy_argb_line(dst, (const uint32_t*)src, enc->width);
+   else
+      copy_bgr24_line(dst, src, enc->width);
+}
 
-   prev_encoded = (uint8_t*)calloc(1, width * bpp);
-   if (!prev_encoded)
+static bool rpng_filter_block(const struct rpng_encode *enc, const struct rpng_encode_block *block)
+{
+   unsigned h;
+   bool ret = true;
+   size_t line_size = enc->width * enc->bpp;
+   uint8_t *encode_target = enc->encode_buf + block->first_row * enc->line_size;
+
+   uint8_t *rgba_line      = (uint8_t*)malloc(line_size);
+   uint8_t *prev_encoded   = (uint8_t*)calloc(1, line_size);
+   uint8_t *up_filtered    = (uint8_t*)malloc(line_size);
+   uint8_t *sub_filtered   = (uint8_t*)malloc(line_size);
+   uint8_t *avg_filtered   = (uint8_t*)malloc(line_size);
+   uint8_t *paeth_filtered = (uint8_t*)malloc(line_size);
+   if (!rgba_line || !prev_encoded || !up_filtered || !sub_filtered || !avg_filtered || !paeth_filtered)
       GOTO_END_ERROR();
 
-   rgba_line      = (uint8_t*)malloc(width * bpp);
-   up_filtered    = (uint8_t*)malloc(width * bpp);
-   sub_filtered   = (uint8_t*)malloc(width * bpp);
-   avg_filtered   = (uint8_t*)malloc(width * bpp);
-   paeth_filtered = (uint8_t*)malloc(width * bpp);
-   if (!rgba_line || !up_filtered || !sub_filtered || !avg_filtered || !paeth_filtered)
-      GOTO_END_ERROR();
+   // Filters only look at unfiltered data, so a block just needs the row above it.
+   if (block->first_row)
+      rpng_copy_line(enc, prev_encoded, block->first_row - 1);
 
-   encode_target = encode_buf;
-   for (h = 0; h < height;
-         h++, encode_target += width * bpp, data += pitch)
+   for (h = block->first_row; h < block->first_row + block->rows; h++)
    {
-      if (bpp == sizeof(uint32_t))
-         copy_argb_line(rgba_line, (const uint32_t*)data, width);
-      else
-         copy_bgr24_line(rgba_line, data, width);
+      rpng_copy_line(enc, rgba_line, h);
 
       // Try every filtering method, and choose the method
       // which has most entries as zero.
       // This is probably not very optimal, but it's very simple to implement.
-      unsigned none_score  = count_sad(rgba_line, width * bpp);
-      unsigned up_score    = filter_up(up_filtered, rgba_line, prev_encoded, width, bpp);
-      unsigned sub_score   = filter_sub(sub_filtered, rgba_line, width, bpp);
-      unsigned avg_score   = filter_avg(avg_filtered, rgba_line, prev_encoded, width, bpp);
-      unsigned paeth_score = filter_paeth(paeth_filtered, rgba_line, prev_encoded, width, bpp);
+      unsigned none_score  = count_sad(rgba_line, line_size);
+      unsigned up_score    = filter_up(up_filtered, rgba_line, prev_encoded, enc->width, enc->bpp);
+      unsigned sub_score   = filter_sub(sub_filtered, rgba_line, enc->width, enc->bpp);
+      unsigned avg_score   = filter_avg(avg_filtered, rgba_line, prev_encoded, enc->width, enc->bpp);
+      unsigned paeth_score = filter_paeth(paeth_filtered, rgba_line, prev_encoded, enc->width, enc->bpp);
 
       uint8_t filter = 0;
       unsigned min_sad = none_score;
@@ -997,47 +1282,206 @@ static bool rpng_save_image(const char *path, const uint8_t *data,
       }
 
       *encode_target++ = filter;
-      memcpy(encode_target, chosen_filtered, width * bpp);
+      memcpy(encode_target, chosen_filtered, line_size);
+      encode_target += line_size;
 
-      memcpy(prev_encoded, rgba_line, width * bpp);
+      memcpy(prev_encoded, rgba_line, line_size);
    }
 
-   deflate_buf = (uint8_t*)malloc(encode_buf_size * 2); // Just to be sure.
-   if (!deflate_buf)
-      GOTO_END_ERROR();
+end:
+   free(rgba_line);
+   free(prev_encoded);
+   free(up_filtered);
+   free(sub_filtered);
+   free(avg_filtered);
+   free(paeth_filtered);
+   return ret;
+}
 
-   stream.next_in   = encode_buf;
-   stream.avail_in  = encode_buf_size;
-   stream.next_out  = deflate_buf + 8;
-   stream.avail_out = encode_buf_size * 2;
+static bool rpng_deflate_block(const struct rpng_encode *enc, struct rpng_encode_block *block)
+{
+   bool ret = true;
+   bool last = block == &enc->blocks[enc->num_blocks - 1];
+   size_t offset = block->first_row * enc->line_size;
+   size_t size = block->rows * enc->line_size;
+   z_stream stream = {0};
+
+   if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+      return false;
 
-   deflateInit(&stream, 9);
-   if (deflate(&stream, Z_FINISH) != Z_STREAM_END)
+   if (offset)
    {
-      deflateEnd(&stream);
-      GOTO_END_ERROR();
+      size_t dict_size = offset < RPNG_DEFLATE_WINDOW ? offset : RPNG_DEFLATE_WINDOW;
+      if (deflateSetDictionary(&stream, enc->encode_buf + offset - dict_size, dict_size) != Z_OK)
+         GOTO_END_ERROR();
    }
+
+   // 2 bytes of zlib header in front, 4 bytes of Adler-32 and the sync flush marker at the end.
+   block->out_size = deflateBound(&stream, size) + 16;
+   if (!(block->out = (uint8_t*)malloc(block->out_size)))
+      GOTO_END_ERROR();
+
+   stream.next_in   = enc->encode_buf + offset;
+   stream.avail_in  = size;
+   stream.next_out  = block->out + 2;
+   stream.avail_out = block->out_size - 6;
+
+   if (deflate(&stream, last ? Z_FINISH : Z_SYNC_FLUSH) != (last ? Z_STREAM_END : Z_OK) ||
+         stream.avail_in)
+      GOTO_END_ERROR();
+
+   block->out_size = stream.total_out;
+   block->adler = adler32(adler32(0, NULL, 0), enc->encode_buf + offset, size);
+
+end:
    deflateEnd(&stream);
+   return ret;
+}
+
+static void rpng_filter_task(void *data, size_t index)
+{
+   struct rpng_encode *enc = (struct rpng_encode*)data;
+   struct rpng_encode_block *block = &enc->blocks[index];
+   block->ok = rpng_filter_block(enc, block);
+}
+
+static void rpng_deflate_task(void *data, size_t index)
+{
+   struct rpng_encode *enc = (struct rpng_encode*)data;
+   struct rpng_encode_block *block = &enc->blocks[index];
+   block->ok = block->ok && rpng_deflate_block(enc, block);
+}
 
-   memcpy(deflate_buf + 4, "IDAT", 4);
-   dword_write_be(deflate_buf + 0, stream.total_out);
-   if (!png_write_idat(file, deflate_buf, stream.total_out + 8))
+// Runs func on every block, in parallel if possible.
+static void rpng_encode_parallel(struct rpng_encode *enc,
+      void (*func)(void *data, size_t index))
+{
+#ifdef RPNG_THREADS
+   unsigned threads = rarch_get_cpu_cores();
+   if (threads > RPNG_ENCODE_MAX_THREADS)
+      threads = RPNG_ENCODE_MAX_THREADS;
+   sthread_parallel_for(enc->num_blocks, threads, func, enc);
+#else
+   unsigned i;
+   for (i = 0; i < enc->num_blocks; i++)
+      func(enc, i);
+#endif
+}
+
+static bool png_write_idat_block(FILE *file, const uint8_t *data, size_t size)
+{
+   uint8_t header[8];
+   dword_write_be(header, size);
+   memcpy(header + 4, "IDAT", 4);
+
+   uint32_t crc = crc32_update(crc32_calculate(header + 4, 4), data, size);
+   uint8_t crc_raw[4];
+   dword_write_be(crc_raw, crc);
+
+   return fwrite(header, 1, sizeof(header), file) == sizeof(header) &&
+      fwrite(data, 1, size, file) == size &&
+      fwrite(crc_raw, 1, sizeof(crc_raw), file) == sizeof(crc_raw);
+}
+
+static bool rpng_save_image(const char *path, const uint8_t *data,
+      unsigned width, unsigned height, unsigned pitch, unsigned bpp)
+{
+   unsigned i, rows_per_block;
+   bool ret = true;
+   struct png_ihdr ihdr = {0};
+   struct rpng_encode enc = {0};
+   uLong adler = adler32(0, NULL, 0);
+
+   FILE *file = fopen(path, "wb");
+   if (!file)
+      GOTO_END_ERROR();
+
+   if (fwrite(png_magic, 1, sizeof(png_magic), file) != sizeof(png_magic))
       GOTO_END_ERROR();
 
+   ihdr.width = width;
+   ihdr.height = height;
+   ihdr.depth = 8;
+   ihdr.color_type = bpp == sizeof(uint32_t) ? 6 : 2; // RGBA or RGB
+   if (!png_write_ihdr(file, &ihdr))
+      GOTO_END_ERROR();
+
+   enc.data = data;
+   enc.width = width;
+   enc.height = height;
+   enc.pitch = pitch;
+   enc.bpp = bpp;
+   enc.line_size = width * bpp + 1;
+
+   enc.num_blocks = (enc.line_size * height + RPNG_ENCODE_BLOCK_SIZE - 1) / RPNG_ENCODE_BLOCK_SIZE;
+   if (enc.num_blocks > RPNG_ENCODE_MAX_BLOCKS)
+      enc.num_blocks = RPNG_ENCODE_MAX_BLOCKS;
+   if (enc.num_blocks > height)
+      enc.num_blocks = height;
+   if (!enc.num_blocks)
+      enc.num_blocks = 1;
+   rows_per_block = (height + enc.num_blocks - 1) / enc.num_blocks;
+   enc.num_blocks = (height + rows_per_block - 1) / rows_per_block;
+
+   enc.encode_buf = (uint8_t*)malloc(enc.line_size * height);
+   enc.blocks = (struct rpng_encode_block*)calloc(enc.num_blocks, sizeof(*enc.blocks));
+   if (!enc.encode_buf || !enc.blocks)
+      GOTO_END_ERROR();
+
+   for (i = 0; i < enc.num_blocks; i++)
+   {
+      enc.blocks[i].first_row = i * rows_per_block;
+      enc.blocks[i].rows = height - enc.blocks[i].first_row < rows_per_block ?
+         height - enc.blocks[i].first_row : rows_per_block;
+   }
+
+   // Every block is filtered before any is deflated, as deflate looks back into the previous block.
+   rpng_encode_parallel(&enc, rpng_filter_task);
+   rpng_encode_parallel(&enc, rpng_deflate_task);
+
+   for (i = 0; i < enc.num_blocks; i++)
+   {
+      struct rpng_encode_block *block = &enc.blocks[i];
+      uint8_t *out = block->out + 2;
+      size_t out_size = block->out_size;
+
+      if (!block->ok)
+         GOTO_END_ERROR();
+
+      adler = adler32_combine(adler, block->adler, block->rows * enc.line_size);
+
+      if (i == 0)
+      {
+         // Default compression level, 32k window.
+         out -= 2;
+         out_size += 2;
+         out[0] = 0x78;
+         out[1] = 0x9c;
+      }
+
+      if (i == enc.num_blocks - 1)
+      {
+         dword_write_be(out + out_size, adler);
+         out_size += 4;
+      }
+
+      if (!png_write_idat_block(file, out, out_size))
+         GOTO_END_ERROR();
+   }
+
    if (!png_write_iend(file))
       GOTO_END_ERROR();
 
 end:
    if (file)
       fclose(file);
-   free(encode_buf);
-   free(deflate_buf);
-   free(rgba_line);
-   free(prev_encoded);
-   free(up_filtered);
-   free(sub_filtered);
-   free(avg_filtered);
-   free(paeth_filtered);
+   if (enc.blocks)
+   {
+      for (i = 0; i < enc.num_blocks; i++)
+         free(enc.blocks[i].out);
+   }
+   free(enc.blocks);
+   free(enc.encode_buf);
    return ret;
 }
 
@@ -58,27 +58,39 @@ bool gl_load_luts(const struct gfx_shader *generic_shader, GLuint *lut_textures)
    //  Original shader_glsl.c code only generated one texture handle.  I assume
    //  it was a bug, but if not, replace num_luts with 1 when GLSL is used.
    glGenTextures(num_luts, lut_textures);
+
+   // Decode all LUTs at once, only the uploads have to happen on the GL thread.
+   struct texture_image imgs[GFX_MAX_TEXTURES] = {{0}};
+   const char *paths[GFX_MAX_TEXTURES];
    for (i = 0; i < num_luts; i++)
    {
-      struct texture_image img = {0};
       RARCH_LOG("Loading texture image from: \"%s\" ...\n",
             generic_shader->lut[i].path);
+      paths[i] = generic_shader->lut[i].path;
+   }
+
+   texture_image_load_batch(imgs, paths, num_luts);
 
-      if (!texture_image_load(&img, generic_shader->lut[i].path))
+   bool ret = true;
+   for (i = 0; i < num_luts; i++)
+   {
+      if (!imgs[i].pixels)
       {
          RARCH_ERR("Failed to load texture image from: \"%s\"\n", generic_shader->lut[i].path);
-         return false;
+         ret = false;
+         continue;
       }
 
-      gl_load_texture_data(lut_textures[i], &img,
-            gl_wrap_type_to_enum(generic_shader->lut[i].wrap),
-            generic_shader->lut[i].filter != RARCH_FILTER_NEAREST,
-            generic_shader->lut[i].mipmap);
-      texture_image_free(&img);
+      if (ret)
+         gl_load_texture_data(lut_textures[i], &imgs[i],
+               gl_wrap_type_to_enum(generic_shader->lut[i].wrap),
+               generic_shader->lut[i].filter != RARCH_FILTER_NEAREST,
+               generic_shader->lut[i].mipmap);
+      texture_image_free(&imgs[i]);
    }
 
    glBindTexture(GL_TEXTURE_2D, 0);
-   return true;
+   return ret;
 }
 #endif // HAVE_OPENGL
 
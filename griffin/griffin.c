@@ -503,6 +503,7 @@ DYNAMIC
 FILE
 ============================================================ */
 #include "../file.c"
+#include "../state_writer.c"
 #include "../file_path.c"
 #include "../file_list.c"
 
@@ -597,12 +598,20 @@ SCREENSHOTS
 #include "../screenshot.c"
 #endif
 
+#ifdef HAVE_FRAME_EXPORT
+#include "../frame_export.c"
+#endif
+
 
 /*============================================================
 HISTORY
 ============================================================ */
 #include "../history.c"
 
+#ifndef RARCH_CONSOLE
+#include "../content_db.c"
+#endif
+
 /*============================================================
 MENU
 ============================================================ */
@@ -20,30 +20,52 @@
 #include <stddef.h>
 
 #include "msvc/msvc_compat.h"
+#include "boolean.h"
 #ifdef HAVE_CONFIG_H
 #include "config.h"
 #endif
 
+struct sha256_ctx
+{
+   union
+   {
+      uint8_t u8[64];
+      uint32_t u32[16];
+   } in;
+   unsigned inlen;
+
+   uint32_t h[8];
+   uint64_t len;
+};
+
+// Incremental interface, for data which isn't in memory all at once.
+// sha256_digest() finalizes the context and writes the 32-byte binary hash.
+void sha256_init(struct sha256_ctx *p);
+void sha256_update(struct sha256_ctx *p, const uint8_t *in, size_t size);
+void sha256_digest(struct sha256_ctx *p, uint8_t *out);
+
 // Hashes sha256 and outputs a human readable string for comparing with the cheat XML values.
 void sha256_hash(char *out, const uint8_t *in, size_t size);
 
-#ifdef HAVE_ZLIB
-#include <zlib.h>
+// CRC32 as used by zlib.
+uint32_t crc32_calculate(const uint8_t *data, size_t length);
+// Continues a CRC32 started with crc32_calculate() (or 0 for an empty prefix).
+uint32_t crc32_update(uint32_t crc, const uint8_t *data, size_t length);
+// Steps the raw (inverted) CRC register by one byte.
+uint32_t crc32_adjust(uint32_t crc, uint8_t data);
 
-static inline uint32_t crc32_calculate(const uint8_t *data, size_t length)
+struct hash_bench_result
 {
-   return crc32(0, data, length);
-}
+   const char *algorithm; // "crc32" or "sha256".
+   const char *path;      // Implementation, e.g. "slice8" or "pclmul".
+   bool selected;         // Picked by the runtime dispatch.
+   bool match;            // Same result as the portable implementation.
+   double gbps;           // 10^9 bytes per second.
+};
 
-static inline uint32_t crc32_adjust(uint32_t crc, uint8_t data)
-{
-   // zlib and nall have different assumptions on "sign" for this function.
-   return ~crc32(~crc, &data, 1);
-}
-#else
-uint32_t crc32_calculate(const uint8_t *data, size_t length);
-uint32_t crc32_adjust(uint32_t crc, uint8_t data);
-#endif
+// Times every CRC32 and SHA-256 implementation this CPU can run, over size bytes in memory.
+// Fills up to max results and returns how many were filled.
+size_t hash_benchmark(size_t size, struct hash_bench_result *results, size_t max);
 
 #endif
 
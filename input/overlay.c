@@ -22,6 +22,7 @@
 #include "../compat/posix_string.h"
 #include "input_common.h"
 #include "../file.h"
+#include "../performance.h"
 #include <stddef.h>
 #include <math.h>
 
@@ -103,6 +104,13 @@ struct input_overlay
 
    unsigned next_index;
    char *overlay_path;
+
+   // Images decoded up front while loading, taken by the overlays that use them.
+   // Each path is decoded once, preload_uses counts the overlays and descs still to take it.
+   struct texture_image *preload_images;
+   char **preload_paths;
+   unsigned *preload_uses;
+   size_t preload_size;
 };
 
 static void input_overlay_scale(struct overlay *overlay, float scale)
@@ -179,6 +187,125 @@ static void input_overlay_free_overlays(input_overlay_t *ol)
    free(ol->overlays);
 }
 
+static void input_overlay_preload_add(input_overlay_t *ol, config_file_t *conf, const char *key)
+{
+   size_t i;
+   char image_path[PATH_MAX];
+   char path[PATH_MAX];
+
+   if (!config_get_path(conf, key, image_path, sizeof(image_path)))
+      return;
+
+   fill_pathname_resolve_relative(path, ol->overlay_path, image_path, sizeof(path));
+   for (i = 0; i < ol->preload_size; i++)
+   {
+      if (strcmp(ol->preload_paths[i], path) == 0)
+      {
+         ol->preload_uses[i]++;
+         return;
+      }
+   }
+
+   ol->preload_paths[ol->preload_size] = strdup(path);
+   if (ol->preload_paths[ol->preload_size])
+      ol->preload_uses[ol->preload_size++] = 1;
+}
+
+// Overlay packs can have dozens of images, decode them all at once rather than one by one as they are parsed.
+static void input_overlay_preload_images(input_overlay_t *ol, config_file_t *conf)
+{
+   size_t i, j, images = 0;
+   char key[64];
+
+   for (i = 0; i < ol->size; i++)
+   {
+      unsigned descs = 0;
+      snprintf(key, sizeof(key), "overlay%u_descs", (unsigned)i);
+      config_get_uint(conf, key, &descs);
+      images += 1 + descs;
+   }
+
+   ol->preload_paths = (char**)calloc(images, sizeof(*ol->preload_paths));
+   ol->preload_uses = (unsigned*)calloc(images, sizeof(*ol->preload_uses));
+   if (!ol->preload_paths || !ol->preload_uses)
+      return;
+
+   for (i = 0; i < ol->size; i++)
+   {
+      unsigned descs = 0;
+      snprintf(key, sizeof(key), "overlay%u_overlay", (unsigned)i);
+      input_overlay_preload_add(ol, conf, key);
+
+      snprintf(key, sizeof(key), "overlay%u_descs", (unsigned)i);
+      config_get_uint(conf, key, &descs);
+      for (j = 0; j < descs; j++)
+      {
+         snprintf(key, sizeof(key), "overlay%u_desc%u_overlay", (unsigned)i, (unsigned)j);
+         input_overlay_preload_add(ol, conf, key);
+      }
+   }
+
+   ol->preload_images = (struct texture_image*)calloc(ol->preload_size, sizeof(*ol->preload_images));
+   if (!ol->preload_images)
+      return;
+
+   RARCH_PERFORMANCE_INIT(overlay_preload);
+   RARCH_PERFORMANCE_START(overlay_preload);
+   texture_image_load_batch(ol->preload_images, (const char * const *)ol->preload_paths, ol->preload_size);
+   RARCH_PERFORMANCE_STOP(overlay_preload);
+}
+
+static void input_overlay_free_preload(input_overlay_t *ol)
+{
+   size_t i;
+   for (i = 0; i < ol->preload_size; i++)
+   {
+      if (ol->preload_images)
+         texture_image_free(&ol->preload_images[i]);
+      free(ol->preload_paths[i]);
+   }
+
+   free(ol->preload_images);
+   free(ol->preload_paths);
+   free(ol->preload_uses);
+   ol->preload_images = NULL;
+   ol->preload_paths = NULL;
+   ol->preload_uses = NULL;
+   ol->preload_size = 0;
+}
+
+// Takes the preloaded image if there is one. Images used more than once are copied for every use but the last,
+// which takes the decoded image itself.
+static bool input_overlay_load_image(input_overlay_t *ol, struct texture_image *img, const char *path)
+{
+   size_t i;
+   for (i = 0; ol->preload_images && i < ol->preload_size; i++)
+   {
+      struct texture_image *preload = &ol->preload_images[i];
+      size_t size;
+
+      if (!preload->pixels || strcmp(ol->preload_paths[i], path))
+         continue;
+
+      if (--ol->preload_uses[i] == 0)
+      {
+         *img = *preload;
+         memset(preload, 0, sizeof(*preload));
+         return true;
+      }
+
+      size = preload->width * preload->height * sizeof(*preload->pixels);
+      if (!(img->pixels = (uint32_t*)malloc(size)))
+         return false;
+      memcpy(img->pixels, preload->pixels, size);
+      img->width = preload->width;
+      img->height = preload->height;
+      return true;
+   }
+
+   return texture_image_load(img, path);
+}
+
 static bool input_overlay_load_desc(input_overlay_t *ol, config_file_t *conf, struct overlay_desc *desc,
       unsigned ol_index, unsigned desc_index,
       unsigned width, unsigned height,
@@ -199,7 +326,7 @@ static bool input_overlay_load_desc(input_overlay_t *ol, config_file_t *conf, st
       fill_pathname_resolve_relative(path, ol->overlay_path, image_path, sizeof(path));
 
       struct texture_image img = {0};
-      if (texture_image_load(&img, path))
+      if (input_overlay_load_image(ol, &img, path))
          desc->image = img;
    }
 
@@ -352,7 +479,7 @@ static bool input_overlay_load_overlay(input_overlay_t *ol, config_file_t *conf,
       fill_pathname_resolve_relative(overlay_resolved_path, config_path,
             overlay_path, sizeof(overlay_resolved_path));
 
-      if (texture_image_load(&img, overlay_resolved_path))
+      if (input_overlay_load_image(ol, &img, overlay_resolved_path))
          overlay->image = img;
       else
       {
@@ -538,6 +665,8 @@ static bool input_overlay_load_overlays(input_overlay_t *ol, const char *path)
 
    ol->size = overlays;
 
+   input_overlay_preload_images(ol, conf);
+
    for (i = 0; i < ol->size; i++)
    {
       if (!input_overlay_load_overlay(ol, conf, path, &ol->overlays[i], i))
@@ -559,6 +688,7 @@ static bool input_overlay_load_overlays(input_overlay_t *ol, const char *path)
    }
 
 end:
+   input_overlay_free_preload(ol);
    config_file_free(conf);
    return ret;
 }
@@ -16,65 +16,194 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stddef.h>
+#include <stdint.h>
 #include "message_queue.h"
 #include "boolean.h"
-#include "compat/posix_string.h"
+#include "compat/strl.h"
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef HAVE_THREADS
+#include "thread.h"
+#endif
+
+// Messages are stored inline, longer ones are truncated.
+#define MSG_QUEUE_MSG_SIZE 512
+
+// Pushes go through a bounded MPSC ring (Vyukov's), so any thread can push.
+// Without atomics, pushes are serialized with a lock instead.
+#if defined(HAVE_THREADS) && defined(RARCH_ATOMICS)
+typedef ratomic_t inbox_seq_t;
+#define INBOX_LOAD(v) ratomic_load(&(v))
+#define INBOX_STORE(v, x) ratomic_store(&(v), (x))
+#define INBOX_CAS(v, e, d) ratomic_cas(&(v), (e), (d))
+#else
+#if defined(HAVE_THREADS)
+#define MSG_QUEUE_LOCKED
+#endif
+typedef uint32_t inbox_seq_t;
+#define INBOX_LOAD(v) (v)
+#define INBOX_STORE(v, x) ((v) = (x))
+#define INBOX_CAS(v, e, d) ((v) == (e) ? ((v) = (d), true) : false)
+#endif
 
 struct queue_elem
 {
    unsigned duration;
    unsigned prio;
-   char *msg;
+   char msg[MSG_QUEUE_MSG_SIZE];
+};
+
+struct inbox_cell
+{
+   inbox_seq_t seq; // Equals the write position when free, write position + 1 when filled.
+   struct queue_elem elem;
 };
 
 struct msg_queue
 {
+   // Max-heap on prio, 1-indexed.
    struct queue_elem **elems;
    size_t ptr;
    size_t size;
-   char *tmp_msg;
+
+   struct queue_elem **free_elems;
+   size_t free_count;
+   struct queue_elem *expired; // Returned by the last pull, recycled on the next one.
+
+   struct inbox_cell *inbox;
+   uint32_t inbox_mask;
+   inbox_seq_t inbox_write;
+   uint32_t inbox_read; // Only touched by the pulling thread.
+#ifdef MSG_QUEUE_LOCKED
+   slock_t *inbox_lock;
+#endif
 };
 
+// Everything lives in one allocation, pushing and pulling never allocates.
 msg_queue_t *msg_queue_new(size_t size)
 {
-   msg_queue_t *queue = (msg_queue_t*)calloc(1, sizeof(*queue));
-   if (!queue)
+   size_t i, inbox_size = 4;
+   struct queue_elem *elem_arena;
+   msg_queue_t *queue;
+   uint8_t *arena;
+
+   while (inbox_size < 2 * size)
+      inbox_size <<= 1;
+
+   arena = (uint8_t*)calloc(1, sizeof(*queue) +
+         2 * (size + 1) * sizeof(struct queue_elem*) +
+         (size + 1) * sizeof(struct queue_elem) +
+         inbox_size * sizeof(struct inbox_cell));
+   if (!arena)
       return NULL;
 
-   queue->size = size + 1;
-   queue->elems = (struct queue_elem**)calloc(queue->size, sizeof(struct queue_elem*)); 
+   queue = (msg_queue_t*)arena;
+   arena += sizeof(*queue);
+   queue->elems = (struct queue_elem**)arena;
+   arena += (size + 1) * sizeof(struct queue_elem*);
+   queue->free_elems = (struct queue_elem**)arena;
+   arena += (size + 1) * sizeof(struct queue_elem*);
+   elem_arena = (struct queue_elem*)arena;
+   arena += (size + 1) * sizeof(struct queue_elem);
+   queue->inbox = (struct inbox_cell*)arena;
 
-   if (!queue->elems)
+#ifdef MSG_QUEUE_LOCKED
+   if (!(queue->inbox_lock = slock_new()))
    {
       free(queue);
       return NULL;
    }
+#endif
+
+   // One element more than the heap holds, for the expired one.
+   for (i = 0; i <= size; i++)
+      queue->free_elems[i] = &elem_arena[i];
+   queue->free_count = size + 1;
+
+   for (i = 0; i < inbox_size; i++)
+      queue->inbox[i].seq = i;
+   queue->inbox_mask = inbox_size - 1;
+
+   queue->size = size + 1;
    queue->ptr = 1;
    return queue;
 }
 
 void msg_queue_free(msg_queue_t *queue)
 {
-   if (queue)
-   {
-      msg_queue_clear(queue);
-      free(queue->elems);
-   }
+   if (!queue)
+      return;
+
+#ifdef MSG_QUEUE_LOCKED
+   slock_free(queue->inbox_lock);
+#endif
    free(queue);
 }
 
 void msg_queue_push(msg_queue_t *queue, const char *msg, unsigned prio, unsigned duration)
 {
-   if (!queue || queue->ptr >= queue->size)
+   struct inbox_cell *cell = NULL;
+   uint32_t pos;
+
+   if (!queue)
+      return;
+
+#ifdef MSG_QUEUE_LOCKED
+   slock_lock(queue->inbox_lock);
+#endif
+
+   pos = INBOX_LOAD(queue->inbox_write);
+   for (;;)
+   {
+      int32_t diff;
+      cell = &queue->inbox[pos & queue->inbox_mask];
+      diff = (int32_t)(INBOX_LOAD(cell->seq) - pos);
+
+      if (diff == 0)
+      {
+         if (INBOX_CAS(queue->inbox_write, pos, pos + 1))
+            break;
+      }
+      else if (diff < 0) // Full, drop the message.
+      {
+         cell = NULL;
+         break;
+      }
+
+      pos = INBOX_LOAD(queue->inbox_write);
+   }
+
+   if (cell)
+   {
+      cell->elem.prio = prio;
+      cell->elem.duration = duration;
+      strlcpy(cell->elem.msg, msg ? msg : "", sizeof(cell->elem.msg));
+      INBOX_STORE(cell->seq, pos + 1);
+   }
+
+#ifdef MSG_QUEUE_LOCKED
+   slock_unlock(queue->inbox_lock);
+#endif
+}
+
+static void msg_queue_insert(msg_queue_t *queue, const struct queue_elem *elem)
+{
+   struct queue_elem *new_elem;
+   size_t tmp_ptr;
+
+   if (queue->ptr >= queue->size || !queue->free_count)
       return;
 
-   struct queue_elem *new_elem = (struct queue_elem*)calloc(1, sizeof(struct queue_elem));
-   new_elem->prio = prio;
-   new_elem->duration = duration;
-   new_elem->msg = msg ? strdup(msg) : NULL;
+   new_elem = queue->free_elems[--queue->free_count];
+   new_elem->prio = elem->prio;
+   new_elem->duration = elem->duration;
+   strlcpy(new_elem->msg, elem->msg, sizeof(new_elem->msg));
 
    queue->elems[queue->ptr] = new_elem;
-   size_t tmp_ptr = queue->ptr++;
+   tmp_ptr = queue->ptr++;
 
    while (tmp_ptr > 1)
    {
@@ -92,74 +221,97 @@ void msg_queue_push(msg_queue_t *queue, const char *msg, unsigned prio, unsigned
    }
 }
 
+// Moves pushed messages into the heap, or throws them away.
+static void msg_queue_drain(msg_queue_t *queue, bool discard)
+{
+   for (;;)
+   {
+      struct inbox_cell *cell = &queue->inbox[queue->inbox_read & queue->inbox_mask];
+      if ((int32_t)(INBOX_LOAD(cell->seq) - (queue->inbox_read + 1)) < 0)
+         break;
+
+      if (!discard)
+         msg_queue_insert(queue, &cell->elem);
+
+      INBOX_STORE(cell->seq, queue->inbox_read + queue->inbox_mask + 1);
+      queue->inbox_read++;
+   }
+}
+
+static void msg_queue_recycle(msg_queue_t *queue)
+{
+   if (queue->expired)
+   {
+      queue->free_elems[queue->free_count++] = queue->expired;
+      queue->expired = NULL;
+   }
+}
+
 void msg_queue_clear(msg_queue_t *queue)
 {
    if (!queue)
       return;
 
    size_t i;
+   msg_queue_drain(queue, true);
+   msg_queue_recycle(queue);
+
    for (i = 1; i < queue->ptr; i++)
-   {
-      if (queue->elems[i])
-      {
-         free(queue->elems[i]->msg);
-         free(queue->elems[i]);
-         queue->elems[i] = NULL;
-      }
-   }
+      queue->free_elems[queue->free_count++] = queue->elems[i];
    queue->ptr = 1;
-   free(queue->tmp_msg);
-   queue->tmp_msg = NULL;
 }
 
 const char *msg_queue_pull(msg_queue_t *queue)
 {
-   if (!queue || queue->ptr == 1) // Nothing in queue.
+   if (!queue)
+      return NULL;
+
+   msg_queue_recycle(queue);
+   msg_queue_drain(queue, false);
+
+   if (queue->ptr == 1) // Nothing in queue.
       return NULL;
 
    struct queue_elem *front = queue->elems[1];
-   front->duration--;
-   if (front->duration > 0)
-      return front->msg;
-   else
+   if (front->duration > 1)
    {
-      free(queue->tmp_msg);
-      queue->tmp_msg = front->msg;
-      front->msg = NULL;
+      front->duration--;
+      return *front->msg ? front->msg : NULL;
+   }
 
-      struct queue_elem *front = queue->elems[1];
-      struct queue_elem *last = queue->elems[--queue->ptr];
-      queue->elems[1] = last;
-      free(front);
+   // Keep the message around until the next pull.
+   queue->expired = front;
+   queue->elems[1] = queue->elems[--queue->ptr];
 
-      size_t tmp_ptr = 1;
-      for (;;)
-      {
-         bool left = (tmp_ptr * 2 <= queue->ptr) && (queue->elems[tmp_ptr] < queue->elems[tmp_ptr * 2]);
-         bool right = (tmp_ptr * 2 + 1 <= queue->ptr) && (queue->elems[tmp_ptr] < queue->elems[tmp_ptr * 2 + 1]);
+   size_t tmp_ptr = 1;
+   for (;;)
+   {
+      bool left = (tmp_ptr * 2 < queue->ptr) &&
+         (queue->elems[tmp_ptr]->prio < queue->elems[tmp_ptr * 2]->prio);
+      bool right = (tmp_ptr * 2 + 1 < queue->ptr) &&
+         (queue->elems[tmp_ptr]->prio < queue->elems[tmp_ptr * 2 + 1]->prio);
 
-         if (!left && !right)
-            break;
+      if (!left && !right)
+         break;
 
-         size_t switch_index = tmp_ptr;
-         if (left && !right)
+      size_t switch_index = tmp_ptr;
+      if (left && !right)
+         switch_index <<= 1;
+      else if (right && !left)
+         switch_index += switch_index + 1;
+      else
+      {
+         if (queue->elems[tmp_ptr * 2]->prio >= queue->elems[tmp_ptr * 2 + 1]->prio)
             switch_index <<= 1;
-         else if (right && !left)
-            switch_index += switch_index + 1;
          else
-         {
-            if (queue->elems[tmp_ptr * 2] >= queue->elems[tmp_ptr * 2 + 1])
-               switch_index <<= 1;
-            else
-               switch_index += switch_index + 1;
-         }
-         struct queue_elem *parent = queue->elems[tmp_ptr];
-         struct queue_elem *child = queue->elems[switch_index];
-         queue->elems[tmp_ptr] = child;
-         queue->elems[switch_index] = parent;
-         tmp_ptr = switch_index;
+            switch_index += switch_index + 1;
       }
-
-      return queue->tmp_msg;
+      struct queue_elem *parent = queue->elems[tmp_ptr];
+      struct queue_elem *child = queue->elems[switch_index];
+      queue->elems[tmp_ptr] = child;
+      queue->elems[switch_index] = parent;
+      tmp_ptr = switch_index;
    }
+
+   return *front->msg ? front->msg : NULL;
 }
@@ -30,6 +30,8 @@ msg_queue_t *msg_queue_new(size_t size);
 void msg_queue_push(msg_queue_t *queue, const char *msg, unsigned prio, unsigned duration);
 
 // Pulls highest prio message in queue. Returns NULL if no message in queue.
+// The message stays valid until the next pull or clear. Pull and clear must be called from one thread,
+// push is safe from any thread.
 const char *msg_queue_pull(msg_queue_t *queue);
 
 // Clear out everything in queue.
@@ -1,6 +1,6 @@
 /*  RetroArch - A frontend for libretro.
  *  Copyright (C) 2010-2014 - Hans-Kristian Arntzen
- * 
+ *
  *  RetroArch is free software: you can redistribute it and/or modify it under the terms
  *  of the GNU General Public License as published by the Free Software Found-
  *  ation, either version 3 of the License, or (at your option) any later version.
@@ -20,11 +20,31 @@
 #include <string.h>
 #include "general.h"
 #include "dynamic.h"
+#include "file_path.h"
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#ifdef HAVE_MMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#if defined(_WIN32)
+#include <io.h>
+#elif !defined(RARCH_CONSOLE)
+#include <unistd.h>
+#endif
 
 struct bsv_movie
 {
    FILE *file;
+   unsigned version;
 
+   // BSV1 playback.
    size_t *frame_pos; // A ring buffer keeping track of positions in the file for each frame.
    size_t frame_mask;
    size_t frame_ptr;
@@ -37,11 +57,58 @@ struct bsv_movie
    bool playback;
    bool first_rewind;
    bool did_rewind;
+
+   // BSV2
+   const uint8_t *data; // The whole movie for playback.
+   size_t data_size;
+   bool mapped;
+
+   uint64_t *index; // Offset of the first record of each frame.
+   size_t index_cap;
+   uint64_t frame_count;
+   uint64_t frame;
+   unsigned keyframe_interval;
+
+   const uint8_t *input; // Playback: unread inputs of the current frame.
+   size_t input_count;
+   bool warned_desync;
+
+   int16_t *frame_input; // Recording: inputs of the current frame.
+   size_t frame_input_count;
+   size_t frame_input_cap;
+
+   uint8_t *compressed;
+   size_t compressed_size;
 };
 
+static inline void bsv_write_le32(uint8_t *buf, uint32_t val)
+{
+   val = swap_if_big32(val);
+   memcpy(buf, &val, sizeof(val));
+}
+
+static inline uint32_t bsv_read_le32(const uint8_t *buf)
+{
+   uint32_t val;
+   memcpy(&val, buf, sizeof(val));
+   return swap_if_big32(val);
+}
+
+static inline void bsv_write_le64(uint8_t *buf, uint64_t val)
+{
+   bsv_write_le32(buf + 0, (uint32_t)val);
+   bsv_write_le32(buf + 4, (uint32_t)(val >> 32));
+}
+
+static inline uint64_t bsv_read_le64(const uint8_t *buf)
+{
+   return bsv_read_le32(buf) | ((uint64_t)bsv_read_le32(buf + 4) << 32);
+}
+
 static bool init_playback(bsv_movie_t *handle, const char *path)
 {
    handle->playback = true;
+   handle->version = 1;
    handle->file = fopen(path, "rb");
    if (!handle->file)
    {
@@ -92,58 +159,376 @@ static bool init_playback(bsv_movie_t *handle, const char *path)
    return true;
 }
 
-static bool init_record(bsv_movie_t *handle, const char *path)
+// Returns false if there is no complete record at pos.
+static bool bsv2_get_record(const bsv_movie_t *handle, uint64_t pos,
+      uint32_t *type, const uint8_t **payload, uint32_t *size)
 {
-   handle->file = fopen(path, "wb");
-   if (!handle->file)
+   if (pos > handle->data_size || handle->data_size - pos < BSV2_RECORD_HEADER_SIZE)
+      return false;
+
+   *type    = bsv_read_le32(handle->data + pos);
+   *size    = bsv_read_le32(handle->data + pos + 4);
+   *payload = handle->data + pos + BSV2_RECORD_HEADER_SIZE;
+   return *size <= handle->data_size - pos - BSV2_RECORD_HEADER_SIZE;
+}
+
+static bool bsv2_push_index(bsv_movie_t *handle, uint64_t frame, uint64_t pos)
+{
+   if (frame >= handle->index_cap)
    {
-      RARCH_ERR("Couldn't open BSV \"%s\" for recording.\n", path);
+      uint64_t *index;
+      size_t cap = handle->index_cap ? handle->index_cap : 4096;
+      while (cap <= frame)
+         cap *= 2;
+
+      if (!(index = (uint64_t*)realloc(handle->index, cap * sizeof(*index))))
+         return false;
+
+      handle->index = index;
+      handle->index_cap = cap;
+   }
+
+   handle->index[frame] = pos;
+   return true;
+}
+
+static bool bsv2_load_index(bsv_movie_t *handle, uint64_t index_offset)
+{
+   uint64_t i;
+   uint32_t type, size;
+   const uint8_t *payload;
+
+   if (!index_offset || !bsv2_get_record(handle, index_offset, &type, &payload, &size) ||
+         type != BSV2_RECORD_INDEX || size != handle->frame_count * sizeof(uint64_t))
       return false;
+
+   for (i = handle->frame_count; i > 0; i--)
+      if (!bsv2_push_index(handle, i - 1, bsv_read_le64(payload + (i - 1) * sizeof(uint64_t))))
+         return false;
+
+   return true;
+}
+
+// Movies which were not closed properly have no index. Frames end with their input record.
+static bool bsv2_scan_index(bsv_movie_t *handle)
+{
+   uint32_t type, size;
+   const uint8_t *payload;
+   uint64_t pos = BSV2_HEADER_SIZE;
+   uint64_t frame_start = pos;
+
+   handle->frame_count = 0;
+
+   while (bsv2_get_record(handle, pos, &type, &payload, &size) && type != BSV2_RECORD_INDEX)
+   {
+      pos += BSV2_RECORD_HEADER_SIZE + size;
+      if (type != BSV2_RECORD_INPUT)
+         continue;
+
+      if (!bsv2_push_index(handle, handle->frame_count++, frame_start))
+         return false;
+      frame_start = pos;
    }
 
-   uint32_t header[4] = {0};
+   RARCH_WARN("Movie has no index, rebuilt it from %llu frames.\n",
+         (unsigned long long)handle->frame_count);
+   return true;
+}
 
-   // This value is supposed to show up as BSV1 in a HEX editor, big-endian.
-   header[MAGIC_INDEX] = swap_if_little32(BSV_MAGIC);
+static bool bsv2_load_keyframe(bsv_movie_t *handle, const uint8_t *payload, uint32_t size)
+{
+   uint32_t state_size;
 
-   header[CRC_INDEX] = swap_if_big32(g_extern.cart_crc);
+   if (size < sizeof(uint32_t))
+      return false;
 
-   uint32_t state_size = pretro_serialize_size();
+   state_size = bsv_read_le32(payload);
+   payload += sizeof(uint32_t);
+   size    -= sizeof(uint32_t);
 
-   header[STATE_SIZE_INDEX] = swap_if_big32(state_size);
-   fwrite(header, 4, sizeof(uint32_t), handle->file);
+   if (state_size != handle->state_size || pretro_serialize_size() != state_size)
+   {
+      RARCH_WARN("Movie format seems to have a different serializer version. Will most likely fail.\n");
+      return false;
+   }
 
-   handle->min_file_pos = sizeof(header) + state_size;
-   handle->state_size = state_size;
+   // Keyframes are only stored compressed if that made them smaller.
+   if (size == state_size)
+      memcpy(handle->state, payload, state_size);
+   else
+   {
+#ifdef HAVE_ZLIB
+      uLongf out_size = state_size;
+      if (uncompress(handle->state, &out_size, payload, size) != Z_OK || out_size != state_size)
+      {
+         RARCH_ERR("Failed to inflate state in movie.\n");
+         return false;
+      }
+#else
+      RARCH_ERR("Movie states are compressed, but zlib support is not compiled in.\n");
+      return false;
+#endif
+   }
 
-   if (state_size)
+   return pretro_unserialize(handle->state, state_size);
+}
+
+// Points input at the input record of the current frame.
+static void bsv2_start_playback_frame(bsv_movie_t *handle)
+{
+   uint32_t type, size;
+   const uint8_t *payload;
+   uint64_t pos;
+
+   handle->input = NULL;
+   handle->input_count = 0;
+
+   if (handle->frame >= handle->frame_count)
+      return;
+
+   for (pos = handle->index[handle->frame];
+         bsv2_get_record(handle, pos, &type, &payload, &size);
+         pos += BSV2_RECORD_HEADER_SIZE + size)
    {
-      handle->state = (uint8_t*)malloc(state_size);
+      if (type == BSV2_RECORD_INPUT)
+      {
+         handle->input = payload;
+         handle->input_count = size / sizeof(int16_t);
+         return;
+      }
+   }
+}
+
+static bool init_playback_bsv2(bsv_movie_t *handle, const char *path)
+{
+   uint32_t type, size;
+   const uint8_t *payload;
+   const uint8_t *header;
+#ifdef HAVE_MMAP
+   int fd;
+   struct stat st;
+#else
+   long size_read;
+#endif
+
+   handle->playback = true;
+   handle->version = 2;
+
+#ifdef HAVE_MMAP
+   if ((fd = open(path, O_RDONLY)) < 0)
+   {
+      RARCH_ERR("Couldn't open BSV file \"%s\" for playback.\n", path);
+      return false;
+   }
+
+   if (fstat(fd, &st) < 0 || st.st_size < BSV2_HEADER_SIZE)
+   {
+      close(fd);
+      RARCH_ERR("Couldn't read movie header.\n");
+      return false;
+   }
+
+   handle->data = (const uint8_t*)mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+   close(fd);
+   if (handle->data == (const uint8_t*)MAP_FAILED)
+   {
+      handle->data = NULL;
+      RARCH_ERR("Couldn't map BSV file \"%s\".\n", path);
+      return false;
+   }
+   handle->data_size = st.st_size;
+   handle->mapped = true;
+#else
+   if ((size_read = read_file(path, (void**)&handle->data)) < BSV2_HEADER_SIZE)
+   {
+      RARCH_ERR("Couldn't read movie header.\n");
+      return false;
+   }
+   handle->data_size = size_read;
+#endif
+
+   header = handle->data;
+
+   if (bsv_read_le32(header + 8) != g_extern.cart_crc)
+      RARCH_WARN("CRC32 checksum mismatch between ROM file and saved ROM checksum in replay file header; replay highly likely to desync on playback.\n");
+
+   handle->state_size        = bsv_read_le32(header + 12);
+   handle->keyframe_interval = bsv_read_le32(header + 16);
+   handle->frame_count       = bsv_read_le64(header + 24);
+
+   if (!handle->keyframe_interval)
+      handle->keyframe_interval = 1;
+
+   if (!bsv2_load_index(handle, bsv_read_le64(header + 32)) && !bsv2_scan_index(handle))
+      return false;
+
+   if (handle->state_size && !(handle->state = (uint8_t*)malloc(handle->state_size)))
+      return false;
+
+   // Frame 0 always starts from the state the movie was recorded from.
+   if (handle->frame_count && bsv2_get_record(handle, handle->index[0], &type, &payload, &size) &&
+         type == BSV2_RECORD_STATE)
+      bsv2_load_keyframe(handle, payload, size);
+
+   bsv2_start_playback_frame(handle);
+   return true;
+}
+
+static bool bsv2_write_record(bsv_movie_t *handle, uint32_t type,
+      const void *prefix, size_t prefix_size, const void *data, size_t size)
+{
+   uint8_t header[BSV2_RECORD_HEADER_SIZE];
+   bsv_write_le32(header + 0, type);
+   bsv_write_le32(header + 4, prefix_size + size);
+
+   return fwrite(header, 1, sizeof(header), handle->file) == sizeof(header) &&
+      (!prefix_size || fwrite(prefix, 1, prefix_size, handle->file) == prefix_size) &&
+      (!size || fwrite(data, 1, size, handle->file) == size);
+}
+
+static bool bsv2_write_keyframe(bsv_movie_t *handle)
+{
+   uint8_t state_size[sizeof(uint32_t)];
+   bsv_write_le32(state_size, handle->state_size);
+
+   if (!pretro_serialize(handle->state, handle->state_size))
+      return false;
+
+#ifdef HAVE_ZLIB_DEFLATE
+   if (handle->compressed)
+   {
+      uLongf size = handle->compressed_size;
+      if (compress2(handle->compressed, &size, handle->state, handle->state_size, Z_BEST_SPEED) == Z_OK &&
+            size < handle->state_size)
+         return bsv2_write_record(handle, BSV2_RECORD_STATE,
+               state_size, sizeof(state_size), handle->compressed, size);
+   }
+#endif
+
+   return bsv2_write_record(handle, BSV2_RECORD_STATE,
+         state_size, sizeof(state_size), handle->state, handle->state_size);
+}
+
+static bool bsv2_write_header(bsv_movie_t *handle, uint64_t index_offset)
+{
+   uint8_t header[BSV2_HEADER_SIZE] = {0};
+
+   // Shows up as BSV2 in a HEX editor, like BSV1.
+   uint32_t magic = swap_if_little32(BSV2_MAGIC);
+   memcpy(header, &magic, sizeof(magic));
+   bsv_write_le32(header +  8, g_extern.cart_crc);
+   bsv_write_le32(header + 12, handle->state_size);
+   bsv_write_le32(header + 16, handle->keyframe_interval);
+   bsv_write_le64(header + 24, index_offset ? handle->frame_count : 0);
+   bsv_write_le64(header + 32, index_offset);
+
+   return fwrite(header, 1, sizeof(header), handle->file) == sizeof(header);
+}
+
+static bool init_record(bsv_movie_t *handle, const char *path)
+{
+   handle->version = 2;
+   handle->file = fopen(path, "wb");
+   if (!handle->file)
+   {
+      RARCH_ERR("Couldn't open BSV \"%s\" for recording.\n", path);
+      return false;
+   }
+
+   handle->state_size = pretro_serialize_size();
+   handle->keyframe_interval = g_settings.movie_keyframe_interval ? g_settings.movie_keyframe_interval : 1;
+
+   if (!bsv2_write_header(handle, 0))
+      return false;
+
+   if (handle->state_size)
+   {
+      handle->state = (uint8_t*)malloc(handle->state_size);
       if (!handle->state)
          return false;
 
-      pretro_serialize(handle->state, state_size);
-      fwrite(handle->state, 1, state_size, handle->file);
+#ifdef HAVE_ZLIB_DEFLATE
+      handle->compressed_size = compressBound(handle->state_size);
+      handle->compressed = (uint8_t*)malloc(handle->compressed_size);
+#endif
    }
 
    return true;
 }
 
+static void bsv2_finalize(bsv_movie_t *handle)
+{
+   uint64_t i;
+   uint8_t entry[sizeof(uint64_t)];
+   uint8_t header[BSV2_RECORD_HEADER_SIZE];
+   long index_offset = ftell(handle->file);
+   bool ret = index_offset > 0;
+
+   bsv_write_le32(header + 0, BSV2_RECORD_INDEX);
+   bsv_write_le32(header + 4, handle->frame_count * sizeof(uint64_t));
+   ret = ret && fwrite(header, 1, sizeof(header), handle->file) == sizeof(header);
+
+   for (i = 0; i < handle->frame_count && ret; i++)
+   {
+      bsv_write_le64(entry, handle->index[i]);
+      ret = fwrite(entry, 1, sizeof(entry), handle->file) == sizeof(entry);
+   }
+
+   ret = ret && fseek(handle->file, 0, SEEK_SET) == 0 && bsv2_write_header(handle, index_offset);
+
+   if (!ret)
+      RARCH_WARN("Failed to write movie index, it will be rebuilt on playback.\n");
+}
+
 void bsv_movie_free(bsv_movie_t *handle)
 {
    if (handle)
    {
       if (handle->file)
+      {
+         if (handle->version == 2 && !handle->playback)
+            bsv2_finalize(handle);
          fclose(handle->file);
+      }
+
+#ifdef HAVE_MMAP
+      if (handle->mapped)
+         munmap((void*)handle->data, handle->data_size);
+      else
+#endif
+         free((void*)handle->data);
+
       free(handle->state);
       free(handle->frame_pos);
+      free(handle->index);
+      free(handle->frame_input);
+      free(handle->compressed);
       free(handle);
    }
 }
 
 bool bsv_movie_get_input(bsv_movie_t *handle, int16_t *input)
 {
-   if (fread(input, sizeof(int16_t), 1, handle->file) != 1)
+   if (handle->version == 2)
+   {
+      if (handle->frame >= handle->frame_count)
+         return false;
+
+      if (!handle->input_count)
+      {
+         if (!handle->warned_desync)
+            RARCH_WARN("Core polled more input in frame %llu than was recorded. Replay will likely desync.\n",
+                  (unsigned long long)handle->frame);
+         handle->warned_desync = true;
+         *input = 0;
+         return true;
+      }
+
+      memcpy(input, handle->input, sizeof(*input));
+      handle->input += sizeof(*input);
+      handle->input_count--;
+   }
+   else if (fread(input, sizeof(int16_t), 1, handle->file) != 1)
       return false;
 
    *input = swap_if_big16(*input);
@@ -152,8 +537,18 @@ bool bsv_movie_get_input(bsv_movie_t *handle, int16_t *input)
 
 void bsv_movie_set_input(bsv_movie_t *handle, int16_t input)
 {
-   input = swap_if_big16(input);
-   fwrite(&input, sizeof(int16_t), 1, handle->file);
+   if (handle->frame_input_count >= handle->frame_input_cap)
+   {
+      size_t cap = handle->frame_input_cap ? handle->frame_input_cap * 2 : 256;
+      int16_t *frame_input = (int16_t*)realloc(handle->frame_input, cap * sizeof(*frame_input));
+      if (!frame_input)
+         return;
+
+      handle->frame_input = frame_input;
+      handle->frame_input_cap = cap;
+   }
+
+   handle->frame_input[handle->frame_input_count++] = swap_if_big16(input);
 }
 
 bsv_movie_t *bsv_movie_init(const char *path, enum rarch_movie_type type)
@@ -164,15 +559,35 @@ bsv_movie_t *bsv_movie_init(const char *path, enum rarch_movie_type type)
 
    if (type == RARCH_MOVIE_PLAYBACK)
    {
+      uint32_t magic = 0;
+      FILE *file = fopen(path, "rb");
+      if (file)
+      {
+         if (fread(&magic, sizeof(magic), 1, file) != 1)
+            magic = 0;
+         fclose(file);
+      }
+
+      if (swap_if_little32(magic) == BSV2_MAGIC)
+      {
+         if (!init_playback_bsv2(handle, path))
+            goto error;
+         return handle;
+      }
+
       if (!init_playback(handle, path))
          goto error;
    }
-   else if (!init_record(handle, path))
-      goto error;
+   else
+   {
+      if (!init_record(handle, path))
+         goto error;
+      return handle;
+   }
 
    // Just pick something really large :D ~1 million frames rewind should do the trick.
    if (!(handle->frame_pos = (size_t*)calloc((1 << 20), sizeof(size_t))))
-      goto error; 
+      goto error;
 
    handle->frame_pos[0] = handle->min_file_pos;
    handle->frame_mask = (1 << 20) - 1;
@@ -186,21 +601,83 @@ error:
 
 void bsv_movie_set_frame_start(bsv_movie_t *handle)
 {
-   handle->frame_pos[handle->frame_ptr] = ftell(handle->file);
+   if (handle->version == 1)
+      handle->frame_pos[handle->frame_ptr] = ftell(handle->file);
+   else if (handle->playback)
+      bsv2_start_playback_frame(handle);
+   else
+   {
+      long pos = ftell(handle->file);
+      handle->frame_input_count = 0;
+
+      if (pos < 0 || !bsv2_push_index(handle, handle->frame, pos))
+         return;
+
+      if (handle->state_size && handle->frame % handle->keyframe_interval == 0)
+         bsv2_write_keyframe(handle);
+   }
 }
 
 void bsv_movie_set_frame_end(bsv_movie_t *handle)
 {
-   handle->frame_ptr = (handle->frame_ptr + 1) & handle->frame_mask;
+   if (handle->version == 1)
+      handle->frame_ptr = (handle->frame_ptr + 1) & handle->frame_mask;
+   else
+   {
+      if (!handle->playback)
+      {
+         bsv2_write_record(handle, BSV2_RECORD_INPUT, NULL, 0,
+               handle->frame_input, handle->frame_input_count * sizeof(int16_t));
+         handle->frame_count = handle->frame + 1;
+      }
+      handle->frame++;
+   }
 
    handle->first_rewind = !handle->did_rewind;
    handle->did_rewind = false;
 }
 
+// Cuts the recording at pos. Otherwise, if recording is cut short after a rewind,
+// the index is rebuilt from new frames followed by the stale frames which were rewound past.
+static void bsv2_truncate(bsv_movie_t *handle, uint64_t pos)
+{
+   bool ret = fflush(handle->file) == 0;
+#if defined(_WIN32)
+   ret = ret && _chsize_s(_fileno(handle->file), pos) == 0;
+#elif !defined(RARCH_CONSOLE)
+   ret = ret && ftruncate(fileno(handle->file), pos) == 0;
+#endif
+   ret = ret && fseek(handle->file, pos, SEEK_SET) == 0;
+
+   if (!ret)
+      RARCH_WARN("Failed to truncate movie after rewind.\n");
+}
+
+static void bsv2_frame_rewind(bsv_movie_t *handle)
+{
+   // Same as BSV1, the first rewind replays the last frame.
+   uint64_t back = handle->first_rewind ? 1 : 2;
+   handle->frame = handle->frame > back ? handle->frame - back : 0;
+
+   // When recording, the frames we rewound past are simply recorded again.
+   // Frame 0 serializes the current state as the new starting point.
+   if (!handle->playback && handle->frame < handle->frame_count)
+   {
+      handle->frame_count = handle->frame;
+      bsv2_truncate(handle, handle->index[handle->frame]);
+   }
+}
+
 void bsv_movie_frame_rewind(bsv_movie_t *handle)
 {
    handle->did_rewind = true;
 
+   if (handle->version == 2)
+   {
+      bsv2_frame_rewind(handle);
+      return;
+   }
+
    // If we're at the beginning ... :)
    if ((handle->frame_ptr <= 1) && (handle->frame_pos[0] == handle->min_file_pos))
    {
@@ -218,16 +695,48 @@ void bsv_movie_frame_rewind(bsv_movie_t *handle)
 
    // We rewound past the beginning. :O
    if (ftell(handle->file) <= (long)handle->min_file_pos)
+      fseek(handle->file, handle->min_file_pos, SEEK_SET);
+}
+
+uint64_t bsv_movie_get_frame(bsv_movie_t *handle)
+{
+   return handle->version == 2 ? handle->frame : handle->frame_ptr;
+}
+
+uint64_t bsv_movie_frame_count(bsv_movie_t *handle)
+{
+   return handle->frame_count;
+}
+
+bool bsv_movie_seek(bsv_movie_t *handle, uint64_t frame)
+{
+   uint32_t type, size;
+   const uint8_t *payload;
+   uint64_t keyframe;
+
+   if (handle->version != 2 || !handle->playback || !handle->state_size || frame > handle->frame_count)
+      return false;
+
+   // A keyframe is missing if recording was rewound past it, then look further back.
+   keyframe = frame - frame % handle->keyframe_interval;
+   for (;;)
    {
-      // If recording, we simply reset the starting point. Nice and easy.
-      if (!handle->playback)
-      {
-         fseek(handle->file, 4 * sizeof(uint32_t), SEEK_SET);
-         pretro_serialize(handle->state, handle->state_size);
-         fwrite(handle->state, 1, handle->state_size, handle->file);
-      }
-      else
-         fseek(handle->file, handle->min_file_pos, SEEK_SET);
+      if (keyframe < handle->frame_count &&
+            bsv2_get_record(handle, handle->index[keyframe], &type, &payload, &size) &&
+            type == BSV2_RECORD_STATE)
+         break;
+
+      if (!keyframe)
+         return false;
+      keyframe -= handle->keyframe_interval;
    }
-}
 
+   if (!bsv2_load_keyframe(handle, payload, size))
+      return false;
+
+   handle->frame = keyframe;
+   handle->did_rewind = false;
+   handle->first_rewind = true;
+   bsv2_start_playback_frame(handle);
+   return true;
+}
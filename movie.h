@@ -27,6 +27,31 @@
 #define CRC_INDEX 2
 #define STATE_SIZE_INDEX 3
 
+// BSV2 is recorded, BSV1 can still be played back.
+// The magic is big endian like BSV1, everything else is little endian.
+//
+// Header:
+//    u32 magic, u32 reserved, u32 content CRC32, u32 state size,
+//    u32 keyframe interval, u32 reserved, u64 frame count, u64 index offset.
+// Frame count and index offset are 0 until recording is finished.
+//
+// Then follow records of u32 type, u32 payload size and the payload.
+// Each frame is an optional state record followed by an input record.
+// Every keyframe interval frames, the frame starts with a state record, so playback can seek.
+// State payloads are the u32 state size and the state, deflated if that is smaller.
+// Input payloads are every int16 input_state() returned during the frame.
+// The index record holds the u64 offset of the first record of every frame.
+#define BSV2_MAGIC 0x42535632
+#define BSV2_HEADER_SIZE 40
+#define BSV2_RECORD_HEADER_SIZE 8
+
+enum bsv2_record_type
+{
+   BSV2_RECORD_INPUT = 0,
+   BSV2_RECORD_STATE,
+   BSV2_RECORD_INDEX
+};
+
 typedef struct bsv_movie bsv_movie_t;
 
 enum rarch_movie_type
@@ -48,6 +73,16 @@ void bsv_movie_set_frame_start(bsv_movie_t *handle); // Debugging purposes.
 void bsv_movie_set_frame_end(bsv_movie_t *handle);
 void bsv_movie_frame_rewind(bsv_movie_t *handle);
 
+// Frame played back or recorded next, counting from 0.
+uint64_t bsv_movie_get_frame(bsv_movie_t *handle);
+// Number of frames in a BSV2 movie. 0 for BSV1.
+uint64_t bsv_movie_frame_count(bsv_movie_t *handle);
+
+// Restores the last keyframe at or before frame, and continues playback from there.
+// Run the core until bsv_movie_get_frame() reaches frame, at most one keyframe interval.
+// Only works for playback of BSV2 movies from cores that can serialize.
+bool bsv_movie_seek(bsv_movie_t *handle, uint64_t frame);
+
 void bsv_movie_free(bsv_movie_t *handle);
 
 #endif
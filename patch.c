@@ -15,6 +15,10 @@
 
 // BPS/UPS/IPS implementation from bSNES (nall::).
 // Modified for RetroArch.
+//
+// Patches are applied straight into a target buffer sized from the patch header.
+// Runs of copied data are memcpy()'d, and the checksums are computed on a worker thread
+// which trails behind the write position, so verifying is mostly free.
 
 #include "patch.h"
 #include "hash.h"
@@ -23,379 +27,589 @@
 #include <stdint.h>
 #include <string.h>
 
-enum bps_mode
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef HAVE_THREADS
+#include "thread.h"
+#endif
+
+// Target data is handed to the checksum thread in steps of this size.
+#define PATCH_VERIFY_STEP (1 << 20)
+
+struct patch_verify
 {
-   SOURCE_READ = 0,
-   TARGET_READ,
-   SOURCE_COPY,
-   TARGET_COPY
+   const uint8_t *source, *patch, *target;
+   size_t source_length, patch_length;
+
+   uint32_t source_checksum, patch_checksum, target_checksum;
+   size_t target_checksum_length; // Bytes of target covered by target_checksum.
+   size_t target_published; // Only touched by the patching thread.
+
+#ifdef HAVE_THREADS
+   sthread_t *thread;
+   slock_t *lock;
+   scond_t *cond;
+   size_t target_ready;
+   bool finished;
+#endif
 };
 
-struct bps_data
+#ifdef HAVE_THREADS
+static void patch_verify_thread(void *data)
 {
-   const uint8_t *modify_data, *source_data; 
-   uint8_t *target_data;
-   size_t modify_length, source_length, target_length;
-   size_t modify_offset, source_offset, target_offset;
-   uint32_t modify_checksum, source_checksum, target_checksum;
+   struct patch_verify *verify = (struct patch_verify*)data;
 
-   size_t source_relative_offset, target_relative_offset, output_offset;
-};
+   verify->source_checksum = crc32_calculate(verify->source, verify->source_length);
+   verify->patch_checksum = crc32_calculate(verify->patch, verify->patch_length);
+
+   for (;;)
+   {
+      size_t ready;
+      bool finished;
+
+      slock_lock(verify->lock);
+      while (verify->target_ready == verify->target_checksum_length && !verify->finished)
+         scond_wait(verify->cond, verify->lock);
+      ready = verify->target_ready;
+      finished = verify->finished;
+      slock_unlock(verify->lock);
+
+      if (ready > verify->target_checksum_length)
+      {
+         verify->target_checksum = crc32_update(verify->target_checksum,
+               verify->target + verify->target_checksum_length,
+               ready - verify->target_checksum_length);
+         verify->target_checksum_length = ready;
+      }
+      else if (finished)
+         break;
+   }
+}
+#endif
+
+// Checksums source, the patch (minus its own trailing checksum) and target as it is written.
+static void patch_verify_start(struct patch_verify *verify,
+      const uint8_t *source, size_t source_length,
+      const uint8_t *patch, size_t patch_length,
+      const uint8_t *target)
+{
+   memset(verify, 0, sizeof(*verify));
+   verify->source = source;
+   verify->source_length = source_length;
+   verify->patch = patch;
+   verify->patch_length = patch_length;
+   verify->target = target;
+
+#ifdef HAVE_THREADS
+   verify->lock = slock_new();
+   verify->cond = scond_new();
+   if (verify->lock && verify->cond)
+      verify->thread = sthread_create(patch_verify_thread, verify);
+#endif
+}
 
-static uint8_t bps_read(struct bps_data *bps)
+// Bytes of target below length are final.
+static void patch_verify_progress(struct patch_verify *verify, size_t length)
 {
-   uint8_t data = bps->modify_data[bps->modify_offset++];
-   bps->modify_checksum = crc32_adjust(bps->modify_checksum, data);
-   return data;
+#ifdef HAVE_THREADS
+   if (!verify->thread || length - verify->target_published < PATCH_VERIFY_STEP)
+      return;
+
+   verify->target_published = length;
+   slock_lock(verify->lock);
+   verify->target_ready = length;
+   scond_signal(verify->cond);
+   slock_unlock(verify->lock);
+#else
+   (void)verify;
+   (void)length;
+#endif
 }
 
-static uint64_t bps_decode(struct bps_data *bps)
+static void patch_verify_finish(struct patch_verify *verify, size_t target_length)
 {
-   uint64_t data = 0, shift = 1;
+#ifdef HAVE_THREADS
+   if (verify->thread)
+   {
+      slock_lock(verify->lock);
+      verify->target_ready = target_length;
+      verify->finished = true;
+      scond_signal(verify->cond);
+      slock_unlock(verify->lock);
+
+      sthread_join(verify->thread);
+   }
+   if (verify->cond)
+      scond_free(verify->cond);
+   if (verify->lock)
+      slock_free(verify->lock);
+
+   if (verify->thread)
+      return;
+#endif
+
+   verify->source_checksum = crc32_calculate(verify->source, verify->source_length);
+   verify->patch_checksum = crc32_calculate(verify->patch, verify->patch_length);
+   verify->target_checksum = crc32_calculate(verify->target, target_length);
+   verify->target_checksum_length = target_length;
+}
+
+// Variable length integer shared by BPS and UPS.
+static bool patch_decode(const uint8_t *data, size_t length, size_t *offset, uint64_t *value)
+{
+   uint64_t ret = 0, shift = 1;
 
    for (;;)
    {
-      uint8_t x = bps_read(bps);
-      data += (x & 0x7f) * shift;
+      uint8_t x;
+      if (*offset >= length || shift > (1ULL << 56))
+         return false;
+
+      x = data[(*offset)++];
+      ret += (x & 0x7f) * shift;
       if (x & 0x80)
          break;
       shift <<= 7;
-      data += shift;
+      ret += shift;
    }
 
-   return data;
+   *value = ret;
+   return true;
 }
 
-static void bps_write(struct bps_data *bps, uint8_t data)
+static uint32_t patch_read_checksum(const uint8_t *data)
 {
-   bps->target_data[bps->output_offset++] = data;
-   bps->target_checksum = crc32_adjust(bps->target_checksum, data);
+   return (uint32_t)data[0] | ((uint32_t)data[1] << 8) |
+      ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24);
 }
 
-patch_error_t bps_apply_patch(
-      const uint8_t *modify_data, size_t modify_length,
-      const uint8_t *source_data, size_t source_length,
-      uint8_t *target_data, size_t *target_length)
+enum bps_mode
+{
+   SOURCE_READ = 0,
+   TARGET_READ,
+   SOURCE_COPY,
+   TARGET_COPY
+};
+
+struct bps_header
+{
+   uint64_t source_size, target_size;
+   size_t offset; // Start of the first command.
+};
+
+static patch_error_t bps_read_header(const uint8_t *modify_data, size_t modify_length,
+      struct bps_header *header)
 {
-   size_t i;
+   uint64_t markup_size;
+
    if (modify_length < 19)
       return PATCH_PATCH_TOO_SMALL;
+   if (memcmp(modify_data, "BPS1", 4))
+      return PATCH_PATCH_INVALID_HEADER;
 
-   struct bps_data bps = {0};
-   bps.modify_data = modify_data;
-   bps.modify_length = modify_length;
-   bps.target_data = target_data;
-   bps.target_length = *target_length;
-   bps.source_data = source_data;
-   bps.source_length = source_length;
-   bps.modify_checksum = ~0;
-   bps.target_checksum = ~0;
-
-   if ((bps_read(&bps) != 'B') || (bps_read(&bps) != 'P') || (bps_read(&bps) != 'S') || (bps_read(&bps) != '1'))
+   header->offset = 4;
+   if (!patch_decode(modify_data, modify_length - 12, &header->offset, &header->source_size) ||
+         !patch_decode(modify_data, modify_length - 12, &header->offset, &header->target_size) ||
+         !patch_decode(modify_data, modify_length - 12, &header->offset, &markup_size) ||
+         markup_size > modify_length - 12 - header->offset ||
+         header->target_size > (size_t)-1)
       return PATCH_PATCH_INVALID_HEADER;
 
-   size_t modify_source_size = bps_decode(&bps);
-   size_t modify_target_size = bps_decode(&bps);
-   size_t modify_markup_size = bps_decode(&bps);
-   for (i = 0; i < modify_markup_size; i++)
-      bps_read(&bps);
+   header->offset += markup_size;
+   return PATCH_SUCCESS;
+}
+
+patch_error_t bps_target_size(
+      const uint8_t *modify_data, size_t modify_length,
+      size_t source_length, size_t *target_length)
+{
+   struct bps_header header;
+   patch_error_t err = bps_read_header(modify_data, modify_length, &header);
+   if (err != PATCH_SUCCESS)
+      return err;
+   if (header.source_size > source_length)
+      return PATCH_SOURCE_TOO_SMALL;
+
+   *target_length = header.target_size;
+   return PATCH_SUCCESS;
+}
 
-   if (modify_source_size > bps.source_length)
+patch_error_t bps_apply_patch(
+      const uint8_t *modify_data, size_t modify_length,
+      const uint8_t *source_data, size_t source_length,
+      uint8_t *target_data, size_t *target_length)
+{
+   struct bps_header header;
+   struct patch_verify verify;
+   size_t modify_offset, modify_end, target_size;
+   size_t output_offset = 0, source_offset = 0, target_offset = 0;
+   patch_error_t err = bps_read_header(modify_data, modify_length, &header);
+
+   if (err != PATCH_SUCCESS)
+      return err;
+   if (header.source_size > source_length)
       return PATCH_SOURCE_TOO_SMALL;
-   if (modify_target_size > bps.target_length)
+   if (header.target_size > *target_length)
       return PATCH_TARGET_TOO_SMALL;
 
-   while (bps.modify_offset < bps.modify_length - 12)
+   target_size = header.target_size;
+   modify_offset = header.offset;
+   modify_end = modify_length - 12;
+
+   patch_verify_start(&verify, source_data, source_length,
+         modify_data, modify_length - 4, target_data);
+
+   while (modify_offset < modify_end)
    {
-      size_t length = bps_decode(&bps);
-      unsigned mode = length & 3;
+      uint64_t length, offset;
+      unsigned mode;
+
+      if (!patch_decode(modify_data, modify_end, &modify_offset, &length))
+         goto invalid;
+      mode = length & 3;
       length = (length >> 2) + 1;
 
+      if (length > target_size - output_offset)
+         goto invalid;
+
       switch (mode)
       {
          case SOURCE_READ:
-            while (length--)
-               bps_write(&bps, bps.source_data[bps.output_offset]);
+            if (output_offset + length > source_length)
+               goto invalid;
+            memcpy(target_data + output_offset, source_data + output_offset, length);
             break;
 
          case TARGET_READ:
-            while (length--)
-               bps_write(&bps, bps_read(&bps));
+            if (length > modify_end - modify_offset)
+               goto invalid;
+            memcpy(target_data + output_offset, modify_data + modify_offset, length);
+            modify_offset += length;
             break;
 
          case SOURCE_COPY:
          case TARGET_COPY:
          {
-            int offset = bps_decode(&bps);
-            bool negative = offset & 1;
-            offset >>= 1;
-            if (negative)
-               offset = -offset;
+            size_t *copy_offset = mode == SOURCE_COPY ? &source_offset : &target_offset;
+            size_t copy_limit = mode == SOURCE_COPY ? source_length : output_offset;
+
+            if (!patch_decode(modify_data, modify_end, &modify_offset, &offset))
+               goto invalid;
+
+            if (offset & 1)
+            {
+               if ((offset >> 1) > *copy_offset)
+                  goto invalid;
+               *copy_offset -= offset >> 1;
+            }
+            else
+            {
+               if ((offset >> 1) >= copy_limit - *copy_offset)
+                  goto invalid;
+               *copy_offset += offset >> 1;
+            }
 
             if (mode == SOURCE_COPY)
             {
-               bps.source_offset += offset;
-               while (length--)
-                  bps_write(&bps, bps.source_data[bps.source_offset++]);
+               if (length > source_length - source_offset)
+                  goto invalid;
+               memcpy(target_data + output_offset, source_data + source_offset, length);
             }
+            else if (target_offset + length <= output_offset)
+               memcpy(target_data + output_offset, target_data + target_offset, length);
             else
             {
-               bps.target_offset += offset;
-               while (length--)
-                  bps_write(&bps, bps.target_data[bps.target_offset++]);
-               break;
+               // Overlapping copy, repeats the data written right before.
+               size_t i;
+               for (i = 0; i < length; i++)
+                  target_data[output_offset + i] = target_data[target_offset + i];
             }
+
+            *copy_offset += length;
             break;
          }
       }
-   }
-
-   uint32_t modify_source_checksum = 0, modify_target_checksum = 0, modify_modify_checksum = 0;
-   for (i = 0; i < 32; i += 8)
-      modify_source_checksum |= bps_read(&bps) << i;
-   for (i = 0; i < 32; i += 8)
-      modify_target_checksum |= bps_read(&bps) << i;
 
-   uint32_t checksum = ~bps.modify_checksum;
-   for (i = 0; i < 32; i += 8)
-      modify_modify_checksum |= bps_read(&bps) << i;
+      output_offset += length;
+      patch_verify_progress(&verify, output_offset);
+   }
 
-   bps.source_checksum = crc32_calculate(bps.source_data, bps.source_length);
-   bps.target_checksum = ~bps.target_checksum;
+   patch_verify_finish(&verify, output_offset);
 
-   if (bps.source_checksum != modify_source_checksum)
+   if (output_offset != target_size)
+      return PATCH_TARGET_INVALID;
+   if (verify.source_checksum != patch_read_checksum(modify_data + modify_end))
       return PATCH_SOURCE_CHECKSUM_INVALID;
-   if (bps.target_checksum != modify_target_checksum)
+   if (verify.target_checksum != patch_read_checksum(modify_data + modify_end + 4))
       return PATCH_TARGET_CHECKSUM_INVALID;
-   if (checksum != modify_modify_checksum)
+   if (verify.patch_checksum != patch_read_checksum(modify_data + modify_end + 8))
       return PATCH_PATCH_CHECKSUM_INVALID;
 
-   *target_length = modify_target_size;
-
+   *target_length = target_size;
    return PATCH_SUCCESS;
+
+invalid:
+   patch_verify_finish(&verify, output_offset);
+   return PATCH_PATCH_INVALID;
 }
 
-struct ups_data
+struct ups_header
 {
-   const uint8_t *patch_data, *source_data; 
-   uint8_t *target_data;
-   unsigned patch_length, source_length, target_length;
-   unsigned patch_offset, source_offset, target_offset;
-   unsigned patch_checksum, source_checksum, target_checksum;
+   uint64_t source_size, target_size;
+   size_t offset;
 };
 
-static uint8_t ups_patch_read(struct ups_data *data) 
+static patch_error_t ups_read_header(const uint8_t *patch_data, size_t patch_length,
+      struct ups_header *header)
 {
-   if (data->patch_offset < data->patch_length) 
-   {
-      uint8_t n = data->patch_data[data->patch_offset++];
-      data->patch_checksum = crc32_adjust(data->patch_checksum, n);
-      return n;
-   }
-   return 0x00;
-}
-
-static uint8_t ups_source_read(struct ups_data *data) 
-{
-   if (data->source_offset < data->source_length) 
-   {
-      uint8_t n = data->source_data[data->source_offset++];
-      data->source_checksum = crc32_adjust(data->source_checksum, n);
-      return n;
-   }
-   return 0x00;
-}
+   if (patch_length < 18 || memcmp(patch_data, "UPS1", 4))
+      return PATCH_PATCH_INVALID;
 
-static void ups_target_write(struct ups_data *data, uint8_t n) 
-{
-   if (data->target_offset < data->target_length) 
-   {
-      data->target_data[data->target_offset] = n;
-      data->target_checksum = crc32_adjust(data->target_checksum, n);
-   }
+   header->offset = 4;
+   if (!patch_decode(patch_data, patch_length - 12, &header->offset, &header->source_size) ||
+         !patch_decode(patch_data, patch_length - 12, &header->offset, &header->target_size))
+      return PATCH_PATCH_INVALID;
 
-   data->target_offset++;
+   return PATCH_SUCCESS;
 }
 
-static uint64_t ups_decode(struct ups_data *data) 
+patch_error_t ups_target_size(
+      const uint8_t *patch_data, size_t patch_length,
+      size_t source_length, size_t *target_length)
 {
-   uint64_t offset = 0, shift = 1;
-   while (true) 
-   {
-      uint8_t x = ups_patch_read(data);
-      offset += (x & 0x7f) * shift;
-      if (x & 0x80) 
-         break;
-      shift <<= 7;
-      offset += shift;
-   }
-   return offset;
+   struct ups_header header;
+   patch_error_t err = ups_read_header(patch_data, patch_length, &header);
+   if (err != PATCH_SUCCESS)
+      return err;
+
+   // UPS patches apply in both directions.
+   if (source_length == header.source_size)
+      *target_length = header.target_size;
+   else if (source_length == header.target_size)
+      *target_length = header.source_size;
+   else
+      return PATCH_SOURCE_INVALID;
+
+   return PATCH_SUCCESS;
 }
 
 patch_error_t ups_apply_patch(
-      const uint8_t *patchdata, size_t patchlength,
-      const uint8_t *sourcedata, size_t sourcelength,
-      uint8_t *targetdata, size_t *targetlength)
+      const uint8_t *patch_data, size_t patch_length,
+      const uint8_t *source_data, size_t source_length,
+      uint8_t *target_data, size_t *target_length)
 {
-   size_t i;
-   struct ups_data data = {0};
-   data.patch_data = patchdata;
-   data.source_data = sourcedata;
-   data.target_data = targetdata;
-   data.patch_length = patchlength;
-   data.source_length = sourcelength;
-   data.target_length = *targetlength;
-   data.patch_checksum = ~0;
-   data.source_checksum = ~0;
-   data.target_checksum = ~0;
-
-   if (data.patch_length < 18) 
-      return PATCH_PATCH_INVALID;
-   if (ups_patch_read(&data) != 'U') 
-      return PATCH_PATCH_INVALID;
-   if (ups_patch_read(&data) != 'P') 
-      return PATCH_PATCH_INVALID;
-   if (ups_patch_read(&data) != 'S') 
-      return PATCH_PATCH_INVALID;
-   if (ups_patch_read(&data) != '1') 
-      return PATCH_PATCH_INVALID;
+   struct ups_header header;
+   struct patch_verify verify;
+   uint32_t source_read_checksum, target_read_checksum;
+   size_t patch_offset, patch_end, target_size, copy_size;
+   size_t target_offset = 0;
+   patch_error_t err = ups_read_header(patch_data, patch_length, &header);
+
+   if (err != PATCH_SUCCESS)
+      return err;
+   if ((err = ups_target_size(patch_data, patch_length, source_length, &target_size)) != PATCH_SUCCESS)
+      return err;
+   if (*target_length < target_size)
+      return PATCH_TARGET_TOO_SMALL;
 
-   unsigned source_read_length = ups_decode(&data);
-   unsigned target_read_length = ups_decode(&data);
+   patch_offset = header.offset;
+   patch_end = patch_length - 12;
 
-   if (data.source_length != source_read_length && data.source_length != target_read_length) 
-      return PATCH_SOURCE_INVALID;
-   *targetlength = (data.source_length == source_read_length ? target_read_length : source_read_length);
-   if (data.target_length < *targetlength) 
-      return PATCH_TARGET_TOO_SMALL;
-   data.target_length = *targetlength;
+   // Target is source XOR the patch hunks, with source padded with zeroes.
+   copy_size = source_length < target_size ? source_length : target_size;
+   memcpy(target_data, source_data, copy_size);
+   memset(target_data + copy_size, 0, target_size - copy_size);
+
+   patch_verify_start(&verify, source_data, source_length,
+         patch_data, patch_length - 4, target_data);
 
-   while (data.patch_offset < data.patch_length - 12) 
+   while (patch_offset < patch_end)
    {
-      unsigned length = ups_decode(&data);
-      while (length--) 
-         ups_target_write(&data, ups_source_read(&data));
-      while (true) 
+      uint64_t length;
+      if (!patch_decode(patch_data, patch_end, &patch_offset, &length) ||
+            length > (size_t)-1 - target_offset)
+         goto invalid;
+
+      target_offset += length;
+
+      for (;;)
       {
-         uint8_t patch_xor = ups_patch_read(&data);
-         ups_target_write(&data, patch_xor ^ ups_source_read(&data));
-         if (patch_xor == 0) break;
-      }
-   }
+         uint8_t patch_xor;
+         if (patch_offset >= patch_end)
+            goto invalid;
 
-   while (data.source_offset < data.source_length) 
-      ups_target_write(&data, ups_source_read(&data));
-   while (data.target_offset < data.target_length) 
-      ups_target_write(&data, ups_source_read(&data));
+         patch_xor = patch_data[patch_offset++];
+         if (target_offset < target_size)
+            target_data[target_offset] ^= patch_xor;
+         target_offset++;
 
-   uint32_t patch_read_checksum = 0, source_read_checksum = 0, target_read_checksum = 0;
-   for (i = 0; i < 4; i++) 
-      source_read_checksum |= ups_patch_read(&data) << (i * 8);
-   for (i = 0; i < 4; i++) 
-      target_read_checksum |= ups_patch_read(&data) << (i * 8);
+         if (patch_xor == 0)
+            break;
+      }
 
-   uint32_t patch_result_checksum = ~data.patch_checksum;
-   data.source_checksum = ~data.source_checksum;
-   data.target_checksum = ~data.target_checksum;
+      patch_verify_progress(&verify, target_offset < target_size ? target_offset : target_size);
+   }
 
-   for (i = 0; i < 4; i++) 
-      patch_read_checksum |= ups_patch_read(&data) << (i * 8);
+   patch_verify_finish(&verify, target_size);
 
-   if (patch_result_checksum != patch_read_checksum) 
+   source_read_checksum = patch_read_checksum(patch_data + patch_end);
+   target_read_checksum = patch_read_checksum(patch_data + patch_end + 4);
+
+   if (verify.patch_checksum != patch_read_checksum(patch_data + patch_end + 8))
       return PATCH_PATCH_INVALID;
 
-   if (data.source_checksum == source_read_checksum && data.source_length == source_read_length) 
+   if (verify.source_checksum == source_read_checksum && source_length == header.source_size)
    {
-      if (data.target_checksum == target_read_checksum && data.target_length == target_read_length) 
-         return PATCH_SUCCESS;
-      return PATCH_TARGET_INVALID;
-   } 
-   else if (data.source_checksum == target_read_checksum && data.source_length == target_read_length) 
+      if (verify.target_checksum != target_read_checksum || target_size != header.target_size)
+         return PATCH_TARGET_INVALID;
+   }
+   else if (verify.source_checksum == target_read_checksum && source_length == header.target_size)
    {
-      if (data.target_checksum == source_read_checksum && data.target_length == source_read_length) 
-         return PATCH_SUCCESS;
-      return PATCH_TARGET_INVALID;
-   } 
+      if (verify.target_checksum != source_read_checksum || target_size != header.source_size)
+         return PATCH_TARGET_INVALID;
+   }
    else
       return PATCH_SOURCE_INVALID;
+
+   *target_length = target_size;
+   return PATCH_SUCCESS;
+
+invalid:
+   patch_verify_finish(&verify, target_size);
+   return PATCH_PATCH_INVALID;
 }
 
-patch_error_t ips_apply_patch(
-      const uint8_t *patchdata, size_t patchlen,
-      const uint8_t *sourcedata, size_t sourcelength,
-      uint8_t *targetdata, size_t *targetlength)
+struct ips_record
 {
-   if (patchlen < 8 ||
-         patchdata[0] != 'P' ||
-         patchdata[1] != 'A' ||
-         patchdata[2] != 'T' ||
-         patchdata[3] != 'C' ||
-         patchdata[4] != 'H')
-      return PATCH_PATCH_INVALID;
+   size_t address, length;
+   const uint8_t *data; // Single byte for RLE records.
+   bool rle;
+};
 
-   memcpy(targetdata, sourcedata, sourcelength);
+enum ips_state
+{
+   IPS_RECORD,
+   IPS_END,
+   IPS_INVALID
+};
 
-   uint32_t offset = 5;
-   *targetlength = sourcelength;
+// *truncate is set if the EOF marker is followed by a target size.
+static enum ips_state ips_next_record(const uint8_t *patch_data, size_t patch_length,
+      size_t *offset, struct ips_record *record, size_t *truncate)
+{
+   size_t pos = *offset;
 
-   for (;;)
-   {
-      if (offset > patchlen - 3)
-         break;
+   if (pos + 3 > patch_length)
+      return IPS_INVALID;
 
-      uint32_t address = patchdata[offset++] << 16;
-      address |= patchdata[offset++] << 8;
-      address |= patchdata[offset++] << 0;
+   record->address = (patch_data[pos] << 16) | (patch_data[pos + 1] << 8) | patch_data[pos + 2];
+   pos += 3;
 
-      if (address == 0x454f46) // EOF
+   if (record->address == 0x454f46) // EOF
+   {
+      if (pos == patch_length)
+         return IPS_END;
+      else if (pos + 3 == patch_length)
       {
-         if (offset == patchlen)
-            return PATCH_SUCCESS;
-         else if (offset == patchlen - 3)
-         {
-            uint32_t size = patchdata[offset++] << 16;
-            size |= patchdata[offset++] << 8;
-            size |= patchdata[offset++] << 0;
-            *targetlength = size;
-            return PATCH_SUCCESS;
-         }
+         *truncate = (patch_data[pos] << 16) | (patch_data[pos + 1] << 8) | patch_data[pos + 2];
+         return IPS_END;
       }
+   }
 
-      if (offset > patchlen - 2)
-         break;
+   if (pos + 2 > patch_length)
+      return IPS_INVALID;
 
-      unsigned length = patchdata[offset++] << 8;
-      length |= patchdata[offset++] << 0;
+   record->length = (patch_data[pos] << 8) | patch_data[pos + 1];
+   pos += 2;
 
-      if (length) // Copy
-      {
-         if (offset > patchlen - length)
-            break;
+   if (record->length) // Copy
+   {
+      if (record->length > patch_length - pos)
+         return IPS_INVALID;
+      record->rle = false;
+      record->data = patch_data + pos;
+      pos += record->length;
+   }
+   else // RLE
+   {
+      if (pos + 3 > patch_length)
+         return IPS_INVALID;
+      record->length = (patch_data[pos] << 8) | patch_data[pos + 1];
+      if (record->length == 0) // Illegal
+         return IPS_INVALID;
+      record->rle = true;
+      record->data = patch_data + pos + 2;
+      pos += 3;
+   }
 
-         while (length--)
-            targetdata[address++] = patchdata[offset++];
-      }
-      else // RLE
-      {
-         if (offset > patchlen - 3)
-            break;
+   *offset = pos;
+   return IPS_RECORD;
+}
 
-         length  = patchdata[offset++] << 8;
-         length |= patchdata[offset++] << 0;
+patch_error_t ips_target_size(
+      const uint8_t *patch_data, size_t patch_length,
+      size_t source_length, size_t *target_length)
+{
+   struct ips_record record;
+   size_t offset = 5, size = source_length, truncate = (size_t)-1;
+
+   if (patch_length < 8 || memcmp(patch_data, "PATCH", 5))
+      return PATCH_PATCH_INVALID;
 
-         if (length == 0) // Illegal
+   for (;;)
+   {
+      switch (ips_next_record(patch_data, patch_length, &offset, &record, &truncate))
+      {
+         case IPS_RECORD:
+            if (record.address + record.length > size)
+               size = record.address + record.length;
             break;
 
-         while (length--)
-            targetdata[address++] = patchdata[offset];
+         case IPS_END:
+            *target_length = truncate != (size_t)-1 ? truncate : size;
+            return PATCH_SUCCESS;
 
-         offset++;
+         default:
+            return PATCH_PATCH_INVALID;
       }
+   }
+}
 
-      if (address > *targetlength)
-         *targetlength = address;
+patch_error_t ips_apply_patch(
+      const uint8_t *patch_data, size_t patch_length,
+      const uint8_t *source_data, size_t source_length,
+      uint8_t *target_data, size_t *target_length)
+{
+   struct ips_record record;
+   size_t offset = 5, truncate = (size_t)-1, target_size, copy_size;
+   patch_error_t err = ips_target_size(patch_data, patch_length, source_length, &target_size);
+
+   if (err != PATCH_SUCCESS)
+      return err;
+   if (*target_length < target_size)
+      return PATCH_TARGET_TOO_SMALL;
+
+   copy_size = source_length < target_size ? source_length : target_size;
+   if (target_data != source_data)
+      memcpy(target_data, source_data, copy_size);
+   memset(target_data + copy_size, 0, target_size - copy_size);
+
+   // The patch was validated above, so records are all well-formed.
+   while (ips_next_record(patch_data, patch_length, &offset, &record, &truncate) == IPS_RECORD)
+   {
+      if (record.address >= target_size)
+         continue;
+      if (record.length > target_size - record.address)
+         record.length = target_size - record.address;
+
+      if (record.rle)
+         memset(target_data + record.address, *record.data, record.length);
+      else
+         memcpy(target_data + record.address, record.data, record.length);
    }
 
-   return PATCH_PATCH_INVALID;
+   *target_length = target_size;
+   return PATCH_SUCCESS;
 }
-
@@ -38,7 +38,22 @@ typedef enum
    PATCH_PATCH_CHECKSUM_INVALID
 } patch_error_t;
 
+// target_length holds the size of target_data on input, and the patched size on success.
 typedef patch_error_t (*patch_func_t)(const uint8_t*, size_t, const uint8_t*, size_t, uint8_t*, size_t*);
+// Size of the patched data, so the target can be allocated exactly before applying.
+typedef patch_error_t (*patch_size_func_t)(const uint8_t*, size_t, size_t, size_t*);
+
+patch_error_t bps_target_size(
+      const uint8_t *patch_data, size_t patch_length,
+      size_t source_length, size_t *target_length);
+
+patch_error_t ups_target_size(
+      const uint8_t *patch_data, size_t patch_length,
+      size_t source_length, size_t *target_length);
+
+patch_error_t ips_target_size(
+      const uint8_t *patch_data, size_t patch_length,
+      size_t source_length, size_t *target_length);
 
 patch_error_t bps_apply_patch(
       const uint8_t *patch_data, size_t patch_length,
@@ -50,7 +65,7 @@ patch_error_t ups_apply_patch(
       const uint8_t *source_data, size_t source_length,
       uint8_t *target_data, size_t *target_length);
 
-
+// IPS can patch in place, target_data may be the same buffer as source_data.
 patch_error_t ips_apply_patch(
       const uint8_t *patch_data, size_t patch_length,
       const uint8_t *source_data, size_t source_length,
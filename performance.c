@@ -15,6 +15,7 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include "libretro.h"
 #include "performance.h"
 #include "general.h"
@@ -72,53 +73,512 @@
 #include <emscripten.h>
 #endif
 
+#if defined(__aarch64__) && defined(__linux__)
+#include <sys/auxv.h>
+#endif
+
 #if defined(BSD) || defined(__APPLE__)
 #include <sys/sysctl.h>
 #endif
 
 #include <string.h>
 
+#ifdef HAVE_THREADS
+#include "thread.h"
+#endif
+
+#if defined(HAVE_THREADS) && defined(__GNUC__) && !defined(RARCH_CONSOLE) && !defined(__APPLE__)
+#define PERF_TLS __thread
+#elif defined(HAVE_THREADS) && defined(_MSC_VER) && !defined(_XBOX)
+#define PERF_TLS __declspec(thread)
+#else
+// No thread-local storage. All threads share one block, like the old counters did.
+#define PERF_TLS
+#endif
+
+#define PERF_MAX_ENTRIES (2 * MAX_COUNTERS)
+#define PERF_HASH_SIZE (4 * PERF_MAX_ENTRIES)
+#define PERF_MAX_DEPTH 32
+#define PERF_IDENT_SIZE 64
+
 const struct retro_perf_counter *perf_counters_rarch[MAX_COUNTERS];
 const struct retro_perf_counter *perf_counters_libretro[MAX_COUNTERS];
 unsigned perf_ptr_rarch;
 unsigned perf_ptr_libretro;
 
+// Registry indices. RetroArch counters live in [0, MAX_COUNTERS),
+// libretro counters in [MAX_COUNTERS, PERF_MAX_ENTRIES).
+struct perf_entry
+{
+   char ident[PERF_IDENT_SIZE]; // Copied, core idents go away with the core.
+   int parent;
+};
+
+struct perf_slot
+{
+   retro_perf_tick_t total;
+   retro_perf_tick_t call_cnt;
+   retro_perf_tick_t min;
+   retro_perf_tick_t max;
+   retro_perf_tick_t hist[RARCH_PERF_HIST_BUCKETS];
+   int parent;
+   enum rarch_perf_unit unit;
+};
+
+struct perf_trace_event
+{
+   uint16_t id;
+   retro_perf_tick_t start;
+   retro_perf_tick_t duration;
+};
+
+// Per-thread accumulation. Only the owning thread writes, readers merge all blocks.
+struct perf_thread
+{
+   struct perf_thread *next;
+   unsigned tid;
+   unsigned generation;
+
+   struct
+   {
+      int id;
+      retro_perf_tick_t start;
+   } stack[PERF_MAX_DEPTH];
+   unsigned depth;
+
+   struct perf_trace_event *trace;
+   unsigned trace_ptr;
+   unsigned trace_dropped;
+
+   struct perf_slot slots[PERF_MAX_ENTRIES];
+};
+
+static struct perf_entry perf_entries[PERF_MAX_ENTRIES];
+static struct
+{
+   const struct retro_perf_counter *key;
+   int id;
+} perf_hash[PERF_HASH_SIZE];
+
+static struct perf_thread *perf_threads;
+static unsigned perf_thread_count;
+static unsigned perf_generation = 1;
+static bool perf_trace_enable;
+static unsigned perf_frames;
+
+static PERF_TLS struct perf_thread *perf_thread_self;
+// Kept outside the block so a stale block is never dereferenced after deinit.
+static PERF_TLS unsigned perf_thread_gen;
+
+#ifdef HAVE_THREADS
+static slock_t *perf_lock;
+#endif
+
+static inline void perf_registry_lock(void)
+{
+#ifdef HAVE_THREADS
+   if (perf_lock)
+      slock_lock(perf_lock);
+#endif
+}
+
+static inline void perf_registry_unlock(void)
+{
+#ifdef HAVE_THREADS
+   if (perf_lock)
+      slock_unlock(perf_lock);
+#endif
+}
+
+static inline unsigned perf_hash_ptr(const struct retro_perf_counter *perf)
+{
+   uintptr_t v = (uintptr_t)perf;
+   v ^= v >> 16;
+   v *= 0x45d9f3bu;
+   v ^= v >> 16;
+   return (unsigned)(v % PERF_HASH_SIZE);
+}
+
+static int perf_lookup(const struct retro_perf_counter *perf)
+{
+   unsigned i, h = perf_hash_ptr(perf);
+   for (i = 0; i < PERF_HASH_SIZE; i++, h = (h + 1) % PERF_HASH_SIZE)
+   {
+      if (perf_hash[h].key == perf)
+         return perf_hash[h].id;
+      if (!perf_hash[h].key)
+         break;
+   }
+   return -1;
+}
+
+static void perf_hash_insert(const struct retro_perf_counter *perf, int id)
+{
+   unsigned h = perf_hash_ptr(perf);
+   while (perf_hash[h].key)
+      h = (h + 1) % PERF_HASH_SIZE;
+
+   // Publish id before key, lookups on other threads stop at the first NULL key.
+   perf_hash[h].id = id;
+#if defined(__GNUC__)
+   __sync_synchronize();
+#endif
+   perf_hash[h].key = perf;
+}
+
+static void perf_hash_rebuild(void)
+{
+   unsigned i;
+   memset(perf_hash, 0, sizeof(perf_hash));
+   for (i = 0; i < perf_ptr_rarch; i++)
+      perf_hash_insert(perf_counters_rarch[i], i);
+   for (i = 0; i < perf_ptr_libretro; i++)
+      if (perf_counters_libretro[i])
+         perf_hash_insert(perf_counters_libretro[i], MAX_COUNTERS + i);
+}
+
+static void perf_add_entry(struct retro_perf_counter *perf, int id)
+{
+   strlcpy(perf_entries[id].ident, perf->ident ? perf->ident : "(null)", sizeof(perf_entries[id].ident));
+   perf_entries[id].parent = -1;
+   perf_hash_insert(perf, id);
+   perf->registered = true;
+}
+
 void rarch_perf_register(struct retro_perf_counter *perf)
 {
-   if (!g_extern.perfcnt_enable || perf->registered || perf_ptr_rarch >= MAX_COUNTERS)
+   if (!g_extern.perfcnt_enable || perf->registered)
       return;
 
-   perf_counters_rarch[perf_ptr_rarch++] = perf;
-   perf->registered = true;
+   perf_registry_lock();
+   if (!perf->registered && perf_ptr_rarch < MAX_COUNTERS)
+   {
+      perf_add_entry(perf, perf_ptr_rarch);
+      perf_counters_rarch[perf_ptr_rarch++] = perf;
+   }
+   perf_registry_unlock();
+}
+
+// A counter of an unloaded core with the same ident, or -1.
+static int perf_find_retired(const char *ident)
+{
+   unsigned i;
+   char name[PERF_IDENT_SIZE];
+
+   strlcpy(name, ident ? ident : "(null)", sizeof(name));
+   for (i = 0; i < perf_ptr_libretro; i++)
+   {
+      if (!perf_counters_libretro[i] && strcmp(perf_entries[MAX_COUNTERS + i].ident, name) == 0)
+         return i;
+   }
+   return -1;
 }
 
 void retro_perf_register(struct retro_perf_counter *perf)
 {
-   if (perf->registered || perf_ptr_libretro >= MAX_COUNTERS)
+   int i;
+
+   if (perf->registered)
       return;
 
-   perf_counters_libretro[perf_ptr_libretro++] = perf;
-   perf->registered = true;
+   perf_registry_lock();
+   if (!perf->registered)
+   {
+      // Reloading a core continues its old counters.
+      if ((i = perf_find_retired(perf->ident)) >= 0)
+      {
+         perf_hash_insert(perf, MAX_COUNTERS + i);
+         perf->registered = true;
+         perf_counters_libretro[i] = perf;
+      }
+      else if (perf_ptr_libretro < MAX_COUNTERS)
+      {
+         perf_add_entry(perf, MAX_COUNTERS + perf_ptr_libretro);
+         perf_counters_libretro[perf_ptr_libretro++] = perf;
+      }
+   }
+   perf_registry_unlock();
 }
 
+// The core is going away, and its counters with it.
+// Their stats stay in the registry under the copied ident, so rarch_perf_deinit() still exports them.
 void retro_perf_clear(void)
 {
-   perf_ptr_libretro = 0;
+   perf_registry_lock();
    memset(perf_counters_libretro, 0, sizeof(perf_counters_libretro));
+   perf_hash_rebuild();
+   perf_registry_unlock();
+}
+
+static struct perf_thread *perf_thread_get(void)
+{
+   struct perf_thread *thr = perf_thread_self;
+   if (thr && perf_thread_gen == perf_generation)
+      return thr;
+
+   thr = (struct perf_thread*)calloc(1, sizeof(*thr));
+   if (!thr)
+      return NULL;
+
+   if (perf_trace_enable)
+      thr->trace = (struct perf_trace_event*)malloc(RARCH_PERF_TRACE_EVENTS * sizeof(*thr->trace));
+
+   perf_registry_lock();
+   thr->generation = perf_generation;
+   thr->tid = ++perf_thread_count;
+   thr->next = perf_threads;
+   perf_threads = thr;
+   perf_registry_unlock();
+
+   perf_thread_self = thr;
+   perf_thread_gen = thr->generation;
+   return thr;
+}
+
+static inline unsigned perf_hist_bucket(retro_perf_tick_t delta)
+{
+   unsigned bucket;
+   if (!delta)
+      return 0;
+#if defined(__GNUC__)
+   bucket = 63 - __builtin_clzll((unsigned long long)delta);
+#else
+   bucket = 0;
+   while (delta >>= 1)
+      bucket++;
+#endif
+   return bucket < RARCH_PERF_HIST_BUCKETS ? bucket : RARCH_PERF_HIST_BUCKETS - 1;
+}
+
+static void perf_slot_add(struct perf_slot *slot, retro_perf_tick_t delta, int parent)
+{
+   if (!slot->call_cnt)
+   {
+      slot->min = delta;
+      slot->parent = parent;
+   }
+   slot->total += delta;
+   slot->call_cnt++;
+   if (delta < slot->min)
+      slot->min = delta;
+   if (delta > slot->max)
+      slot->max = delta;
+   slot->hist[perf_hist_bucket(delta)]++;
+}
+
+void rarch_perf_begin(struct retro_perf_counter *perf)
+{
+   struct perf_thread *thr;
+
+   // The counter itself is shared between threads, so nothing is written to it.
+   if (!(thr = perf_thread_get()))
+      return;
+
+   if (thr->depth < PERF_MAX_DEPTH)
+   {
+      thr->stack[thr->depth].id = perf_lookup(perf);
+      thr->stack[thr->depth].start = rarch_get_perf_counter();
+   }
+   thr->depth++;
+}
+
+void rarch_perf_end(struct retro_perf_counter *perf)
+{
+   int id;
+   unsigned i;
+   struct perf_thread *thr;
+   retro_perf_tick_t start, delta, now = rarch_get_perf_counter();
+
+   thr = perf_thread_self;
+   if (!thr || perf_thread_gen != perf_generation || !thr->depth)
+      return;
+
+   if (thr->depth > PERF_MAX_DEPTH)
+   {
+      thr->depth--;
+      return;
+   }
+
+   // Tolerate counters which were not stopped in LIFO order.
+   id = perf_lookup(perf);
+   for (i = thr->depth; i > 0 && thr->stack[i - 1].id != id; i--);
+   if (i == 0)
+      return;
+
+   start = thr->stack[i - 1].start;
+   thr->depth = i - 1;
+   if (id < 0)
+      return;
+   delta = now - start;
+
+   perf_slot_add(&thr->slots[id], delta, thr->depth ? thr->stack[thr->depth - 1].id : -1);
+
+   if (thr->trace)
+   {
+      if (thr->trace_ptr < RARCH_PERF_TRACE_EVENTS)
+      {
+         struct perf_trace_event *ev = &thr->trace[thr->trace_ptr++];
+         ev->id = id;
+         ev->start = start;
+         ev->duration = delta;
+      }
+      else
+         thr->trace_dropped++;
+   }
+}
+
+void rarch_perf_sample(struct retro_perf_counter *perf, retro_perf_tick_t value, enum rarch_perf_unit unit)
+{
+   int id;
+   struct perf_thread *thr;
+
+   if (!(thr = perf_thread_get()) || (id = perf_lookup(perf)) < 0)
+      return;
+
+   thr->slots[id].unit = unit;
+   perf_slot_add(&thr->slots[id], value, -1);
+}
+
+const char *rarch_perf_unit_name(enum rarch_perf_unit unit)
+{
+   return unit == RARCH_PERF_UNIT_COUNT ? "count" : "ticks";
+}
+
+// Caller holds registry lock.
+static bool perf_merge_id(int id, rarch_perf_stats_t *stats)
+{
+   unsigned i;
+   const struct perf_thread *thr;
+   int parent = perf_entries[id].parent;
+
+   memset(stats, 0, sizeof(*stats));
+
+   for (thr = perf_threads; thr; thr = thr->next)
+   {
+      const struct perf_slot *slot = &thr->slots[id];
+      if (!slot->call_cnt)
+         continue;
+
+      if (!stats->call_cnt || slot->min < stats->min)
+         stats->min = slot->min;
+      if (slot->max > stats->max)
+         stats->max = slot->max;
+      stats->total += slot->total;
+      stats->call_cnt += slot->call_cnt;
+      stats->unit = slot->unit;
+      for (i = 0; i < RARCH_PERF_HIST_BUCKETS; i++)
+         stats->hist[i] += slot->hist[i];
+
+      if (parent < 0)
+         parent = slot->parent;
+   }
+
+   if (parent >= 0 && perf_entries[parent].ident[0])
+      stats->parent = perf_entries[parent].ident;
+
+   return stats->call_cnt != 0;
+}
+
+bool rarch_perf_get_stats(const struct retro_perf_counter *perf, rarch_perf_stats_t *stats)
+{
+   bool ret;
+   int id;
+
+   perf_registry_lock();
+   id = perf_lookup(perf);
+   if (id >= 0)
+      ret = perf_merge_id(id, stats);
+   else
+   {
+      memset(stats, 0, sizeof(*stats));
+      ret = false;
+   }
+   perf_registry_unlock();
+
+   return ret;
+}
+
+void rarch_perf_reset(struct retro_perf_counter *perf)
+{
+   int id;
+   struct perf_thread *thr;
+
+   perf_registry_lock();
+   if ((id = perf_lookup(perf)) >= 0)
+   {
+      for (thr = perf_threads; thr; thr = thr->next)
+         memset(&thr->slots[id], 0, sizeof(thr->slots[id]));
+   }
+   perf_registry_unlock();
+}
+
+void rarch_perf_init(void)
+{
+#ifdef HAVE_THREADS
+   if (!perf_lock)
+      perf_lock = slock_new();
+#endif
+   perf_trace_enable = g_extern.perfcnt_enable && *g_extern.perfcnt_trace_path;
+}
+
+void rarch_perf_deinit(void)
+{
+   struct perf_thread *thr;
+
+   if (perf_trace_enable)
+      rarch_perf_write_trace(g_extern.perfcnt_trace_path);
+   if (g_extern.perfcnt_enable && *g_extern.perfcnt_export_path)
+      rarch_perf_export(g_extern.perfcnt_export_path);
+
+   perf_registry_lock();
+   thr = perf_threads;
+   perf_threads = NULL;
+   perf_thread_count = 0;
+   // Threads still holding a block from this generation allocate a new one.
+   perf_generation++;
+   perf_registry_unlock();
+
+   while (thr)
+   {
+      struct perf_thread *next = thr->next;
+      free(thr->trace);
+      free(thr);
+      thr = next;
+   }
+
+   perf_trace_enable = false;
+
+#ifdef HAVE_THREADS
+   if (perf_lock)
+      slock_free(perf_lock);
+   perf_lock = NULL;
+#endif
 }
 
 static void log_counters(const struct retro_perf_counter **counters, unsigned num)
 {
    unsigned i;
+   rarch_perf_stats_t stats;
+
    for (i = 0; i < num; i++)
    {
-      if (counters[i]->call_cnt)
-      {
+      if (!counters[i] || !rarch_perf_get_stats(counters[i], &stats))
+         continue;
+
+      if (stats.unit == RARCH_PERF_UNIT_COUNT)
+         RARCH_LOG(PERF_LOG_COUNT_FMT,
+               counters[i]->ident,
+               (unsigned long long)stats.total / (unsigned long long)stats.call_cnt,
+               (unsigned long long)stats.call_cnt,
+               (unsigned long long)stats.min,
+               (unsigned long long)stats.max);
+      else
          RARCH_LOG(PERF_LOG_FMT,
                counters[i]->ident,
-               (unsigned long long)counters[i]->total / (unsigned long long)counters[i]->call_cnt,
-               (unsigned long long)counters[i]->call_cnt);
-      }
+               (unsigned long long)stats.total / (unsigned long long)stats.call_cnt,
+               (unsigned long long)stats.call_cnt,
+               (unsigned long long)stats.min,
+               (unsigned long long)stats.max);
    }
 }
 
@@ -137,6 +597,160 @@ void retro_perf_log(void)
    log_counters(perf_counters_libretro, perf_ptr_libretro);
 }
 
+static void perf_write_json_string(FILE *file, const char *str)
+{
+   fputc('"', file);
+   for (; *str; str++)
+   {
+      if (*str == '"' || *str == '\\')
+         fputc('\\', file);
+      if ((unsigned char)*str >= 0x20)
+         fputc(*str, file);
+   }
+   fputc('"', file);
+}
+
+static void perf_export_entry(FILE *file, bool csv, bool first, int id, const rarch_perf_stats_t *stats)
+{
+   unsigned i;
+   const char *owner = id < MAX_COUNTERS ? "rarch" : "libretro";
+
+   if (csv)
+   {
+      fprintf(file, "%s,%s,%s,%s,%llu,%llu,%llu,%llu,%llu,", owner, perf_entries[id].ident,
+            stats->parent ? stats->parent : "", rarch_perf_unit_name(stats->unit),
+            (unsigned long long)stats->call_cnt, (unsigned long long)stats->total,
+            (unsigned long long)(stats->total / stats->call_cnt),
+            (unsigned long long)stats->min, (unsigned long long)stats->max);
+      for (i = 0; i < RARCH_PERF_HIST_BUCKETS; i++)
+         fprintf(file, i ? ";%llu" : "%llu", (unsigned long long)stats->hist[i]);
+      fputc('\n', file);
+      return;
+   }
+
+   fprintf(file, "%s\n    { \"owner\": \"%s\", \"ident\": ", first ? "" : ",", owner);
+   perf_write_json_string(file, perf_entries[id].ident);
+   fputs(", \"parent\": ", file);
+   if (stats->parent)
+      perf_write_json_string(file, stats->parent);
+   else
+      fputs("null", file);
+   fprintf(file, ", \"unit\": \"%s\", \"runs\": %llu, \"total\": %llu, \"avg\": %llu, \"min\": %llu, \"max\": %llu, \"hist\": [",
+         rarch_perf_unit_name(stats->unit), (unsigned long long)stats->call_cnt, (unsigned long long)stats->total,
+         (unsigned long long)(stats->total / stats->call_cnt),
+         (unsigned long long)stats->min, (unsigned long long)stats->max);
+   for (i = 0; i < RARCH_PERF_HIST_BUCKETS; i++)
+      fprintf(file, i ? ", %llu" : "%llu", (unsigned long long)stats->hist[i]);
+   fputs("] }", file);
+}
+
+void rarch_perf_export_counters(FILE *file, bool csv)
+{
+   unsigned i;
+   bool first = true;
+   rarch_perf_stats_t stats;
+
+   if (csv)
+      fputs("owner,ident,parent,unit,runs,total,avg,min,max,hist\n", file);
+   else
+      fputc('[', file);
+
+   perf_registry_lock();
+   for (i = 0; i < PERF_MAX_ENTRIES; i++)
+   {
+      if (i >= perf_ptr_rarch && i < MAX_COUNTERS)
+         continue;
+      if (i >= MAX_COUNTERS + perf_ptr_libretro)
+         break;
+      if (!perf_merge_id(i, &stats))
+         continue;
+
+      perf_export_entry(file, csv, first, i, &stats);
+      first = false;
+   }
+   perf_registry_unlock();
+
+   if (!csv)
+      fputs("\n  ]", file);
+}
+
+bool rarch_perf_export(const char *path)
+{
+   const char *ext = strrchr(path, '.');
+   bool csv = ext && strcasecmp(ext, ".csv") == 0;
+
+   FILE *file = fopen(path, "w");
+   if (!file)
+   {
+      RARCH_ERR("[PERF]: Failed to open \"%s\" for export.\n", path);
+      return false;
+   }
+
+   if (!csv)
+      fprintf(file, "{\n  \"frames\": %u,\n  \"counters\": ", perf_frames);
+   rarch_perf_export_counters(file, csv);
+   if (!csv)
+      fputs("\n}\n", file);
+
+   fclose(file);
+   return true;
+}
+
+bool rarch_perf_write_trace(const char *path)
+{
+   unsigned i;
+   bool first = true;
+   const struct perf_thread *thr;
+   FILE *file = fopen(path, "w");
+   if (!file)
+   {
+      RARCH_ERR("[PERF]: Failed to open \"%s\" for trace output.\n", path);
+      return false;
+   }
+
+   // Timestamps are in microseconds. This assumes perf counter ticks are nanoseconds,
+   // which holds for the clock_gettime() path. Elsewhere, the timeline is scaled.
+   fputs("{\"traceEvents\":[", file);
+
+   perf_registry_lock();
+   for (thr = perf_threads; thr; thr = thr->next)
+   {
+      if (!thr->trace)
+         continue;
+
+      if (thr->trace_dropped)
+         RARCH_WARN("[PERF]: Thread #%u dropped %u trace events.\n", thr->tid, thr->trace_dropped);
+
+      for (i = 0; i < thr->trace_ptr; i++)
+      {
+         const struct perf_trace_event *ev = &thr->trace[i];
+         fputs(first ? "\n" : ",\n", file);
+         fputs("{\"name\":", file);
+         perf_write_json_string(file, perf_entries[ev->id].ident);
+         fprintf(file, ",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+               ev->id < MAX_COUNTERS ? "rarch" : "libretro", thr->tid,
+               ev->start / 1000.0, ev->duration / 1000.0);
+         first = false;
+      }
+   }
+   perf_registry_unlock();
+
+   fputs("\n]}\n", file);
+   fclose(file);
+   return true;
+}
+
+void rarch_perf_update(void)
+{
+   perf_frames++;
+
+   if (!g_extern.perfcnt_enable || !g_extern.perfcnt_export_interval || !*g_extern.perfcnt_export_path)
+      return;
+
+   if ((perf_frames % g_extern.perfcnt_export_interval) == 0)
+      rarch_perf_export(g_extern.perfcnt_export_path);
+}
+
 retro_perf_tick_t rarch_get_perf_counter(void)
 {
    retro_perf_tick_t time = 0;
@@ -255,9 +869,9 @@ static void x86_cpuid(int func, int flags[4])
          "cpuid\n"
          "xchg %%" REG_b ", %%" REG_S "\n"
          : "=a"(flags[0]), "=S"(flags[1]), "=c"(flags[2]), "=d"(flags[3])
-         : "a"(func));
+         : "a"(func), "c"(0));
 #elif defined(_MSC_VER)
-   __cpuid(flags, func);
+   __cpuidex(flags, func, 0);
 #else
    RARCH_WARN("Unknown compiler. Cannot check CPUID with inline assembly.\n");
    memset(flags, 0, 4 * sizeof(int));
@@ -386,6 +1000,9 @@ uint64_t rarch_get_cpu_features(void)
    if (flags[2] & (1 << 20))
       cpu |= RETRO_SIMD_SSE42;
 
+   if (flags[2] & (1 << 1))
+      cpu |= RARCH_SIMD_PCLMUL;
+
    const int avx_flags = (1 << 27) | (1 << 28);
    // Must only perform xgetbv check if we have AVX CPU support (guaranteed to have at least i686).
    if (((flags[2] & avx_flags) == avx_flags) && ((xgetbv_x86(0) & 0x6) == 0x6))
@@ -396,6 +1013,8 @@ uint64_t rarch_get_cpu_features(void)
       x86_cpuid(7, flags);
       if (flags[1] & (1 << 5))
          cpu |= RETRO_SIMD_AVX2;
+      if (flags[1] & (1 << 29))
+         cpu |= RARCH_SIMD_SHA;
    }
 
    x86_cpuid(0x80000000, flags);
@@ -419,6 +1038,8 @@ uint64_t rarch_get_cpu_features(void)
    RARCH_LOG("[CPUID]: SSE4.2: %u\n", !!(cpu & RETRO_SIMD_SSE42));
    RARCH_LOG("[CPUID]: AVX:    %u\n", !!(cpu & RETRO_SIMD_AVX));
    RARCH_LOG("[CPUID]: AVX2:   %u\n", !!(cpu & RETRO_SIMD_AVX2));
+   RARCH_LOG("[CPUID]: PCLMUL: %u\n", !!(cpu & RARCH_SIMD_PCLMUL));
+   RARCH_LOG("[CPUID]: SHA:    %u\n", !!(cpu & RARCH_SIMD_SHA));
 #elif defined(ANDROID) && defined(ANDROID_ARM)
    uint64_t cpu_flags = android_getCpuFeatures();
    (void)cpu_flags;
@@ -432,6 +1053,16 @@ uint64_t rarch_get_cpu_features(void)
 #endif
 
    RARCH_LOG("[CPUID]: NEON: %u\n", !!(cpu & RETRO_SIMD_NEON));
+#elif defined(__aarch64__) && defined(__linux__)
+   unsigned long hwcap = getauxval(AT_HWCAP);
+   cpu |= RETRO_SIMD_NEON;
+   if (hwcap & (1 << 7)) // HWCAP_CRC32
+      cpu |= RARCH_SIMD_ARM_CRC32;
+   if (hwcap & (1 << 6)) // HWCAP_SHA2
+      cpu |= RARCH_SIMD_ARM_SHA2;
+   RARCH_LOG("[CPUID]: NEON: %u\n", !!(cpu & RETRO_SIMD_NEON));
+   RARCH_LOG("[CPUID]: CRC32: %u\n", !!(cpu & RARCH_SIMD_ARM_CRC32));
+   RARCH_LOG("[CPUID]: SHA2: %u\n", !!(cpu & RARCH_SIMD_ARM_SHA2));
 #elif defined(__ARM_NEON__)
    cpu |= RETRO_SIMD_NEON;
    arm_enable_runfast_mode();
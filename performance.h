@@ -18,9 +18,11 @@
 #define _RARCH_PERF_H
 
 #ifdef _WIN32
-#define PERF_LOG_FMT "[PERF]: Avg (%s): %I64u ticks, %I64u runs.\n"
+#define PERF_LOG_FMT "[PERF]: Avg (%s): %I64u ticks, %I64u runs, min %I64u, max %I64u.\n"
+#define PERF_LOG_COUNT_FMT "[PERF]: Avg (%s): %I64u, %I64u samples, min %I64u, max %I64u.\n"
 #else
-#define PERF_LOG_FMT "[PERF]: Avg (%s): %llu ticks, %llu runs.\n"
+#define PERF_LOG_FMT "[PERF]: Avg (%s): %llu ticks, %llu runs, min %llu, max %llu.\n"
+#define PERF_LOG_COUNT_FMT "[PERF]: Avg (%s): %llu, %llu samples, min %llu, max %llu.\n"
 #endif
 
 #ifdef __cplusplus
@@ -29,36 +31,88 @@ extern "C" {
 
 #include "general.h"
 
-#define MAX_COUNTERS 64
+#define MAX_COUNTERS 256
+
+// Bucket N counts runs which took [2^N, 2^(N+1)) ticks.
+#define RARCH_PERF_HIST_BUCKETS 32
+
+// Events buffered per thread for the trace-event writer.
+#define RARCH_PERF_TRACE_EVENTS (1 << 16)
 
 extern const struct retro_perf_counter *perf_counters_rarch[MAX_COUNTERS];
 extern const struct retro_perf_counter *perf_counters_libretro[MAX_COUNTERS];
 extern unsigned perf_ptr_rarch;
 extern unsigned perf_ptr_libretro;
 
+// What the values of a counter are. Timed counters are always in ticks.
+enum rarch_perf_unit
+{
+   RARCH_PERF_UNIT_TICKS = 0,
+   RARCH_PERF_UNIT_COUNT // Plain quantities, e.g. queue depths.
+};
+
+// Statistics of a counter, merged over every thread which has run it.
+typedef struct rarch_perf_stats
+{
+   retro_perf_tick_t total;
+   retro_perf_tick_t call_cnt;
+   retro_perf_tick_t min;
+   retro_perf_tick_t max;
+   retro_perf_tick_t hist[RARCH_PERF_HIST_BUCKETS];
+   const char *parent; // ident of the counter this one first ran nested in, or NULL.
+   enum rarch_perf_unit unit;
+} rarch_perf_stats_t;
+
 retro_perf_tick_t rarch_get_perf_counter(void);
 retro_time_t rarch_get_time_usec(void);
 void rarch_perf_register(struct retro_perf_counter *perf);
 void retro_perf_register(struct retro_perf_counter *perf); // Same as rarch_perf_register, just for libretro cores.
-void retro_perf_clear(void);
+void retro_perf_clear(void); // Core unloaded. Its stats are kept for export.
 void rarch_perf_log(void);
 void retro_perf_log(void);
 
+// Sets up the registry lock and trace buffers. Must be called before any thread other than the main thread starts counters.
+void rarch_perf_init(void);
+void rarch_perf_deinit(void);
+
+// Thread-safe accumulation. Start times and nesting are tracked per thread, the counter itself is not written.
+void rarch_perf_begin(struct retro_perf_counter *perf);
+void rarch_perf_end(struct retro_perf_counter *perf);
+// Records a value measured by other means, e.g. a latency spanning threads (ticks) or a queue depth (count).
+void rarch_perf_sample(struct retro_perf_counter *perf, retro_perf_tick_t value, enum rarch_perf_unit unit);
+const char *rarch_perf_unit_name(enum rarch_perf_unit unit);
+
+bool rarch_perf_get_stats(const struct retro_perf_counter *perf, rarch_perf_stats_t *stats);
+void rarch_perf_reset(struct retro_perf_counter *perf);
+
+// Writes all counters to path. Format is picked from extension, .csv or .json (default).
+bool rarch_perf_export(const char *path);
+// Writes the counter table only. For JSON, this is an array which can be embedded in another document.
+void rarch_perf_export_counters(FILE *file, bool csv);
+// Writes buffered events in Chrome trace-event format (chrome://tracing).
+bool rarch_perf_write_trace(const char *path);
+// Called once per frame. Handles periodic export.
+void rarch_perf_update(void);
+
 static inline void rarch_perf_start(struct retro_perf_counter *perf)
 {
    if (g_extern.perfcnt_enable)
-   {
-      perf->call_cnt++;
-      perf->start = rarch_get_perf_counter();
-   }
+      rarch_perf_begin(perf);
 }
 
 static inline void rarch_perf_stop(struct retro_perf_counter *perf)
 {
    if (g_extern.perfcnt_enable)
-      perf->total += rarch_get_perf_counter() - perf->start;
+      rarch_perf_end(perf);
 }
 
+// Frontend-only feature bits, above the RETRO_SIMD_* range. They are not passed to cores.
+#define RARCH_SIMD_PCLMUL      (1ULL << 32)
+#define RARCH_SIMD_SHA         (1ULL << 33)
+#define RARCH_SIMD_ARM_CRC32   (1ULL << 34)
+#define RARCH_SIMD_ARM_SHA2    (1ULL << 35)
+#define RARCH_SIMD_FRONTEND_MASK (~0ULL << 32)
+
 uint64_t rarch_get_cpu_features(void);
 unsigned rarch_get_cpu_cores(void);
 
@@ -72,6 +126,11 @@ unsigned rarch_get_cpu_cores(void);
 
 #define RARCH_PERFORMANCE_START(X) rarch_perf_start(&(X))
 #define RARCH_PERFORMANCE_STOP(X) rarch_perf_stop(&(X))
+#define RARCH_PERFORMANCE_SAMPLE(X, value, unit) \
+   do { \
+      if (g_extern.perfcnt_enable) \
+         rarch_perf_sample(&(X), (value), (unit)); \
+   } while(0)
 
 #ifdef __cplusplus
 }
@@ -40,6 +40,7 @@ HAVE_XVIDEO=auto        # Enable XVideo support
 HAVE_PYTHON=auto        # Enable Python 3 support for shaders
 HAVE_V4L2=auto          # Enable video4linux2 support
 HAVE_BSV_MOVIE=yes      # Disable BSV movie support
+HAVE_FRAME_EXPORT=auto  # Enable shared memory frame export
 HAVE_NEON=no            # Forcefully enable ARM NEON optimizations
 HAVE_SSE=no             # Forcefully enable x86 SSE optimizations (SSE, SSE2)
 HAVE_FLOATHARD=no       # Force hard float ABI (for ARM)
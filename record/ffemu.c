@@ -23,6 +23,10 @@
 static const ffemu_backend_t *ffemu_backends[] = {
 #ifdef HAVE_FFMPEG
    &ffemu_ffmpeg,
+#endif
+   // Takes any file name, so it has to come after the backends that pick a container from the extension.
+#ifdef HAVE_RECORD_LOSSLESS
+   &ffemu_lossless,
 #endif
    NULL,
 };
@@ -90,6 +90,7 @@ typedef struct ffemu_backend
 } ffemu_backend_t;
 
 extern const ffemu_backend_t ffemu_ffmpeg;
+extern const ffemu_backend_t ffemu_lossless;
 
 const ffemu_backend_t *ffemu_find_backend(const char *ident);
 bool ffemu_init_first(const ffemu_backend_t **backend, void **data, const struct ffemu_params *params);
@@ -43,15 +43,14 @@ extern "C" {
 #include <stdio.h>
 #include <stdlib.h>
 #include "../boolean.h"
-#include "../fifo_buffer.h"
 #include "../thread.h"
 #include "../general.h"
 #include "../gfx/scaler/scaler.h"
 #include "../conf/config_file.h"
 #include "../audio/utils.h"
 #include "../audio/resampler.h"
+#include "../performance.h"
 #include "ffemu.h"
-#include <assert.h>
 
 #ifdef FFEMU_PERF
 #include <time.h>
@@ -62,13 +61,50 @@ extern "C" {
 #define av_frame_free avcodec_free_frame
 #endif
 
+// Recording runs as a pipeline: captured frames are scaled on one thread and encoded on another,
+// while audio is encoded on a third. Stages are connected by single-producer, single-consumer rings.
+// Positions only ever grow (wrapping at 2^32), so the hot path needs no lock.
+// Threads only go through cond when a ring is full or empty.
+#ifdef RARCH_ATOMICS
+typedef ratomic_t ff_pos_t;
+#else
+typedef volatile uint32_t ff_pos_t;
+#endif
+
+#define MAX_FRAMES 32
+
+// Frames in flight between the scale and encode stages. Dupes share the frame they repeat.
+#define FF_SCALED_FRAMES 4
+#define FF_ENCODE_QUEUE 8
+
+struct ff_video_slot
+{
+   struct ffemu_video_data attr;
+   uint8_t *buf;
+   retro_perf_tick_t queued;
+};
+
+struct ff_scaled_frame
+{
+   AVFrame *frame;
+   uint8_t *buf;
+   ff_pos_t refs; // Queued encodes using this frame.
+};
+
+struct ff_encode_entry
+{
+   unsigned frame;
+   int64_t pts;
+   retro_perf_tick_t queued;
+};
+
 struct ff_video_info
 {
    AVCodecContext *codec;
    AVCodec *encoder;
 
-   AVFrame *conv_frame;
-   uint8_t *conv_frame_buf;
+   struct ff_scaled_frame scaled[FF_SCALED_FRAMES];
+   unsigned last_scaled;
    int64_t frame_cnt;
 
    uint8_t *outbuf;
@@ -173,14 +209,28 @@ typedef struct ffmpeg
 
    scond_t *cond;
    slock_t *cond_lock;
-   slock_t *lock;
-   fifo_buffer_t *audio_fifo;
-   fifo_buffer_t *video_fifo;
-   fifo_buffer_t *attr_fifo;
-   sthread_t *thread;
-
-   volatile bool alive;
-   volatile bool can_sleep;
+   slock_t *lock; // Only guards ring positions if there are no atomics.
+   slock_t *mux_lock;
+   sthread_t *scale_thread;
+   sthread_t *encode_thread;
+   sthread_t *audio_thread;
+
+   struct ff_video_slot *video_slots;
+   ff_pos_t video_read;
+   ff_pos_t video_write;
+
+   struct ff_encode_entry encode_queue[FF_ENCODE_QUEUE];
+   ff_pos_t encode_read;
+   ff_pos_t encode_write;
+
+   uint8_t *audio_ring;
+   size_t audio_ring_size; // Power of two.
+   size_t audio_chunk_size; // One codec frame.
+   ff_pos_t audio_read;
+   ff_pos_t audio_write;
+
+   ff_pos_t sleepers;
+   ff_pos_t alive;
 } ffmpeg_t;
 
 static bool ffmpeg_codec_has_sample_format(enum AVSampleFormat fmt, const enum AVSampleFormat *fmts)
@@ -347,6 +397,7 @@ static bool ffmpeg_init_audio(ffmpeg_t *handle)
 
 static bool ffmpeg_init_video(ffmpeg_t *handle)
 {
+   unsigned i;
    struct ff_config_param *params = &handle->config;
    struct ff_video_info *video    = &handle->video;
    struct ffemu_params *param     = &handle->params;
@@ -460,11 +511,19 @@ static bool ffmpeg_init_video(ffmpeg_t *handle)
 
    video->frame_drop_ratio = params->frame_drop_ratio;
 
+   // Cleared, so a dupe before the first real frame encodes black.
    size_t size = avpicture_get_size(video->pix_fmt, param->out_width, param->out_height);
-   video->conv_frame_buf = (uint8_t*)av_malloc(size);
-   video->conv_frame = av_frame_alloc();
-   avpicture_fill((AVPicture*)video->conv_frame, video->conv_frame_buf, video->pix_fmt,
-         param->out_width, param->out_height);
+   for (i = 0; i < FF_SCALED_FRAMES; i++)
+   {
+      struct ff_scaled_frame *scaled = &video->scaled[i];
+      scaled->buf   = (uint8_t*)av_mallocz(size);
+      scaled->frame = av_frame_alloc();
+      if (!scaled->buf || !scaled->frame)
+         return false;
+
+      avpicture_fill((AVPicture*)scaled->frame, scaled->buf, video->pix_fmt,
+            param->out_width, param->out_height);
+   }
 
    return true;
 }
@@ -473,7 +532,7 @@ static bool ffmpeg_init_config(struct ff_config_param *params, const char *confi
 {
    params->out_pix_fmt = PIX_FMT_NONE;
    params->scale_factor = 1;
-   params->threads = 1;
+   params->threads = 0; // Let libavcodec pick, the encoder has a thread of its own to saturate.
    params->frame_drop_ratio = 1;
 
    if (!config)
@@ -581,74 +640,230 @@ static bool ffmpeg_init_muxer_post(ffmpeg_t *handle)
    return avformat_write_header(handle->muxer.ctx, NULL) >= 0;
 }
 
-#define MAX_FRAMES 32
+static void ffmpeg_scale_thread(void *data);
+static void ffmpeg_encode_thread(void *data);
+static void ffmpeg_audio_thread(void *data);
 
-static void ffmpeg_thread(void *data);
+static inline uint32_t ffmpeg_pos_load(ffmpeg_t *handle, ff_pos_t *pos)
+{
+#ifdef RARCH_ATOMICS
+   return ratomic_load(pos);
+#else
+   uint32_t val;
+   slock_lock(handle->lock);
+   val = *pos;
+   slock_unlock(handle->lock);
+   return val;
+#endif
+}
+
+// Only the owner of a position moves it.
+static inline void ffmpeg_pos_store(ffmpeg_t *handle, ff_pos_t *pos, uint32_t val)
+{
+#ifdef RARCH_ATOMICS
+   ratomic_store(pos, val);
+#else
+   slock_lock(handle->lock);
+   *pos = val;
+   slock_unlock(handle->lock);
+#endif
+}
+
+// For counters which more than one thread moves.
+static inline void ffmpeg_pos_add(ffmpeg_t *handle, ff_pos_t *pos, int delta)
+{
+#ifdef RARCH_ATOMICS
+   uint32_t val;
+   do
+   {
+      val = ratomic_load(pos);
+   } while (!ratomic_cas(pos, val, val + delta));
+#else
+   slock_lock(handle->lock);
+   *pos += delta;
+   slock_unlock(handle->lock);
+#endif
+}
+
+// Waking and sleeping is a store-load pattern on both sides: the waker stores a position, then
+// loads sleepers; a sleeper stores sleepers, then loads positions. Without full fences in between,
+// both loads can see the old values and the wakeup is lost.
+static void ffmpeg_wake(ffmpeg_t *handle)
+{
+#ifdef RARCH_ATOMICS
+   ratomic_fence();
+   if (!ratomic_load(&handle->sleepers))
+      return;
+#endif
+   slock_lock(handle->cond_lock);
+   scond_broadcast(handle->cond);
+   slock_unlock(handle->cond_lock);
+}
+
+// Blocks until ready() holds. Returns false once the pipeline is shutting down.
+static bool ffmpeg_wait(ffmpeg_t *handle, bool (*ready)(ffmpeg_t*))
+{
+   if (ready(handle))
+      return ffmpeg_pos_load(handle, &handle->alive);
+
+   slock_lock(handle->cond_lock);
+   ffmpeg_pos_add(handle, &handle->sleepers, 1);
+#ifdef RARCH_ATOMICS
+   ratomic_fence();
+#endif
+
+   while (ffmpeg_pos_load(handle, &handle->alive) && !ready(handle))
+      scond_wait(handle->cond, handle->cond_lock);
+
+   ffmpeg_pos_add(handle, &handle->sleepers, -1);
+   slock_unlock(handle->cond_lock);
+
+   return ffmpeg_pos_load(handle, &handle->alive);
+}
+
+static bool ffmpeg_video_slot_free(ffmpeg_t *handle)
+{
+   return ffmpeg_pos_load(handle, &handle->video_write) - ffmpeg_pos_load(handle, &handle->video_read) < MAX_FRAMES;
+}
+
+static bool ffmpeg_video_avail(ffmpeg_t *handle)
+{
+   return ffmpeg_pos_load(handle, &handle->video_write) != ffmpeg_pos_load(handle, &handle->video_read);
+}
+
+static uint32_t ffmpeg_encode_queued(ffmpeg_t *handle)
+{
+   return ffmpeg_pos_load(handle, &handle->encode_write) - ffmpeg_pos_load(handle, &handle->encode_read);
+}
+
+static bool ffmpeg_encode_avail(ffmpeg_t *handle)
+{
+   return ffmpeg_encode_queued(handle) != 0;
+}
+
+// Dupes don't need a new frame, but waiting for one anyway keeps this simple.
+static bool ffmpeg_scale_ready(ffmpeg_t *handle)
+{
+   unsigned next = (handle->video.last_scaled + 1) % FF_SCALED_FRAMES;
+   return ffmpeg_video_avail(handle) &&
+      ffmpeg_encode_queued(handle) < FF_ENCODE_QUEUE &&
+      !ffmpeg_pos_load(handle, &handle->video.scaled[next].refs);
+}
+
+static size_t ffmpeg_audio_avail(ffmpeg_t *handle)
+{
+   return ffmpeg_pos_load(handle, &handle->audio_write) - ffmpeg_pos_load(handle, &handle->audio_read);
+}
+
+static bool ffmpeg_audio_space_free(ffmpeg_t *handle)
+{
+   return ffmpeg_audio_avail(handle) < handle->audio_ring_size;
+}
+
+static bool ffmpeg_audio_ready(ffmpeg_t *handle)
+{
+   return ffmpeg_audio_avail(handle) >= handle->audio_chunk_size;
+}
 
 static bool init_thread(ffmpeg_t *handle)
 {
+   unsigned i;
+   // Keep some slack at the end, swscale's SIMD paths like to read past the last line.
+   size_t slot_size = (handle->params.fb_width * (handle->params.fb_height + 1) + 64) * handle->video.pix_size;
+
    handle->lock = slock_new();
    handle->cond_lock = slock_new();
+   handle->mux_lock = slock_new();
    handle->cond = scond_new();
-   handle->audio_fifo = fifo_new(32000 * sizeof(int16_t) * handle->params.channels * MAX_FRAMES / 60); // Some arbitrary max size.
-   handle->attr_fifo = fifo_new(sizeof(struct ffemu_video_data) * MAX_FRAMES);
-   handle->video_fifo = fifo_new(handle->params.fb_width * handle->params.fb_height *
-            handle->video.pix_size * MAX_FRAMES);
+   if (!handle->lock || !handle->cond_lock || !handle->mux_lock || !handle->cond)
+      return false;
+
+   handle->video_slots = (struct ff_video_slot*)calloc(MAX_FRAMES, sizeof(*handle->video_slots));
+   if (!handle->video_slots)
+      return false;
 
-   handle->alive = true;
-   handle->can_sleep = true;
-   handle->thread = sthread_create(ffmpeg_thread, handle);
+   for (i = 0; i < MAX_FRAMES; i++)
+      if (!(handle->video_slots[i].buf = (uint8_t*)av_malloc(slot_size)))
+         return false;
 
-   assert(handle->lock && handle->cond_lock &&
-      handle->cond && handle->audio_fifo &&
-      handle->attr_fifo && handle->video_fifo && handle->thread);
+   if (handle->config.audio_enable)
+   {
+      handle->audio_chunk_size = handle->audio.codec->frame_size * handle->params.channels * sizeof(int16_t);
+      handle->audio_ring_size = next_pow2(32000 * sizeof(int16_t) * handle->params.channels * MAX_FRAMES / 60); // Some arbitrary max size.
+      if (handle->audio_ring_size < 2 * handle->audio_chunk_size)
+         handle->audio_ring_size = next_pow2(2 * handle->audio_chunk_size);
 
-   return true;
+      if (!(handle->audio_ring = (uint8_t*)av_malloc(handle->audio_ring_size)))
+         return false;
+   }
+
+   handle->alive = 1;
+   handle->scale_thread = sthread_create(ffmpeg_scale_thread, handle);
+   handle->encode_thread = sthread_create(ffmpeg_encode_thread, handle);
+   if (handle->config.audio_enable)
+      handle->audio_thread = sthread_create(ffmpeg_audio_thread, handle);
+
+   return handle->scale_thread && handle->encode_thread &&
+      (handle->audio_thread || !handle->config.audio_enable);
 }
 
 static void deinit_thread(ffmpeg_t *handle)
 {
-   if (!handle->thread)
+   if (!handle->cond_lock)
       return;
 
+   // Stages stop between items. Whatever is still queued is drained in ffmpeg_finalize().
    slock_lock(handle->cond_lock);
-   handle->alive = false;
-   handle->can_sleep = false;
+   ffmpeg_pos_store(handle, &handle->alive, 0);
+   scond_broadcast(handle->cond);
    slock_unlock(handle->cond_lock);
 
-   scond_signal(handle->cond);
-   sthread_join(handle->thread);
+   if (handle->scale_thread)
+      sthread_join(handle->scale_thread);
+   if (handle->encode_thread)
+      sthread_join(handle->encode_thread);
+   if (handle->audio_thread)
+      sthread_join(handle->audio_thread);
 
-   slock_free(handle->lock);
-   slock_free(handle->cond_lock);
-   scond_free(handle->cond);
-
-   handle->thread = NULL;
+   handle->scale_thread = NULL;
+   handle->encode_thread = NULL;
+   handle->audio_thread = NULL;
 }
 
 static void deinit_thread_buf(ffmpeg_t *handle)
 {
-   if (handle->audio_fifo)
-   {
-      fifo_free(handle->audio_fifo);
-      handle->audio_fifo = NULL;
-   }
-   
-   if (handle->attr_fifo)
-   {
-      fifo_free(handle->attr_fifo);
-      handle->attr_fifo = NULL;
-   }
+   unsigned i;
 
-   if (handle->video_fifo)
+   if (handle->video_slots)
    {
-      fifo_free(handle->video_fifo);
-      handle->video_fifo = NULL;
+      for (i = 0; i < MAX_FRAMES; i++)
+         av_free(handle->video_slots[i].buf);
+      free(handle->video_slots);
+      handle->video_slots = NULL;
    }
+
+   av_free(handle->audio_ring);
+   handle->audio_ring = NULL;
+
+   // The rings are still drained after the threads are gone, so the locks live until here.
+   if (handle->lock)
+      slock_free(handle->lock);
+   if (handle->cond_lock)
+      slock_free(handle->cond_lock);
+   if (handle->mux_lock)
+      slock_free(handle->mux_lock);
+   if (handle->cond)
+      scond_free(handle->cond);
+
+   handle->lock = NULL;
+   handle->cond_lock = NULL;
+   handle->mux_lock = NULL;
+   handle->cond = NULL;
 }
 
 static void ffmpeg_free(void *data)
 {
+   unsigned i;
    ffmpeg_t *handle = (ffmpeg_t*)data;
    if (!handle)
       return;
@@ -670,8 +885,11 @@ static void ffmpeg_free(void *data)
       av_free(handle->video.codec);
    }
 
-   av_frame_free(&handle->video.conv_frame);
-   av_free(handle->video.conv_frame_buf);
+   for (i = 0; i < FF_SCALED_FRAMES; i++)
+   {
+      av_frame_free(&handle->video.scaled[i].frame);
+      av_free(handle->video.scaled[i].buf);
+   }
 
    scaler_ctx_gen_reset(&handle->video.scaler);
 
@@ -736,6 +954,8 @@ static bool ffmpeg_push_video(void *data, const struct ffemu_video_data *video_d
 {
    unsigned y;
    bool drop_frame;
+   uint32_t write;
+   struct ff_video_slot *slot;
    ffmpeg_t *handle = (ffmpeg_t*)data;
 
    if (!handle || !video_data)
@@ -748,55 +968,45 @@ static bool ffmpeg_push_video(void *data, const struct ffemu_video_data *video_d
    if (drop_frame)
       return true;
 
-   for (;;)
-   {
-      slock_lock(handle->lock);
-      unsigned avail = fifo_write_avail(handle->attr_fifo);
-      slock_unlock(handle->lock);
-
-      if (!handle->alive)
-         return false;
-
-      if (avail >= sizeof(*video_data))
-         break;
+   if (!ffmpeg_wait(handle, ffmpeg_video_slot_free))
+      return false;
 
-      slock_lock(handle->cond_lock);
-      if (handle->can_sleep)
-      {
-         handle->can_sleep = false;
-         scond_wait(handle->cond, handle->cond_lock);
-         handle->can_sleep = true;
-      }
-      else
-         scond_signal(handle->cond);
+   write = ffmpeg_pos_load(handle, &handle->video_write);
+   slot = &handle->video_slots[write % MAX_FRAMES];
+   slot->attr = *video_data;
+   slot->queued = rarch_get_perf_counter();
 
-      slock_unlock(handle->cond_lock);
+   if (slot->attr.is_dupe)
+   {
+      // Nothing to copy, the encoder just sends the last frame again.
+      slot->attr.width = slot->attr.height = slot->attr.pitch = 0;
+      slot->attr.data = NULL;
    }
-
-   slock_lock(handle->lock);
-
-   // Tightly pack our frame to conserve memory. libretro tends to use a very large pitch.
-   struct ffemu_video_data attr_data = *video_data;
-
-   if (attr_data.is_dupe)
-      attr_data.width = attr_data.height = attr_data.pitch = 0;
    else
-      attr_data.pitch = attr_data.width * handle->video.pix_size;
+   {
+      // Tightly pack our frame to conserve memory. libretro tends to use a very large pitch.
+      const uint8_t *src = (const uint8_t*)video_data->data;
 
-   fifo_write(handle->attr_fifo, &attr_data, sizeof(attr_data));
+      slot->attr.pitch = slot->attr.width * handle->video.pix_size;
+      slot->attr.data = slot->buf;
 
-   int offset = 0;
-   for (y = 0; y < attr_data.height; y++, offset += video_data->pitch)
-      fifo_write(handle->video_fifo, (const uint8_t*)video_data->data + offset, attr_data.pitch);
+      for (y = 0; y < slot->attr.height; y++, src += video_data->pitch)
+         memcpy(slot->buf + y * slot->attr.pitch, src, slot->attr.pitch);
+   }
 
-   slock_unlock(handle->lock);
-   scond_signal(handle->cond);
+   ffmpeg_pos_store(handle, &handle->video_write, write + 1);
+   ffmpeg_wake(handle);
 
+   RARCH_PERFORMANCE_INIT(ffmpeg_scale_backlog);
+   RARCH_PERFORMANCE_SAMPLE(ffmpeg_scale_backlog, write + 1 - ffmpeg_pos_load(handle, &handle->video_read),
+         RARCH_PERF_UNIT_COUNT);
    return true;
 }
 
 static bool ffmpeg_push_audio(void *data, const struct ffemu_audio_data *audio_data)
 {
+   const uint8_t *src;
+   size_t size;
    ffmpeg_t *handle = (ffmpeg_t*)data;
 
    if (!handle || !audio_data)
@@ -805,35 +1015,33 @@ static bool ffmpeg_push_audio(void *data, const struct ffemu_audio_data *audio_d
    if (!handle->config.audio_enable)
       return true;
 
-   for (;;)
+   src = (const uint8_t*)audio_data->data;
+   size = audio_data->frames * handle->params.channels * sizeof(int16_t);
+
+   // Large batches are pushed in pieces as the encoder frees up space.
+   while (size)
    {
-      slock_lock(handle->lock);
-      unsigned avail = fifo_write_avail(handle->audio_fifo);
-      slock_unlock(handle->lock);
+      uint32_t write, offset;
+      size_t chunk, first;
 
-      if (!handle->alive)
+      if (!ffmpeg_wait(handle, ffmpeg_audio_space_free))
          return false;
 
-      if (avail >= audio_data->frames * handle->params.channels * sizeof(int16_t))
-         break;
+      write  = ffmpeg_pos_load(handle, &handle->audio_write);
+      chunk  = handle->audio_ring_size - ffmpeg_audio_avail(handle);
+      chunk  = min(chunk, size);
+      offset = write & (handle->audio_ring_size - 1);
+      first  = min(chunk, handle->audio_ring_size - offset);
 
-      slock_lock(handle->cond_lock);
-      if (handle->can_sleep)
-      {
-         handle->can_sleep = false;
-         scond_wait(handle->cond, handle->cond_lock);
-         handle->can_sleep = true;
-      }
-      else
-         scond_signal(handle->cond);
+      memcpy(handle->audio_ring + offset, src, first);
+      memcpy(handle->audio_ring, src + first, chunk - first);
 
-      slock_unlock(handle->cond_lock);
-   }
+      ffmpeg_pos_store(handle, &handle->audio_write, write + chunk);
+      ffmpeg_wake(handle);
 
-   slock_lock(handle->lock);
-   fifo_write(handle->audio_fifo, audio_data->data, audio_data->frames * handle->params.channels * sizeof(int16_t));
-   slock_unlock(handle->lock);
-   scond_signal(handle->cond);
+      src  += chunk;
+      size -= chunk;
+   }
 
    return true;
 }
@@ -872,7 +1080,7 @@ static bool encode_video(ffmpeg_t *handle, AVPacket *pkt, AVFrame *frame)
    return true;
 }
 
-static void ffmpeg_scale_input(ffmpeg_t *handle, const struct ffemu_video_data *data)
+static void ffmpeg_scale_input(ffmpeg_t *handle, AVFrame *out, const struct ffemu_video_data *data)
 {
    // Attempt to preserve more information if we scale down.
    bool shrunk = handle->params.out_width < data->width || handle->params.out_height < data->height;
@@ -885,7 +1093,7 @@ static void ffmpeg_scale_input(ffmpeg_t *handle, const struct ffemu_video_data *
 
       int linesize = data->pitch;
       sws_scale(handle->video.sws, (const uint8_t* const*)&data->data, &linesize, 0,
-            data->height, handle->video.conv_frame->data, handle->video.conv_frame->linesize);
+            data->height, out->data, out->linesize);
    }
    else
    {
@@ -899,34 +1107,83 @@ static void ffmpeg_scale_input(ffmpeg_t *handle, const struct ffemu_video_data *
 
          handle->video.scaler.out_width  = handle->params.out_width;
          handle->video.scaler.out_height = handle->params.out_height;
-         handle->video.scaler.out_stride = handle->video.conv_frame->linesize[0];
+         handle->video.scaler.out_stride = out->linesize[0];
 
          scaler_ctx_gen_filter(&handle->video.scaler);
       }
 
-      scaler_ctx_scale(&handle->video.scaler, handle->video.conv_frame->data[0], data->data);
+      scaler_ctx_scale(&handle->video.scaler, out->data[0], data->data);
    }
 }
 
-static bool ffmpeg_push_video_thread(ffmpeg_t *handle, const struct ffemu_video_data *data)
+static bool ffmpeg_write_packet(ffmpeg_t *handle, AVPacket *pkt)
 {
-   if (!data->is_dupe)
-      ffmpeg_scale_input(handle, data);
+   bool ret;
 
-   handle->video.conv_frame->pts = handle->video.frame_cnt;
+   // Video and audio are encoded on different threads, but share the muxer.
+   slock_lock(handle->mux_lock);
+   ret = av_interleaved_write_frame(handle->muxer.ctx, pkt) >= 0;
+   slock_unlock(handle->mux_lock);
 
-   AVPacket pkt;
-   if (!encode_video(handle, &pkt, handle->video.conv_frame))
-      return false;
+   return ret;
+}
+
+// Scale stage. Converts the next captured frame into a free frame of the pool.
+static void ffmpeg_scale_next(ffmpeg_t *handle)
+{
+   uint32_t read = ffmpeg_pos_load(handle, &handle->video_read);
+   uint32_t write = ffmpeg_pos_load(handle, &handle->encode_write);
+   const struct ff_video_slot *slot = &handle->video_slots[read % MAX_FRAMES];
+   struct ff_encode_entry *entry = &handle->encode_queue[write % FF_ENCODE_QUEUE];
+   unsigned frame = handle->video.last_scaled;
 
-   if (pkt.size)
+   if (!slot->attr.is_dupe)
    {
-      if (av_interleaved_write_frame(handle->muxer.ctx, &pkt) < 0)
-         return false;
+      frame = (frame + 1) % FF_SCALED_FRAMES;
+
+      RARCH_PERFORMANCE_INIT(ffmpeg_scale);
+      RARCH_PERFORMANCE_START(ffmpeg_scale);
+      ffmpeg_scale_input(handle, handle->video.scaled[frame].frame, &slot->attr);
+      RARCH_PERFORMANCE_STOP(ffmpeg_scale);
+
+      handle->video.last_scaled = frame;
    }
 
-   handle->video.frame_cnt++;
-   return true;
+   entry->frame  = frame;
+   entry->pts    = handle->video.frame_cnt++;
+   entry->queued = slot->queued;
+   ffmpeg_pos_add(handle, &handle->video.scaled[frame].refs, 1);
+
+   ffmpeg_pos_store(handle, &handle->video_read, read + 1);
+   ffmpeg_pos_store(handle, &handle->encode_write, write + 1);
+   ffmpeg_wake(handle);
+
+   RARCH_PERFORMANCE_INIT(ffmpeg_encode_backlog);
+   RARCH_PERFORMANCE_SAMPLE(ffmpeg_encode_backlog, ffmpeg_encode_queued(handle), RARCH_PERF_UNIT_COUNT);
+}
+
+// Encode stage. The codec may well spread this over threads of its own.
+static void ffmpeg_encode_next(ffmpeg_t *handle)
+{
+   AVPacket pkt;
+   uint32_t read = ffmpeg_pos_load(handle, &handle->encode_read);
+   const struct ff_encode_entry *entry = &handle->encode_queue[read % FF_ENCODE_QUEUE];
+   struct ff_scaled_frame *scaled = &handle->video.scaled[entry->frame];
+
+   RARCH_PERFORMANCE_INIT(ffmpeg_video_encode);
+   RARCH_PERFORMANCE_START(ffmpeg_video_encode);
+   scaled->frame->pts = entry->pts;
+   if (encode_video(handle, &pkt, scaled->frame) && pkt.size)
+      ffmpeg_write_packet(handle, &pkt);
+   RARCH_PERFORMANCE_STOP(ffmpeg_video_encode);
+
+   // Time from ffmpeg_push_video() until the frame is handed to the muxer.
+   RARCH_PERFORMANCE_INIT(ffmpeg_video_latency);
+   RARCH_PERFORMANCE_SAMPLE(ffmpeg_video_latency, rarch_get_perf_counter() - entry->queued, RARCH_PERF_UNIT_TICKS);
+
+   ffmpeg_pos_add(handle, &scaled->refs, -1);
+   ffmpeg_pos_store(handle, &handle->encode_read, read + 1);
+   ffmpeg_wake(handle);
 }
 
 static void planarize_float(float *out, const float *in, size_t frames)
@@ -1127,7 +1384,7 @@ static bool ffmpeg_push_audio_thread(ffmpeg_t *handle, struct ffemu_audio_data *
 
       if (pkt.size)
       {
-         if (av_interleaved_write_frame(handle->muxer.ctx, &pkt) < 0)
+         if (!ffmpeg_write_packet(handle, &pkt))
             return false;
       }
    }
@@ -1135,25 +1392,53 @@ static bool ffmpeg_push_audio_thread(ffmpeg_t *handle, struct ffemu_audio_data *
    return true;
 }
 
-static void ffmpeg_flush_audio(ffmpeg_t *handle, void *audio_buf, size_t audio_buf_size)
+// Returns the next size bytes of audio. They are only copied to buf if they wrap around the ring.
+static const void *ffmpeg_audio_peek(ffmpeg_t *handle, void *buf, size_t size)
 {
-   size_t avail = fifo_read_avail(handle->audio_fifo);
-   if (avail)
-   {
-      fifo_read(handle->audio_fifo, audio_buf, avail);
+   uint32_t offset = ffmpeg_pos_load(handle, &handle->audio_read) & (handle->audio_ring_size - 1);
+   size_t first = min(size, handle->audio_ring_size - offset);
 
-      struct ffemu_audio_data aud = {0};
-      aud.frames = avail / (sizeof(int16_t) * handle->params.channels);
-      aud.data = audio_buf;
+   if (first == size)
+      return handle->audio_ring + offset;
 
-      ffmpeg_push_audio_thread(handle, &aud, false);
-   }
+   memcpy(buf, handle->audio_ring + offset, first);
+   memcpy((uint8_t*)buf + first, handle->audio_ring, size - first);
+   return buf;
+}
+
+static void ffmpeg_audio_consume(ffmpeg_t *handle, size_t size)
+{
+   uint32_t read = ffmpeg_pos_load(handle, &handle->audio_read);
+   ffmpeg_pos_store(handle, &handle->audio_read, read + size);
+   ffmpeg_wake(handle);
+}
+
+// Audio stage. Resampling and encoding happen here, off the video threads.
+static void ffmpeg_encode_audio_chunk(ffmpeg_t *handle, void *audio_buf, size_t size, bool require_block)
+{
+   struct ffemu_audio_data aud = {0};
+   aud.frames = size / (sizeof(int16_t) * handle->params.channels);
+   aud.data = ffmpeg_audio_peek(handle, audio_buf, size);
+
+   RARCH_PERFORMANCE_INIT(ffmpeg_audio_encode);
+   RARCH_PERFORMANCE_START(ffmpeg_audio_encode);
+   ffmpeg_push_audio_thread(handle, &aud, require_block);
+   RARCH_PERFORMANCE_STOP(ffmpeg_audio_encode);
+
+   ffmpeg_audio_consume(handle, size);
+}
+
+static void ffmpeg_flush_audio(ffmpeg_t *handle, void *audio_buf)
+{
+   size_t avail = ffmpeg_audio_avail(handle);
+   if (avail)
+      ffmpeg_encode_audio_chunk(handle, audio_buf, avail, false);
 
    for (;;)
    {
       AVPacket pkt;
       if (!encode_audio(handle, &pkt, true) || !pkt.size ||
-            av_interleaved_write_frame(handle->muxer.ctx, &pkt) < 0)
+            !ffmpeg_write_packet(handle, &pkt))
          break;
    }
 }
@@ -1164,58 +1449,48 @@ static void ffmpeg_flush_video(ffmpeg_t *handle)
    {
       AVPacket pkt;
       if (!encode_video(handle, &pkt, NULL) || !pkt.size ||
-            av_interleaved_write_frame(handle->muxer.ctx, &pkt) < 0)
+            !ffmpeg_write_packet(handle, &pkt))
          break;
    }
 }
 
 static void ffmpeg_flush_buffers(ffmpeg_t *handle)
 {
-   void *video_buf = av_malloc(2 * handle->params.fb_width * handle->params.fb_height * handle->video.pix_size);
-   size_t audio_buf_size = handle->config.audio_enable ? (handle->audio.codec->frame_size * handle->params.channels * sizeof(int16_t)) : 0;
-   void *audio_buf = audio_buf_size ? av_malloc(audio_buf_size) : NULL;
+   // Big enough for whatever is left in the ring when flushing.
+   void *audio_buf = handle->config.audio_enable ? av_malloc(handle->audio_ring_size) : NULL;
 
-   // Try pushing data in an interleaving pattern to ease the work of the muxer a bit.
+   // Drain the pipeline in order, interleaving audio to ease the work of the muxer a bit.
+   // Encoding before scaling more makes sure a free frame is always available.
    bool did_work;
    do
    {
       did_work = false;
 
-      if (handle->config.audio_enable)
+      if (handle->config.audio_enable && ffmpeg_audio_ready(handle))
       {
-         if (fifo_read_avail(handle->audio_fifo) >= audio_buf_size)
-         {
-            fifo_read(handle->audio_fifo, audio_buf, audio_buf_size);
-
-            struct ffemu_audio_data aud = {0};
-            aud.frames = handle->audio.codec->frame_size;
-            aud.data = audio_buf;
-
-            ffmpeg_push_audio_thread(handle, &aud, true);
-            did_work = true;
-         }
+         ffmpeg_encode_audio_chunk(handle, audio_buf, handle->audio_chunk_size, true);
+         did_work = true;
       }
 
-      struct ffemu_video_data attr_buf;
-      if (fifo_read_avail(handle->attr_fifo) >= sizeof(attr_buf))
+      if (ffmpeg_encode_avail(handle))
       {
-         fifo_read(handle->attr_fifo, &attr_buf, sizeof(attr_buf));
-         fifo_read(handle->video_fifo, video_buf, attr_buf.height * attr_buf.pitch);
-         attr_buf.data = video_buf;
-         ffmpeg_push_video_thread(handle, &attr_buf);
-
+         ffmpeg_encode_next(handle);
+         did_work = true;
+      }
+      else if (ffmpeg_video_avail(handle))
+      {
+         ffmpeg_scale_next(handle);
          did_work = true;
       }
    } while (did_work);
 
    // Flush out last audio.
    if (handle->config.audio_enable)
-      ffmpeg_flush_audio(handle, audio_buf, audio_buf_size);
+      ffmpeg_flush_audio(handle, audio_buf);
 
    // Flush out last video.
    ffmpeg_flush_video(handle);
 
-   av_free(video_buf);
    av_free(audio_buf);
 }
 
@@ -1239,76 +1514,34 @@ static bool ffmpeg_finalize(void *data)
    return true;
 }
 
-static void ffmpeg_thread(void *data)
+static void ffmpeg_scale_thread(void *data)
 {
    ffmpeg_t *ff = (ffmpeg_t*)data;
+   while (ffmpeg_wait(ff, ffmpeg_scale_ready))
+      ffmpeg_scale_next(ff);
+}
 
-   // For some reason, FFmpeg has a tendency to crash if we don't overallocate a bit. :s
-   void *video_buf = av_malloc(2 * ff->params.fb_width * ff->params.fb_height * ff->video.pix_size);
-   assert(video_buf);
+static void ffmpeg_encode_thread(void *data)
+{
+   ffmpeg_t *ff = (ffmpeg_t*)data;
+   while (ffmpeg_wait(ff, ffmpeg_encode_avail))
+      ffmpeg_encode_next(ff);
+}
 
-   size_t audio_buf_size = ff->config.audio_enable ? (ff->audio.codec->frame_size * ff->params.channels * sizeof(int16_t)) : 0;
-   void *audio_buf = audio_buf_size ? av_malloc(audio_buf_size) : NULL;
+static void ffmpeg_audio_thread(void *data)
+{
+   ffmpeg_t *ff = (ffmpeg_t*)data;
+   void *audio_buf = av_malloc(ff->audio_chunk_size);
 
-   while (ff->alive)
+   while (ffmpeg_wait(ff, ffmpeg_audio_ready))
    {
-      struct ffemu_video_data attr_buf;
-
-      bool avail_video = false;
-      bool avail_audio = false;
-
-      slock_lock(ff->lock);
-      if (fifo_read_avail(ff->attr_fifo) >= sizeof(attr_buf))
-         avail_video = true;
-
-      if (ff->config.audio_enable)
-         if (fifo_read_avail(ff->audio_fifo) >= audio_buf_size)
-            avail_audio = true;
-      slock_unlock(ff->lock);
-
-      if (!avail_video && !avail_audio)
-      {
-         slock_lock(ff->cond_lock);
-         if (ff->can_sleep)
-         {
-            ff->can_sleep = false;
-            scond_wait(ff->cond, ff->cond_lock);
-            ff->can_sleep = true;
-         }
-         else
-            scond_signal(ff->cond);
-
-         slock_unlock(ff->cond_lock);
-      }
-
-      if (avail_video)
-      {
-         slock_lock(ff->lock);
-         fifo_read(ff->attr_fifo, &attr_buf, sizeof(attr_buf));
-         fifo_read(ff->video_fifo, video_buf, attr_buf.height * attr_buf.pitch);
-         slock_unlock(ff->lock);
-         scond_signal(ff->cond);
-
-         attr_buf.data = video_buf;
-         ffmpeg_push_video_thread(ff, &attr_buf);
-      }
-
-      if (avail_audio)
-      {
-         slock_lock(ff->lock);
-         fifo_read(ff->audio_fifo, audio_buf, audio_buf_size);
-         slock_unlock(ff->lock);
-         scond_signal(ff->cond);
-
-         struct ffemu_audio_data aud = {0};
-         aud.frames = ff->audio.codec->frame_size;
-         aud.data = audio_buf;
+      RARCH_PERFORMANCE_INIT(ffmpeg_audio_backlog);
+      RARCH_PERFORMANCE_SAMPLE(ffmpeg_audio_backlog, ffmpeg_audio_avail(ff) / ff->audio_chunk_size,
+            RARCH_PERF_UNIT_COUNT);
 
-         ffmpeg_push_audio_thread(ff, &aud, true);
-      }
+      ffmpeg_encode_audio_chunk(ff, audio_buf, ff->audio_chunk_size, true);
    }
 
-   av_free(video_buf);
    av_free(audio_buf);
 }
 
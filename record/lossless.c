@@ -0,0 +1,477 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2014 - Hans-Kristian Arntzen
+ *
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Lossless recording without any external dependencies except zlib.
+// Frames are stored as they come from the core, XORed against the previous frame,
+// which leaves mostly zeroes for deflate to chew through.
+
+#include "ffemu.h"
+#include "lossless.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+#include "../boolean.h"
+#include "../thread.h"
+#include "../general.h"
+#include "../performance.h"
+#include "../file.h"
+#include "../compat/posix_string.h"
+
+#ifdef HAVE_CONFIG_H
+#include "../config.h"
+#endif
+
+// Packets in flight between the frontend and the encoder thread.
+// push_video() blocks once they are all taken.
+#define LOSSLESS_PACKETS 8
+
+// Key frames make it possible to start decoding in the middle of a file.
+#define LOSSLESS_KEY_INTERVAL 600
+
+#define LOSSLESS_FILE_BUFFER (1024 * 1024)
+
+struct lossless_packet
+{
+   enum rlv_packet_type type;
+   unsigned width;
+   unsigned height;
+   uint8_t *data;
+   size_t size;
+   size_t capacity;
+};
+
+typedef struct lossless
+{
+   struct ffemu_params params;
+   size_t pix_size;
+
+   FILE *file;
+   char *file_buf;
+
+   sthread_t *thread;
+   slock_t *lock;
+   scond_t *cond;
+   // Audio can be pushed from the audio callback thread, so producers take turns.
+   slock_t *push_lock;
+   bool alive;
+   bool quit;
+
+   struct lossless_packet packets[LOSSLESS_PACKETS];
+   unsigned read_index;
+   unsigned count;
+
+   // Only touched by the encoder thread.
+   z_stream stream;
+   bool stream_init;
+   uint8_t *prev;
+   size_t prev_capacity;
+   unsigned prev_width;
+   unsigned prev_height;
+   bool has_prev;
+   unsigned frames_since_key;
+
+   uint8_t *delta;
+   size_t delta_capacity;
+   uint8_t *out;
+   size_t out_capacity;
+
+   uint64_t bytes_in;
+   uint64_t bytes_out;
+} lossless_t;
+
+static bool lossless_reserve(uint8_t **buf, size_t *capacity, size_t size)
+{
+   uint8_t *new_buf;
+   if (*capacity >= size)
+      return true;
+
+   new_buf = (uint8_t*)realloc(*buf, size);
+   if (!new_buf)
+      return false;
+
+   *buf = new_buf;
+   *capacity = size;
+   return true;
+}
+
+static bool lossless_write_packet(lossless_t *handle, enum rlv_packet_type type,
+      const uint8_t *header, size_t header_size, const uint8_t *data, size_t size)
+{
+   uint8_t packet[RLV_PACKET_HEADER_SIZE];
+   rlv_write_le32(packet + 0, type);
+   rlv_write_le32(packet + 4, header_size + size);
+
+   handle->bytes_out += sizeof(packet) + header_size + size;
+
+   return fwrite(packet, 1, sizeof(packet), handle->file) == sizeof(packet) &&
+      (!header_size || fwrite(header, 1, header_size, handle->file) == header_size) &&
+      (!size || fwrite(data, 1, size, handle->file) == size);
+}
+
+static bool lossless_encode_video(lossless_t *handle, struct lossless_packet *pkt)
+{
+   size_t i, tmp_capacity;
+   uLong bound;
+   uint8_t *tmp_buf;
+   uint8_t header[RLV_VIDEO_HEADER_SIZE];
+   const uint8_t *src = pkt->data;
+   enum rlv_packet_type type = RLV_PACKET_DELTA_FRAME;
+
+   if (!handle->has_prev || handle->prev_width != pkt->width || handle->prev_height != pkt->height ||
+         handle->frames_since_key >= LOSSLESS_KEY_INTERVAL)
+   {
+      type = RLV_PACKET_KEY_FRAME;
+      handle->frames_since_key = 0;
+   }
+   else
+   {
+      if (!lossless_reserve(&handle->delta, &handle->delta_capacity, pkt->size))
+         return false;
+
+      for (i = 0; i < pkt->size; i++)
+         handle->delta[i] = pkt->data[i] ^ handle->prev[i];
+      src = handle->delta;
+   }
+
+   handle->frames_since_key++;
+
+   bound = deflateBound(&handle->stream, pkt->size);
+   if (!lossless_reserve(&handle->out, &handle->out_capacity, bound))
+      return false;
+
+   deflateReset(&handle->stream);
+   handle->stream.next_in   = (Bytef*)src;
+   handle->stream.avail_in  = pkt->size;
+   handle->stream.next_out  = handle->out;
+   handle->stream.avail_out = handle->out_capacity;
+   if (deflate(&handle->stream, Z_FINISH) != Z_STREAM_END)
+      return false;
+
+   // The packet buffer goes back into the pool, so just swap it with the previous frame.
+   tmp_buf      = handle->prev;
+   tmp_capacity = handle->prev_capacity;
+   handle->prev = pkt->data;
+   handle->prev_capacity = pkt->capacity;
+   pkt->data = tmp_buf;
+   pkt->capacity = tmp_capacity;
+
+   handle->prev_width  = pkt->width;
+   handle->prev_height = pkt->height;
+   handle->has_prev    = true;
+   handle->bytes_in   += pkt->size;
+
+   rlv_write_le32(header + 0, pkt->width);
+   rlv_write_le32(header + 4, pkt->height);
+   return lossless_write_packet(handle, type, header, sizeof(header),
+         handle->out, handle->stream.total_out);
+}
+
+static bool lossless_encode(lossless_t *handle, struct lossless_packet *pkt)
+{
+   switch (pkt->type)
+   {
+      case RLV_PACKET_DUPE_FRAME:
+         // Nothing to repeat if the very first frame was a dupe.
+         if (!handle->has_prev)
+            return true;
+         return lossless_write_packet(handle, pkt->type, NULL, 0, NULL, 0);
+
+      case RLV_PACKET_AUDIO:
+         return lossless_write_packet(handle, pkt->type, NULL, 0, pkt->data, pkt->size);
+
+      default:
+         return lossless_encode_video(handle, pkt);
+   }
+}
+
+static void lossless_thread(void *data)
+{
+   lossless_t *handle = (lossless_t*)data;
+
+   for (;;)
+   {
+      struct lossless_packet *pkt;
+      bool ret;
+
+      slock_lock(handle->lock);
+      while (!handle->count && !handle->quit)
+         scond_wait(handle->cond, handle->lock);
+      if (!handle->count)
+      {
+         slock_unlock(handle->lock);
+         break;
+      }
+      pkt = &handle->packets[handle->read_index];
+      slock_unlock(handle->lock);
+
+      RARCH_PERFORMANCE_INIT(lossless_frame);
+      RARCH_PERFORMANCE_START(lossless_frame);
+      ret = lossless_encode(handle, pkt);
+      RARCH_PERFORMANCE_STOP(lossless_frame);
+
+      slock_lock(handle->lock);
+      handle->read_index = (handle->read_index + 1) % LOSSLESS_PACKETS;
+      handle->count--;
+      if (!ret)
+         handle->alive = false;
+      scond_broadcast(handle->cond);
+      slock_unlock(handle->lock);
+
+      if (!ret)
+      {
+         RARCH_ERR("[Lossless]: Failed to write to \"%s\".\n", handle->params.filename);
+         break;
+      }
+   }
+}
+
+static void lossless_stop(lossless_t *handle)
+{
+   if (!handle->thread)
+      return;
+
+   slock_lock(handle->lock);
+   handle->quit = true;
+   scond_broadcast(handle->cond);
+   slock_unlock(handle->lock);
+
+   sthread_join(handle->thread);
+   handle->thread = NULL;
+}
+
+static void lossless_free(void *data)
+{
+   unsigned i;
+   lossless_t *handle = (lossless_t*)data;
+   if (!handle)
+      return;
+
+   lossless_stop(handle);
+
+   if (handle->file)
+      fclose(handle->file);
+   free(handle->file_buf);
+
+   if (handle->lock)
+      slock_free(handle->lock);
+   if (handle->cond)
+      scond_free(handle->cond);
+   if (handle->push_lock)
+      slock_free(handle->push_lock);
+
+   if (handle->stream_init)
+      deflateEnd(&handle->stream);
+
+   for (i = 0; i < LOSSLESS_PACKETS; i++)
+      free(handle->packets[i].data);
+   free(handle->prev);
+   free(handle->delta);
+   free(handle->out);
+   free(handle);
+}
+
+static void *lossless_new(const struct ffemu_params *params)
+{
+   uint8_t header[RLV_HEADER_SIZE];
+   lossless_t *handle = (lossless_t*)calloc(1, sizeof(*handle));
+   if (!handle)
+      return NULL;
+
+   handle->params = *params;
+   switch (params->pix_fmt)
+   {
+      case FFEMU_PIX_RGB565:
+         handle->pix_size = sizeof(uint16_t);
+         break;
+      case FFEMU_PIX_BGR24:
+         handle->pix_size = 3;
+         break;
+      case FFEMU_PIX_ARGB8888:
+         handle->pix_size = sizeof(uint32_t);
+         break;
+      default:
+         goto error;
+   }
+
+   if (deflateInit(&handle->stream, Z_BEST_SPEED) != Z_OK)
+      goto error;
+   handle->stream_init = true;
+
+   handle->file = fopen(params->filename, "wb");
+   if (!handle->file)
+   {
+      RARCH_ERR("[Lossless]: Failed to open \"%s\".\n", params->filename);
+      goto error;
+   }
+
+   handle->file_buf = (char*)malloc(LOSSLESS_FILE_BUFFER);
+   if (handle->file_buf)
+      setvbuf(handle->file, handle->file_buf, _IOFBF, LOSSLESS_FILE_BUFFER);
+
+   memcpy(header, RLV_MAGIC, 8);
+   rlv_write_le32(header + 8, params->pix_fmt);
+   rlv_write_le32(header + 12, params->channels);
+   rlv_write_f64(header + 16, params->fps);
+   rlv_write_f64(header + 24, params->samplerate);
+   rlv_write_f32(header + 32, params->aspect_ratio);
+   if (fwrite(header, 1, sizeof(header), handle->file) != sizeof(header))
+      goto error;
+
+   handle->lock = slock_new();
+   handle->cond = scond_new();
+   handle->push_lock = slock_new();
+   if (!handle->lock || !handle->cond || !handle->push_lock)
+      goto error;
+
+   handle->alive = true;
+   if (!(handle->thread = sthread_create(lossless_thread, handle)))
+      goto error;
+
+   if (strcasecmp(path_get_extension(params->filename), "rlv") != 0)
+      RARCH_WARN("[Lossless]: \"%s\" will be an .rlv file, use retroarch-rlv to convert it.\n", params->filename);
+
+   RARCH_LOG("[Lossless]: Recording to \"%s\".\n", params->filename);
+   return handle;
+
+error:
+   lossless_free(handle);
+   return NULL;
+}
+
+// Waits for a free packet. Called with push_lock held, so the packet is ours until it is queued.
+// Threaded audio drivers can still push after the writer has stopped, that must not wait forever.
+static struct lossless_packet *lossless_get_packet(lossless_t *handle)
+{
+   struct lossless_packet *pkt = NULL;
+
+   slock_lock(handle->lock);
+   while (handle->alive && !handle->quit && handle->count == LOSSLESS_PACKETS)
+      scond_wait(handle->cond, handle->lock);
+   if (handle->alive && !handle->quit)
+      pkt = &handle->packets[(handle->read_index + handle->count) % LOSSLESS_PACKETS];
+   slock_unlock(handle->lock);
+
+   return pkt;
+}
+
+static void lossless_queue_packet(lossless_t *handle)
+{
+   slock_lock(handle->lock);
+   handle->count++;
+   scond_broadcast(handle->cond);
+   slock_unlock(handle->lock);
+}
+
+static bool lossless_push_packet(lossless_t *handle, const struct ffemu_video_data *video_data,
+      const struct ffemu_audio_data *audio_data)
+{
+   unsigned y;
+   struct lossless_packet *pkt;
+
+   if (!(pkt = lossless_get_packet(handle)))
+      return false;
+
+   if (audio_data)
+   {
+      pkt->type = RLV_PACKET_AUDIO;
+      pkt->size = audio_data->frames * handle->params.channels * sizeof(int16_t);
+      if (!lossless_reserve(&pkt->data, &pkt->capacity, pkt->size))
+         return false;
+      memcpy(pkt->data, audio_data->data, pkt->size);
+   }
+   else if (video_data->is_dupe || !video_data->data)
+   {
+      pkt->type = RLV_PACKET_DUPE_FRAME;
+      pkt->size = 0;
+   }
+   else
+   {
+      // Tightly pack the frame, libretro tends to use a very large pitch.
+      size_t line_size = video_data->width * handle->pix_size;
+      const uint8_t *src = (const uint8_t*)video_data->data;
+
+      pkt->type   = RLV_PACKET_KEY_FRAME;
+      pkt->width  = video_data->width;
+      pkt->height = video_data->height;
+      pkt->size   = line_size * video_data->height;
+      if (!lossless_reserve(&pkt->data, &pkt->capacity, pkt->size))
+         return false;
+
+      for (y = 0; y < video_data->height; y++, src += video_data->pitch)
+         memcpy(pkt->data + y * line_size, src, line_size);
+   }
+
+   lossless_queue_packet(handle);
+   return true;
+}
+
+static bool lossless_push_video(void *data, const struct ffemu_video_data *video_data)
+{
+   bool ret;
+   lossless_t *handle = (lossless_t*)data;
+
+   if (!handle || !video_data)
+      return false;
+
+   slock_lock(handle->push_lock);
+   ret = lossless_push_packet(handle, video_data, NULL);
+   slock_unlock(handle->push_lock);
+   return ret;
+}
+
+static bool lossless_push_audio(void *data, const struct ffemu_audio_data *audio_data)
+{
+   bool ret;
+   lossless_t *handle = (lossless_t*)data;
+
+   if (!handle || !audio_data)
+      return false;
+
+   if (!audio_data->frames)
+      return true;
+
+   slock_lock(handle->push_lock);
+   ret = lossless_push_packet(handle, NULL, audio_data);
+   slock_unlock(handle->push_lock);
+   return ret;
+}
+
+static bool lossless_finalize(void *data)
+{
+   lossless_t *handle = (lossless_t*)data;
+   bool ret;
+
+   if (!handle)
+      return false;
+
+   lossless_stop(handle);
+   ret = handle->alive && fflush(handle->file) == 0;
+
+   if (handle->bytes_in)
+      RARCH_LOG("[Lossless]: Wrote %.1f MB of frames in %.1f MB.\n",
+            handle->bytes_in / (1024.0 * 1024.0), handle->bytes_out / (1024.0 * 1024.0));
+
+   return ret;
+}
+
+const ffemu_backend_t ffemu_lossless = {
+   lossless_new,
+   lossless_free,
+   lossless_push_video,
+   lossless_push_audio,
+   lossless_finalize,
+   "lossless",
+};
@@ -0,0 +1,105 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2014 - Hans-Kristian Arntzen
+ *
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __FFEMU_LOSSLESS_H
+#define __FFEMU_LOSSLESS_H
+
+#include <stdint.h>
+#include <string.h>
+
+// Container written by the lossless recording backend (.rlv).
+// Everything is little endian.
+//
+// The header is RLV_MAGIC followed by:
+//    u32 pix_fmt (enum ffemu_pix_format), u32 channels,
+//    f64 fps, f64 sample rate, f32 aspect ratio.
+//
+// Then follows a sequence of packets, in the order they were pushed:
+//    u32 type, u32 payload size, payload.
+//
+// Video payloads are u32 width, u32 height and a zlib stream of the frame,
+// tightly packed in the input pixel format.
+// A delta frame holds the XOR against the previous frame, which always has the same size.
+// Audio payloads are interleaved signed 16-bit PCM.
+
+#define RLV_MAGIC "RLVIDEO1"
+#define RLV_HEADER_SIZE (8 + 4 + 4 + 8 + 8 + 4)
+#define RLV_PACKET_HEADER_SIZE 8
+#define RLV_VIDEO_HEADER_SIZE 8
+
+enum rlv_packet_type
+{
+   RLV_PACKET_KEY_FRAME = 0,
+   RLV_PACKET_DELTA_FRAME,
+   RLV_PACKET_DUPE_FRAME, // No payload, shows the previous frame again.
+   RLV_PACKET_AUDIO
+};
+
+static inline void rlv_write_le32(uint8_t *buf, uint32_t val)
+{
+   buf[0] = (uint8_t)(val >>  0);
+   buf[1] = (uint8_t)(val >>  8);
+   buf[2] = (uint8_t)(val >> 16);
+   buf[3] = (uint8_t)(val >> 24);
+}
+
+static inline uint32_t rlv_read_le32(const uint8_t *buf)
+{
+   return ((uint32_t)buf[0] << 0) | ((uint32_t)buf[1] << 8) |
+      ((uint32_t)buf[2] << 16) | ((uint32_t)buf[3] << 24);
+}
+
+static inline void rlv_write_le64(uint8_t *buf, uint64_t val)
+{
+   rlv_write_le32(buf + 0, (uint32_t)val);
+   rlv_write_le32(buf + 4, (uint32_t)(val >> 32));
+}
+
+static inline uint64_t rlv_read_le64(const uint8_t *buf)
+{
+   return rlv_read_le32(buf) | ((uint64_t)rlv_read_le32(buf + 4) << 32);
+}
+
+static inline void rlv_write_f64(uint8_t *buf, double val)
+{
+   uint64_t bits;
+   memcpy(&bits, &val, sizeof(bits));
+   rlv_write_le64(buf, bits);
+}
+
+static inline double rlv_read_f64(const uint8_t *buf)
+{
+   double val;
+   uint64_t bits = rlv_read_le64(buf);
+   memcpy(&val, &bits, sizeof(val));
+   return val;
+}
+
+static inline void rlv_write_f32(uint8_t *buf, float val)
+{
+   uint32_t bits;
+   memcpy(&bits, &val, sizeof(bits));
+   rlv_write_le32(buf, bits);
+}
+
+static inline float rlv_read_f32(const uint8_t *buf)
+{
+   float val;
+   uint32_t bits = rlv_read_le32(buf);
+   memcpy(&val, &bits, sizeof(val));
+   return val;
+}
+
+#endif
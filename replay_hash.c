@@ -0,0 +1,313 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2014 - Hans-Kristian Arntzen
+ *
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "replay_hash.h"
+#include "hash.h"
+#include "general.h"
+#include "dynamic.h"
+#include "performance.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct replay_entry
+{
+   char video[9];
+   char audio[9];
+   char state[65];
+};
+
+struct replay_hash
+{
+   FILE *log;
+   FILE *verify;
+   unsigned interval;
+   bool hash_audio;
+
+   // The frame being run. Only folded into the interval once it completed,
+   // so a frame cut short by the end of the movie is not logged.
+   uint32_t frame_video;
+   uint32_t frame_audio;
+   bool frame_has_video;
+
+   uint32_t video;
+   uint32_t audio;
+   unsigned frames; // Frames in the current interval.
+   uint64_t last_frame;
+   uint64_t first_frame;
+   uint64_t total_frames;
+   bool skip_to_first; // Verified log has not been read up to first_frame yet.
+
+   uint8_t *state;
+   size_t state_size;
+
+   int64_t diverged;
+   const char *mismatch;
+};
+
+replay_hash_t *replay_hash_new(const char *log_path, const char *verify_path,
+      unsigned interval, bool hash_audio, uint64_t first_frame)
+{
+   replay_hash_t *handle = (replay_hash_t*)calloc(1, sizeof(*handle));
+   if (!handle)
+      return NULL;
+
+   handle->interval      = interval ? interval : 1;
+   handle->hash_audio    = hash_audio;
+   handle->diverged      = -1;
+   handle->first_frame   = first_frame;
+   handle->skip_to_first = first_frame > 0;
+
+   if (verify_path && !(handle->verify = fopen(verify_path, "r")))
+   {
+      RARCH_ERR("Couldn't open replay hash log \"%s\".\n", verify_path);
+      goto error;
+   }
+
+   if (log_path)
+   {
+      if (!(handle->log = fopen(log_path, "w")))
+      {
+         RARCH_ERR("Couldn't open replay hash log \"%s\" for writing.\n", log_path);
+         goto error;
+      }
+
+      fprintf(handle->log, "# %s %s, interval %u, from frame %llu\n",
+            g_extern.system.info.library_name, g_extern.system.info.library_version, handle->interval,
+            (unsigned long long)handle->first_frame);
+   }
+
+   handle->state_size = pretro_serialize_size();
+   if (handle->state_size && !(handle->state = (uint8_t*)malloc(handle->state_size)))
+      goto error;
+
+   return handle;
+
+error:
+   replay_hash_free(handle);
+   return NULL;
+}
+
+void replay_hash_free(replay_hash_t *handle)
+{
+   if (!handle)
+      return;
+
+   if (handle->log)
+      fclose(handle->log);
+   if (handle->verify)
+      fclose(handle->verify);
+   free(handle->state);
+   free(handle);
+}
+
+void replay_hash_video(replay_hash_t *handle, const void *data,
+      unsigned width, unsigned height, size_t pitch, unsigned bpp)
+{
+   unsigned h;
+   uint32_t size[2];
+   const uint8_t *in = (const uint8_t*)data;
+   uint32_t crc = 0;
+
+   // Dupes hash as the previous frame, like they would show.
+   if (!data)
+   {
+      handle->frame_has_video = true;
+      return;
+   }
+
+   RARCH_PERFORMANCE_INIT(replay_hash_video_crc);
+   RARCH_PERFORMANCE_START(replay_hash_video_crc);
+
+   size[0] = width;
+   size[1] = height;
+   crc = crc32_update(crc, (const uint8_t*)size, sizeof(size));
+   for (h = 0; h < height; h++, in += pitch)
+      crc = crc32_update(crc, in, width * bpp);
+
+   handle->frame_video = crc;
+   handle->frame_has_video = true;
+
+   RARCH_PERFORMANCE_STOP(replay_hash_video_crc);
+}
+
+void replay_hash_audio(replay_hash_t *handle, const int16_t *data, size_t samples)
+{
+   if (handle->hash_audio)
+      handle->frame_audio = crc32_update(handle->frame_audio,
+            (const uint8_t*)data, samples * sizeof(int16_t));
+}
+
+static void replay_hash_state(replay_hash_t *handle, char *out)
+{
+   if (!handle->state_size || !pretro_serialize(handle->state, handle->state_size))
+   {
+      strlcpy(out, "-", 65);
+      return;
+   }
+
+   RARCH_PERFORMANCE_INIT(replay_hash_state_sha256);
+   RARCH_PERFORMANCE_START(replay_hash_state_sha256);
+   sha256_hash(out, handle->state, handle->state_size);
+   RARCH_PERFORMANCE_STOP(replay_hash_state_sha256);
+}
+
+static bool replay_read_entry(replay_hash_t *handle, uint64_t *frame, struct replay_entry *entry)
+{
+   char line[256];
+   unsigned long long val;
+
+   while (fgets(line, sizeof(line), handle->verify))
+   {
+      if (*line == '#' || *line == '\n')
+         continue;
+
+      if (sscanf(line, "%llu %8s %8s %64s", &val, entry->video, entry->audio, entry->state) != 4)
+         return false;
+
+      *frame = val;
+      return true;
+   }
+
+   return false;
+}
+
+static void replay_diverged(replay_hash_t *handle, uint64_t frame, const char *what,
+      const char *expected, const char *got)
+{
+   uint64_t first = frame + 1 - handle->frames;
+
+   handle->diverged = frame;
+   handle->mismatch = what;
+
+   if (first == frame)
+      RARCH_ERR("Replay diverged at frame %llu: %s is %s, expected %s.\n",
+            (unsigned long long)frame, what, got, expected);
+   else
+      RARCH_ERR("Replay diverged in frames %llu - %llu: %s is %s, expected %s.\n",
+            (unsigned long long)first, (unsigned long long)frame, what, got, expected);
+}
+
+// Logs and verifies the interval ending with frame.
+static bool replay_hash_flush(replay_hash_t *handle, uint64_t frame)
+{
+   struct replay_entry entry, expected;
+   uint64_t expected_frame;
+   bool found;
+
+   snprintf(entry.video, sizeof(entry.video), "%08x", (unsigned)handle->video);
+   if (handle->hash_audio)
+      snprintf(entry.audio, sizeof(entry.audio), "%08x", (unsigned)handle->audio);
+   else
+      strlcpy(entry.audio, "-", sizeof(entry.audio));
+   replay_hash_state(handle, entry.state);
+
+   if (handle->log)
+      fprintf(handle->log, "%llu %s %s %s\n", (unsigned long long)frame,
+            entry.video, entry.audio, entry.state);
+
+   handle->video  = 0;
+   handle->audio  = 0;
+
+   if (!handle->verify || handle->diverged >= 0)
+   {
+      handle->frames = 0;
+      return true;
+   }
+
+   found = replay_read_entry(handle, &expected_frame, &expected);
+   // A seeked replay compares from its first frame on.
+   while (found && handle->skip_to_first && expected_frame < frame + 1 - handle->frames)
+      found = replay_read_entry(handle, &expected_frame, &expected);
+   handle->skip_to_first = false;
+
+   if (!found)
+   {
+      RARCH_ERR("Replay hash log ends before frame %llu.\n", (unsigned long long)frame);
+      handle->diverged = frame;
+      handle->mismatch = "length";
+   }
+   else if (expected_frame != frame)
+   {
+      RARCH_ERR("Replay hash log has frame %llu where frame %llu was expected. Was it written with another interval?\n",
+            (unsigned long long)expected_frame, (unsigned long long)frame);
+      handle->diverged = frame;
+      handle->mismatch = "length";
+   }
+   // Only compare what both runs hashed.
+   else if (strcmp(entry.video, expected.video))
+      replay_diverged(handle, frame, "video", expected.video, entry.video);
+   else if (*entry.audio != '-' && *expected.audio != '-' && strcmp(entry.audio, expected.audio))
+      replay_diverged(handle, frame, "audio", expected.audio, entry.audio);
+   else if (*entry.state != '-' && *expected.state != '-' && strcmp(entry.state, expected.state))
+      replay_diverged(handle, frame, "state", expected.state, entry.state);
+
+   handle->frames = 0;
+   return handle->diverged < 0;
+}
+
+bool replay_hash_frame(replay_hash_t *handle, uint64_t frame)
+{
+   if (handle->frame_has_video)
+      handle->video = crc32_update(handle->video, (const uint8_t*)&handle->frame_video, sizeof(uint32_t));
+   handle->audio = crc32_update(handle->audio, (const uint8_t*)&handle->frame_audio, sizeof(uint32_t));
+
+   handle->frame_audio     = 0;
+   handle->frame_has_video = false;
+   handle->last_frame      = frame;
+   handle->total_frames++;
+
+   if (++handle->frames < handle->interval)
+      return true;
+
+   return replay_hash_flush(handle, frame);
+}
+
+bool replay_hash_finish(replay_hash_t *handle)
+{
+   uint64_t expected_frame;
+   struct replay_entry expected;
+
+   if (handle->frames && !replay_hash_flush(handle, handle->last_frame))
+      return false;
+
+   if (handle->verify && handle->diverged < 0 && replay_read_entry(handle, &expected_frame, &expected))
+   {
+      RARCH_ERR("Replay ended at frame %llu, but the hash log continues to frame %llu.\n",
+            (unsigned long long)(handle->first_frame + handle->total_frames), (unsigned long long)expected_frame);
+      handle->diverged = handle->first_frame + handle->total_frames;
+      handle->mismatch = "length";
+   }
+
+   if (handle->log)
+      fflush(handle->log);
+
+   return handle->diverged < 0;
+}
+
+int64_t replay_hash_diverged_frame(const replay_hash_t *handle)
+{
+   return handle->diverged;
+}
+
+const char *replay_hash_mismatch(const replay_hash_t *handle)
+{
+   return handle->mismatch;
+}
+
+uint64_t replay_hash_frames(const replay_hash_t *handle)
+{
+   return handle->total_frames;
+}
@@ -0,0 +1,63 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2014 - Hans-Kristian Arntzen
+ *
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __RARCH_REPLAY_HASH_H
+#define __RARCH_REPLAY_HASH_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "boolean.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Hashes core output while a movie plays back, to check that a build or core is still deterministic.
+//
+// Every interval frames a line is logged:
+//    frame video_crc32 audio_crc32 state_sha256
+// frame is the last frame of the interval, counting from 0.
+// The CRCs cover every frame of the interval, the state is serialized after the last one.
+// Fields which were not hashed are "-". Lines starting with '#' are comments.
+typedef struct replay_hash replay_hash_t;
+
+// Either path may be NULL. verify_path is a log written earlier, which output is compared against.
+// first_frame is the movie frame playback starts at, a multiple of interval.
+// Lines before it in the verified log are skipped.
+replay_hash_t *replay_hash_new(const char *log_path, const char *verify_path,
+      unsigned interval, bool hash_audio, uint64_t first_frame);
+void replay_hash_free(replay_hash_t *handle);
+
+void replay_hash_video(replay_hash_t *handle, const void *data,
+      unsigned width, unsigned height, size_t pitch, unsigned bpp);
+void replay_hash_audio(replay_hash_t *handle, const int16_t *data, size_t samples);
+
+// Call once frame has been run. Returns false once output diverged from the verified log.
+bool replay_hash_frame(replay_hash_t *handle, uint64_t frame);
+// Logs the partial interval, if any. Returns false if the verified log has more frames.
+bool replay_hash_finish(replay_hash_t *handle);
+
+// First frame that differs, or -1.
+int64_t replay_hash_diverged_frame(const replay_hash_t *handle);
+// Which of "video", "audio", "state" or "length" differed first.
+const char *replay_hash_mismatch(const replay_hash_t *handle);
+// Frames hashed, not counting the frames skipped before first_frame.
+uint64_t replay_hash_frames(const replay_hash_t *handle);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
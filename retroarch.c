@@ -24,6 +24,7 @@
 #include <errno.h>
 #include "driver.h"
 #include "file.h"
+#include "file_extract.h"
 #include "general.h"
 #include "dynamic.h"
 #include "performance.h"
@@ -39,6 +40,7 @@
 #include "input/keyboard_line.h"
 #include "input/input_common.h"
 #include "git_version.h"
+#include "hash.h"
 
 #ifdef HAVE_MENU
 #include "frontend/menu/menu_common.h"
@@ -270,16 +272,50 @@ static void recording_dump_frame(const void *data, unsigned width, unsigned heig
 }
 #endif
 
+#ifdef HAVE_FRAME_EXPORT
+static void frame_export_dump_frame(const void *data, unsigned width, unsigned height, size_t pitch, bool filtered)
+{
+   bool rgb32 = filtered ? g_extern.filter.out_rgb32 : g_extern.system.pix_fmt == RETRO_PIXEL_FORMAT_XRGB8888;
+
+   if (data == RETRO_HW_FRAME_BUFFER_VALID)
+      data = NULL;
+
+   frame_export_video(g_extern.frame_export, data, width, height, pitch,
+         rgb32 ? FRAME_EXPORT_PIX_XRGB8888 : FRAME_EXPORT_PIX_RGB565);
+}
+#endif
+
+static inline bool video_frame_is_exported(void)
+{
+#ifdef HAVE_FRAME_EXPORT
+   if (g_extern.frame_export)
+      return true;
+#endif
+#ifdef HAVE_BSV_MOVIE
+   if (g_extern.replay.hash)
+      return true;
+#endif
+   return false;
+}
+
 static void video_frame(const void *data, unsigned width, unsigned height, size_t pitch)
 {
    if (!g_extern.video_active)
       return;
 
+   // Hidden run-ahead frames are still cached, a failed run-ahead redraws the real frame from here.
    g_extern.frame_cache.data   = data;
    g_extern.frame_cache.width  = width;
    g_extern.frame_cache.height = height;
    g_extern.frame_cache.pitch  = pitch;
 
+   if (g_extern.run_ahead.hide_video)
+      return;
+
+   // Skipped fast forward frames are not even converted, unless someone else wants them.
+   if (g_extern.fastforward.skip && !video_frame_is_exported())
+      return;
+
    if (g_extern.system.pix_fmt == RETRO_PIXEL_FORMAT_0RGB1555 && data && data != RETRO_HW_FRAME_BUFFER_VALID)
    {
       RARCH_PERFORMANCE_INIT(video_frame_conv);
@@ -297,12 +333,25 @@ static void video_frame(const void *data, unsigned width, unsigned height, size_
       RARCH_PERFORMANCE_STOP(video_frame_conv);
    }
 
+#ifdef HAVE_BSV_MOVIE
+   if (g_extern.replay.hash)
+      replay_hash_video(g_extern.replay.hash, data == RETRO_HW_FRAME_BUFFER_VALID ? NULL : data, width, height, pitch,
+            g_extern.system.pix_fmt == RETRO_PIXEL_FORMAT_XRGB8888 ? sizeof(uint32_t) : sizeof(uint16_t));
+#endif
+
    // Slightly messy code,
    // but we really need to do processing before blocking on VSync for best possible scheduling.
 #ifdef HAVE_RECORD
    if (g_extern.rec && (!g_extern.filter.filter || !g_settings.video.post_filter_record || !data || g_extern.record_gpu_buffer))
       recording_dump_frame(data, width, height, pitch);
 #endif
+#ifdef HAVE_FRAME_EXPORT
+   if (g_extern.frame_export && (!g_extern.filter.filter || !g_settings.frame_export.post_filter || !data))
+      frame_export_dump_frame(data, width, height, pitch, false);
+#endif
+
+   if (g_extern.fastforward.skip)
+      return;
 
    const char *msg = msg_queue_pull(g_extern.msg_queue);
    driver.current_msg = msg;
@@ -328,6 +377,10 @@ static void video_frame(const void *data, unsigned width, unsigned height, size_
       if (g_extern.rec && g_settings.video.post_filter_record)
          recording_dump_frame(g_extern.filter.buffer, owidth, oheight, opitch);
 #endif
+#ifdef HAVE_FRAME_EXPORT
+      if (g_extern.frame_export && g_settings.frame_export.post_filter)
+         frame_export_dump_frame(g_extern.filter.buffer, owidth, oheight, opitch, true);
+#endif
 
       if (!video_frame_func(g_extern.filter.buffer, owidth, oheight, opitch, msg))
          g_extern.video_active = false;
@@ -343,6 +396,17 @@ void rarch_render_cached_frame(void)
    void *recording = g_extern.rec;
    g_extern.rec = NULL;
 #endif
+#ifdef HAVE_FRAME_EXPORT
+   // Exported frames should match what the core ran, not redraws of the menu.
+   frame_export_t *frame_export = g_extern.frame_export;
+   g_extern.frame_export = NULL;
+#endif
+#ifdef HAVE_BSV_MOVIE
+   replay_hash_t *replay_hash = g_extern.replay.hash;
+   g_extern.replay.hash = NULL;
+#endif
+   bool skip = g_extern.fastforward.skip;
+   g_extern.fastforward.skip = false;
 
    const void *frame = g_extern.frame_cache.data;
    if (frame == RETRO_HW_FRAME_BUFFER_VALID)
@@ -359,6 +423,13 @@ void rarch_render_cached_frame(void)
 #ifdef HAVE_RECORD
    g_extern.rec = recording;
 #endif
+#ifdef HAVE_FRAME_EXPORT
+   g_extern.frame_export = frame_export;
+#endif
+#ifdef HAVE_BSV_MOVIE
+   g_extern.replay.hash = replay_hash;
+#endif
+   g_extern.fastforward.skip = skip;
 }
 
 static bool audio_flush(const int16_t *data, size_t samples)
@@ -373,8 +444,12 @@ static bool audio_flush(const int16_t *data, size_t samples)
       g_extern.rec_driver->push_audio(g_extern.rec, &ffemu_data);
    }
 #endif
+#ifdef HAVE_FRAME_EXPORT
+   if (g_extern.frame_export)
+      frame_export_audio(g_extern.frame_export, data, samples / 2);
+#endif
 
-   if (g_extern.is_paused || g_extern.audio_data.mute)
+   if (g_extern.is_paused || g_extern.audio_data.mute || g_extern.fastforward.skip)
       return true;
    if (!g_extern.audio_active)
       return false;
@@ -467,6 +542,18 @@ size_t audio_sample_batch_rewind(const int16_t *data, size_t frames)
 
 static void audio_sample(int16_t left, int16_t right)
 {
+   if (g_extern.run_ahead.hide_audio)
+      return;
+
+#ifdef HAVE_BSV_MOVIE
+   // Hashed as the core outputs it. A buffered chunk is flushed during whichever frame fills it.
+   if (g_extern.replay.hash)
+   {
+      int16_t samples[2] = { left, right };
+      replay_hash_audio(g_extern.replay.hash, samples, 2);
+   }
+#endif
+
    g_extern.audio_data.conv_outsamples[g_extern.audio_data.data_ptr++] = left;
    g_extern.audio_data.conv_outsamples[g_extern.audio_data.data_ptr++] = right;
 
@@ -481,9 +568,17 @@ static void audio_sample(int16_t left, int16_t right)
 
 size_t audio_sample_batch(const int16_t *data, size_t frames)
 {
+   if (g_extern.run_ahead.hide_audio)
+      return frames;
+
    if (frames > (AUDIO_CHUNK_SIZE_NONBLOCKING >> 1))
       frames = AUDIO_CHUNK_SIZE_NONBLOCKING >> 1;
 
+#ifdef HAVE_BSV_MOVIE
+   if (g_extern.replay.hash)
+      replay_hash_audio(g_extern.replay.hash, data, frames << 1);
+#endif
+
    g_extern.audio_active = audio_flush(data, frames << 1) && g_extern.audio_active;
    return frames;
 }
@@ -590,8 +685,16 @@ static inline void input_poll_overlay(void)
 
 void rarch_input_poll(void)
 {
+   // Frames run ahead use the input of the real frame. Polling again would also drop commands.
+   if (g_extern.run_ahead.hide_audio)
+      return;
+
    input_poll_func();
 
+   if (!++g_extern.input_snapshot.poll)
+      g_extern.input_snapshot.poll = 1;
+   memset(g_extern.input_snapshot.keys_valid, 0, sizeof(g_extern.input_snapshot.keys_valid));
+
 #ifdef HAVE_OVERLAY
    if (driver.overlay)
       input_poll_overlay();
@@ -619,32 +722,21 @@ static bool input_apply_turbo(unsigned port, unsigned id, bool res)
       return res;
 }
 
-static int16_t input_state(unsigned port, unsigned device, unsigned index, unsigned id)
+static const struct retro_keybind *libretro_input_binds[MAX_PLAYERS] = {
+   g_settings.input.binds[0],
+   g_settings.input.binds[1],
+   g_settings.input.binds[2],
+   g_settings.input.binds[3],
+   g_settings.input.binds[4],
+   g_settings.input.binds[5],
+   g_settings.input.binds[6],
+   g_settings.input.binds[7],
+};
+
+// Queries the driver, then applies overlay and turbo.
+static int16_t input_state_resolve(unsigned port, unsigned device, unsigned index, unsigned id)
 {
-   device &= RETRO_DEVICE_MASK;
-
-#ifdef HAVE_BSV_MOVIE
-   if (g_extern.bsv.movie && g_extern.bsv.movie_playback)
-   {
-      int16_t ret;
-      if (bsv_movie_get_input(g_extern.bsv.movie, &ret))
-         return ret;
-      else
-         g_extern.bsv.movie_end = true;
-   }
-#endif
-
-   static const struct retro_keybind *binds[MAX_PLAYERS] = {
-      g_settings.input.binds[0],
-      g_settings.input.binds[1],
-      g_settings.input.binds[2],
-      g_settings.input.binds[3],
-      g_settings.input.binds[4],
-      g_settings.input.binds[5],
-      g_settings.input.binds[6],
-      g_settings.input.binds[7],
-   };
-
+   const struct retro_keybind **binds = libretro_input_binds;
    int16_t res = 0;
    if (!driver.block_libretro_input && (id < RARCH_FIRST_META_KEY || device == RETRO_DEVICE_KEYBOARD))
       res = input_input_state_func(binds, port, device, index, id);
@@ -667,6 +759,87 @@ static int16_t input_state(unsigned port, unsigned device, unsigned index, unsig
    if (device == RETRO_DEVICE_JOYPAD && (id < RETRO_DEVICE_ID_JOYPAD_UP || id > RETRO_DEVICE_ID_JOYPAD_RIGHT))
       res = input_apply_turbo(port, id, res);
 
+   return res;
+}
+
+static inline uint16_t input_snapshot_buttons(unsigned port)
+{
+   unsigned id;
+
+   if (g_extern.input_snapshot.buttons_poll[port] != g_extern.input_snapshot.poll)
+   {
+      uint16_t buttons = 0;
+      for (id = 0; id < RARCH_FIRST_CUSTOM_BIND; id++)
+         if (input_state_resolve(port, RETRO_DEVICE_JOYPAD, 0, id))
+            buttons |= 1 << id;
+
+      g_extern.input_snapshot.buttons[port] = buttons;
+      g_extern.input_snapshot.buttons_poll[port] = g_extern.input_snapshot.poll;
+   }
+
+   return g_extern.input_snapshot.buttons[port];
+}
+
+// Left X, Left Y, Right X, Right Y.
+static inline const int16_t *input_snapshot_analog(unsigned port)
+{
+   unsigned i;
+
+   if (g_extern.input_snapshot.analog_poll[port] != g_extern.input_snapshot.poll)
+   {
+      for (i = 0; i < 4; i++)
+         g_extern.input_snapshot.analog[port][i] = input_state_resolve(port, RETRO_DEVICE_ANALOG, i >> 1, i & 1);
+      g_extern.input_snapshot.analog_poll[port] = g_extern.input_snapshot.poll;
+   }
+
+   return g_extern.input_snapshot.analog[port];
+}
+
+static inline bool input_snapshot_key(unsigned id)
+{
+   uint32_t bit = 1u << (id % 32);
+
+   if (!(g_extern.input_snapshot.keys_valid[id / 32] & bit))
+   {
+      if (input_state_resolve(0, RETRO_DEVICE_KEYBOARD, 0, id))
+         g_extern.input_snapshot.keys[id / 32] |= bit;
+      else
+         g_extern.input_snapshot.keys[id / 32] &= ~bit;
+      g_extern.input_snapshot.keys_valid[id / 32] |= bit;
+   }
+
+   return g_extern.input_snapshot.keys[id / 32] & bit;
+}
+
+static int16_t input_state(unsigned port, unsigned device, unsigned index, unsigned id)
+{
+   int16_t res;
+   device &= RETRO_DEVICE_MASK;
+
+#ifdef HAVE_BSV_MOVIE
+   if (g_extern.bsv.movie && g_extern.bsv.movie_playback)
+   {
+      int16_t ret;
+      if (bsv_movie_get_input(g_extern.bsv.movie, &ret))
+         return ret;
+      else
+         g_extern.bsv.movie_end = true;
+   }
+#endif
+
+   // Cores ask for the same few buttons of every port each frame, so resolve those once per poll.
+   // Everything else, or a core which never polled, goes straight to the driver.
+   if (!g_extern.input_snapshot.poll || port >= MAX_PLAYERS)
+      res = input_state_resolve(port, device, index, id);
+   else if (device == RETRO_DEVICE_JOYPAD && id < RARCH_FIRST_CUSTOM_BIND)
+      res = (input_snapshot_buttons(port) >> id) & 1;
+   else if (device == RETRO_DEVICE_ANALOG && index <= RETRO_DEVICE_INDEX_ANALOG_RIGHT && id <= RETRO_DEVICE_ID_ANALOG_Y)
+      res = input_snapshot_analog(port)[(index << 1) | id];
+   else if (device == RETRO_DEVICE_KEYBOARD && port == 0 && id < RETROK_LAST)
+      res = input_snapshot_key(id);
+   else
+      res = input_state_resolve(port, device, index, id);
+
 #ifdef HAVE_BSV_MOVIE
    if (g_extern.bsv.movie && !g_extern.bsv.movie_playback)
       bsv_movie_set_input(g_extern.bsv.movie, res);
@@ -716,12 +889,39 @@ static void print_features(void)
    _PSUPP(fbo, "FBO", "OpenGL render-to-texture (multi-pass shaders)");
    _PSUPP(dynamic, "Dynamic", "Dynamic run-time loading of libretro library");
    _PSUPP(ffmpeg, "FFmpeg", "On-the-fly recording of gameplay with libavcodec");
+   _PSUPP(lossless, "Lossless", "Lossless .rlv recording of gameplay with zlib");
    _PSUPP(freetype, "FreeType", "TTF font rendering with FreeType");
    _PSUPP(netplay, "Netplay", "Peer-to-peer netplay");
    _PSUPP(python, "Python", "Script support in shaders");
 }
 #undef _PSUPP
 
+// --benchmark hash. Returns false if any SIMD path disagrees with the portable one.
+static bool print_hash_benchmark(void)
+{
+   size_t i, num;
+   bool match = true;
+   struct hash_bench_result results[8];
+   const size_t size = 32 * 1024 * 1024;
+
+   num = hash_benchmark(size, results, sizeof(results) / sizeof(results[0]));
+
+   printf("{\n  \"hash_benchmark\": {\n");
+   printf("    \"size\": %u,\n", (unsigned)size);
+   printf("    \"paths\": [\n");
+   for (i = 0; i < num; i++)
+   {
+      printf("      { \"algorithm\": \"%s\", \"path\": \"%s\", \"selected\": %s, \"match\": %s, \"gbps\": %.3f }%s\n",
+            results[i].algorithm, results[i].path,
+            results[i].selected ? "true" : "false", results[i].match ? "true" : "false",
+            results[i].gbps, i + 1 < num ? "," : "");
+      match &= results[i].match;
+   }
+   printf("    ]\n  }\n}\n");
+   fflush(stdout);
+   return match && num;
+}
+
 static void print_compiler(FILE *file)
 {
    fprintf(file, "\nCompiler: ");
@@ -805,6 +1005,7 @@ static void print_help(void)
 
 #ifdef HAVE_RECORD
    puts("\t-r/--record: Path to record video file.\n\t\tUsing .mkv extension is recommended.");
+   puts("\t\tWithout FFmpeg, or with .rlv extension, a lossless .rlv file is written. Convert it with retroarch-rlv.");
    puts("\t--recordconfig: Path to settings used during recording.");
    puts("\t--size: Overrides output video size when recording with FFmpeg (format: WIDTHxHEIGHT).");
 #endif
@@ -813,6 +1014,18 @@ static void print_help(void)
    puts("\t--bps: Specifies path for BPS patch that will be applied to ROM.");
    puts("\t--ips: Specifies path for IPS patch that will be applied to ROM.");
    puts("\t--no-patch: Disables all forms of rom patching.");
+   puts("\t--benchmark: Runs content for N frames with null drivers and no frame limiting.");
+   puts("\t\tFrames per second and performance counters are printed to stdout as JSON.");
+   puts("\t\tCombine with --bsvplay for deterministic input.");
+   puts("\t\t--benchmark hash instead prints CRC32 and SHA-256 throughput of each implementation the CPU supports.");
+#ifdef HAVE_BSV_MOVIE
+   puts("\t--replay-hash: Plays the --bsvplay movie with null drivers and writes a log of video, audio and state hashes.");
+   puts("\t--replay-verify: Plays the --bsvplay movie with null drivers and compares against a log written by --replay-hash.");
+   puts("\t\tThe first divergent frame is reported, and RetroArch exits with status 1.");
+   puts("\t--replay-interval: Frames between each logged hash. Defaults to 1.");
+   puts("\t--bsvseek: Starts --bsvplay playback at this frame of a BSV2 movie. The core must support savestates.");
+   puts("\t\tWith --replay-verify, only frames from there on are compared, e.g. to bisect a divergence.");
+#endif
    puts("\t-D/--detach: Detach RetroArch from the running console. Not relevant for all platforms.\n");
 }
 
@@ -911,6 +1124,13 @@ static void parse_input(int argc, char *argv[])
 
    *g_extern.subsystem = '\0';
 
+   g_extern.benchmark.frames = 0;
+#ifdef HAVE_BSV_MOVIE
+   *g_extern.replay.log_path = '\0';
+   *g_extern.replay.verify_path = '\0';
+   g_extern.replay.interval = 1;
+#endif
+
    if (argc < 2)
    {
       g_extern.libretro_dummy = true;
@@ -962,6 +1182,13 @@ static void parse_input(int argc, char *argv[])
       { "bps", 1, &val, 'B' },
       { "ips", 1, &val, 'I' },
       { "no-patch", 0, &val, 'n' },
+      { "benchmark", 1, &val, 'b' },
+#ifdef HAVE_BSV_MOVIE
+      { "replay-hash", 1, &val, 'y' },
+      { "replay-verify", 1, &val, 'V' },
+      { "replay-interval", 1, &val, 'i' },
+      { "bsvseek", 1, &val, 'k' },
+#endif
       { "detach", 0, NULL, 'D' },
       { "features", 0, &val, 'f' },
       { "subsystem", 1, NULL, 'Z' },
@@ -1212,6 +1439,43 @@ static void parse_input(int argc, char *argv[])
                   g_extern.block_patch = true;
                   break;
 
+               case 'b':
+                  if (!strcmp(optarg, "hash"))
+                     exit(print_hash_benchmark() ? 0 : 1);
+
+                  g_extern.benchmark.frames = strtoul(optarg, NULL, 0);
+                  if (!g_extern.benchmark.frames)
+                  {
+                     RARCH_ERR("--benchmark needs a frame count larger than 0.\n");
+                     print_help();
+                     rarch_fail(1, "parse_input()");
+                  }
+                  break;
+
+#ifdef HAVE_BSV_MOVIE
+               case 'y':
+                  strlcpy(g_extern.replay.log_path, optarg, sizeof(g_extern.replay.log_path));
+                  break;
+
+               case 'V':
+                  strlcpy(g_extern.replay.verify_path, optarg, sizeof(g_extern.replay.verify_path));
+                  break;
+
+               case 'i':
+                  g_extern.replay.interval = strtoul(optarg, NULL, 0);
+                  if (!g_extern.replay.interval)
+                  {
+                     RARCH_ERR("--replay-interval needs a frame count larger than 0.\n");
+                     print_help();
+                     rarch_fail(1, "parse_input()");
+                  }
+                  break;
+
+               case 'k':
+                  g_extern.bsv.movie_start_frame = strtoull(optarg, NULL, 0);
+                  break;
+#endif
+
 #ifdef HAVE_RECORD
                case 's':
                {
@@ -1247,6 +1511,31 @@ static void parse_input(int argc, char *argv[])
       }
    }
 
+#ifdef HAVE_BSV_MOVIE
+   if ((*g_extern.replay.log_path || *g_extern.replay.verify_path) && !g_extern.bsv.movie_start_playback)
+   {
+      RARCH_ERR("--replay-hash and --replay-verify need a movie to play with --bsvplay.\n");
+      print_help();
+      rarch_fail(1, "parse_input()");
+   }
+
+   if (g_extern.bsv.movie_start_frame && !g_extern.bsv.movie_start_playback)
+   {
+      RARCH_ERR("--bsvseek needs a movie to play with --bsvplay.\n");
+      print_help();
+      rarch_fail(1, "parse_input()");
+   }
+
+   // Hash log lines must cover the same frames as in a replay from the start.
+   if ((*g_extern.replay.log_path || *g_extern.replay.verify_path) &&
+         g_extern.bsv.movie_start_frame % g_extern.replay.interval)
+   {
+      RARCH_ERR("--bsvseek must be a multiple of --replay-interval.\n");
+      print_help();
+      rarch_fail(1, "parse_input()");
+   }
+#endif
+
    if (g_extern.libretro_dummy)
    {
       if (optind < argc)
@@ -1430,7 +1719,7 @@ void rarch_init_recording(void)
       }
    }
 
-   RARCH_LOG("Recording with FFmpeg to %s @ %ux%u. (FB size: %ux%u pix_fmt: %u)\n",
+   RARCH_LOG("Recording to %s @ %ux%u. (FB size: %ux%u pix_fmt: %u)\n",
          g_extern.record_path,
          params.out_width, params.out_height,
          params.fb_width, params.fb_height,
@@ -1438,10 +1727,12 @@ void rarch_init_recording(void)
 
    if (!ffemu_init_first(&g_extern.rec_driver, &g_extern.rec, &params))
    {
-      RARCH_ERR("Failed to start FFmpeg recording.\n");
+      RARCH_ERR("Failed to start recording.\n");
       free(g_extern.record_gpu_buffer);
       g_extern.record_gpu_buffer = NULL;
    }
+   else
+      RARCH_LOG("Recording backend: %s.\n", g_extern.rec_driver->ident);
 }
 
 void rarch_deinit_recording(void)
@@ -1460,6 +1751,44 @@ void rarch_deinit_recording(void)
 }
 #endif
 
+#ifdef HAVE_FRAME_EXPORT
+void rarch_init_frame_export(void)
+{
+   struct frame_export_params params = {0};
+   const struct retro_system_av_info *info = &g_extern.system.av_info;
+
+   if (!*g_settings.frame_export.shm_name || g_extern.libretro_dummy)
+      return;
+
+   if (g_extern.system.hw_render_callback.context_type)
+   {
+      RARCH_WARN("Libretro core is hardware rendered. Frame export is not supported.\n");
+      return;
+   }
+
+   params.max_width   = info->geometry.max_width;
+   params.max_height  = info->geometry.max_height;
+   params.video_slots = g_settings.frame_export.video_slots;
+   params.channels    = 2;
+   params.fps         = info->timing.fps;
+   params.sample_rate = info->timing.sample_rate;
+
+   if (g_settings.frame_export.post_filter && g_extern.filter.filter)
+      rarch_softfilter_get_max_output_size(g_extern.filter.filter, &params.max_width, &params.max_height);
+
+   g_extern.frame_export = frame_export_new(g_settings.frame_export.shm_name, &params);
+   if (g_extern.frame_export)
+      RARCH_LOG("Exporting frames to shared memory \"%s\" (%u slots, max %ux%u).\n",
+            g_settings.frame_export.shm_name, params.video_slots, params.max_width, params.max_height);
+}
+
+void rarch_deinit_frame_export(void)
+{
+   frame_export_free(g_extern.frame_export);
+   g_extern.frame_export = NULL;
+}
+#endif
+
 void rarch_init_msg_queue(void)
 {
    if (g_extern.msg_queue)
@@ -1526,6 +1855,37 @@ void rarch_deinit_rewind(void)
    g_extern.state_manager = NULL;
 }
 
+static void init_run_ahead(void)
+{
+   if (!g_settings.run_ahead_frames || g_extern.run_ahead.state)
+      return;
+
+   g_extern.run_ahead.state_size = pretro_serialize_size();
+   if (!g_extern.run_ahead.state_size)
+   {
+      RARCH_ERR("Implementation does not support save states. Cannot use run-ahead.\n");
+      return;
+   }
+
+   g_extern.run_ahead.state = malloc(g_extern.run_ahead.state_size);
+   if (!g_extern.run_ahead.state)
+   {
+      RARCH_ERR("Failed to allocate run-ahead state.\n");
+      return;
+   }
+
+   g_extern.run_ahead.warned = false;
+   RARCH_LOG("Running %u frame(s) ahead.\n", g_settings.run_ahead_frames);
+}
+
+static void deinit_run_ahead(void)
+{
+   free(g_extern.run_ahead.state);
+   g_extern.run_ahead.state = NULL;
+   g_extern.run_ahead.hide_video = false;
+   g_extern.run_ahead.hide_audio = false;
+}
+
 #ifdef HAVE_BSV_MOVIE
 static void init_movie(void)
 {
@@ -1569,6 +1929,31 @@ static void deinit_movie(void)
    if (g_extern.bsv.movie)
       bsv_movie_free(g_extern.bsv.movie);
 }
+
+static void init_replay_hash(void)
+{
+   bool hash_audio;
+
+   if (!*g_extern.replay.log_path && !*g_extern.replay.verify_path)
+      return;
+
+   // Audio callbacks run on their own schedule, so their audio does not line up with frames.
+   hash_audio = !g_extern.system.audio_callback.callback;
+   if (!hash_audio)
+      RARCH_WARN("Core uses an audio callback, audio will not be hashed.\n");
+
+   g_extern.replay.hash = replay_hash_new(*g_extern.replay.log_path ? g_extern.replay.log_path : NULL,
+         *g_extern.replay.verify_path ? g_extern.replay.verify_path : NULL,
+         g_extern.replay.interval, hash_audio, g_extern.bsv.movie_start_frame);
+   if (!g_extern.replay.hash)
+      rarch_fail(1, "init_replay_hash()");
+}
+
+static void deinit_replay_hash(void)
+{
+   replay_hash_free(g_extern.replay.hash);
+   g_extern.replay.hash = NULL;
+}
 #endif
 
 #define RARCH_DEFAULT_PORT 55435
@@ -2887,6 +3272,259 @@ static void validate_cpu_features(void)
 #endif
 }
 
+// Overrides whatever config_load() picked. Nothing a headless run does should be persisted.
+static void set_headless_settings(void)
+{
+   strlcpy(g_settings.video.driver, "null", sizeof(g_settings.video.driver));
+   strlcpy(g_settings.audio.driver, "null", sizeof(g_settings.audio.driver));
+   strlcpy(g_settings.input.driver, "null", sizeof(g_settings.input.driver));
+   g_settings.video.threaded = false;
+   g_settings.audio.sync = false;
+   g_settings.fastforward_ratio = -1.0f;
+   g_settings.rewind_enable = false;
+   g_settings.savestate_auto_load = false;
+   g_settings.savestate_auto_save = false;
+   g_settings.load_dummy_on_core_shutdown = false;
+   g_settings.autosave_interval = 0;
+
+   g_extern.config_save_on_exit = false;
+   g_extern.sram_load_disable = true;
+   g_extern.sram_save_disable = true;
+   g_extern.perfcnt_enable = true;
+}
+
+static void init_benchmark(void)
+{
+   if (!g_extern.benchmark.frames)
+      return;
+
+   set_headless_settings();
+   g_extern.benchmark.frame = 0;
+   g_extern.benchmark.start_time = 0;
+}
+
+static void print_benchmark(void)
+{
+   retro_time_t elapsed = rarch_get_time_usec() - g_extern.benchmark.start_time;
+   double fps = elapsed > 0 ? (double)g_extern.benchmark.frame * 1000000.0 / elapsed : 0.0;
+   double core_fps = g_extern.system.av_info.timing.fps;
+
+   printf("{\n  \"benchmark\": {\n");
+   printf("    \"core\": \"%s\",\n", g_extern.system.info.library_name ? g_extern.system.info.library_name : "");
+   printf("    \"core_version\": \"%s\",\n", g_extern.system.info.library_version ? g_extern.system.info.library_version : "");
+#ifdef HAVE_BSV_MOVIE
+   printf("    \"movie\": %s,\n", g_extern.bsv.movie ? "true" : "false");
+#endif
+   printf("    \"frames\": %u,\n", g_extern.benchmark.frame);
+   printf("    \"usec\": %lld,\n", (long long)elapsed);
+   printf("    \"fps\": %.3f,\n", fps);
+   printf("    \"speed\": %.3f\n", core_fps > 0.0 ? fps / core_fps : 0.0);
+   printf("  },\n  \"counters\": ");
+   rarch_perf_export_counters(stdout, false);
+   printf("\n}\n");
+   fflush(stdout);
+}
+
+#ifdef HAVE_BSV_MOVIE
+static void init_replay_settings(void)
+{
+   if (*g_extern.replay.log_path || *g_extern.replay.verify_path)
+      set_headless_settings();
+}
+
+static void print_replay_hash(bool match)
+{
+   replay_hash_t *hash = g_extern.replay.hash;
+
+   printf("{\n  \"replay\": {\n");
+   printf("    \"core\": \"%s\",\n", g_extern.system.info.library_name ? g_extern.system.info.library_name : "");
+   printf("    \"core_version\": \"%s\",\n", g_extern.system.info.library_version ? g_extern.system.info.library_version : "");
+   printf("    \"first_frame\": %llu,\n", (unsigned long long)g_extern.bsv.movie_start_frame);
+   printf("    \"frames\": %llu,\n", (unsigned long long)replay_hash_frames(hash));
+   printf("    \"interval\": %u,\n", g_extern.replay.interval);
+   printf("    \"verified\": %s,\n", *g_extern.replay.verify_path ? "true" : "false");
+   printf("    \"match\": %s,\n", match ? "true" : "false");
+   if (match)
+      printf("    \"diverged_frame\": null,\n    \"mismatch\": null\n");
+   else
+   {
+      printf("    \"diverged_frame\": %lld,\n", (long long)replay_hash_diverged_frame(hash));
+      printf("    \"mismatch\": \"%s\"\n", replay_hash_mismatch(hash));
+   }
+   printf("  },\n  \"counters\": ");
+   rarch_perf_export_counters(stdout, false);
+   printf("\n}\n");
+   fflush(stdout);
+}
+
+// Called after each frame of movie playback.
+// The frame which ran out of input is not part of the movie, so it is not hashed.
+static void check_replay_hash(void)
+{
+   bsv_movie_t *movie = g_extern.bsv.movie;
+   replay_hash_t *hash = g_extern.replay.hash;
+   uint64_t count;
+   bool match;
+
+   if (!hash)
+      return;
+
+   count = movie ? bsv_movie_frame_count(movie) : 0;
+   if (movie && !g_extern.bsv.movie_end)
+   {
+      uint64_t frame = g_extern.bsv.movie_start_frame + replay_hash_frames(hash);
+      match = replay_hash_frame(hash, frame);
+      // BSV2 knows its length, so the run can stop without an extra frame.
+      if (match && (!count || frame + 1 < count))
+         return;
+   }
+
+   match = replay_hash_finish(hash);
+   print_replay_hash(match);
+
+   if (!match)
+      g_extern.exit_code = 1;
+   g_extern.system.shutdown = true;
+}
+#endif
+
+static void run_core(void)
+{
+   RARCH_PERFORMANCE_INIT(core_run);
+   RARCH_PERFORMANCE_START(core_run);
+   pretro_run();
+   RARCH_PERFORMANCE_STOP(core_run);
+}
+
+#ifdef HAVE_BSV_MOVIE
+// Loads the keyframe before --bsvseek, then plays back up to it.
+static void seek_movie(void)
+{
+   replay_hash_t *hash;
+   bsv_movie_t *movie = g_extern.bsv.movie;
+   uint64_t frame = g_extern.bsv.movie_start_frame;
+
+   if (!movie || !frame)
+      return;
+
+   if (frame >= bsv_movie_frame_count(movie) || !bsv_movie_seek(movie, frame))
+   {
+      RARCH_ERR("Failed to seek movie to frame %llu. This needs a BSV2 movie of more frames, and a core which can load states.\n",
+            (unsigned long long)frame);
+      rarch_fail(1, "seek_movie()");
+   }
+
+   // Frames leading up to the seek target are not hashed.
+   hash = g_extern.replay.hash;
+   g_extern.replay.hash = NULL;
+
+   RARCH_PERFORMANCE_INIT(movie_seek);
+   RARCH_PERFORMANCE_START(movie_seek);
+   while (bsv_movie_get_frame(movie) < frame)
+   {
+      bsv_movie_set_frame_start(movie);
+      run_core();
+      bsv_movie_set_frame_end(movie);
+   }
+   RARCH_PERFORMANCE_STOP(movie_seek);
+
+   g_extern.replay.hash = hash;
+   RARCH_LOG("Movie playback continues from frame %llu.\n", (unsigned long long)frame);
+}
+#endif
+
+static bool run_ahead_active(void)
+{
+   if (!g_extern.run_ahead.state || g_extern.frame_is_reverse)
+      return false;
+
+#ifdef HAVE_NETPLAY
+   // Netplay already rolls back the core on its own.
+   if (g_extern.netplay)
+      return false;
+#endif
+#ifdef HAVE_BSV_MOVIE
+   // Movies log and replay input for exactly one run per frame.
+   if (g_extern.bsv.movie)
+      return false;
+#endif
+   // Dumps take video and audio from a single timeline. Predicted frames would not match the real audio.
+#ifdef HAVE_RECORD
+   if (g_extern.rec)
+      return false;
+#endif
+#ifdef HAVE_FRAME_EXPORT
+   if (g_extern.frame_export)
+      return false;
+#endif
+
+   return true;
+}
+
+// Runs the real frame with its audio, saves state, then runs ahead with the same input
+// and only shows the last frame. Loading the state puts the core back after the real frame.
+static void run_ahead(void)
+{
+   unsigned i;
+   bool ret;
+
+   g_extern.run_ahead.hide_video = true;
+   run_core();
+   g_extern.run_ahead.hide_audio = true;
+
+   RARCH_PERFORMANCE_INIT(run_ahead_serialize);
+   RARCH_PERFORMANCE_START(run_ahead_serialize);
+   ret = pretro_serialize(g_extern.run_ahead.state, g_extern.run_ahead.state_size);
+   RARCH_PERFORMANCE_STOP(run_ahead_serialize);
+
+   if (!ret)
+   {
+      // Cores may refuse to save in some states. Show the real frame again and try next frame.
+      if (!g_extern.run_ahead.warned)
+         RARCH_WARN("Core failed to save state, not running ahead.\n");
+      g_extern.run_ahead.warned = true;
+      g_extern.run_ahead.hide_video = false;
+      g_extern.run_ahead.hide_audio = false;
+      rarch_render_cached_frame();
+      return;
+   }
+
+   RARCH_PERFORMANCE_INIT(run_ahead_run);
+   RARCH_PERFORMANCE_START(run_ahead_run);
+   for (i = 1; i <= g_settings.run_ahead_frames; i++)
+   {
+      g_extern.run_ahead.hide_video = i < g_settings.run_ahead_frames;
+      pretro_run();
+   }
+   RARCH_PERFORMANCE_STOP(run_ahead_run);
+
+   g_extern.run_ahead.hide_video = false;
+   g_extern.run_ahead.hide_audio = false;
+
+   RARCH_PERFORMANCE_INIT(run_ahead_unserialize);
+   RARCH_PERFORMANCE_START(run_ahead_unserialize);
+   ret = pretro_unserialize(g_extern.run_ahead.state, g_extern.run_ahead.state_size);
+   RARCH_PERFORMANCE_STOP(run_ahead_unserialize);
+
+   if (!ret)
+   {
+      RARCH_ERR("Core failed to load run-ahead state. Disabling run-ahead.\n");
+      deinit_run_ahead();
+   }
+}
+
+static inline void check_benchmark(void)
+{
+   if (!g_extern.benchmark.frames)
+      return;
+
+   if (++g_extern.benchmark.frame < g_extern.benchmark.frames)
+      return;
+
+   print_benchmark();
+   g_extern.system.shutdown = true;
+}
+
 int rarch_main_init(int argc, char *argv[])
 {
    init_state();
@@ -2913,6 +3551,14 @@ int rarch_main_init(int argc, char *argv[])
 
    validate_cpu_features();
    config_load();
+   init_benchmark();
+#ifdef HAVE_BSV_MOVIE
+   init_replay_settings();
+#endif
+   rarch_perf_init();
+#ifdef HAVE_ZLIB
+   zlib_archive_init();
+#endif
 
    init_libretro_sym(g_extern.libretro_dummy);
    rarch_init_system_info();
@@ -2948,6 +3594,7 @@ int rarch_main_init(int argc, char *argv[])
 
 #ifdef HAVE_BSV_MOVIE
       init_movie();
+      init_replay_hash();
 #endif
 
 #ifdef HAVE_NETPLAY
@@ -2955,6 +3602,16 @@ int rarch_main_init(int argc, char *argv[])
 #endif
    }
 
+#ifdef HAVE_BSV_MOVIE
+   // Replay runs headless and only stops when the movie ends. Without content there is no movie to play.
+   if ((*g_extern.replay.log_path || *g_extern.replay.verify_path) &&
+         (!g_extern.bsv.movie || !g_extern.replay.hash))
+   {
+      RARCH_ERR("--replay-hash and --replay-verify need a core which loads content, and a movie to play.\n");
+      goto error;
+   }
+#endif
+
    init_libretro_cbs();
    init_system_av_info();
    init_drivers();
@@ -2968,11 +3625,19 @@ int rarch_main_init(int argc, char *argv[])
 #endif
       rarch_init_rewind();
 
+   init_run_ahead();
    init_controllers();
 
+#ifdef HAVE_BSV_MOVIE
+   seek_movie();
+#endif
+
 #ifdef HAVE_RECORD
    rarch_init_recording();
 #endif
+#ifdef HAVE_FRAME_EXPORT
+   rarch_init_frame_export();
+#endif
 
 #ifdef HAVE_NETPLAY
    g_extern.use_sram = g_extern.use_sram && !g_extern.sram_save_disable && (!g_extern.netplay || !g_extern.netplay_is_client);
@@ -2986,6 +3651,14 @@ int rarch_main_init(int argc, char *argv[])
 #if defined(HAVE_THREADS)
    if (g_extern.use_sram)
       rarch_init_autosave();
+
+   if (!(g_extern.state_writer = state_writer_new()))
+      RARCH_WARN("Could not initialize state writer, states will be saved synchronously.\n");
+
+#ifndef _XBOX1
+   if (!(g_extern.screenshot_writer = screenshot_writer_new()))
+      RARCH_WARN("Could not initialize screenshot writer, screenshots will be saved synchronously.\n");
+#endif
 #endif
 
 #ifdef HAVE_NETPLAY
@@ -3054,6 +3727,88 @@ static inline void update_frame_time(void)
    g_extern.system.frame_time.callback(delta);
 }
 
+static void report_fastforward_speed(retro_time_t now, bool done)
+{
+   char msg[64];
+   double fps = (double)(g_extern.fastforward.frames - g_extern.fastforward.report_frames) * 1000000.0 /
+      (now - g_extern.fastforward.report_time);
+   double speed = fps / g_extern.system.av_info.timing.fps;
+
+   if (done)
+   {
+      fps = (double)g_extern.fastforward.frames * 1000000.0 / (now - g_extern.fastforward.start_time);
+      RARCH_LOG("Fast forwarded %llu frames at %.2fx speed.\n",
+            (unsigned long long)g_extern.fastforward.frames, fps / g_extern.system.av_info.timing.fps);
+      return;
+   }
+
+   // Shown for as many frames as were presented over the last second, so it expires about when the next one comes.
+   snprintf(msg, sizeof(msg), "Fast forward: %.1fx (%.0f fps)", speed, fps);
+   msg_queue_push(g_extern.msg_queue, msg, 1,
+         g_extern.fastforward.report_presented ? g_extern.fastforward.report_presented : 1);
+
+   g_extern.fastforward.report_time = now;
+   g_extern.fastforward.report_frames = g_extern.fastforward.frames;
+   g_extern.fastforward.report_presented = 0;
+}
+
+// Decides whether the coming frame is presented.
+// While fast forwarding only every fastforward_frameskip + 1th frame, or fastforward_present_rate
+// frames per second, goes through filters, the video driver and the audio chain.
+static void update_fastforward(void)
+{
+   bool present;
+   retro_time_t now;
+
+   if (!driver.nonblock_state)
+   {
+      if (g_extern.fastforward.start_time)
+         report_fastforward_speed(rarch_get_time_usec(), true);
+      g_extern.fastforward.start_time = 0;
+      g_extern.fastforward.skip = false;
+      return;
+   }
+
+   now = rarch_get_time_usec();
+   if (!g_extern.fastforward.start_time)
+   {
+      g_extern.fastforward.start_time = now;
+      g_extern.fastforward.report_time = now;
+      g_extern.fastforward.frames = 0;
+      g_extern.fastforward.report_frames = 0;
+      g_extern.fastforward.report_presented = 0;
+      g_extern.fastforward.skipped = 0;
+      g_extern.fastforward.last_present = 0;
+   }
+   else if (g_settings.fastforward_show_speed && now - g_extern.fastforward.report_time >= 1000000)
+      report_fastforward_speed(now, false);
+
+   g_extern.fastforward.frames++;
+
+   if (g_settings.fastforward_present_rate > 0.0f)
+      present = now - g_extern.fastforward.last_present >= (retro_time_t)(1000000.0f / g_settings.fastforward_present_rate);
+   else
+      present = g_extern.fastforward.skipped >= g_settings.fastforward_frameskip;
+
+   if (present)
+   {
+      g_extern.fastforward.skipped = 0;
+      g_extern.fastforward.last_present = now;
+   }
+   else
+      g_extern.fastforward.skipped++;
+
+#ifdef HAVE_RECORD
+   // Recordings need every frame.
+   if (g_extern.rec)
+      present = true;
+#endif
+
+   if (present)
+      g_extern.fastforward.report_presented++;
+   g_extern.fastforward.skip = !present;
+}
+
 static inline void limit_frame_time(void)
 {
    if (g_settings.fastforward_ratio < 0.0f)
@@ -3187,7 +3942,16 @@ bool rarch_main_iterate(void)
    }
 
    update_frame_time();
-   pretro_run();
+   update_fastforward();
+
+   if (g_extern.benchmark.frames && !g_extern.benchmark.start_time)
+      g_extern.benchmark.start_time = rarch_get_time_usec();
+
+   if (run_ahead_active())
+      run_ahead();
+   else
+      run_core();
+
    limit_frame_time();
 
    for (i = 0; i < MAX_PLAYERS; i++)
@@ -3197,6 +3961,8 @@ bool rarch_main_iterate(void)
    }
 
 #ifdef HAVE_BSV_MOVIE
+   check_replay_hash();
+
    if (g_extern.bsv.movie)
       bsv_movie_set_frame_end(g_extern.bsv.movie);
 #endif
@@ -3210,6 +3976,9 @@ bool rarch_main_iterate(void)
    unlock_autosave();
 #endif
 
+   rarch_perf_update();
+   check_benchmark();
+
    return true;
 }
 
@@ -3237,6 +4006,9 @@ void rarch_main_deinit(void)
 #ifdef HAVE_RECORD
    rarch_deinit_recording();
 #endif
+#ifdef HAVE_FRAME_EXPORT
+   rarch_deinit_frame_export();
+#endif
 
    if (g_extern.use_sram)
       save_files();
@@ -3246,15 +4018,26 @@ void rarch_main_deinit(void)
 #endif
       rarch_deinit_rewind();
 
+   deinit_run_ahead();
    deinit_cheats();
 
 #ifdef HAVE_BSV_MOVIE
+   deinit_replay_hash();
    deinit_movie();
 #endif
 
    if (!g_extern.libretro_dummy && !g_extern.libretro_no_rom)
       save_auto_state();
 
+#if defined(HAVE_THREADS)
+   state_writer_free(g_extern.state_writer);
+   g_extern.state_writer = NULL;
+#ifndef _XBOX1
+   screenshot_writer_free(g_extern.screenshot_writer);
+   g_extern.screenshot_writer = NULL;
+#endif
+#endif
+
    uninit_drivers();
 
    rarch_main_deinit_core();
@@ -23,11 +23,16 @@
 #include "general.h"
 #include "file.h"
 #include "gfx/scaler/scaler.h"
+#include "performance.h"
 
 #ifdef HAVE_CONFIG_H
 #include "config.h"
 #endif
 
+#ifdef HAVE_THREADS
+#include "thread.h"
+#endif
+
 #ifdef HAVE_ZLIB_DEFLATE
 #include "gfx/rpng/rpng.h"
 #else
@@ -99,7 +104,7 @@ static void dump_line_32(uint8_t *line, const uint32_t *src, unsigned width)
 }
 
 static void dump_content(FILE *file, const void *frame,
-      int width, int height, int pitch, bool bgr24)
+      int width, int height, int pitch, bool bgr24, enum retro_pixel_format pix_fmt)
 {
    int i, j;
    union
@@ -128,7 +133,7 @@ static void dump_content(FILE *file, const void *frame,
       for (j = 0; j < height; j++, u.u8 += pitch)
          dump_line_bgr(lines[j], u.u8, width);
    }
-   else if (g_extern.system.pix_fmt == RETRO_PIXEL_FORMAT_XRGB8888)
+   else if (pix_fmt == RETRO_PIXEL_FORMAT_XRGB8888)
    {
       for (j = 0; j < height; j++, u.u8 += pitch)
          dump_line_32(lines[j], u.u32, width);
@@ -148,22 +153,16 @@ end:
 }
 #endif
 
-// Take frame bottom-up.
-bool screenshot_dump(const char *folder, const void *frame,
-      unsigned width, unsigned height, int pitch, bool bgr24)
-{
-   char filename[PATH_MAX];
-   char shotname[PATH_MAX];
-
 #ifdef HAVE_ZLIB_DEFLATE
 #define IMG_EXT "png"
 #else
 #define IMG_EXT "bmp"
 #endif
 
-   fill_dated_filename(shotname, IMG_EXT, sizeof(shotname));
-   fill_pathname_join(filename, folder, shotname, sizeof(filename));
-
+// Take frame bottom-up.
+static bool screenshot_write(const char *filename, const void *frame,
+      unsigned width, unsigned height, int pitch, bool bgr24, enum retro_pixel_format pix_fmt)
+{
 #ifdef HAVE_ZLIB_DEFLATE
    uint8_t *out_buffer = (uint8_t*)malloc(width * height * 3);
    if (!out_buffer)
@@ -181,7 +180,7 @@ bool screenshot_dump(const char *folder, const void *frame,
 
    if (bgr24)
       scaler.in_fmt = SCALER_FMT_BGR24;
-   else if (g_extern.system.pix_fmt == RETRO_PIXEL_FORMAT_XRGB8888)
+   else if (pix_fmt == RETRO_PIXEL_FORMAT_XRGB8888)
       scaler.in_fmt = SCALER_FMT_ARGB8888;
    else
       scaler.in_fmt = SCALER_FMT_RGB565;
@@ -207,7 +206,7 @@ bool screenshot_dump(const char *folder, const void *frame,
    bool ret = write_header_bmp(file, width, height);
 
    if (ret)
-      dump_content(file, frame, width, height, pitch, bgr24);
+      dump_content(file, frame, width, height, pitch, bgr24, pix_fmt);
    else
       RARCH_ERR("Failed to write image header.\n");
 
@@ -216,3 +215,119 @@ bool screenshot_dump(const char *folder, const void *frame,
 #endif
 }
 
+
+#ifdef HAVE_THREADS
+// Screenshots in flight. Taking more blocks until one is written.
+#define SCREENSHOT_WRITER_BUFFERS 2
+
+struct screenshot_job
+{
+   char filename[PATH_MAX];
+   unsigned width, height;
+   int pitch;
+   bool bgr24;
+   enum retro_pixel_format pix_fmt;
+};
+
+struct screenshot_writer
+{
+   sjob_queue_t *queue;
+};
+
+static void screenshot_writer_job(void *userdata, void *job_, void *buffer)
+{
+   const struct screenshot_job *job = (const struct screenshot_job*)job_;
+   bool ret;
+   (void)userdata;
+
+   RARCH_PERFORMANCE_INIT(screenshot_encode);
+   RARCH_PERFORMANCE_START(screenshot_encode);
+   ret = screenshot_write(job->filename, buffer,
+         job->width, job->height, job->pitch, job->bgr24, job->pix_fmt);
+   RARCH_PERFORMANCE_STOP(screenshot_encode);
+
+   if (ret)
+      RARCH_LOG("Wrote screenshot to \"%s\".\n", job->filename);
+   else
+      msg_queue_push(g_extern.msg_queue, "Failed to take screenshot.", 1, 180);
+}
+
+screenshot_writer_t *screenshot_writer_new(void)
+{
+   screenshot_writer_t *writer = (screenshot_writer_t*)calloc(1, sizeof(*writer));
+   if (!writer)
+      return NULL;
+
+   if (!(writer->queue = sjob_queue_new(SCREENSHOT_WRITER_BUFFERS, sizeof(struct screenshot_job),
+               screenshot_writer_job, writer)))
+   {
+      free(writer);
+      return NULL;
+   }
+
+   return writer;
+}
+
+void screenshot_writer_free(screenshot_writer_t *writer)
+{
+   if (!writer)
+      return;
+
+   sjob_queue_free(writer->queue);
+   free(writer);
+}
+
+// Copies the frame into a pooled buffer and queues it, the frame can be gone by the time it's encoded.
+static bool screenshot_writer_queue(screenshot_writer_t *writer, const char *filename,
+      const void *frame, unsigned width, unsigned height, int pitch, bool bgr24,
+      enum retro_pixel_format pix_fmt)
+{
+   unsigned i;
+   uint8_t *buffer;
+   struct screenshot_job job;
+   size_t line_size;
+
+   if (bgr24)
+      line_size = width * 3;
+   else if (pix_fmt == RETRO_PIXEL_FORMAT_XRGB8888)
+      line_size = width * sizeof(uint32_t);
+   else
+      line_size = width * sizeof(uint16_t);
+
+   if (!(buffer = (uint8_t*)sjob_queue_get_buffer(writer->queue, line_size * height)))
+      return false;
+
+   // Rows stay bottom-up, but pitch might be negative.
+   for (i = 0; i < height; i++)
+      memcpy(buffer + i * line_size, (const uint8_t*)frame + (int)i * pitch, line_size);
+
+   strlcpy(job.filename, filename, sizeof(job.filename));
+   job.width = width;
+   job.height = height;
+   job.pitch = line_size;
+   job.bgr24 = bgr24;
+   job.pix_fmt = pix_fmt;
+   sjob_queue_push(writer->queue, &job, buffer);
+
+   return true;
+}
+#endif
+
+// Take frame bottom-up.
+bool screenshot_dump(const char *folder, const void *frame,
+      unsigned width, unsigned height, int pitch, bool bgr24)
+{
+   char filename[PATH_MAX];
+   char shotname[PATH_MAX];
+
+   fill_dated_filename(shotname, IMG_EXT, sizeof(shotname));
+   fill_pathname_join(filename, folder, shotname, sizeof(filename));
+
+#ifdef HAVE_THREADS
+   if (g_extern.screenshot_writer)
+      return screenshot_writer_queue(g_extern.screenshot_writer, filename,
+            frame, width, height, pitch, bgr24, g_extern.system.pix_fmt);
+#endif
+
+   return screenshot_write(filename, frame, width, height, pitch, bgr24, g_extern.system.pix_fmt);
+}
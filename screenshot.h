@@ -25,4 +25,12 @@ bool screenshot_dump(const char *folder, const void *frame,
 
 void screenshot_generate_filename(char *filename, size_t size);
 
+// Encodes and writes screenshots on a background thread, so taking one doesn't stall the frame.
+// Only available with HAVE_THREADS.
+typedef struct screenshot_writer screenshot_writer_t;
+
+screenshot_writer_t *screenshot_writer_new(void);
+// Finishes pending screenshots.
+void screenshot_writer_free(screenshot_writer_t *writer);
+
 #endif
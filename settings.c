@@ -330,6 +330,12 @@ void config_set_defaults(void)
    g_settings.video.gpu_screenshot = gpu_screenshot;
    g_settings.video.rotation = ORIENTATION_NORMAL;
 
+#ifdef HAVE_FRAME_EXPORT
+   *g_settings.frame_export.shm_name = '\0';
+   g_settings.frame_export.post_filter = frame_export_post_filter;
+   g_settings.frame_export.video_slots = frame_export_video_slots;
+#endif
+
    g_settings.audio.enable = audio_enable;
    g_settings.audio.out_rate = out_rate;
    g_settings.audio.block_frames = 0;
@@ -351,8 +357,13 @@ void config_set_defaults(void)
    g_settings.rewind_enable = rewind_enable;
    g_settings.rewind_buffer_size = rewind_buffer_size;
    g_settings.rewind_granularity = rewind_granularity;
+   g_settings.movie_keyframe_interval = movie_keyframe_interval;
+   g_settings.run_ahead_frames = run_ahead_frames;
    g_settings.slowmotion_ratio = slowmotion_ratio;
    g_settings.fastforward_ratio = fastforward_ratio;
+   g_settings.fastforward_frameskip = fastforward_frameskip;
+   g_settings.fastforward_present_rate = fastforward_present_rate;
+   g_settings.fastforward_show_speed = fastforward_show_speed;
    g_settings.pause_nonactive = pause_nonactive;
    g_settings.autosave_interval = autosave_interval;
 
@@ -360,6 +371,7 @@ void config_set_defaults(void)
    g_settings.savestate_auto_index = savestate_auto_index;
    g_settings.savestate_auto_save  = savestate_auto_save;
    g_settings.savestate_auto_load  = savestate_auto_load;
+   g_settings.savestate_compression = savestate_compression;
    g_settings.network_cmd_enable   = network_cmd_enable;
    g_settings.network_cmd_port     = network_cmd_port;
    g_settings.stdin_cmd_enable     = stdin_cmd_enable;
@@ -435,6 +447,7 @@ void config_set_defaults(void)
 
    *g_settings.core_options_path = '\0';
    *g_settings.game_history_path = '\0';
+   *g_settings.content_database_path = '\0';
    *g_settings.cheat_database = '\0';
    *g_settings.cheat_settings_path = '\0';
    *g_settings.screenshot_directory = '\0';
@@ -511,6 +524,7 @@ void config_set_defaults(void)
       fill_pathname_expand_special(g_extern.config_path, g_defaults.config_path, sizeof(g_extern.config_path));
    
    fill_pathname_resolve_relative(g_settings.game_history_path, g_extern.config_path, ".retroarch-game-history.txt", sizeof(g_settings.game_history_path));
+   fill_pathname_resolve_relative(g_settings.core_info_cache_path, g_extern.config_path, ".retroarch-core-info.cache", sizeof(g_settings.core_info_cache_path));
 
    g_extern.config_save_on_exit = config_save_on_exit;
 
@@ -924,6 +938,12 @@ bool config_load_file(const char *path, bool set_defaults)
    CONFIG_GET_BOOL(video.gpu_record, "video_gpu_record");
    CONFIG_GET_BOOL(video.gpu_screenshot, "video_gpu_screenshot");
 
+#ifdef HAVE_FRAME_EXPORT
+   CONFIG_GET_STRING(frame_export.shm_name, "frame_export_shm");
+   CONFIG_GET_BOOL(frame_export.post_filter, "frame_export_post_filter");
+   CONFIG_GET_INT(frame_export.video_slots, "frame_export_video_slots");
+#endif
+
 #ifdef HAVE_DYLIB
    CONFIG_GET_PATH(video.filter_path, "video_filter");
 #endif
@@ -1044,6 +1064,9 @@ bool config_load_file(const char *path, bool set_defaults)
       CONFIG_GET_BOOL_EXTERN(verbosity, "log_verbosity");
 
    CONFIG_GET_BOOL_EXTERN(perfcnt_enable, "perfcnt_enable");
+   CONFIG_GET_PATH_EXTERN(perfcnt_export_path, "perfcnt_export_path");
+   CONFIG_GET_INT_EXTERN(perfcnt_export_interval, "perfcnt_export_interval");
+   CONFIG_GET_PATH_EXTERN(perfcnt_trace_path, "perfcnt_trace_path");
 
 #ifdef HAVE_OVERLAY
    CONFIG_GET_PATH_EXTERN(overlay_dir, "overlay_directory");
@@ -1062,11 +1085,16 @@ bool config_load_file(const char *path, bool set_defaults)
       g_settings.rewind_buffer_size = buffer_size * UINT64_C(1000000);
 
    CONFIG_GET_INT(rewind_granularity, "rewind_granularity");
+   CONFIG_GET_INT(movie_keyframe_interval, "movie_keyframe_interval");
+   CONFIG_GET_INT(run_ahead_frames, "run_ahead_frames");
    CONFIG_GET_FLOAT(slowmotion_ratio, "slowmotion_ratio");
    if (g_settings.slowmotion_ratio < 1.0f)
       g_settings.slowmotion_ratio = 1.0f;
 
    CONFIG_GET_FLOAT(fastforward_ratio, "fastforward_ratio");
+   CONFIG_GET_INT(fastforward_frameskip, "fastforward_frameskip");
+   CONFIG_GET_FLOAT(fastforward_present_rate, "fastforward_present_rate");
+   CONFIG_GET_BOOL(fastforward_show_speed, "fastforward_show_speed");
 
    CONFIG_GET_BOOL(pause_nonactive, "pause_nonactive");
    CONFIG_GET_INT(autosave_interval, "autosave_interval");
@@ -1078,6 +1106,7 @@ bool config_load_file(const char *path, bool set_defaults)
    CONFIG_GET_BOOL(savestate_auto_index, "savestate_auto_index");
    CONFIG_GET_BOOL(savestate_auto_save, "savestate_auto_save");
    CONFIG_GET_BOOL(savestate_auto_load, "savestate_auto_load");
+   CONFIG_GET_BOOL(savestate_compression, "savestate_compression");
 
    CONFIG_GET_BOOL(network_cmd_enable, "network_cmd_enable");
    CONFIG_GET_INT(network_cmd_port, "network_cmd_port");
@@ -1086,6 +1115,8 @@ bool config_load_file(const char *path, bool set_defaults)
    if (config_get_path(conf, "game_history_path", tmp_str, sizeof(tmp_str)))
       strlcpy(g_settings.game_history_path, tmp_str, sizeof(g_settings.game_history_path));
    CONFIG_GET_INT(game_history_size, "game_history_size");
+   CONFIG_GET_PATH(core_info_cache_path, "core_info_cache_path");
+   CONFIG_GET_PATH(content_database_path, "content_database_path");
 
    CONFIG_GET_INT(input.turbo_period, "input_turbo_period");
    CONFIG_GET_INT(input.turbo_duty_cycle, "input_duty_cycle");
@@ -1355,6 +1386,7 @@ bool config_save_file(const char *path)
    config_set_bool(conf,  "audio_sync",    g_settings.audio.sync);
    config_set_int(conf,   "audio_block_frames", g_settings.audio.block_frames);
    config_set_int(conf,   "rewind_granularity", g_settings.rewind_granularity);
+   config_set_int(conf,   "run_ahead_frames", g_settings.run_ahead_frames);
    config_set_path(conf,  "video_shader", g_settings.video.shader_path);
    config_set_bool(conf,  "video_shader_enable", g_settings.video.shader_enable);
    config_set_float(conf, "video_aspect_ratio", g_settings.video.aspect_ratio);
@@ -1424,6 +1456,8 @@ bool config_save_file(const char *path)
 
    config_set_path(conf, "game_history_path", g_settings.game_history_path);
    config_set_int(conf, "game_history_size", g_settings.game_history_size);
+   config_set_path(conf, "core_info_cache_path", g_settings.core_info_cache_path);
+   config_set_path(conf, "content_database_path", g_settings.content_database_path);
    config_set_path(conf, "joypad_autoconfig_dir", g_settings.input.autoconfig_dir);
    config_set_bool(conf, "input_autodetect_enable", g_settings.input.autodetect_enable);
 
@@ -1459,8 +1493,12 @@ bool config_save_file(const char *path)
    config_set_bool(conf, "savestate_auto_index", g_settings.savestate_auto_index);
    config_set_bool(conf, "savestate_auto_save", g_settings.savestate_auto_save);
    config_set_bool(conf, "savestate_auto_load", g_settings.savestate_auto_load);
+   config_set_bool(conf, "savestate_compression", g_settings.savestate_compression);
 
    config_set_float(conf, "fastforward_ratio", g_settings.fastforward_ratio);
+   config_set_int(conf,   "fastforward_frameskip", g_settings.fastforward_frameskip);
+   config_set_float(conf, "fastforward_present_rate", g_settings.fastforward_present_rate);
+   config_set_bool(conf, "fastforward_show_speed", g_settings.fastforward_show_speed);
    config_set_float(conf, "slowmotion_ratio", g_settings.slowmotion_ratio);
 
    // g_extern
@@ -0,0 +1,287 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2014 - Hans-Kristian Arntzen
+ *
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "state_writer.h"
+#include "general.h"
+#include "file.h"
+#include "performance.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <limits.h>
+
+#ifdef HAVE_THREADS
+#include "thread.h"
+#endif
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#if defined(_WIN32) && !defined(_XBOX)
+#include <io.h>
+#elif defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#endif
+
+// Compressed states are a header followed by a zlib stream.
+// Header is the magic and the inflated size as little endian 64-bit.
+#define STATE_MAGIC "RZSTATE1"
+#define STATE_HEADER_SIZE 16
+#define STATE_CHUNK_SIZE (256 * 1024)
+
+#ifdef HAVE_ZLIB_DEFLATE
+static bool state_write_compressed(FILE *file, const void *data, size_t size, uint8_t *chunk)
+{
+   unsigned i;
+   int ret;
+   z_stream stream = {0};
+   uint8_t header[STATE_HEADER_SIZE];
+   bool success = true;
+
+   memcpy(header, STATE_MAGIC, 8);
+   for (i = 0; i < 8; i++)
+      header[8 + i] = (uint8_t)((uint64_t)size >> (8 * i));
+   if (fwrite(header, 1, sizeof(header), file) != sizeof(header))
+      return false;
+
+   // Speed matters more than ratio, states are mostly zeroes and repeats anyway.
+   if (deflateInit(&stream, Z_BEST_SPEED) != Z_OK)
+      return false;
+
+   stream.next_in = (Bytef*)data;
+   stream.avail_in = size;
+
+   do
+   {
+      size_t out_size;
+      stream.next_out = chunk;
+      stream.avail_out = STATE_CHUNK_SIZE;
+      ret = deflate(&stream, Z_FINISH);
+
+      out_size = STATE_CHUNK_SIZE - stream.avail_out;
+      if (ret == Z_STREAM_ERROR || fwrite(chunk, 1, out_size, file) != out_size)
+      {
+         success = false;
+         break;
+      }
+   } while (ret != Z_STREAM_END);
+
+   deflateEnd(&stream);
+   return success;
+}
+#endif
+
+static bool state_write_file_chunk(const char *path, const void *data, size_t size,
+      bool compress, uint8_t *chunk)
+{
+   char tmp_path[PATH_MAX];
+   bool ret;
+   FILE *file;
+
+   if ((size_t)snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path) >= sizeof(tmp_path))
+   {
+      RARCH_ERR("State path \"%s\" is too long.\n", path);
+      return false;
+   }
+
+   if (!(file = fopen(tmp_path, "wb")))
+      return false;
+
+#ifdef HAVE_ZLIB_DEFLATE
+   if (compress && chunk && size <= UINT_MAX)
+      ret = state_write_compressed(file, data, size, chunk);
+   else
+#endif
+      ret = fwrite(data, 1, size, file) == size;
+
+   ret = fflush(file) == 0 && ret;
+   // A crash right after saving must not leave a truncated state behind.
+#if defined(_WIN32) && !defined(_XBOX)
+   ret = _commit(_fileno(file)) == 0 && ret;
+#elif defined(__unix__) || defined(__APPLE__)
+   ret = fsync(fileno(file)) == 0 && ret;
+#endif
+   ret = fclose(file) == 0 && ret;
+
+   if (ret)
+   {
+#ifdef _WIN32
+      // rename() doesn't replace existing files here.
+      remove(path);
+#endif
+      ret = rename(tmp_path, path) == 0;
+   }
+
+   if (!ret)
+      remove(tmp_path);
+   return ret;
+}
+
+bool state_write_file(const char *path, const void *data, size_t size, bool compress)
+{
+   uint8_t *chunk = compress ? (uint8_t*)malloc(STATE_CHUNK_SIZE) : NULL;
+   bool ret = state_write_file_chunk(path, data, size, compress, chunk);
+   free(chunk);
+   return ret;
+}
+
+ssize_t state_read_file(const char *path, void **buf)
+{
+   uint64_t size = 0;
+   unsigned i;
+   ssize_t ret = read_file(path, buf);
+
+   if (ret < STATE_HEADER_SIZE || memcmp(*buf, STATE_MAGIC, 8))
+      return ret;
+
+   for (i = 0; i < 8; i++)
+      size |= (uint64_t)((const uint8_t*)*buf)[8 + i] << (8 * i);
+
+#ifdef HAVE_ZLIB
+   {
+      z_stream stream = {0};
+      uint8_t *data = NULL;
+      int err = Z_DATA_ERROR;
+
+      if (size <= UINT_MAX && (data = (uint8_t*)malloc(size + 1)) && inflateInit(&stream) == Z_OK)
+      {
+         stream.next_in = (Bytef*)*buf + STATE_HEADER_SIZE;
+         stream.avail_in = ret - STATE_HEADER_SIZE;
+         stream.next_out = data;
+         stream.avail_out = size;
+
+         err = inflate(&stream, Z_FINISH);
+         if (stream.total_out != size)
+            err = Z_DATA_ERROR;
+         inflateEnd(&stream);
+      }
+
+      free(*buf);
+      *buf = NULL;
+
+      if (err != Z_STREAM_END)
+      {
+         RARCH_ERR("Failed to inflate state \"%s\".\n", path);
+         free(data);
+         return -1;
+      }
+
+      data[size] = '\0';
+      *buf = data;
+      return size;
+   }
+#else
+   RARCH_ERR("State \"%s\" is compressed, but zlib support is not compiled in.\n", path);
+   free(*buf);
+   *buf = NULL;
+   return -1;
+#endif
+}
+
+#ifdef HAVE_THREADS
+// In flight states. Saving more blocks until one is written.
+#define STATE_WRITER_BUFFERS 2
+
+struct state_job
+{
+   char path[PATH_MAX];
+   size_t size;
+   bool compress;
+};
+
+struct state_writer
+{
+   sjob_queue_t *queue;
+   uint8_t *chunk; // Only used on the queue's thread.
+};
+
+static void state_writer_job(void *userdata, void *job_, void *buffer)
+{
+   state_writer_t *writer = (state_writer_t*)userdata;
+   const struct state_job *job = (const struct state_job*)job_;
+   bool ret;
+
+   RARCH_PERFORMANCE_INIT(state_write);
+   RARCH_PERFORMANCE_START(state_write);
+   ret = state_write_file_chunk(job->path, buffer, job->size, job->compress, writer->chunk);
+   RARCH_PERFORMANCE_STOP(state_write);
+
+   if (ret)
+      RARCH_LOG("Wrote state to \"%s\".\n", job->path);
+   else
+   {
+      RARCH_ERR("Failed to save state to \"%s\".\n", job->path);
+      msg_queue_push(g_extern.msg_queue, "Failed to save state.", 2, 180);
+   }
+}
+
+state_writer_t *state_writer_new(void)
+{
+   state_writer_t *writer = (state_writer_t*)calloc(1, sizeof(*writer));
+   if (!writer)
+      return NULL;
+
+   if (!(writer->chunk = (uint8_t*)malloc(STATE_CHUNK_SIZE)))
+      goto error;
+
+   if (!(writer->queue = sjob_queue_new(STATE_WRITER_BUFFERS, sizeof(struct state_job),
+               state_writer_job, writer)))
+      goto error;
+
+   return writer;
+
+error:
+   state_writer_free(writer);
+   return NULL;
+}
+
+void state_writer_free(state_writer_t *writer)
+{
+   if (!writer)
+      return;
+
+   sjob_queue_free(writer->queue);
+   free(writer->chunk);
+   free(writer);
+}
+
+void *state_writer_get_buffer(state_writer_t *writer, size_t size)
+{
+   return sjob_queue_get_buffer(writer->queue, size);
+}
+
+void state_writer_release(state_writer_t *writer, void *data)
+{
+   sjob_queue_release(writer->queue, data);
+}
+
+void state_writer_write(state_writer_t *writer, const char *path, void *data, size_t size, bool compress)
+{
+   struct state_job job;
+
+   strlcpy(job.path, path, sizeof(job.path));
+   job.size = size;
+   job.compress = compress;
+   sjob_queue_push(writer->queue, &job, data);
+}
+
+void state_writer_flush(state_writer_t *writer)
+{
+   if (writer)
+      sjob_queue_flush(writer->queue);
+}
+#endif
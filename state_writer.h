@@ -0,0 +1,55 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2014 - Hans-Kristian Arntzen
+ *
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __RARCH_STATE_WRITER_H
+#define __RARCH_STATE_WRITER_H
+
+#include <stddef.h>
+#include <sys/types.h>
+#include "boolean.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Writes savestates to disk, optionally deflated.
+// Files are written to a temporary, synced and renamed over the old state.
+bool state_write_file(const char *path, const void *data, size_t size, bool compress);
+
+// Like read_file(), but inflates compressed states transparently.
+ssize_t state_read_file(const char *path, void **buf);
+
+// Background writer, so saving a state doesn't stall the main thread on disk I/O.
+// Only available with HAVE_THREADS.
+typedef struct state_writer state_writer_t;
+
+state_writer_t *state_writer_new(void);
+// Flushes pending writes.
+void state_writer_free(state_writer_t *writer);
+
+// Returns a pooled buffer of at least size bytes. Blocks if all buffers are still being written.
+void *state_writer_get_buffer(state_writer_t *writer, size_t size);
+// Hands back a buffer without writing it.
+void state_writer_release(state_writer_t *writer, void *buffer);
+// Queues a buffer from state_writer_get_buffer() for writing. The writer owns it from here.
+void state_writer_write(state_writer_t *writer, const char *path, void *buffer, size_t size, bool compress);
+// Waits until all queued states are on disk.
+void state_writer_flush(state_writer_t *writer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
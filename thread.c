@@ -16,6 +16,8 @@
 
 #include "thread.h"
 #include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
 
 #if defined(_WIN32)
 #ifdef _XBOX
@@ -371,3 +373,273 @@ void scond_signal(scond_t *cond)
 
 #endif
 
+
+// Generic helpers, built on the primitives above.
+
+struct sthread_parallel
+{
+   void (*func)(void *userdata, size_t index);
+   void *userdata;
+   size_t count;
+   size_t next;
+   slock_t *lock;
+};
+
+static void sthread_parallel_worker(void *data)
+{
+   struct sthread_parallel *par = (struct sthread_parallel*)data;
+
+   for (;;)
+   {
+      size_t index;
+
+      slock_lock(par->lock);
+      index = par->next++;
+      slock_unlock(par->lock);
+
+      if (index >= par->count)
+         break;
+
+      par->func(par->userdata, index);
+   }
+}
+
+void sthread_parallel_for(size_t count, unsigned threads,
+      void (*func)(void *userdata, size_t index), void *userdata)
+{
+   size_t i;
+   struct sthread_parallel par = {0};
+   sthread_t **workers = NULL;
+
+   if (threads > count)
+      threads = count;
+
+   if (threads > 1 && (par.lock = slock_new()) &&
+         (workers = (sthread_t**)calloc(threads - 1, sizeof(*workers))))
+   {
+      unsigned started = 0;
+
+      par.func = func;
+      par.userdata = userdata;
+      par.count = count;
+
+      // The calling thread is one of the workers, and picks up whatever the others don't get to.
+      for (i = 1; i < threads; i++)
+         if ((workers[started] = sthread_create(sthread_parallel_worker, &par)))
+            started++;
+
+      sthread_parallel_worker(&par);
+
+      for (i = 0; i < started; i++)
+         sthread_join(workers[i]);
+
+      free(workers);
+      slock_free(par.lock);
+      return;
+   }
+
+   if (par.lock)
+      slock_free(par.lock);
+
+   for (i = 0; i < count; i++)
+      func(userdata, i);
+}
+
+struct sjob_buffer
+{
+   void *data;
+   size_t capacity;
+   bool busy;
+};
+
+struct sjob_queue
+{
+   sthread_t *thread;
+   slock_t *lock;
+   scond_t *cond;
+   bool quit;
+
+   sjob_func_t func;
+   void *userdata;
+
+   struct sjob_buffer *buffers;
+   unsigned num_buffers;
+
+   // Every queued job holds a buffer, so there is one job slot per buffer.
+   // Jobs stay queued until they have run, so flushing can wait for job_count to drop.
+   uint8_t *jobs;
+   struct sjob_buffer **job_buffers;
+   size_t job_size;
+   unsigned job_read;
+   unsigned job_count;
+};
+
+static void sjob_queue_thread(void *data)
+{
+   sjob_queue_t *queue = (sjob_queue_t*)data;
+
+   for (;;)
+   {
+      struct sjob_buffer *buffer;
+      void *job;
+
+      slock_lock(queue->lock);
+      while (!queue->job_count && !queue->quit)
+         scond_wait(queue->cond, queue->lock);
+      if (!queue->job_count)
+      {
+         slock_unlock(queue->lock);
+         break;
+      }
+      job = queue->jobs + queue->job_read * queue->job_size;
+      buffer = queue->job_buffers[queue->job_read];
+      slock_unlock(queue->lock);
+
+      queue->func(queue->userdata, job, buffer->data);
+
+      slock_lock(queue->lock);
+      buffer->busy = false;
+      queue->job_read = (queue->job_read + 1) % queue->num_buffers;
+      queue->job_count--;
+      scond_broadcast(queue->cond);
+      slock_unlock(queue->lock);
+   }
+}
+
+sjob_queue_t *sjob_queue_new(unsigned buffers, size_t job_size, sjob_func_t func, void *userdata)
+{
+   sjob_queue_t *queue = (sjob_queue_t*)calloc(1, sizeof(*queue));
+   if (!queue)
+      return NULL;
+
+   queue->func = func;
+   queue->userdata = userdata;
+   queue->num_buffers = buffers ? buffers : 1;
+   queue->job_size = job_size;
+
+   queue->lock = slock_new();
+   queue->cond = scond_new();
+   queue->buffers = (struct sjob_buffer*)calloc(queue->num_buffers, sizeof(*queue->buffers));
+   queue->jobs = (uint8_t*)calloc(queue->num_buffers, job_size);
+   queue->job_buffers = (struct sjob_buffer**)calloc(queue->num_buffers, sizeof(*queue->job_buffers));
+   if (!queue->lock || !queue->cond || !queue->buffers || !queue->jobs || !queue->job_buffers)
+      goto error;
+
+   if (!(queue->thread = sthread_create(sjob_queue_thread, queue)))
+      goto error;
+
+   return queue;
+
+error:
+   sjob_queue_free(queue);
+   return NULL;
+}
+
+void sjob_queue_free(sjob_queue_t *queue)
+{
+   unsigned i;
+   if (!queue)
+      return;
+
+   if (queue->thread)
+   {
+      slock_lock(queue->lock);
+      queue->quit = true;
+      scond_broadcast(queue->cond);
+      slock_unlock(queue->lock);
+      sthread_join(queue->thread);
+   }
+
+   if (queue->lock)
+      slock_free(queue->lock);
+   if (queue->cond)
+      scond_free(queue->cond);
+
+   if (queue->buffers)
+   {
+      for (i = 0; i < queue->num_buffers; i++)
+         free(queue->buffers[i].data);
+   }
+   free(queue->buffers);
+   free(queue->jobs);
+   free(queue->job_buffers);
+   free(queue);
+}
+
+void *sjob_queue_get_buffer(sjob_queue_t *queue, size_t size)
+{
+   struct sjob_buffer *buffer = NULL;
+   unsigned i;
+
+   slock_lock(queue->lock);
+   for (;;)
+   {
+      for (i = 0; i < queue->num_buffers && !buffer; i++)
+         if (!queue->buffers[i].busy)
+            buffer = &queue->buffers[i];
+      if (buffer)
+         break;
+      scond_wait(queue->cond, queue->lock);
+   }
+   buffer->busy = true;
+   slock_unlock(queue->lock);
+
+   // The buffer is ours now, no need to hold the lock while growing it.
+   if (buffer->capacity < size)
+   {
+      free(buffer->data);
+      buffer->data = malloc(size);
+      buffer->capacity = buffer->data ? size : 0;
+   }
+
+   if (!buffer->data)
+   {
+      slock_lock(queue->lock);
+      buffer->busy = false;
+      scond_broadcast(queue->cond);
+      slock_unlock(queue->lock);
+   }
+
+   return buffer->data;
+}
+
+static struct sjob_buffer *sjob_queue_find(sjob_queue_t *queue, void *data)
+{
+   unsigned i;
+   for (i = 0; i < queue->num_buffers; i++)
+      if (queue->buffers[i].data == data && queue->buffers[i].busy)
+         return &queue->buffers[i];
+   return NULL;
+}
+
+void sjob_queue_release(sjob_queue_t *queue, void *data)
+{
+   struct sjob_buffer *buffer;
+
+   slock_lock(queue->lock);
+   if ((buffer = sjob_queue_find(queue, data)))
+      buffer->busy = false;
+   scond_broadcast(queue->cond);
+   slock_unlock(queue->lock);
+}
+
+void sjob_queue_push(sjob_queue_t *queue, const void *job, void *data)
+{
+   unsigned slot;
+
+   slock_lock(queue->lock);
+   slot = (queue->job_read + queue->job_count) % queue->num_buffers;
+   memcpy(queue->jobs + slot * queue->job_size, job, queue->job_size);
+   queue->job_buffers[slot] = sjob_queue_find(queue, data);
+   queue->job_count++;
+   scond_broadcast(queue->cond);
+   slock_unlock(queue->lock);
+}
+
+void sjob_queue_flush(sjob_queue_t *queue)
+{
+   slock_lock(queue->lock);
+   while (queue->job_count)
+      scond_wait(queue->cond, queue->lock);
+   slock_unlock(queue->lock);
+}
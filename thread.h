@@ -19,6 +19,7 @@
 
 #include "boolean.h"
 #include <stdint.h>
+#include <stddef.h>
 
 #if defined(__cplusplus) && !defined(MSC_VER)
 extern "C" {
@@ -53,6 +54,87 @@ bool scond_wait_timeout(scond_t *cond, slock_t *lock, int64_t timeout_us);
 int scond_broadcast(scond_t *cond);
 void scond_signal(scond_t *cond);
 
+// Runs func(userdata, i) for every i in [0, count) on up to threads threads, the calling thread included.
+// Indices are handed out one at a time, so uneven items balance out. Returns when all have run.
+// Falls back to a plain loop if threads can't be started.
+void sthread_parallel_for(size_t count, unsigned threads,
+      void (*func)(void *userdata, size_t index), void *userdata);
+
+// Background job queue. Jobs run in order on a single worker thread.
+// Each job carries one of a fixed number of pooled buffers, which bounds how many can be in flight.
+typedef struct sjob_queue sjob_queue_t;
+typedef void (*sjob_func_t)(void *userdata, void *job, void *buffer);
+
+// job_size bytes of job data are copied on push and handed to func along with the buffer.
+sjob_queue_t *sjob_queue_new(unsigned buffers, size_t job_size, sjob_func_t func, void *userdata);
+// Runs pending jobs first.
+void sjob_queue_free(sjob_queue_t *queue);
+
+// Returns a pooled buffer of at least size bytes, or NULL if out of memory.
+// Blocks if all buffers are still in use.
+void *sjob_queue_get_buffer(sjob_queue_t *queue, size_t size);
+// Hands back a buffer without queueing a job.
+void sjob_queue_release(sjob_queue_t *queue, void *buffer);
+// Queues a job with a buffer from sjob_queue_get_buffer(). The buffer is returned to the pool once the job has run.
+void sjob_queue_push(sjob_queue_t *queue, const void *job, void *buffer);
+// Waits until all queued jobs have run.
+void sjob_queue_flush(sjob_queue_t *queue);
+
+// Atomics on a 32-bit value, for lock-free structures.
+// RARCH_ATOMICS is only defined if the compiler has them. Fall back to slock otherwise.
+#if defined(__clang__) || (defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 7)))
+#define RARCH_ATOMICS
+typedef volatile uint32_t ratomic_t;
+
+static inline uint32_t ratomic_load(ratomic_t *v)
+{
+   return __atomic_load_n(v, __ATOMIC_ACQUIRE);
+}
+
+static inline void ratomic_store(ratomic_t *v, uint32_t val)
+{
+   __atomic_store_n(v, val, __ATOMIC_RELEASE);
+}
+
+static inline bool ratomic_cas(ratomic_t *v, uint32_t expected, uint32_t desired)
+{
+   return __atomic_compare_exchange_n(v, &expected, desired, false,
+         __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+
+// Full barrier. Needed when a store must be visible before a later load of another variable.
+static inline void ratomic_fence(void)
+{
+   __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+#elif defined(_MSC_VER) && _MSC_VER >= 1400 && !defined(_XBOX)
+#include <intrin.h>
+#define RARCH_ATOMICS
+typedef volatile long ratomic_t;
+
+static inline uint32_t ratomic_load(ratomic_t *v)
+{
+   return (uint32_t)_InterlockedCompareExchange(v, 0, 0);
+}
+
+static inline void ratomic_store(ratomic_t *v, uint32_t val)
+{
+   _InterlockedExchange(v, (long)val);
+}
+
+static inline bool ratomic_cas(ratomic_t *v, uint32_t expected, uint32_t desired)
+{
+   return _InterlockedCompareExchange(v, (long)desired, (long)expected) == (long)expected;
+}
+
+// Interlocked operations are full barriers.
+static inline void ratomic_fence(void)
+{
+   long dummy = 0;
+   _InterlockedExchange(&dummy, 0);
+}
+#endif
+
 #ifndef RARCH_INTERNAL
 #if defined(__CELLOS_LV2__) && !defined(__PSL1GHT__)
 #include <sys/timer.h>
@@ -0,0 +1,459 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2014 - Hans-Kristian Arntzen
+ *
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Decodes .rlv files written by the lossless recording backend
+// into raw video and WAV audio, which anything (e.g. ffmpeg) can encode further.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <zlib.h>
+#include "../compat/getopt_rarch.h"
+#include "../boolean.h"
+#include "../record/ffemu.h"
+#include "../record/lossless.h"
+
+struct rlv_file
+{
+   FILE *file;
+   enum ffemu_pix_format pix_fmt;
+   unsigned pix_size;
+   unsigned channels;
+   double fps;
+   double samplerate;
+   float aspect_ratio;
+
+   uint8_t *payload;
+   size_t payload_capacity;
+};
+
+struct rlv_stats
+{
+   unsigned max_width;
+   unsigned max_height;
+   unsigned frames;
+   unsigned key_frames;
+   unsigned dupes;
+   uint64_t audio_frames;
+   uint64_t video_bytes;
+};
+
+static const char *g_in_path = NULL;
+static const char *g_video_path = NULL;
+static const char *g_audio_path = NULL;
+
+static void print_help(void)
+{
+   puts("================");
+   puts(" retroarch-rlv");
+   puts("================");
+   puts("Usage: retroarch-rlv [ options ... ] <recording.rlv>");
+   puts("");
+   puts("Converts lossless RetroArch recordings. Without options, stream info is printed.");
+   puts("");
+   puts("-v/--video: Writes the video as raw frames in the recorded pixel format. Use - for stdout.");
+   puts("\tFrames smaller than the largest one are padded at the right and bottom.");
+   puts("-a/--audio: Writes the audio as a 16-bit WAV file.");
+   puts("-h/--help: Shows this help.");
+}
+
+static void parse_input(int argc, char *argv[])
+{
+   char optstring[] = "v:a:h";
+   struct option opts[] = {
+      { "video", 1, NULL, 'v' },
+      { "audio", 1, NULL, 'a' },
+      { "help", 0, NULL, 'h' },
+      { NULL, 0, NULL, 0 }
+   };
+
+   int option_index = 0;
+   for (;;)
+   {
+      int c = getopt_long(argc, argv, optstring, opts, &option_index);
+      if (c == -1)
+         break;
+
+      switch (c)
+      {
+         case 'h':
+            print_help();
+            exit(0);
+
+         case 'v':
+            g_video_path = optarg;
+            break;
+
+         case 'a':
+            g_audio_path = optarg;
+            break;
+
+         default:
+            print_help();
+            exit(1);
+      }
+   }
+
+   if (optind != argc - 1)
+   {
+      print_help();
+      exit(1);
+   }
+
+   g_in_path = argv[optind];
+}
+
+static bool rlv_open(struct rlv_file *rlv, const char *path)
+{
+   uint8_t header[RLV_HEADER_SIZE];
+
+   memset(rlv, 0, sizeof(*rlv));
+   if (!(rlv->file = fopen(path, "rb")))
+   {
+      fprintf(stderr, "Failed to open \"%s\".\n", path);
+      return false;
+   }
+
+   if (fread(header, 1, sizeof(header), rlv->file) != sizeof(header) ||
+         memcmp(header, RLV_MAGIC, 8) != 0)
+   {
+      fprintf(stderr, "\"%s\" is not a lossless RetroArch recording.\n", path);
+      return false;
+   }
+
+   rlv->pix_fmt      = (enum ffemu_pix_format)rlv_read_le32(header + 8);
+   rlv->channels     = rlv_read_le32(header + 12);
+   rlv->fps          = rlv_read_f64(header + 16);
+   rlv->samplerate   = rlv_read_f64(header + 24);
+   rlv->aspect_ratio = rlv_read_f32(header + 32);
+
+   switch (rlv->pix_fmt)
+   {
+      case FFEMU_PIX_RGB565:
+         rlv->pix_size = 2;
+         break;
+      case FFEMU_PIX_BGR24:
+         rlv->pix_size = 3;
+         break;
+      case FFEMU_PIX_ARGB8888:
+         rlv->pix_size = 4;
+         break;
+      default:
+         fprintf(stderr, "Unknown pixel format %u.\n", (unsigned)rlv->pix_fmt);
+         return false;
+   }
+
+   return true;
+}
+
+static void rlv_close(struct rlv_file *rlv)
+{
+   if (rlv->file)
+      fclose(rlv->file);
+   free(rlv->payload);
+}
+
+// Returns false at the end of the file. A truncated last packet (e.g. after a crash) is dropped.
+static bool rlv_next_packet(struct rlv_file *rlv, uint32_t *type, size_t *size)
+{
+   uint8_t header[RLV_PACKET_HEADER_SIZE];
+   if (fread(header, 1, sizeof(header), rlv->file) != sizeof(header))
+      return false;
+
+   *type = rlv_read_le32(header + 0);
+   *size = rlv_read_le32(header + 4);
+
+   if (*size > rlv->payload_capacity)
+   {
+      uint8_t *payload = (uint8_t*)realloc(rlv->payload, *size);
+      if (!payload)
+         return false;
+      rlv->payload = payload;
+      rlv->payload_capacity = *size;
+   }
+
+   return fread(rlv->payload, 1, *size, rlv->file) == *size;
+}
+
+static bool rlv_scan(struct rlv_file *rlv, struct rlv_stats *stats)
+{
+   uint32_t type;
+   size_t size;
+
+   memset(stats, 0, sizeof(*stats));
+   while (rlv_next_packet(rlv, &type, &size))
+   {
+      switch (type)
+      {
+         case RLV_PACKET_KEY_FRAME:
+         case RLV_PACKET_DELTA_FRAME:
+         {
+            unsigned width, height;
+            if (size < RLV_VIDEO_HEADER_SIZE)
+               return false;
+
+            width  = rlv_read_le32(rlv->payload + 0);
+            height = rlv_read_le32(rlv->payload + 4);
+            if (width > stats->max_width)
+               stats->max_width = width;
+            if (height > stats->max_height)
+               stats->max_height = height;
+
+            stats->frames++;
+            stats->video_bytes += size;
+            if (type == RLV_PACKET_KEY_FRAME)
+               stats->key_frames++;
+            break;
+         }
+
+         case RLV_PACKET_DUPE_FRAME:
+            stats->frames++;
+            stats->dupes++;
+            break;
+
+         case RLV_PACKET_AUDIO:
+            stats->audio_frames += size / (rlv->channels * sizeof(int16_t));
+            break;
+
+         default:
+            break;
+      }
+   }
+
+   return fseek(rlv->file, RLV_HEADER_SIZE, SEEK_SET) == 0;
+}
+
+static const char *rlv_ffmpeg_pix_fmt(enum ffemu_pix_format pix_fmt)
+{
+   switch (pix_fmt)
+   {
+      case FFEMU_PIX_RGB565:
+         return "rgb565le";
+      case FFEMU_PIX_BGR24:
+         return "bgr24";
+      case FFEMU_PIX_ARGB8888:
+      default:
+         return "bgr0";
+   }
+}
+
+static void rlv_print_info(const struct rlv_file *rlv, const struct rlv_stats *stats)
+{
+   fprintf(stderr, "Video: %u frames (%u key frames, %u dupes), up to %ux%u, %s @ %.4f FPS, aspect %.4f.\n",
+         stats->frames, stats->key_frames, stats->dupes,
+         stats->max_width, stats->max_height,
+         rlv_ffmpeg_pix_fmt(rlv->pix_fmt), rlv->fps, rlv->aspect_ratio);
+   fprintf(stderr, "Audio: %llu frames, %u channels @ %.4f Hz.\n",
+         (unsigned long long)stats->audio_frames, rlv->channels, rlv->samplerate);
+
+   if (stats->frames)
+      fprintf(stderr, "Average video packet: %.1f kB.\n",
+            stats->video_bytes / (1024.0 * (stats->frames - stats->dupes ? stats->frames - stats->dupes : 1)));
+
+   fprintf(stderr, "Encode with e.g.: ffmpeg -f rawvideo -pix_fmt %s -s %ux%u -r %.4f -i video.raw "
+         "-i audio.wav -vf setdar=%.4f out.mkv\n",
+         rlv_ffmpeg_pix_fmt(rlv->pix_fmt), stats->max_width, stats->max_height, rlv->fps,
+         rlv->aspect_ratio);
+}
+
+static bool write_wav_header(FILE *file, const struct rlv_file *rlv, uint64_t frames)
+{
+   uint8_t header[44];
+   uint32_t rate = (uint32_t)(rlv->samplerate + 0.5);
+   uint32_t block = rlv->channels * sizeof(int16_t);
+   uint64_t data_size = frames * block;
+
+   if (data_size > 0xffffffffu - 36)
+      data_size = 0xffffffffu - 36;
+
+   memcpy(header + 0, "RIFF", 4);
+   rlv_write_le32(header + 4, (uint32_t)(36 + data_size));
+   memcpy(header + 8, "WAVEfmt ", 8);
+   rlv_write_le32(header + 16, 16);
+   rlv_write_le32(header + 20, 1 | (rlv->channels << 16)); // PCM
+   rlv_write_le32(header + 24, rate);
+   rlv_write_le32(header + 28, rate * block);
+   rlv_write_le32(header + 32, block | (16 << 16));
+   memcpy(header + 36, "data", 4);
+   rlv_write_le32(header + 40, (uint32_t)data_size);
+
+   return fwrite(header, 1, sizeof(header), file) == sizeof(header);
+}
+
+static bool rlv_decode_frame(struct rlv_file *rlv, uint32_t type, size_t size,
+      uint8_t *frame, uint8_t *tmp, unsigned *width, unsigned *height)
+{
+   size_t i;
+   unsigned new_width  = rlv_read_le32(rlv->payload + 0);
+   unsigned new_height = rlv_read_le32(rlv->payload + 4);
+   uLongf frame_size   = new_width * new_height * rlv->pix_size;
+
+   if (type == RLV_PACKET_DELTA_FRAME && (new_width != *width || new_height != *height))
+      return false;
+
+   if (uncompress(type == RLV_PACKET_DELTA_FRAME ? tmp : frame, &frame_size,
+            rlv->payload + RLV_VIDEO_HEADER_SIZE, size - RLV_VIDEO_HEADER_SIZE) != Z_OK ||
+         frame_size != new_width * new_height * rlv->pix_size)
+      return false;
+
+   if (type == RLV_PACKET_DELTA_FRAME)
+      for (i = 0; i < frame_size; i++)
+         frame[i] ^= tmp[i];
+
+   *width  = new_width;
+   *height = new_height;
+   return true;
+}
+
+static bool rlv_write_frame(FILE *file, const uint8_t *frame, unsigned width, unsigned height,
+      const struct rlv_stats *stats, const uint8_t *padding, unsigned pix_size)
+{
+   unsigned y;
+   size_t line = width * pix_size;
+   size_t pad  = (stats->max_width - width) * pix_size;
+
+   for (y = 0; y < height; y++)
+   {
+      if (fwrite(frame + y * line, 1, line, file) != line)
+         return false;
+      if (pad && fwrite(padding, 1, pad, file) != pad)
+         return false;
+   }
+
+   for (; y < stats->max_height; y++)
+      if (fwrite(padding, 1, stats->max_width * pix_size, file) != stats->max_width * pix_size)
+         return false;
+
+   return true;
+}
+
+static bool rlv_convert(struct rlv_file *rlv, const struct rlv_stats *stats)
+{
+   uint32_t type;
+   size_t size;
+   bool ret = false;
+   unsigned width = 0, height = 0;
+   size_t frame_size = (size_t)stats->max_width * stats->max_height * rlv->pix_size;
+   FILE *video = NULL, *audio = NULL;
+
+   uint8_t *frame   = (uint8_t*)calloc(1, frame_size + 1);
+   uint8_t *tmp     = (uint8_t*)calloc(1, frame_size + 1);
+   uint8_t *padding = (uint8_t*)calloc(1, stats->max_width * rlv->pix_size + 1);
+   if (!frame || !tmp || !padding)
+      goto end;
+
+   if (g_video_path)
+   {
+      video = strcmp(g_video_path, "-") == 0 ? stdout : fopen(g_video_path, "wb");
+      if (!video)
+      {
+         fprintf(stderr, "Failed to open \"%s\".\n", g_video_path);
+         goto end;
+      }
+   }
+
+   if (g_audio_path)
+   {
+      audio = fopen(g_audio_path, "wb");
+      if (!audio || !write_wav_header(audio, rlv, stats->audio_frames))
+      {
+         fprintf(stderr, "Failed to open \"%s\".\n", g_audio_path);
+         goto end;
+      }
+   }
+
+   while (rlv_next_packet(rlv, &type, &size))
+   {
+      switch (type)
+      {
+         case RLV_PACKET_KEY_FRAME:
+         case RLV_PACKET_DELTA_FRAME:
+            if (!video)
+               break;
+
+            if (!rlv_decode_frame(rlv, type, size, frame, tmp, &width, &height))
+            {
+               fprintf(stderr, "Corrupt video frame.\n");
+               goto end;
+            }
+            // Fall-through, a decoded frame is written just like a repeated one.
+
+         case RLV_PACKET_DUPE_FRAME:
+            if (video && width && !rlv_write_frame(video, frame, width, height, stats, padding, rlv->pix_size))
+            {
+               fprintf(stderr, "Failed to write video.\n");
+               goto end;
+            }
+            break;
+
+         case RLV_PACKET_AUDIO:
+            if (audio && fwrite(rlv->payload, 1, size, audio) != size)
+            {
+               fprintf(stderr, "Failed to write audio.\n");
+               goto end;
+            }
+            break;
+
+         default:
+            break;
+      }
+   }
+
+   ret = true;
+
+end:
+   if (video && video != stdout)
+      fclose(video);
+   if (audio)
+      fclose(audio);
+   free(frame);
+   free(tmp);
+   free(padding);
+   return ret;
+}
+
+int main(int argc, char *argv[])
+{
+   struct rlv_file rlv;
+   struct rlv_stats stats;
+   int ret = 1;
+
+   parse_input(argc, argv);
+
+   if (!rlv_open(&rlv, g_in_path))
+      goto end;
+
+   if (!rlv_scan(&rlv, &stats))
+   {
+      fprintf(stderr, "Failed to read \"%s\".\n", g_in_path);
+      goto end;
+   }
+
+   rlv_print_info(&rlv, &stats);
+
+   if ((g_video_path || g_audio_path) && !rlv_convert(&rlv, &stats))
+      goto end;
+
+   ret = 0;
+
+end:
+   rlv_close(&rlv);
+   return ret;
+}